@@ -118,6 +118,26 @@ static void testdemos_header_only(benchmark::State &state) {
   get_bytes(state);
 }
 
+static void testdemos_input_timeline(benchmark::State &state) {
+  dg_input_timeline timeline;
+  dg_input_timeline_init(&timeline, NULL);
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.input_timeline = &timeline;
+
+  auto demos = get_test_demos();
+
+  for (auto _ : state) {
+    for (auto &demo : demos) {
+      dg_input_timeline_clear(&timeline);
+      dg_parse_file(&settings, demo.c_str());
+    }
+  }
+
+  dg_input_timeline_free(&timeline);
+  get_bytes(state);
+}
+
 static void testdemos_freddie_parse(benchmark::State &state) {
   auto demos = get_test_demos();
 
@@ -174,6 +194,7 @@ BENCHMARK(testdemos_parse_only);
 BENCHMARK(testdemos_packet_only);
 BENCHMARK(testdemos_header_only);
 BENCHMARK(testdemos_parse_everything);
+BENCHMARK(testdemos_input_timeline);
 BENCHMARK(testdemos_freddie_parse);
 BENCHMARK(testdemos_freddie_write);
 BENCHMARK(testdemos_freddie_convert);
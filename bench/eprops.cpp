@@ -1,4 +1,5 @@
 #include "benchmark/benchmark.h"
+#include <algorithm>
 #include <cstdlib>
 #include "demogobbler.h"
 
@@ -78,7 +79,83 @@ static void eproplist_demosim(benchmark::State &state) {
   }
 }
 
+// Simulates entities of a class with prop_count props where fill_percent of the props ever get
+// set. A few hot props (origin, angles, simulation time, ...) change almost every tick and sit at
+// the front due to the changesoften sort, the rest of the set props change rarely.
+static std::vector<std::vector<uint16_t>> get_fill_sim(uint16_t prop_count, int fill_percent) {
+  std::vector<std::vector<uint16_t>> updates;
+  std::vector<uint16_t> set_props;
+  std::srand(1);
+
+  for (uint16_t i = 0; i < prop_count; ++i) {
+    if (std::rand() % 100 < fill_percent) {
+      set_props.push_back(i);
+    }
+  }
+
+  const size_t hot_props = std::max<size_t>(1, set_props.size() / 10);
+  // First update is the entity entering the pvs with all the non-default values
+  updates.push_back(set_props);
+
+  for (size_t tick = 0; tick < 1000; ++tick) {
+    std::vector<uint16_t> update;
+    for (size_t i = 0; i < set_props.size(); ++i) {
+      double rng = std::rand() / ((double)RAND_MAX);
+      if ((i < hot_props && rng < 0.9) || rng < 0.02) {
+        update.push_back(set_props[i]);
+      }
+    }
+    updates.push_back(std::move(update));
+  }
+
+  return updates;
+}
+
+static void eproparr_fill(benchmark::State &state) {
+  bool newprop;
+  const uint16_t prop_count = state.range(0);
+  auto updates = get_fill_sim(prop_count, state.range(1));
+
+  for (auto _ : state) {
+    dg_eproparr arr = dg_eproparr_init(prop_count);
+    for (size_t i = 0; i < updates.size(); ++i) {
+      for (size_t u = 0; u < updates[i].size(); ++u) {
+        benchmark::DoNotOptimize(dg_eproparr_get(&arr, updates[i][u], &newprop));
+      }
+    }
+
+    for (dg_prop_value_inner *value = dg_eproparr_next(&arr, nullptr); value != nullptr;
+         value = dg_eproparr_next(&arr, value)) {
+      benchmark::DoNotOptimize(value);
+    }
+    dg_eproparr_free(&arr);
+  }
+}
+
+static void eproplist_fill(benchmark::State &state) {
+  bool newprop;
+  auto updates = get_fill_sim(state.range(0), state.range(1));
+
+  for (auto _ : state) {
+    dg_eproplist list = dg_eproplist_init();
+    for (size_t i = 0; i < updates.size(); ++i) {
+      dg_epropnode *node = nullptr;
+      for (size_t u = 0; u < updates[i].size(); ++u) {
+        node = dg_eproplist_get(&list, node, updates[i][u], &newprop);
+      }
+    }
+    dg_eproplist_free(&list);
+  }
+}
+
+// Small entities, typical player/weapon classes and the 500+ prop classes with little set
+static void fill_args(benchmark::internal::Benchmark *bench) {
+  bench->Args({40, 50})->Args({200, 25})->Args({600, 2})->Args({600, 10})->Args({600, 60});
+}
+
 BENCHMARK(eproparr_insert);
 BENCHMARK(eproplist_insert);
 BENCHMARK(eproparr_demosim);
 BENCHMARK(eproplist_demosim);
+BENCHMARK(eproparr_fill)->Apply(fill_args);
+BENCHMARK(eproplist_fill)->Apply(fill_args);
@@ -264,6 +264,38 @@ static void hashmap_custom(benchmark::State &state) {
   }
 }
 
+// Keys hashed up front like the datatable parser does for sendtable names
+static void hashmap_custom_prehashed(benchmark::State &state) {
+  const size_t array_size = ARRAYSIZE(TEST_STRINGS);
+  size_t lengths[ARRAYSIZE(TEST_STRINGS)];
+  uint32_t hashes[ARRAYSIZE(TEST_STRINGS)];
+  for (size_t i = 0; i < array_size; ++i) {
+    lengths[i] = strlen(TEST_STRINGS[i]);
+    hashes[i] = dg_hashtable_hash(TEST_STRINGS[i], lengths[i]);
+  }
+
+  for (auto _ : state) {
+    auto table = dg_hashtable_create(array_size);
+
+    for (size_t i = 0; i < array_size; ++i) {
+      dg_hashtable_entry entry;
+      entry.str = TEST_STRINGS[i];
+      entry.value = i;
+      dg_hashtable_insert_hashed(&table, entry, lengths[i], hashes[i]);
+    }
+
+    for (size_t u = 0; u < TIMES_SEARCHED; ++u) {
+      for (size_t i = 0; i < array_size; ++i) {
+        auto entry = dg_hashtable_get_hashed(&table, TEST_STRINGS[i], lengths[i], hashes[i]);
+        if (entry.value != i) {
+          abort();
+        }
+      }
+    }
+    dg_hashtable_free(&table);
+  }
+}
+
 struct keyhash {
   std::size_t operator()(const char *str) const { return XXH32(str, strlen(str), 0); }
 };
@@ -347,6 +379,7 @@ static void hashmap_nomap(benchmark::State &state) {
 }
 
 BENCHMARK(hashmap_custom);
+BENCHMARK(hashmap_custom_prehashed);
 BENCHMARK(hashmap_nomap);
 BENCHMARK(hashmap_map);
 BENCHMARK(hashmap_unordered_map);
@@ -0,0 +1,69 @@
+#include "benchmark/benchmark.h"
+#include "demogobbler.h"
+#include <cstring>
+#include <vector>
+
+const std::size_t PACKETS = 1 << 12;
+const std::size_t MESSAGES_PER_PACKET = 64;
+
+template <typename T> static void append(std::vector<uint8_t> &out, T value) {
+  out.insert(out.end(), (uint8_t *)&value, (uint8_t *)&value + sizeof(value));
+}
+
+// Protocol 3/15 demo full of packets with nothing but small messages, so the per message overhead
+// dominates over the message bodies
+static std::vector<uint8_t> small_message_demo() {
+  std::vector<uint8_t> out(1072);
+  memcpy(out.data(), "HL2DEMO", 8);
+  int32_t protocols[] = {3, 15};
+  memcpy(out.data() + 8, protocols, sizeof(protocols));
+
+  dg_bitwriter writer;
+  dg_bitwriter_init(&writer, 1 << 12);
+  for (std::size_t i = 0; i < MESSAGES_PER_PACKET; i += 2) {
+    dg_bitwriter_write_uint(&writer, 3, 6); // net_tick
+    dg_bitwriter_write_uint32(&writer, i);
+    dg_bitwriter_write_uint(&writer, 1, 16);
+    dg_bitwriter_write_uint(&writer, 2, 16);
+    dg_bitwriter_write_uint(&writer, 0, 6); // net_nop
+  }
+  uint32_t bytes = (writer.bitoffset + 7) / 8;
+
+  dg_cmdinfo cmdinfo;
+  memset(&cmdinfo, 0, sizeof(cmdinfo));
+  for (std::size_t i = 0; i < PACKETS; ++i) {
+    out.push_back(dg_type_packet);
+    append<int32_t>(out, i);
+    append(out, cmdinfo);
+    append<int32_t>(out, 0);
+    append<int32_t>(out, 0);
+    append<int32_t>(out, bytes);
+    out.insert(out.end(), writer.ptr, writer.ptr + bytes);
+  }
+  dg_bitwriter_free(&writer);
+
+  out.push_back(dg_type_stop);
+  append<int32_t>(out, PACKETS);
+  out.resize(out.size() + 64);
+  return out;
+}
+
+static void packet_parsed_handler(parser_state *, packet_parsed *message) {
+  benchmark::DoNotOptimize(message->first_message);
+}
+
+static void netmessage_dispatch(benchmark::State &state) {
+  std::vector<uint8_t> demo = small_message_demo();
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.packet_parsed_handler = packet_parsed_handler;
+
+  for (auto _ : state) {
+    dg_parse_result result = dg_parse_buffer(&settings, demo.data(), demo.size());
+    benchmark::DoNotOptimize(result);
+  }
+
+  state.SetItemsProcessed(PACKETS * MESSAGES_PER_PACKET * state.iterations());
+}
+
+BENCHMARK(netmessage_dispatch);
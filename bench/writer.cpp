@@ -0,0 +1,72 @@
+#include "benchmark/benchmark.h"
+#include "demogobbler.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+const std::size_t PACKETS = 1 << 14;
+const std::size_t PAYLOAD_BYTES = 64;
+
+struct writer_fixture {
+  std::vector<uint8_t> payload;
+  dg_packet packet;
+  dg_header header;
+  std::string path;
+
+  writer_fixture() : payload(PAYLOAD_BYTES, 0xab) {
+    memset(&packet, 0, sizeof(packet));
+    packet.preamble.type = dg_type_packet;
+    packet.data = payload.data();
+    packet.size_bytes = payload.size();
+    memset(&header, 0, sizeof(header));
+    memcpy(header.ID, "HL2DEMO", 8);
+    header.demo_protocol = 3;
+    header.net_protocol = 15;
+    path = (std::filesystem::temp_directory_path() / "demogobbler_writer_bench.dem").string();
+  }
+
+  ~writer_fixture() { std::remove(path.c_str()); }
+
+  // Small packets are almost all fixed size fields, so this measures the per write overhead
+  void write(writer *w) {
+    w->version = dg_get_demo_version(&header);
+    dg_write_header(w, &header);
+    for (std::size_t i = 0; i < PACKETS; ++i) {
+      packet.preamble.tick = i;
+      dg_write_packet(w, &packet);
+    }
+  }
+};
+
+static void writer_packets_file(benchmark::State &state) {
+  writer_fixture fixture;
+
+  for (auto _ : state) {
+    writer w;
+    dg_writer_init(&w);
+    dg_writer_open_file(&w, fixture.path.c_str());
+    fixture.write(&w);
+    dg_writer_free(&w);
+  }
+
+  state.SetItemsProcessed(PACKETS * state.iterations());
+}
+
+BENCHMARK(writer_packets_file);
+
+static void writer_packets_mapped(benchmark::State &state) {
+  writer_fixture fixture;
+
+  for (auto _ : state) {
+    writer w;
+    dg_writer_init(&w);
+    dg_writer_open_file_mapped(&w, fixture.path.c_str());
+    fixture.write(&w);
+    dg_writer_free(&w);
+  }
+
+  state.SetItemsProcessed(PACKETS * state.iterations());
+}
+
+BENCHMARK(writer_packets_mapped);
@@ -4,17 +4,20 @@
 extern "C" {
 #endif
 
+#include "demogobbler/alloc_report.h"
 #include "demogobbler/allocator.h"
 #include "demogobbler/bitwriter.h"
 #include "demogobbler/datatable_types.h"
 #include "demogobbler/entity_types.h"
 #include "demogobbler/header.h"
+#include "demogobbler/input_timeline.h"
 #include "demogobbler/io.h"
 #include "demogobbler/packet_netmessages.h"
 #include "demogobbler/packettypes.h"
 #include "demogobbler/parser.h"
 #include "demogobbler/parser_types.h"
 #include "demogobbler/stringtable_types.h"
+#include "demogobbler/user_message_types.h"
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -31,14 +34,26 @@ typedef struct dg_parse_result dg_parse_result;
 dg_parse_result dg_parse_file(dg_settings *settings, const char *filepath);
 dg_parse_result dg_parse_buffer(dg_settings *settings, void *buffer, size_t size);
 dg_parse_result dg_parse(dg_settings *settings, void *stream, dg_input_interface dg_input_interface);
+// Frees the arenas cached for the calling thread by dg_settings.reuse_thread_arenas
+void dg_release_thread_arenas(void);
 
 struct dg_writer {
   void *_stream;
   const char *error_message;
   output_interface output_funcs;
+  uint8_t *_buffer;
+  uint32_t _buffer_offset;
+  uint32_t _buffer_capacity;
+  // Small writes are coalesced into a buffer of this many bytes before reaching output_funcs. Set
+  // before the first write, 0 uses the default
+  uint32_t buffer_size;
   bool error;
   bool _custom_stream;
+  bool _mapped;
   bool expect_equal;
+  // Copy netmessages that are not marked dirty from the bits they were parsed from instead of
+  // encoding them again. Only turn this on if every change to a message also sets its dirty flag
+  bool copy_clean_messages;
   dg_demver_data version;
   struct dg_bitwriter bitwriter;
 };
@@ -47,7 +62,14 @@ typedef struct dg_writer writer;
 
 void dg_writer_init(writer *thisptr);
 void dg_writer_open_file(writer *thisptr, const char *filepath);
+// Output is buffered, custom streams only receive data on dg_writer_flush, dg_writer_close or
+// dg_writer_free
 void dg_writer_open(writer *thisptr, void *stream, output_interface output_interface);
+// Writes through a memory mapping of the file, falls back to dg_writer_open_file when mapping
+// is not supported
+void dg_writer_open_file_mapped(writer *thisptr, const char *filepath);
+// Passes buffered bytes on to the output, done automatically on close
+void dg_writer_flush(writer *thisptr);
 void dg_writer_close(writer *thisptr);
 void dg_write_consolecmd(writer *thisptr, dg_consolecmd *message);
 void dg_write_customdata(writer *thisptr, dg_customdata *message);
@@ -73,6 +95,9 @@ typedef struct {
   const dg_demver_data *version_data;
   dg_datatables_parsed *message;
   dg_alloc_state* allocator;
+  // Memory that is freed before the estate is, entity props and flattening scratch.
+  // NULL uses dg_heap_allocator
+  dg_alloc_state* heap_allocator;
   bool flatten_datatables;
   bool should_store_props;
 } estate_init_args;
@@ -81,22 +106,59 @@ dg_parse_result dg_parse_instancebaseline(const dg_instancebaseline_args* args);
 dg_datatables_parsed_rval dg_parse_datatables(dg_demver_data *state, dg_alloc_state *allocator,
                                               dg_datatables *message);
 dg_parse_result dg_estate_init(estate *thisptr, estate_init_args args);
+// Same as dg_estate_init but reuses the flattened serverclasses from the cache if a demo with
+// identical datatables has been seen before. Misses flatten every serverclass and add them to the
+// cache. On a hit class_datas points to memory owned by the cache, which must outlive the estate
+dg_parse_result dg_estate_init_cached(estate *thisptr, estate_init_args args,
+                                      dg_estate_cache *cache);
+// Same as dg_estate_init_cached with the number of threads used when flattening eagerly. 0 and 1
+// flatten on the calling thread like dg_estate_init and dg_estate_init_cached,
+// DG_FLATTEN_THREADS_AUTO picks based on core count. cache can be NULL
+dg_parse_result dg_estate_init_ex(estate *thisptr, estate_init_args args, dg_estate_cache *cache,
+                                  uint32_t flatten_threads);
+// The cache locks internally, so one cache can be shared by parsers on several threads
+dg_estate_cache *dg_estate_cache_create(void);
+void dg_estate_cache_free(dg_estate_cache *thisptr);
+size_t dg_estate_cache_entry_count(const dg_estate_cache *thisptr);
+// Add the entries from a file written by dg_estate_cache_save. Files with a different format
+// version are rejected.
+dg_parse_result dg_estate_cache_load(dg_estate_cache *thisptr, const char *filepath);
+dg_parse_result dg_estate_cache_save(const dg_estate_cache *thisptr, const char *filepath);
 dg_parse_result dg_parse_stringtables(dg_stringtables_parsed *out, stringtable_parse_args args);
 dg_parse_result dg_estate_update(estate *entity_state, const dg_packetentities_data *data);
 void dg_estate_free(estate *thisptr);
+// Iterate over the entities that currently exist, pass in NULL as current to get the first one.
+// Order is unspecified and the iteration is invalidated by dg_estate_update
+dg_edict *dg_estate_next_live(const estate *thisptr, const dg_edict *current);
 
 void dg_estate_init_table(dg_parser *thisptr, size_t index);
 void dg_parser_init_estate(dg_parser *thisptr, dg_datatables_parsed *message);
 dg_serverclass_data *dg_estate_serverclass_data(estate *thisptr, const dg_demver_data* demver_data, dg_alloc_state* allocator, size_t index);
+// Look up a prop of a flattened serverclass by its fully qualified name "table.prop",
+// "table.prop[3]" gets a handle to a single element of an array prop.
+// Returns a handle with prop_index DG_PROP_HANDLE_INVALID if not found
+dg_prop_handle dg_estate_find_prop(const estate *thisptr, uint32_t serverclass, const char *name);
+// Look up the prop with the same owner table and name as prop, which can be from another estate
+dg_prop_handle dg_estate_find_sendprop(const estate *thisptr, uint32_t serverclass,
+                                       const dg_sendprop *prop);
+dg_sendprop *dg_estate_handle_prop(const estate *thisptr, dg_prop_handle handle);
 dg_eproparr dg_eproparr_init(uint16_t prop_count);
+// NULL allocator uses dg_heap_allocator
+dg_eproparr dg_eproparr_init_ex(uint16_t prop_count, dg_alloc_state *allocator);
 // Get a dg_prop_value_inner for this index, also creates it if doesnt exist
 dg_prop_value_inner *dg_eproparr_get(dg_eproparr *thisptr, uint16_t index, bool *new_prop);
 // Get the next value that is not default, pass in NULL as current to get the first value
-// Returns null when no more values left
+// Returns null when no more values left. Values are returned in prop index order, inserting a
+// new prop invalidates previously returned pointers.
 dg_prop_value_inner *dg_eproparr_next(const dg_eproparr *thisptr, dg_prop_value_inner *current);
+// Get the prop index of a value returned by dg_eproparr_get or dg_eproparr_next
+uint16_t dg_eproparr_index(const dg_eproparr *thisptr, const dg_prop_value_inner *value);
+// Get the value pointed to by the handle, returns NULL if the prop has not been set
+dg_prop_value_inner *dg_eproparr_find(const dg_eproparr *thisptr, dg_prop_handle handle);
 void dg_eproparr_free(dg_eproparr *thisptr);
 
 dg_eproplist dg_eproplist_init(void);
+dg_eproplist dg_eproplist_init_ex(dg_alloc_state *allocator);
 dg_epropnode *dg_eproplist_get(dg_eproplist *thisptr, dg_epropnode *initial_guess, uint16_t index,
                                bool *new_prop);
 dg_epropnode *dg_eproplist_next(const dg_eproplist *thisptr, dg_epropnode *current);
@@ -105,23 +167,88 @@ void dg_sendprop_name(char* buffer, size_t size, const dg_sendprop *prop);
 enum dg_proptype dg_sendprop_type(const dg_sendprop* prop);
 dg_parse_result dg_parse_stringtable_entry(dg_sentry_parse_args *args, dg_sentry *out);
 dg_parse_result dg_write_stringtable_entry(dg_sentry_write_args *args);
+// Writes for the given version, NULL is treated as protocol 3. Protocol 4 tables are always
+// written without a dictionary
+dg_parse_result dg_write_stringtable_entry_ex(dg_sentry_write_args *args,
+                                             const struct dg_demver_data *demver_data);
+// Live stringtable contents, kept when dg_settings.track_stringtables is set. Names have
+// their reused prefixes filled in. Returns NULL if the entry does not exist
+const dg_stringtable_item *dg_stringtable_get(const parser_state *state, uint32_t table_id,
+                                              uint32_t index);
+// Returns the index of the entry or -1 if not found
+int32_t dg_stringtable_find(const parser_state *state, uint32_t table_id, const char *name);
+// Returns the table id or -1 if not found
+int32_t dg_stringtable_find_table(const parser_state *state, const char *table_name);
+// Changes made to the tables during the tick of the latest packet, in the order they were made
+const dg_stringtable_change *dg_stringtable_changes(const parser_state *state, int32_t *tick,
+                                                   uint32_t *count);
+// Build the decoders for svc_game_event from the descriptors in the event list. Everything is
+// allocated from allocator, dg_game_event_list_free only releases the name lookup
+dg_parse_result dg_parse_game_event_list(dg_game_event_list *out,
+                                         const struct dg_svc_game_event_list *message,
+                                         dg_alloc_state *allocator);
+void dg_game_event_list_free(dg_game_event_list *thisptr);
+// Only the named events are decoded by dg_parse_game_event, NULL names wants every event
+void dg_game_event_list_set_wanted(dg_game_event_list *thisptr, const char *const *names,
+                                   uint32_t count);
+// Returns NULL if the demo has no event with this name
+const dg_game_event_descriptor *dg_game_event_list_find(const dg_game_event_list *thisptr,
+                                                        const char *name);
+// Returns the index of the key in the event's values or -1 if not found
+int32_t dg_game_event_key_index(const dg_game_event_descriptor *descriptor, const char *key);
+// Events that are unknown or not wanted leave out->descriptor NULL
+dg_parse_result dg_parse_game_event(dg_game_event *out, const dg_game_event_list *list,
+                                    const struct dg_svc_game_event *message,
+                                    dg_alloc_state *allocator);
+// Mods number their user messages differently, so only games whose ids are known get a non-empty
+// registry
+dg_user_message_registry dg_user_message_registry_get(const dg_demver_data *version,
+                                                      const char *game_directory);
+// Returns NULL if the game has no decoder for this user message id
+const dg_user_message_type *dg_user_message_type_get(const dg_user_message_registry *registry,
+                                                     uint32_t msg_type);
+// Decode the payload on first access, later calls return the same message. out is NULL for
+// types without a decoder. The message is allocated from the packet's memory so it is only
+// valid during the packet callback
+dg_parse_result dg_user_message_decode(struct dg_svc_user_message *message,
+                                       const dg_user_message **out);
 
 void dg_parser_init(dg_parser *thisptr, dg_settings *settings);
 void dg_parser_arena_check_init(dg_parser *thisptr);
 void dg_parser_parse(dg_parser *thisptr, void *stream, dg_input_interface input);
 void dg_parser_update_l4d2_version(dg_parser *thisptr, int l4d2_version);
 dg_parse_result dg_parser_add_stringtable(dg_parser *thisptr, dg_sentry* table);
+// Same as dg_parser_add_stringtable but the tracked table can be looked up by name
+dg_parse_result dg_parser_add_stringtable_ex(dg_parser *thisptr, const char *name,
+                                             dg_sentry *table);
+// Apply the entries of an update to the tracked contents of the table
+dg_parse_result dg_parser_update_stringtable(dg_parser *thisptr, uint32_t table_id,
+                                             const dg_sentry *update);
 dg_alloc_state* dg_parser_temp_allocator(dg_parser *thisptr);
 dg_alloc_state* dg_parser_perm_allocator(dg_parser *thisptr);
+dg_alloc_state* dg_parser_heap_allocator(dg_parser *thisptr);
 dg_alloc_state* dg_parser_packet_allocator(dg_parser *thisptr);
 void dg_init_baseline(dg_ent_update *baseline, const dg_serverclass_data *target_datatable,
                           dg_alloc_state* allocator);
 dg_parse_result dg_parse_packetentities(dg_packetentities_parse_args* args);
+// Decode temp entities with the estate's flattened serverclasses
+dg_parse_result dg_parse_temp_entities(dg_temp_entities_parse_args *args);
 
 struct dg_usercmd_parsed;
 
 dg_parse_result dg_parser_parse_usercmd(const dg_demver_data* version_data, const dg_usercmd *input, struct dg_usercmd_parsed* out);
 void dg_bitwriter_write_usercmd(dg_bitwriter* thisptr, struct dg_usercmd_parsed* parsed);
+// Set dg_settings.input_timeline to have dg_parse fill the timeline. NULL allocator uses
+// dg_heap_allocator
+void dg_input_timeline_init(dg_input_timeline *thisptr, dg_alloc_state *allocator);
+// Make room for this many more rows, dg_parse reserves rows based on the demo's tick count
+void dg_input_timeline_reserve(dg_input_timeline *thisptr, size_t usercmds, size_t cmdinfo);
+// Remove all rows but keep the memory for the next demo
+void dg_input_timeline_clear(dg_input_timeline *thisptr);
+void dg_input_timeline_free(dg_input_timeline *thisptr);
+void dg_input_timeline_add_usercmd(dg_input_timeline *thisptr,
+                                   const struct dg_usercmd_parsed *cmd);
+void dg_input_timeline_add_cmdinfo(dg_input_timeline *thisptr, const dg_packet *packet);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,78 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "demogobbler/entity_types.h"
+#include "demogobbler/packettypes.h"
+#include "demogobbler/parser_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Allocation telemetry, only collected when the library is built with
+// DEMOGOBBLER_ALLOC_TELEMETRY. Otherwise the report is always empty and enabled is false.
+
+// clang-format off
+#define DEMOGOBBLER_MACRO_ALL_ALLOC_SITES(macro) \
+  macro(other) \
+  macro(message_data) \
+  macro(parse_netmessages_scrap) \
+  macro(parse_netmessages) \
+  macro(netmessage_body) \
+  macro(parse_props) \
+  macro(read_vector3) \
+  macro(read_vector2) \
+  macro(read_string) \
+  macro(read_array) \
+  macro(ent_updates) \
+  macro(explicit_deletes) \
+  macro(alloc_inner_value) \
+  macro(eproparr) \
+  macro(eproplist) \
+  macro(parse_sentry) \
+  macro(stringtables) \
+  macro(datatables)
+// clang-format on
+
+#define DEMOGOBBLER_DECLARE_ENUMS(x) dg_alloc_site_##x,
+
+enum dg_alloc_site { DEMOGOBBLER_MACRO_ALL_ALLOC_SITES(DEMOGOBBLER_DECLARE_ENUMS) dg_alloc_site_count };
+typedef enum dg_alloc_site dg_alloc_site;
+
+#undef DEMOGOBBLER_DECLARE_ENUMS
+
+struct dg_alloc_counter {
+  uint64_t allocs;
+  uint64_t bytes;
+  uint64_t frees;
+  uint64_t freed_bytes;
+};
+
+typedef struct dg_alloc_counter dg_alloc_counter;
+
+// Index 0 counts allocations made outside of any message, the rest are indexed by enum dg_type
+enum { DG_ALLOC_REPORT_MESSAGE_TYPES = dg_type_stringtables + 1 };
+// Index svc_invalid counts allocations made outside of any netmessage
+enum { DG_ALLOC_REPORT_NETMESSAGE_TYPES = svc_invalid + 1 };
+
+struct dg_alloc_report {
+  bool enabled;
+  dg_alloc_counter by_message[DG_ALLOC_REPORT_MESSAGE_TYPES][dg_alloc_site_count];
+  dg_alloc_counter by_netmessage[DG_ALLOC_REPORT_NETMESSAGE_TYPES][dg_alloc_site_count];
+};
+
+typedef struct dg_alloc_report dg_alloc_report;
+
+// Counters are per thread, these only see allocations made by the calling thread
+void dg_alloc_report_get(dg_alloc_report *out);
+void dg_alloc_report_reset(void);
+// Sums all message types for a site
+dg_alloc_counter dg_alloc_report_site_total(const dg_alloc_report *report, dg_alloc_site site);
+const char *dg_alloc_site_name(dg_alloc_site site);
+const char *dg_message_type_name(int type);
+const char *dg_net_message_name(net_message_type type);
+
+#ifdef __cplusplus
+}
+#endif
@@ -16,19 +16,39 @@ struct dg_arena_block {
   void *data;           // Pointer to data
 };
 
+// Arena flags
+enum {
+  // Back blocks with transparent huge pages where supported (Linux), ignored elsewhere
+  DG_ARENA_HUGE_PAGES = 1 << 0,
+};
+
 // The arena lazily allocates memory
 typedef struct {
   struct dg_arena_block *blocks;
   uint32_t block_count;
   uint32_t first_block_size;
   uint32_t current_block;
+  uint32_t flags;
+  // Usage is only summed on clear so allocation stays a pointer bump
+  uint64_t peak_bytes;
+  uint64_t bytes_cleared;
 } dg_arena;
 
+typedef struct {
+  uint64_t bytes_allocated; // Total bytes handed out since creation, including alignment padding
+  uint64_t bytes_in_use;    // Bytes handed out since the last clear
+  uint64_t peak_bytes;      // Highest bytes_in_use seen between clears
+  uint64_t bytes_reserved;  // Sum of block sizes
+  uint32_t block_count;
+} dg_arena_stats;
+
 typedef void* (*func_dg_alloc)(void* allocator, uint32_t size, uint32_t alignment);
 typedef void* (*func_dg_realloc)(void* allocator, void *ptr, uint32_t prev_size, uint32_t size, uint32_t alignment);
 typedef void (*func_dg_clear)(void* allocator);
 typedef void (*func_dg_free)(void* allocator);
 typedef void (*func_dg_attach)(void* allocator, void *ptr, uint32_t size);
+// size is the size the memory was last allocated or reallocated with
+typedef void (*func_dg_dealloc)(void* allocator, void *ptr, uint32_t size);
 
 struct dg_alloc_state
 {
@@ -37,19 +57,31 @@ struct dg_alloc_state
   func_dg_clear clear;
   func_dg_realloc realloc;
   func_dg_attach attach;
+  func_dg_dealloc dealloc; // Optional, memory is only released on clear if this is NULL
 };
 
 typedef struct dg_alloc_state dg_alloc_state;
 
 dg_alloc_state dg_arena_create_allocator(dg_arena* arena);
 dg_arena dg_arena_create(uint32_t first_block_size);
+dg_arena dg_arena_create_ex(uint32_t first_block_size, uint32_t flags);
 void dg_arena_clear(dg_arena *a);
 void *dg_arena_allocate(dg_arena *a, uint32_t size, uint32_t alignment);
 void *dg_arena_reallocate(dg_arena *a, void *ptr, uint32_t prev_size, uint32_t size,
                           uint32_t alignment);
+// Only gives the memory back if it was the last allocation
+void dg_arena_deallocate(dg_arena *a, void *ptr, uint32_t size);
 void dg_arena_free(dg_arena *a);
 // Add memory that is currently in use to the arena pool
 void dg_arena_attach(dg_arena *a, void *ptr, uint32_t size);
+dg_arena_stats dg_arena_get_stats(const dg_arena *a);
+// Frees unused blocks from the end of the arena until at most max_reserved_bytes are reserved.
+// Blocks that hold live allocations are never freed
+void dg_arena_trim(dg_arena *a, uint64_t max_reserved_bytes);
+
+// Allocator backed by malloc, realloc and free, used wherever the library needs memory with an
+// individual lifetime and no allocator was supplied. Alignments up to that of max_align_t only
+dg_alloc_state *dg_heap_allocator(void);
 
 static inline void* dg_alloc_allocate(dg_alloc_state* state, uint32_t size, uint32_t alignment)
 {
@@ -66,6 +98,12 @@ static inline void dg_alloc_clear(dg_alloc_state* state)
   state->clear(state->allocator);
 }
 
+static inline void dg_alloc_free(dg_alloc_state* state, void *ptr, uint32_t size)
+{
+  if (state->dealloc)
+    state->dealloc(state->allocator, ptr, size);
+}
+
 static inline void dg_alloc_attach(dg_alloc_state* state, void *ptr, uint32_t size)
 {
   state->attach(state->allocator, ptr, size);
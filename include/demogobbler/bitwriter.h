@@ -21,6 +21,7 @@ struct dg_bitwriter {
   uint32_t bitoffset;
   bool error;
   char *error_message;
+  dg_alloc_state *allocator;
 #ifdef GROUND_TRUTH_CHECK
   void *truth_data;
   uint32_t truth_data_offset;
@@ -39,6 +40,9 @@ struct write_packetentities_args {
 typedef struct write_packetentities_args write_packetentities_args;
 
 void dg_bitwriter_init(dg_bitwriter *thisptr, uint32_t initial_size_bits);
+// Same as dg_bitwriter_init but the buffer comes from allocator, NULL uses dg_heap_allocator
+void dg_bitwriter_init_ex(dg_bitwriter *thisptr, uint32_t initial_size_bits,
+                          dg_alloc_state *allocator);
 int64_t dg_bitwriter_get_available_bits(dg_bitwriter *thisptr);
 void dg_bitwriter_write_bit(dg_bitwriter *thisptr, bool value);
 void dg_bitwriter_write_bitcoord(dg_bitwriter *thisptr, dg_bitcoord value);
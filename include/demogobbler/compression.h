@@ -0,0 +1,20 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Buffers compressed by the engine's COM_BufferToBufferCompress. They start with a 4 byte id,
+// "LZSS" followed by the uncompressed size, or "SNAP" followed by a raw snappy stream
+
+// Returns the uncompressed size stored in the buffer, 0 if the buffer is not compressed
+uint32_t dg_decompressed_size(const void *src, uint32_t src_bytes);
+// Returns false if the input is corrupt or does not decompress to exactly dest_bytes
+bool dg_decompress(void *dest, uint32_t dest_bytes, const void *src, uint32_t src_bytes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,7 @@ extern "C" {
 #include "demogobbler/datatable_types.h"
 #include "demogobbler/entity_types.h"
 
+float dg_bitcoord_to_float(dg_bitcoord value);
 float dg_prop_to_float(dg_sendprop *prop, dg_prop_value_inner value);
 
 #ifdef __cplusplus
@@ -76,10 +76,14 @@ struct dg_sendtable {
   dg_sendprop *props;
   size_t prop_count;
   bool needs_decoder;
+  uint16_t name_length; // Set by the parser along with the dg_hashtable_hash of the name, 0 if unset
+  uint32_t name_hash;
 };
 
 struct dg_serverclass {
   uint16_t serverclass_id;
+  uint16_t datatable_name_length; // Same as name_length in dg_sendtable
+  uint32_t datatable_name_hash;
   const char *serverclass_name;
   const char *datatable_name;
 };
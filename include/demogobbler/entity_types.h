@@ -7,6 +7,7 @@ extern "C" {
 #include "demogobbler/allocator.h"
 #include "demogobbler/floats.h"
 #include <stddef.h>
+#include <stdint.h>
 
 struct dg_sendprop;
 struct dg_sendtable;
@@ -19,9 +20,19 @@ typedef struct {
 } dg_hashtable_entry;
 
 typedef struct {
-  dg_hashtable_entry *arr;
-  size_t max_items;
+  dg_hashtable_entry entry;
+  uint32_t hash;
+  uint32_t length;
+} dg_hashtable_slot;
+
+// Open addressed string table in the style of a Swiss table. Each slot has a control byte holding
+// 7 bits of its hash, or marking it as empty, and a whole group of control bytes is matched at once
+typedef struct {
+  dg_hashtable_slot *slots;
+  uint8_t *ctrl;
+  size_t max_items; // Number of slots, a power of two and a multiple of the group size
   size_t item_count;
+  dg_alloc_state *allocator;
 } dg_hashtable;
 
 typedef struct {
@@ -32,6 +43,7 @@ typedef struct {
   dg_pes_entry *arr;
   size_t max_items;
   size_t item_count;
+  dg_alloc_state *allocator;
 } dg_pes;
 
 struct dg_array_value;
@@ -72,6 +84,11 @@ typedef struct {
   dg_prop_value_inner value; // Actual value
   uint32_t prop_index;
   //struct dg_sendprop *prop;  // Pointer to sendprop containing all the metadata
+  // Bits the prop was read from in dg_ent_update.prop_source, zero length if not recorded. The
+  // writer copies these bits as is, so set dirty after changing the value
+  uint32_t bit_start;
+  uint32_t bit_length;
+  bool dirty;
 } prop_value;
 
 struct dg_string_value {
@@ -102,6 +119,7 @@ struct dg_ent_update {
   size_t update_type;
   prop_value *prop_value_array;
   size_t prop_value_array_size;
+  const void *prop_source; // Message data the prop spans point into, NULL if they were not recorded
   bool new_way;
 };
 
@@ -122,6 +140,21 @@ typedef struct {
   struct dg_svc_packet_entities *orig;
 } dg_svc_packetentities_parsed;
 
+struct dg_temp_entity {
+  float delay; // Seconds after the packet's tick that the effect fires
+  // datatable_id is the serverclass and ent_index is -1. Entries that don't send a class reuse
+  // the previous entry's class, the engine applies their props on top of the previous entry's
+  dg_ent_update update;
+};
+
+typedef struct dg_temp_entity dg_temp_entity;
+
+typedef struct dg_svc_temp_entities_parsed {
+  dg_temp_entity *entities; // Only entities of the wanted classes
+  size_t entities_count;
+  struct dg_svc_temp_entities *orig;
+} dg_svc_temp_entities_parsed;
+
 struct dg_epropnode;
 typedef struct dg_epropnode dg_epropnode;
 
@@ -133,12 +166,21 @@ struct dg_epropnode {
 
 typedef struct {
   dg_epropnode *head;
+  dg_alloc_state *allocator;
 } dg_eproplist;
 
+// Props set on an entity. While only a few props are set the values are packed in prop index
+// order and located by their rank in the presence bitset, once enough props are set the storage
+// switches to a dense array indexed by the prop index.
 typedef struct {
   dg_prop_value_inner *values;
-  uint16_t *next_prop_indices;
+  uint64_t *present;     // Bitset of the props that have a value
+  uint16_t *word_ranks;  // Number of set bits in the words of present before this word
+  dg_alloc_state *allocator;
   uint16_t prop_count;
+  uint16_t value_count;
+  uint16_t value_capacity;
+  bool dense;
 } dg_eproparr;
 
 typedef struct {
@@ -154,49 +196,136 @@ typedef struct {
 #endif
 } dg_edict;
 
+typedef struct {
+  uint32_t hash;
+  uint32_t prop_index; // Flattened prop index + 1, 0 marks an empty slot
+} dg_propname_entry;
+
 typedef struct {
   struct dg_sendprop *props;
   size_t prop_count;
   const char *dt_name;
+  // Open addressed index from "table.prop" to the flattened prop index, built when the
+  // serverclass is flattened. Size is a power of two.
+  dg_propname_entry *name_index;
+  size_t name_index_size;
 } dg_serverclass_data;
 
+enum { DG_PROP_HANDLE_INVALID = UINT16_MAX };
+
+// Stable reference to a flattened prop, valid for the lifetime of the estate
+typedef struct {
+  uint32_t serverclass;
+  uint16_t prop_index;  // DG_PROP_HANDLE_INVALID if the prop was not found
+  int16_t array_index;  // -1 unless the handle refers to a single element of an array prop
+} dg_prop_handle;
+
+// Sendtable layout resolved to integer ids when the estate is initialized, props are identified
+// by the id of the first prop of their sendtable + their index in it. Read only while flattening
+typedef struct {
+  uint32_t *prop_offsets;    // Id of the first prop of each sendtable, sendtable_count + 1 entries
+  int32_t *datatable_ids;    // Sendtable a datatable prop points to, -1 for other or unknown props
+  uint32_t *exclude_offsets; // Range in exclude_targets for each prop, prop_count + 1 entries
+  uint32_t *exclude_targets; // Ids of the props excluded by each exclude prop
+  uint32_t prop_count;
+  uint32_t exclude_target_count;
+} dg_flatten_index;
+
+// Scratch for flattening a single serverclass, one per thread
+typedef struct {
+  uint32_t *excluded_stamps; // A prop is excluded if its stamp matches the current one
+  uint32_t stamp_count;
+  uint32_t stamp;
+  uint32_t *baseclasses;     // Non-collapsible baseclasses in the order their props are sent
+  size_t baseclass_capacity;
+} dg_flatten_scratch;
+
 struct entity_parse_scrap {
-  dg_pes excluded_props;
-  dg_hashtable dts_with_excludes;
   dg_hashtable dt_hashtable;
+  dg_flatten_index index;
+  dg_flatten_scratch scratch;
 };
 
 typedef struct entity_parse_scrap entity_parse_scrap;
 
+// Cache of flattened serverclasses keyed by the contents of the datatables message
+typedef struct dg_estate_cache dg_estate_cache;
+
 struct estate {
   dg_serverclass_data *class_datas;
   struct dg_sendtable *sendtables;
   struct dg_serverclass *serverclasses;
   dg_edict *edicts;
+  uint16_t *live_edicts; // Indices of the edicts that exist, in no particular order
+  uint16_t *live_slots;  // Position of each existing edict in live_edicts
+  uint32_t live_count;
   uint32_t sendtable_count;
   uint32_t serverclass_count;
   entity_parse_scrap scrap;
+  dg_alloc_state *heap_allocator; // Entity props and flattening scratch
   bool should_store_props;
 };
 
 typedef struct estate estate;
 
+// Current contents of a stringtable entry
+struct dg_stringtable_item {
+  const char *name;
+  const uint8_t *userdata; // NULL if the entry has no userdata
+  uint32_t userdata_bits;
+};
+
+typedef struct dg_stringtable_item dg_stringtable_item;
+
 struct dg_stringtable_data {
   uint32_t max_entries;
   uint32_t user_data_size_bits;
   uint32_t flags;
   bool user_data_fixed_size;
+  // Filled in when dg_settings.track_stringtables is set
+  const char *name;
+  dg_stringtable_item *items; // max_entries long, items_count of them exist
+  uint32_t items_count;
+  dg_hashtable item_names; // Entry name => index
 };
 
 typedef struct dg_stringtable_data dg_stringtable_data;
 
 enum { MAX_STRINGTABLES = 32 };
 
+enum dg_stringtable_change_flags {
+  dg_stringtable_change_added = 1 << 0,
+  dg_stringtable_change_userdata = 1 << 1,
+};
+
+struct dg_stringtable_change {
+  uint32_t table_id;
+  uint32_t entry_index;
+  uint32_t flags; // dg_stringtable_change_flags
+};
+
+typedef struct dg_stringtable_change dg_stringtable_change;
+
+// Changes beyond this in a single tick are counted in stringtable_changes_dropped
+enum { MAX_STRINGTABLE_CHANGES = 4096 };
+
+struct dg_game_event_list;
+
 struct dg_parser_state {
   void *client_state;
   estate entity_state;
   dg_stringtable_data stringtables[MAX_STRINGTABLES];
   uint32_t stringtables_count;
+  // Changes to the tracked stringtables during stringtable_changes_tick
+  dg_stringtable_change *stringtable_changes;
+  uint32_t stringtable_changes_count;
+  uint32_t stringtable_changes_dropped;
+  int32_t stringtable_changes_tick;
+  // Indexed by serverclass, resolved from dg_settings.temp_entity_classes once the estate exists
+  bool *temp_entity_classes;
+  uint32_t temp_entity_classes_count;
+  // Descriptors from svc_game_event_list, set when game_event_handler is set
+  const struct dg_game_event_list *game_event_list;
   const char *error_message;
   bool error;
 };
@@ -6,35 +6,105 @@
 #include "demogobbler/allocator.h"
 #include <functional>
 #include <memory>
+#include <new>
 #include <stddef.h>
+#include <type_traits>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
 namespace freddie {
 
-  struct mallocator {
-  std::vector<void*> pointers;
-
-  mallocator();
-  mallocator(const mallocator& rhs) = delete;
-  mallocator& operator=(mallocator&& rhs) = default;
-  mallocator& operator=(const mallocator& rhs) = delete;
-  ~mallocator();
-  void* alloc(uint32_t size);
-  void attach(void* ptr);
-  void release();       // release the memory stored without freeing
-  void free(void *ptr); // free specific pointer
-  };
-
   typedef std::variant<packet_parsed, dg_customdata, dg_datatables_parsed,
                       dg_stringtables_parsed, dg_consolecmd, dg_synctick, dg_usercmd,
                       dg_stop>
       packet_variant_t;
 
+  // Packet memory lives in the arena of the demo_t that owns the packet
   struct demo_packet {
   packet_variant_t packet;
-  mallocator memory;
+  };
+
+  template <typename T, typename... Ts> constexpr uint8_t variant_index(std::variant<Ts...> *) {
+    constexpr bool matches[] = {std::is_same_v<T, Ts>...};
+    uint8_t index = 0;
+    while (!matches[index]) {
+      ++index;
+    }
+    return index;
+  }
+
+  // Index of T in packet_variant_t, used as the type tag of packed packets
+  template <typename T>
+  constexpr uint8_t packet_type_index = variant_index<T>((packet_variant_t *)nullptr);
+
+  // Non-owning view of a packet, valid for as long as the packet it points to
+  struct packet_view {
+    void *data = nullptr;
+    uint8_t type = 0; // Index of the packet type in packet_variant_t
+
+    template <typename T> T *get_if() const {
+      return type == packet_type_index<T> ? (T *)data : nullptr;
+    }
+  };
+
+  struct packet_store_usage {
+    size_t packet_count;
+    size_t header_bytes;   // Reserved for the header array
+    size_t payload_bytes;  // Used by the packet structs, including alignment padding
+    size_t reserved_bytes; // Header array and payload chunks together
+  };
+
+  // Packets packed by type. Every packet has an 8 byte header in one array and its struct is
+  // stored at its own size in shared arena chunks, instead of taking up a variant sized for the
+  // largest packet type
+  struct packet_store {
+    struct header {
+      uint32_t offset;     // Offset of the payload in its arena block
+      uint32_t block : 24; // Enough for a terabyte of 64 KiB chunks
+      uint32_t type : 8;   // Index of the packet type in packet_variant_t
+    };
+
+    packet_store();
+    ~packet_store();
+    packet_store(const packet_store &rhs) = delete;
+    packet_store &operator=(const packet_store &rhs) = delete;
+
+    template <typename T> T *push_back(const T &packet) {
+      headers.emplace_back();
+      return store(&headers.back(), packet);
+    }
+
+    // A payload replaced with one of a different type stays in the arena until clear
+    template <typename T> T *set(size_t index, const T &packet) {
+      if (headers[index].type == packet_type_index<T>) {
+        T *dest = (*this)[index].get_if<T>();
+        *dest = packet;
+        return dest;
+      }
+      return store(&headers[index], packet);
+    }
+
+    packet_view operator[](size_t index) const;
+    size_t size() const { return headers.size(); }
+    void clear();
+    packet_store_usage memory_usage() const;
+
+    std::vector<header> headers;
+    dg_arena arena; // Payload chunks
+
+  private:
+    void *allocate(header *dest, uint8_t type, uint32_t size, uint32_t alignment);
+
+    template <typename T> T *store(header *dest, const T &packet) {
+      void *memory = allocate(dest, packet_type_index<T>, sizeof(T), alignof(T));
+      return new (memory) T(packet);
+    }
+  };
+
+  struct demo_memory_usage {
+    packet_store_usage packets;
+    dg_arena_stats data; // Messages, datatables and everything else the packets point to
   };
 
   dg_parse_result splice_demos(const char *output_path, const char **demo_paths, size_t demo_count);
@@ -43,32 +113,86 @@ namespace freddie {
     demo_t();
     ~demo_t();
 
-    mallocator temp_allocator;
+    // Chunked bump allocator shared by all packets, released in bulk with the demo.
+    // Reallocating the latest allocation is done in place
     dg_arena arena;
+    dg_alloc_state allocator; // Allocates from arena
     dg_demver_data demver_data;
     dg_header header;
-    std::vector<std::shared_ptr<demo_packet>> packets;
+    packet_store packets;
     demo_t(const demo_t &rhs) = delete;
     demo_t &operator=(const demo_t &rhs) = delete;
-  
-
-    template <typename T> std::shared_ptr<demo_packet> copy_packet(T *orig) {
-        auto packet = std::make_shared<demo_packet>();
-        packet->memory = std::move(temp_allocator);
-        packet->packet = *orig;
-        temp_allocator.release();
-
-        return packet;
-    }
 
     static dg_parse_result parse_demo(demo_t *output, void *stream, dg_input_interface interface);
     static dg_parse_result parse_demo(demo_t *output, const char *filepath);
+    // Messages that are not marked dirty are copied from the bits they were parsed from
     dg_parse_result write_demo(void *stream, dg_output_interface interface, bool expect_equal=false);
     dg_parse_result write_demo(const char *filepath);
     dg_datatables_parsed *get_datatables() const;
+    demo_memory_usage memory_usage() const;
+  };
+
+  // Writes a single packet, false if the variant holds an unknown packet type
+  bool write_packet(dg_writer *writer, demo_packet *packet);
+  bool write_packet(dg_writer *writer, packet_view packet);
+
+  // Parses demos and writes each packet right after the transforms have run on it, so memory use
+  // does not grow with the length of the demo. Packets are only valid until they are written, the
+  // parser keeps the datatables, entity state and stringtables between packets
+  struct demo_stream_t {
+    typedef std::function<void(demo_stream_t *, dg_header *)> header_transform;
+    // Return false to leave the packet out of the output
+    typedef std::function<bool(demo_stream_t *, demo_packet *)> packet_transform;
+    // Set message->dirty after changing the message, clean messages are written as they were read
+    typedef std::function<void(demo_stream_t *, packet_parsed *, packet_net_message *)>
+        netmessage_transform;
+
+    demo_stream_t();
+    ~demo_stream_t();
+    demo_stream_t(const demo_stream_t &rhs) = delete;
+    demo_stream_t &operator=(const demo_stream_t &rhs) = delete;
+
+    void add_header_transform(header_transform func);
+    // Runs after the netmessage transforms of the packet
+    void add_packet_transform(packet_transform func);
+    // Registering svc_packet_entities turns on dg_settings.parse_packetentities. Invalid types are
+    // not registered and set result, which parse and close return
+    void add_netmessage_transform(net_message_type type, netmessage_transform func);
+
+    void open(void *stream, dg_output_interface interface);
+    void open(const char *filepath);
+    // Can be called several times to write demos one after another, only the first header is
+    // written
+    dg_parse_result parse(void *stream, dg_input_interface interface);
+    dg_parse_result parse(const char *filepath);
+    // Flushes and closes the output, returns the first error from the transforms or the writer
+    dg_parse_result close();
+
+    // Cleared after every packet, for memory the transforms need until the packet is written
+    dg_arena arena;
+    dg_alloc_state allocator; // Allocates from arena
+    dg_settings settings; // Extra parser settings, parse sets the handlers
+    dg_writer writer;
+    dg_header header; // Header of the demo being parsed, after the header transforms
+    dg_demver_data demver_data; // Version of the demo being parsed
+    const dg_demver_data *output_version = nullptr; // Version to write, NULL for demver_data
+    parser_state *state = nullptr; // Set while parsing
+    dg_parse_result result; // First error from a transform
+    void *client_state = nullptr;
+
+    std::vector<header_transform> header_transforms;
+    std::vector<packet_transform> packet_transforms;
+    std::vector<netmessage_transform> netmessage_transforms[svc_invalid];
+    bool header_written = false;
   };
 
   dg_parse_result convert_demo(const demo_t *example, demo_t *demo);
+  // Converts while streaming the input, only the example is kept in memory
+  dg_parse_result convert_demo(const demo_t *example, const char *input_path,
+                               const char *output_path);
+  // Encode the parsed entity updates of a svc_packet_entities message into its data
+  void encode_packetentities(packet_net_message *msg, const dg_demver_data *version,
+                             dg_alloc_state *allocator);
 
   struct prop_status {
     dg_sendprop* target = nullptr;
@@ -90,6 +214,8 @@ namespace freddie {
     datatable_change_info& operator=(const datatable_change_info& lhs) = delete;
 
     dg_parse_result init(freddie::demo_t *input, const freddie::demo_t *target);
+    dg_parse_result init(dg_datatables_parsed *input, const dg_demver_data *input_version,
+                         const freddie::demo_t *target);
     void add_datatable(uint32_t new_index, bool changed, bool exists);
     void add_prop(dg_sendprop* prop, prop_status status);
     void print(bool print_props);
@@ -101,8 +227,12 @@ namespace freddie {
     dg_parse_result convert_instancebaselines(dg_sentry* stringtable, dg_bitstream* data);
     dg_parse_result convert_props(dg_ent_update* update, uint32_t new_datatable_id);
     dg_parse_result convert_demo(freddie::demo_t* input);
+    // Converts the message in place and marks it dirty if anything changed
+    dg_parse_result convert_netmessage(packet_net_message* netmsg);
 
     dg_alloc_state allocator;
+    // Used for the converted messages, same as allocator unless changed after construction
+    dg_alloc_state message_allocator;
     estate input_estate;
     estate target_estate;
     std::unordered_map<dg_sendprop*, prop_status> prop_map;
@@ -6,13 +6,24 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// The table grows as needed, array_size is the number of items to reserve space for
 dg_hashtable dg_hashtable_create(size_t array_size);
+// Same as dg_hashtable_create but takes its memory from allocator, NULL uses dg_heap_allocator
+dg_hashtable dg_hashtable_create_ex(size_t array_size, dg_alloc_state *allocator);
 dg_hashtable_entry dg_hashtable_get(dg_hashtable *thisptr, const char *str);
+// Returns false if the string is already in the table
 bool dg_hashtable_insert(dg_hashtable *thisptr, dg_hashtable_entry entry);
+// Variants for keys whose length and dg_hashtable_hash are already known
+uint32_t dg_hashtable_hash(const char *str, size_t length);
+dg_hashtable_entry dg_hashtable_get_hashed(dg_hashtable *thisptr, const char *str, size_t length,
+                                           uint32_t hash);
+bool dg_hashtable_insert_hashed(dg_hashtable *thisptr, dg_hashtable_entry entry, size_t length,
+                                uint32_t hash);
 void dg_hashtable_clear(dg_hashtable *thisptr);
 void dg_hashtable_free(dg_hashtable *thisptr);
 
 dg_pes dg_pes_create(size_t array_size);
+dg_pes dg_pes_create_ex(size_t array_size, dg_alloc_state *allocator);
 bool dg_pes_has(dg_pes *thisptr, dg_sendtable *table, dg_sendprop *prop);
 bool dg_pes_insert(dg_pes *thisptr, dg_sendprop *entry);
 void dg_pes_free(dg_pes *thisptr);
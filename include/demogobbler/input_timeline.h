@@ -0,0 +1,69 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "demogobbler/allocator.h"
+#include "demogobbler/vector.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// One row per usercmd message. Fields missing from a usercmd are zero, same as in the engine
+// which encodes demo usercmds against an empty command
+#define DEMOGOBBLER_MACRO_USERCMD_COLUMNS(macro)                                                   \
+  macro(int32_t, tick)                                                                             \
+  macro(uint8_t, slot)                                                                             \
+  macro(uint32_t, command_number)                                                                  \
+  macro(uint32_t, tick_count)                                                                      \
+  macro(vector, viewangles)                                                                        \
+  macro(float, forwardmove)                                                                        \
+  macro(float, sidemove)                                                                           \
+  macro(float, upmove)                                                                             \
+  macro(int32_t, buttons)                                                                          \
+  macro(uint8_t, impulse)                                                                          \
+  macro(uint16_t, weapon_select)                                                                   \
+  macro(int16_t, mouse_dx)                                                                         \
+  macro(int16_t, mouse_dy)
+
+// One row per splitscreen slot of every packet message
+#define DEMOGOBBLER_MACRO_CMDINFO_COLUMNS(macro)                                                   \
+  macro(int32_t, tick)                                                                             \
+  macro(uint8_t, slot)                                                                             \
+  macro(int32_t, interp_flags)                                                                     \
+  macro(vector, view_origin)                                                                       \
+  macro(vector, view_angles)                                                                       \
+  macro(vector, local_viewangles)
+
+#define DEMOGOBBLER_DECLARE_COLUMN(type, name) type *name;
+
+struct dg_usercmd_columns {
+  DEMOGOBBLER_MACRO_USERCMD_COLUMNS(DEMOGOBBLER_DECLARE_COLUMN)
+  size_t count;
+  size_t capacity;
+};
+
+typedef struct dg_usercmd_columns dg_usercmd_columns;
+
+struct dg_cmdinfo_columns {
+  DEMOGOBBLER_MACRO_CMDINFO_COLUMNS(DEMOGOBBLER_DECLARE_COLUMN)
+  size_t count;
+  size_t capacity;
+};
+
+typedef struct dg_cmdinfo_columns dg_cmdinfo_columns;
+
+#undef DEMOGOBBLER_DECLARE_COLUMN
+
+// Player input of a demo in structure of arrays form, rows are in demo order
+struct dg_input_timeline {
+  dg_usercmd_columns usercmds;
+  dg_cmdinfo_columns cmdinfo;
+  dg_alloc_state *allocator;
+};
+
+typedef struct dg_input_timeline dg_input_timeline;
+
+#ifdef __cplusplus
+}
+#endif
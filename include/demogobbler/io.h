@@ -19,10 +19,20 @@ struct dg_input_interface {
 typedef struct dg_input_interface dg_input_interface;
 
 // For writing
+struct dg_output_chunk {
+  const void *data;
+  size_t bytes;
+};
+
+typedef struct dg_output_chunk dg_output_chunk;
+
 typedef size_t (*dg_output_write)(void *stream, const void *src, size_t bytes);
+// Writes the chunks in order, returns the total bytes written
+typedef size_t (*dg_output_writev)(void *stream, const dg_output_chunk *chunks, int count);
 
 struct dg_output_interface {
   dg_output_write write;
+  dg_output_writev writev; // Optional, lets the writer pass large payloads in the same call
 };
 
 typedef struct dg_output_interface output_interface;
@@ -4,10 +4,17 @@
 extern "C" {
 #endif
 
+#include "demogobbler/parser_types.h"
+#include <stdint.h>
+
 struct dg_packet_net_message;
 struct dg_demver_data;
 struct dg_bitwriter;
 
+// Size of the record holding a message of this type, a multiple of 8
+uint32_t dg_netmessage_record_bytes(enum net_message_type type);
+// Step to the message after this one in packet_parsed.first_message
+struct dg_packet_net_message *dg_netmessage_next(const struct dg_packet_net_message *message);
 void dg_bitwriter_write_netmessage(struct dg_bitwriter *writer, struct dg_demver_data *version,
                                    struct dg_packet_net_message *message);
 
@@ -8,9 +8,11 @@ extern "C" {
 #include "demogobbler/datatable_types.h"
 #include "demogobbler/entity_types.h"
 #include "demogobbler/filereader.h"
+#include "demogobbler/input_timeline.h"
 #include "demogobbler/packettypes.h"
 #include "demogobbler/parser_types.h"
 #include "demogobbler/stringtable_types.h"
+#include "demogobbler/user_message_types.h"
 #include "stdbool.h"
 #include "stdio.h"
 
@@ -56,12 +58,23 @@ typedef void (*func_dg_usercmd)(parser_state *state, dg_usercmd *ptr);
 typedef void (*func_dg_datatables_parsed)(parser_state *state, dg_datatables_parsed *message);
 typedef void (*func_dg_packetentities_parsed)(parser_state *state,
                                               dg_svc_packetentities_parsed *message);
+typedef void (*func_dg_temp_entities_parsed)(parser_state *state,
+                                             dg_svc_temp_entities_parsed *message);
 typedef void (*func_dg_estate_init)(parser_state *state);
+typedef void (*func_dg_game_event)(parser_state *state, const dg_game_event *event);
 typedef struct dg_settings dg_settings;
 
 enum dg_alloc_type { dg_alloc_temp, dg_alloc_permanent };
 typedef enum dg_alloc_type dg_alloc_type;
 
+// Memory usage of a single dg_parse call. Arena stats are zero for roles whose allocator is not a
+// dg_arena
+typedef struct {
+  dg_arena_stats temp;
+  dg_arena_stats permanent;
+  uint64_t packet_bytes; // Requested through the packet allocator, whichever arena backs it
+} dg_memory_stats;
+
 // The settings struct contains all the callbacks for application code
 struct dg_settings {
   func_dg_consolecmd consolecmd_handler;
@@ -69,6 +82,10 @@ struct dg_settings {
   func_dg_datatables datatables_handler;
   func_dg_datatables_parsed datatables_parsed_handler;
   func_dg_packetentities_parsed packetentities_parsed_handler;
+  func_dg_temp_entities_parsed temp_entities_parsed_handler;
+  // Serverclass names passed to temp_entities_parsed_handler, e.g. "CTEExplosion". NULL for all
+  const char *const *temp_entity_classes;
+  uint32_t temp_entity_classes_count;
   func_dg_demover demo_version_handler;
   func_dg_estate_init flattened_props_handler; // Called after parsing prop flattening stuff
   func_dg_header header_handler;
@@ -79,21 +96,73 @@ struct dg_settings {
   func_dg_stringtables stringtables_handler;
   func_dg_stringtables_parsed stringtables_parsed_handler;
   func_dg_usercmd usercmd_handler;
+  func_dg_game_event game_event_handler;
+  // Events passed to game_event_handler, others are skipped without decoding. NULL for all events
+  const char *const *game_event_names;
+  uint32_t game_event_names_count;
   dg_parser_funcs funcs;
   dg_alloc_state temp_alloc_state;
   dg_alloc_state permanent_alloc_state;
+  // Used for memory that is freed piece by piece, e.g. entity props. Leave alloc NULL for malloc
+  dg_alloc_state heap_alloc_state;
   dg_alloc_type packet_alloc_type;
   bool parse_packetentities;
+  // Remember where each entity prop was read from so that the props that were not changed are
+  // copied instead of encoded again when the update is written. The packet memory must outlive
+  // the updates, e.g. with dg_alloc_permanent packets
+  bool record_prop_spans;
+  // Optional, shares flattened serverclasses between demos with identical datatables. Parsers on
+  // any number of threads can use the same cache. Must outlive the parser
+  dg_estate_cache *estate_cache;
+  // Keep the current contents of every stringtable, see dg_stringtable_get
+  bool track_stringtables;
+  // Optional, gets a row for every usercmd and packet cmdinfo. Doesn't need any handlers, when
+  // nothing else is requested the netmessages are skipped without being parsed
+  dg_input_timeline *input_timeline;
+  // Passed on to dg_estate_init_ex, 0 or 1 flattens serially, see DG_FLATTEN_THREADS_AUTO
+  uint32_t flatten_threads;
+  // Flags for the arenas dg_parse creates when no allocator is set, see DG_ARENA_*
+  uint32_t arena_flags;
+  // Keep dg_parse's arenas in a per-thread cache so that the next demo parsed on the same thread
+  // reuses their blocks. Call dg_release_thread_arenas before the thread exits
+  bool reuse_thread_arenas;
+  // Cached arenas are trimmed to this many reserved bytes after each demo, 0 uses the default
+  uint64_t arena_retain_bytes;
+  dg_memory_stats *memory_stats; // Optional, filled in before dg_parse returns
   void *client_state;
 };
 
+// Raw netmessage type ids are at most 6 bits wide
+#define DG_NETMESSAGE_MAX_IDS 64
+// Flatten with as many threads as there are cores, when there are enough serverclasses
+#define DG_FLATTEN_THREADS_AUTO UINT32_MAX
+
+struct dg_netmessage_scrap;
+typedef void (*func_dg_netmessage_handler)(struct dg_parser *thisptr, dg_bitstream *stream,
+                                           struct dg_packet_net_message *message,
+                                           struct dg_netmessage_scrap *scrap);
+
+// Built whenever demo_version changes. Maps raw type ids straight to the message type and a
+// handler with the version dependent branches already resolved, NULL for ids not on the protocol
+struct dg_netmessage_dispatch {
+  net_message_type types[DG_NETMESSAGE_MAX_IDS];
+  func_dg_netmessage_handler handlers[DG_NETMESSAGE_MAX_IDS];
+};
+
+typedef struct dg_netmessage_dispatch dg_netmessage_dispatch;
+
 struct dg_parser {
   parser_state state;
   dg_settings m_settings;
   dg_parser_funcs _parser_funcs;
   dg_filereader m_reader;
   dg_demver_data demo_version;
+  dg_netmessage_dispatch netmessage_dispatch;
+  dg_user_message_registry user_messages;
   const char *error_message;
+  dg_alloc_state packet_alloc_state; // Counts packet_bytes when memory stats are requested
+  dg_alloc_state *packet_alloc_target;
+  uint64_t packet_bytes;
   bool error;
   bool parse_netmessages;
 };
@@ -5,6 +5,7 @@ extern "C" {
 #endif
 
 #include "demogobbler/bitstream.h"
+#include "demogobbler/entity_types.h"
 #include "demogobbler/floats.h"
 #include "stringtable_types.h"
 
@@ -217,10 +218,18 @@ struct dg_svc_bsp_decal {
   bool lowpriority;
 };
 
+struct dg_user_message_type;
+struct dg_user_message;
+
 struct dg_svc_user_message {
   uint8_t msg_type; // type of the user message
   uint32_t length;  // specifies the length for the void* buffer in bits
   dg_bitstream data;
+  // Registry entry for msg_type in this game, NULL if the type has no decoder
+  const struct dg_user_message_type *type;
+  // Set by the first dg_user_message_decode, which allocates it from allocator
+  const struct dg_user_message *decoded;
+  dg_alloc_state *allocator;
 };
 
 struct dg_svc_entity_message {
@@ -230,9 +239,13 @@ struct dg_svc_entity_message {
   dg_bitstream data;
 };
 
+struct dg_game_event;
+
 struct dg_svc_game_event {
   uint32_t length;
   dg_bitstream data;
+  // Set when game_event_handler is set and the event is wanted, NULL otherwise
+  struct dg_game_event *event;
 };
 
 struct dg_svc_packet_entities {
@@ -254,6 +267,8 @@ struct dg_svc_splitscreen {
 struct dg_svc_temp_entities {
   uint8_t num_entries;
   dg_bitstream data;
+  // Set when temp_entities_parsed_handler is set and the entities were decoded
+  struct dg_svc_temp_entities_parsed *parsed;
 };
 
 struct dg_svc_prefetch {
@@ -265,22 +280,66 @@ struct dg_svc_menu {
   dg_bitstream data;
 };
 
+enum dg_game_event_key_type {
+  dg_game_event_key_local = 0, // Ends the key list, never networked
+  dg_game_event_key_string,
+  dg_game_event_key_float,
+  dg_game_event_key_long,
+  dg_game_event_key_short,
+  dg_game_event_key_byte,
+  dg_game_event_key_bool,
+  dg_game_event_key_uint64
+};
+
 struct dg_game_event_descriptor_key {
   const char *key_value;
-  uint32_t type;
+  uint32_t type; // dg_game_event_key_type
 };
 
+// The keys are also the decode recipe, values are read in key order with the key's type
 struct dg_game_event_descriptor {
   uint32_t event_id;
   const char *name;
   size_t key_count;
   struct dg_game_event_descriptor_key *keys;
+  bool wanted; // Events that are not wanted are skipped without decoding
 };
 
+typedef struct dg_game_event_descriptor dg_game_event_descriptor;
+
+enum { DG_MAX_GAME_EVENTS = 1 << 9 };
+
+struct dg_game_event_list {
+  dg_game_event_descriptor *descriptors; // Indexed by event id, name is NULL for unused ids
+  uint32_t descriptor_count;
+  dg_hashtable names; // Event name => event id
+};
+
+typedef struct dg_game_event_list dg_game_event_list;
+
+union dg_game_event_value {
+  const char *str_val;
+  float float_val;
+  int32_t int_val; // long, short and byte keys
+  uint64_t uint64_val;
+  bool bool_val;
+};
+
+typedef union dg_game_event_value dg_game_event_value;
+
+struct dg_game_event {
+  const dg_game_event_descriptor *descriptor;
+  dg_game_event_value *values; // One per key of the descriptor
+};
+
+typedef struct dg_game_event dg_game_event;
+
 struct dg_svc_game_event_list {
   uint32_t events;
   uint32_t length;
-  dg_bitstream data; // Add game event descriptor array here later on
+  dg_bitstream data;
+  // Set when game_event_handler is set, owned by the parser
+  const dg_game_event_list *list;
 };
 
 struct dg_svc_get_cvar_value {
@@ -298,11 +357,15 @@ struct dg_svc_paintmap_data {
 
 #define DECLARE_MESSAGE_IN_UNION(message) struct dg_##message message_##message
 
+// Messages of a packet are stored back to back as records that only hold the header and the
+// member for mtype, so no other member of the union may be accessed
 struct dg_packet_net_message {
   net_message_type mtype;
-#ifdef DEBUG
-  uint32_t offset;
-#endif
+  // Bits of the message in packet_parsed.orig, type id included. A writer with
+  // copy_clean_messages set copies them verbatim unless dirty is set
+  uint32_t bit_start;
+  uint32_t bit_end;
+  bool dirty;
 
   union {
     DECLARE_MESSAGE_IN_UNION(net_nop);
@@ -366,6 +429,7 @@ struct dg_demver_data {
   unsigned int svc_update_stringtable_table_id_bits : 4;
   net_message_type *netmessage_array;
   unsigned int netmessage_count;
+  int8_t netmessage_ids[svc_invalid]; // Raw type id of each message type, -1 if not on protocol
   unsigned int network_protocol;
   unsigned int l4d2_version;
 };
@@ -374,10 +438,12 @@ typedef struct dg_demver_data dg_demver_data;
 struct dg_packet;
 
 struct packet_parsed {
-  packet_net_message *messages;
+  // Records of different sizes, step through them with dg_netmessage_next. Not an array
+  packet_net_message *first_message;
   uint32_t message_count;
   dg_bitstream leftover_bits;
   struct dg_packet orig;
+  dg_demver_data version; // Messages are only copied verbatim when writing this same version
 };
 
 typedef struct packet_parsed packet_parsed;
@@ -9,12 +9,24 @@ extern "C" {
 #include <stdint.h>
 #include <stdlib.h>
 
+struct dg_output_chunk;
+
 void* dg_fstream_init(const char* filepath, const char* modes);
 size_t dg_fstream_read(void* stream, void* dest, size_t bytes);
 int dg_fstream_seek(void* stream, long int offset);
 size_t dg_fstream_write(void* stream, const void* src, size_t bytes);
+size_t dg_fstream_writev(void* stream, const struct dg_output_chunk* chunks, int count);
 void dg_fstream_free(void* stream);
 
+// Output file that is grown with ftruncate and written through a memory mapping. Not available on
+// MSVC, where dg_mapped_output_open always returns NULL
+typedef struct dg_mapped_output dg_mapped_output;
+
+dg_mapped_output* dg_mapped_output_open(const char* filepath);
+size_t dg_mapped_output_write(void* stream, const void* src, size_t bytes);
+// Truncates the file to the bytes written. Returns false if unmapping or truncating failed
+bool dg_mapped_output_close(dg_mapped_output* thisptr);
+
 struct buffer_stream
 {
   void* buffer;
@@ -94,7 +94,7 @@ struct dg_sentry {
   uint32_t user_data_size_bits;
   uint32_t flags;
   bool user_data_fixed_size;
-  bool dictionary_enabled;
+  bool dictionary_enabled; // Protocol 4 only, dictionary encoded tables are left unparsed
 };
 
 typedef struct dg_sentry dg_sentry;
@@ -116,10 +116,26 @@ struct dg_packetentities_parse_args {
   struct estate* entity_state;
   struct dg_packetentities_data* output;
   struct dg_alloc_state* permanent_allocator;
+  bool record_prop_spans; // See dg_settings.record_prop_spans
 };
 
 typedef struct dg_packetentities_parse_args dg_packetentities_parse_args;
 
+struct dg_temp_entities_parse_args {
+  struct dg_svc_temp_entities *message;
+  struct dg_alloc_state *allocator;
+  const struct dg_demver_data *demver_data;
+  struct estate *entity_state;
+  struct dg_svc_temp_entities_parsed *output;
+  struct dg_alloc_state *permanent_allocator;
+  // Indexed by serverclass, entities of other classes are read past but not stored. NULL keeps
+  // every class
+  const bool *wanted_classes;
+  bool record_prop_spans; // See dg_settings.record_prop_spans
+};
+
+typedef struct dg_temp_entities_parse_args dg_temp_entities_parse_args;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,124 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "demogobbler/allocator.h"
+#include "demogobbler/bitstream.h"
+#include "demogobbler/vector.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// User message kinds that have a decoder, the ids for each are in the per-game registries
+// clang-format off
+#define DEMOGOBBLER_MACRO_USER_MESSAGES(macro) \
+  macro(say_text) \
+  macro(say_text2) \
+  macro(text_msg) \
+  macro(hud_msg) \
+  macro(reset_hud) \
+  macro(shake) \
+  macro(fade) \
+  macro(damage)
+// clang-format on
+
+#define DEMOGOBBLER_DECLARE_ENUMS(x) dg_user_message_##x,
+
+enum dg_user_message_kind { DEMOGOBBLER_MACRO_USER_MESSAGES(DEMOGOBBLER_DECLARE_ENUMS) };
+
+#undef DEMOGOBBLER_DECLARE_ENUMS
+
+struct dg_um_say_text {
+  uint8_t client;
+  bool chat;
+  const char *text;
+};
+
+struct dg_um_say_text2 {
+  uint8_t client;
+  bool chat;
+  const char *msg_name;
+  const char *params[4];
+};
+
+struct dg_um_text_msg {
+  uint8_t dest;
+  const char *msg_name;
+  const char *params[4];
+};
+
+struct dg_um_hud_msg {
+  uint8_t channel;
+  float x;
+  float y;
+  uint8_t color1[4];
+  uint8_t color2[4];
+  uint8_t effect;
+  float fade_in;
+  float fade_out;
+  float hold_time;
+  float fx_time;
+  const char *message;
+};
+
+struct dg_um_reset_hud {
+  uint8_t reset;
+};
+
+struct dg_um_shake {
+  uint8_t command;
+  float amplitude;
+  float frequency;
+  float duration;
+};
+
+struct dg_um_fade {
+  uint16_t duration;
+  uint16_t hold_time;
+  uint16_t flags;
+  uint8_t color[4];
+};
+
+struct dg_um_damage {
+  uint8_t armor;
+  uint8_t damage_taken;
+  int32_t bits_damage;
+  vector origin;
+};
+
+#define DEMOGOBBLER_DECLARE_MEMBER(x) struct dg_um_##x x;
+
+struct dg_user_message {
+  enum dg_user_message_kind kind;
+  union {
+    DEMOGOBBLER_MACRO_USER_MESSAGES(DEMOGOBBLER_DECLARE_MEMBER)
+  };
+};
+
+#undef DEMOGOBBLER_DECLARE_MEMBER
+
+typedef struct dg_user_message dg_user_message;
+
+// Decoders read the payload into out and return false if the payload was malformed. Strings are
+// allocated from allocator
+typedef bool (*func_dg_user_message_decode)(dg_bitstream *stream, dg_user_message *out,
+                                            dg_alloc_state *allocator);
+
+struct dg_user_message_type {
+  const char *name; // Name the game registers the message under
+  enum dg_user_message_kind kind;
+  func_dg_user_message_decode decode;
+};
+
+typedef struct dg_user_message_type dg_user_message_type;
+
+// User message ids of one game, indexed by id. Ids without a decoder have decode set to NULL
+typedef struct {
+  const dg_user_message_type *types;
+  uint32_t count;
+} dg_user_message_registry;
+
+#ifdef __cplusplus
+}
+#endif
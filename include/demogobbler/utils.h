@@ -2,6 +2,9 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
@@ -35,6 +38,31 @@ static inline size_t alignment_loss(size_t bytes_allocated, size_t alignment) {
   }
 }
 
+static inline unsigned dg_popcount64(uint64_t value) {
+#if defined(_MSC_VER)
+  return (unsigned)__popcnt64(value);
+#elif defined(__POPCNT__)
+  return (unsigned)__builtin_popcountll(value);
+#else
+  // Without popcnt the builtin turns into a libgcc call, this is faster
+  value = value - ((value >> 1) & UINT64_C(0x5555555555555555));
+  value = (value & UINT64_C(0x3333333333333333)) + ((value >> 2) & UINT64_C(0x3333333333333333));
+  value = (value + (value >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+  return (unsigned)((value * UINT64_C(0x0101010101010101)) >> 56);
+#endif
+}
+
+// Index of the lowest set bit, value must not be zero
+static inline unsigned dg_ctz64(uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctzll(value);
+#endif
+}
+
 unsigned dg_bits_required(unsigned i);
 unsigned int highest_bit_index(unsigned int number);
 int Q_log2(int val);
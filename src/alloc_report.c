@@ -0,0 +1,104 @@
+#include "demogobbler/alloc_report.h"
+#include "alloc_telemetry.h"
+#include "threads.h"
+#include <string.h>
+
+#ifdef DG_ALLOC_TELEMETRY
+static DG_THREAD_LOCAL dg_alloc_report report;
+static DG_THREAD_LOCAL int current_message;
+static DG_THREAD_LOCAL net_message_type current_netmessage = svc_invalid;
+
+void dg_telemetry_alloc(dg_alloc_site site, uint64_t bytes) {
+  dg_alloc_counter *msg = &report.by_message[current_message][site];
+  dg_alloc_counter *net = &report.by_netmessage[current_netmessage][site];
+  msg->allocs += 1;
+  msg->bytes += bytes;
+  net->allocs += 1;
+  net->bytes += bytes;
+}
+
+void dg_telemetry_free(dg_alloc_site site, uint64_t bytes) {
+  dg_alloc_counter *msg = &report.by_message[current_message][site];
+  dg_alloc_counter *net = &report.by_netmessage[current_netmessage][site];
+  msg->frees += 1;
+  msg->freed_bytes += bytes;
+  net->frees += 1;
+  net->freed_bytes += bytes;
+}
+
+void dg_telemetry_set_message(int type) {
+  current_message = type >= 0 && type < DG_ALLOC_REPORT_MESSAGE_TYPES ? type : 0;
+}
+
+void dg_telemetry_set_netmessage(net_message_type type) {
+  current_netmessage = type >= 0 && type < svc_invalid ? type : svc_invalid;
+}
+
+void dg_alloc_report_get(dg_alloc_report *out) {
+  *out = report;
+  out->enabled = true;
+}
+
+void dg_alloc_report_reset(void) { memset(&report, 0, sizeof(report)); }
+#else
+void dg_alloc_report_get(dg_alloc_report *out) { memset(out, 0, sizeof(*out)); }
+
+void dg_alloc_report_reset(void) {}
+#endif
+
+dg_alloc_counter dg_alloc_report_site_total(const dg_alloc_report *report, dg_alloc_site site) {
+  dg_alloc_counter out;
+  memset(&out, 0, sizeof(out));
+
+  for (size_t i = 0; i < DG_ALLOC_REPORT_MESSAGE_TYPES; ++i) {
+    const dg_alloc_counter *counter = &report->by_message[i][site];
+    out.allocs += counter->allocs;
+    out.bytes += counter->bytes;
+    out.frees += counter->frees;
+    out.freed_bytes += counter->freed_bytes;
+  }
+
+  return out;
+}
+
+#define DECLARE_NAME(x) #x,
+
+static const char *site_names[] = {DEMOGOBBLER_MACRO_ALL_ALLOC_SITES(DECLARE_NAME)};
+static const char *net_message_names[] = {DEMOGOBBLER_MACRO_ALL_MESSAGES(DECLARE_NAME)};
+
+#undef DECLARE_NAME
+
+const char *dg_alloc_site_name(dg_alloc_site site) {
+  return site >= 0 && site < dg_alloc_site_count ? site_names[site] : "unknown";
+}
+
+const char *dg_message_type_name(int type) {
+  switch (type) {
+  case 0:
+    return "none";
+  case dg_type_signon:
+    return "signon";
+  case dg_type_packet:
+    return "packet";
+  case dg_type_synctick:
+    return "synctick";
+  case dg_type_consolecmd:
+    return "consolecmd";
+  case dg_type_usercmd:
+    return "usercmd";
+  case dg_type_datatables:
+    return "datatables";
+  case dg_type_stop:
+    return "stop";
+  case dg_type_customdata:
+    return "customdata";
+  case dg_type_stringtables:
+    return "stringtables";
+  default:
+    return "unknown";
+  }
+}
+
+const char *dg_net_message_name(net_message_type type) {
+  return type >= 0 && type < svc_invalid ? net_message_names[type] : "none";
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "demogobbler/alloc_report.h"
+
+// Hooks for the allocation report, compile to nothing unless DG_ALLOC_TELEMETRY is defined.
+// site is the suffix of a dg_alloc_site value, e.g. DG_TRACK_ALLOC(read_string, len)
+#ifdef DG_ALLOC_TELEMETRY
+void dg_telemetry_alloc(dg_alloc_site site, uint64_t bytes);
+void dg_telemetry_free(dg_alloc_site site, uint64_t bytes);
+void dg_telemetry_set_message(int type);
+void dg_telemetry_set_netmessage(net_message_type type);
+
+#define DG_TRACK_ALLOC(site, bytes) dg_telemetry_alloc(dg_alloc_site_##site, (bytes))
+#define DG_TRACK_FREE(site, bytes) dg_telemetry_free(dg_alloc_site_##site, (bytes))
+#define DG_TRACK_MESSAGE(type) dg_telemetry_set_message(type)
+#define DG_TRACK_NETMESSAGE(type) dg_telemetry_set_netmessage(type)
+#else
+#define DG_TRACK_ALLOC(site, bytes) ((void)0)
+#define DG_TRACK_FREE(site, bytes) ((void)0)
+#define DG_TRACK_MESSAGE(type) ((void)0)
+#define DG_TRACK_NETMESSAGE(type) ((void)0)
+#endif
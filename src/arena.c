@@ -5,13 +5,23 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#define HUGE_PAGE_SIZE (1u << 21)
+#endif
+
 // Turn this macro on for more readable profiler output
 #define FUN_ATTRIBUTE //__attribute__((noinline))
 
 dg_arena FUN_ATTRIBUTE dg_arena_create(uint32_t first_block_size) {
+  return dg_arena_create_ex(first_block_size, 0);
+}
+
+dg_arena dg_arena_create_ex(uint32_t first_block_size, uint32_t flags) {
   dg_arena out;
   memset(&out, 0, sizeof(dg_arena));
   out.first_block_size = first_block_size;
+  out.flags = flags;
 
   return out;
 }
@@ -23,10 +33,23 @@ dg_alloc_state dg_arena_create_allocator(dg_arena* arena) {
   state.attach = (func_dg_attach)dg_arena_attach;
   state.clear = (func_dg_clear)dg_arena_clear;
   state.realloc = (func_dg_realloc)dg_arena_reallocate;
+  state.dealloc = (func_dg_dealloc)dg_arena_deallocate;
   return state;
 }
 
+static uint64_t bytes_in_use(const dg_arena *a) {
+  uint64_t out = 0;
+  for (size_t i = 0; i < a->block_count; ++i) {
+    out += a->blocks[i].bytes_used;
+  }
+  return out;
+}
+
 void FUN_ATTRIBUTE dg_arena_clear(dg_arena *a) {
+  uint64_t used = bytes_in_use(a);
+  a->bytes_cleared += used;
+  a->peak_bytes = MAX(a->peak_bytes, used);
+
   for (size_t i = 0; i < a->block_count; ++i) {
     a->blocks[i].bytes_used = 0;
   }
@@ -47,6 +70,25 @@ static struct dg_arena_block *FUN_ATTRIBUTE get_last_block(dg_arena *a) {
   }
 }
 
+// Huge page blocks come from posix_memalign so that every block can be released with free
+static void *allocate_block_memory(dg_arena *a, size_t *size) {
+#ifdef __linux__
+  if (a->flags & DG_ARENA_HUGE_PAGES) {
+    *size = (*size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+    if (*size > UINT32_MAX) {
+      *size = UINT32_MAX & ~(HUGE_PAGE_SIZE - 1);
+    }
+
+    void *out = NULL;
+    if (posix_memalign(&out, HUGE_PAGE_SIZE, *size) == 0) {
+      madvise(out, *size, MADV_HUGEPAGE); // Only a hint, the block works either way
+      return out;
+    }
+  }
+#endif
+  return malloc(*size);
+}
+
 static void FUN_ATTRIBUTE allocate_new_block(dg_arena *a, uint32_t requested_size) {
   size_t allocated_size;
   if (a->block_count == 0) {
@@ -72,7 +114,7 @@ static void FUN_ATTRIBUTE allocate_new_block(dg_arena *a, uint32_t requested_siz
   ++a->block_count;
   a->blocks = realloc(a->blocks, sizeof(struct dg_arena_block) * a->block_count);
   struct dg_arena_block *ptr = get_last_block(a);
-  ptr->data = malloc(allocated_size);
+  ptr->data = allocate_block_memory(a, &allocated_size);
   ptr->bytes_used = 0;
   ptr->total_bytes = allocated_size;
 }
@@ -137,6 +179,19 @@ void *dg_arena_reallocate(dg_arena *a, void *_ptr, uint32_t prev_size, uint32_t
   }
 }
 
+void dg_arena_deallocate(dg_arena *a, void *ptr, uint32_t size) {
+  if (ptr == NULL || a->blocks == NULL) {
+    return;
+  }
+
+  struct dg_arena_block *blk_ptr = &a->blocks[a->current_block];
+  uint8_t *previous = (uint8_t *)blk_ptr->data + blk_ptr->bytes_used - size;
+
+  if (previous == ptr) {
+    blk_ptr->bytes_used -= size;
+  }
+}
+
 void FUN_ATTRIBUTE dg_arena_free(dg_arena *a) {
   for (size_t i = 0; i < a->block_count; ++i) {
     free(a->blocks[i].data);
@@ -153,3 +208,76 @@ void dg_arena_attach(dg_arena *a, void *data, uint32_t size) {
   ptr->bytes_used = size;
   ptr->total_bytes = size;
 }
+
+dg_arena_stats dg_arena_get_stats(const dg_arena *a) {
+  dg_arena_stats out;
+  out.bytes_in_use = bytes_in_use(a);
+  out.bytes_allocated = a->bytes_cleared + out.bytes_in_use;
+  out.peak_bytes = MAX(a->peak_bytes, out.bytes_in_use);
+  out.bytes_reserved = 0;
+  out.block_count = a->block_count;
+
+  for (size_t i = 0; i < a->block_count; ++i) {
+    out.bytes_reserved += a->blocks[i].total_bytes;
+  }
+
+  return out;
+}
+
+void dg_arena_trim(dg_arena *a, uint64_t max_reserved_bytes) {
+  uint64_t reserved = dg_arena_get_stats(a).bytes_reserved;
+
+  while (reserved > max_reserved_bytes && a->block_count > 0) {
+    struct dg_arena_block *last = get_last_block(a);
+    if (last->bytes_used != 0) {
+      break;
+    }
+
+    reserved -= last->total_bytes;
+    free(last->data);
+    --a->block_count;
+
+    if (a->current_block == a->block_count && a->current_block > 0) {
+      --a->current_block;
+    }
+  }
+
+  if (a->block_count == 0) {
+    free(a->blocks);
+    a->blocks = NULL;
+    a->current_block = 0;
+  }
+}
+
+static void *heap_allocate(void *allocator, uint32_t size, uint32_t alignment) {
+  (void)allocator;
+  (void)alignment;
+  return malloc(size);
+}
+
+static void *heap_reallocate(void *allocator, void *ptr, uint32_t prev_size, uint32_t size,
+                             uint32_t alignment) {
+  (void)allocator;
+  (void)prev_size;
+  (void)alignment;
+  return realloc(ptr, size);
+}
+
+static void heap_deallocate(void *allocator, void *ptr, uint32_t size) {
+  (void)allocator;
+  (void)size;
+  free(ptr);
+}
+
+static void heap_clear(void *allocator) { (void)allocator; }
+
+static void heap_attach(void *allocator, void *ptr, uint32_t size) {
+  (void)allocator;
+  (void)ptr;
+  (void)size;
+}
+
+static dg_alloc_state heap_state = {NULL,         heap_allocate, heap_clear,
+                                    heap_reallocate, heap_attach, heap_deallocate};
+
+dg_alloc_state *dg_heap_allocator(void) { return &heap_state; }
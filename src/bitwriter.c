@@ -10,11 +10,17 @@
 #endif
 
 void dg_bitwriter_init(dg_bitwriter *thisptr, uint32_t initial_size_bits) {
+  dg_bitwriter_init_ex(thisptr, initial_size_bits, NULL);
+}
+
+void dg_bitwriter_init_ex(dg_bitwriter *thisptr, uint32_t initial_size_bits,
+                          dg_alloc_state *allocator) {
   memset(thisptr, 0, sizeof(*thisptr));
+  thisptr->allocator = allocator != NULL ? allocator : dg_heap_allocator();
   uint32_t bytes = initial_size_bits / 8;
   if((initial_size_bits & 0x7) != 0)
     ++bytes;
-  thisptr->ptr = malloc(bytes);
+  thisptr->ptr = dg_alloc_allocate(thisptr->allocator, bytes, 1);
   thisptr->bitoffset = 0;
   thisptr->bitsize = bytes * 8;
 }
@@ -79,7 +85,7 @@ static void bitwriter_allocate_space_if_needed(dg_bitwriter *thisptr, unsigned i
     if(bits_wanted % 8 != 0)
       ++bytes;
     bytes = MAX(current_bytes * 2, bytes);
-    thisptr->ptr = realloc(thisptr->ptr, bytes);
+    thisptr->ptr = dg_alloc_reallocate(thisptr->allocator, thisptr->ptr, current_bytes, bytes, 1);
     thisptr->bitsize = bytes * 8;
   }
 }
@@ -159,18 +165,45 @@ void dg_bitwriter_write_bitcoord(dg_bitwriter *thisptr, dg_bitcoord coord) {
   }
 }
 
-void dg_bitwriter_write_bitstream(dg_bitwriter *thisptr, const dg_bitstream *_stream) {
+void NO_ASAN dg_bitwriter_write_bitstream(dg_bitwriter *thisptr, const dg_bitstream *_stream) {
   dg_bitstream copy = *_stream;
-  while (dg_bitstream_bits_left(&copy) > 32) {
-    uint32_t value = dg_bitstream_read_uint32(&copy);
-    dg_bitwriter_write_bits(thisptr, &value, 32);
+  unsigned int bits = dg_bitstream_bits_left(&copy);
+  CHECK_SIZE();
+
+  // Fill up the partially written byte, after that whole bytes can be stored directly
+  unsigned int head = MIN(bits, (8 - (thisptr->bitoffset & 0x7)) & 0x7);
+  if (head > 0) {
+    dg_bitwriter_write_uint(thisptr, dg_bitstream_read_uint(&copy, head), head);
+    bits -= head;
   }
 
-  unsigned int bits = dg_bitstream_bits_left(&copy);
+  unsigned int body = bits & ~7u;
+  uint8_t *dest = thisptr->ptr + thisptr->bitoffset / 8;
 
+  if ((copy.bitoffset & 0x7) == 0) {
+    memcpy(dest, (uint8_t *)copy.data + copy.bitoffset / 8, body / 8);
+    dg_bitstream_advance(&copy, body);
+  } else {
+    unsigned int i = 0;
+    for (; i + 32 <= body; i += 32, dest += 4) {
+      uint32_t value = dg_bitstream_read_uint32(&copy);
+      memcpy(dest, &value, 4);
+    }
+    for (; i < body; i += 8, ++dest) {
+      *dest = dg_bitstream_read_uint(&copy, 8);
+    }
+  }
+
+  thisptr->bitoffset += body;
+#ifdef GROUND_TRUTH_CHECK
+  if (body > 0) {
+    ground_truth_check(thisptr, body);
+  }
+#endif
+
+  bits -= body;
   if (bits > 0) {
-    uint32_t remainder = dg_bitstream_read_uint(&copy, bits);
-    dg_bitwriter_write_bits(thisptr, &remainder, bits);
+    dg_bitwriter_write_uint(thisptr, dg_bitstream_read_uint(&copy, bits), bits);
   }
 }
 
@@ -408,6 +441,8 @@ void dg_bitwriter_write_ubitvar(dg_bitwriter *thisptr, uint32_t value) {
 }
 
 void dg_bitwriter_free(dg_bitwriter *thisptr) {
-  free(thisptr->ptr);
+  if (thisptr->ptr) {
+    dg_alloc_free(thisptr->allocator, thisptr->ptr, thisptr->bitsize / 8);
+  }
   memset(thisptr, 0, sizeof(dg_bitwriter));
 }
@@ -0,0 +1,191 @@
+#include "demogobbler/compression.h"
+#include <string.h>
+
+#define LZSS_HEADER_BYTES 8
+#define LZSS_LOOKSHIFT 4
+#define SNAPPY_HEADER_BYTES 4
+
+static uint32_t read_le32(const uint8_t *src) {
+  return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static bool is_lzss(const uint8_t *src, uint32_t src_bytes) {
+  return src_bytes >= LZSS_HEADER_BYTES && memcmp(src, "LZSS", 4) == 0;
+}
+
+static bool is_snappy(const uint8_t *src, uint32_t src_bytes) {
+  return src_bytes >= SNAPPY_HEADER_BYTES && memcmp(src, "SNAP", 4) == 0;
+}
+
+// Returns the number of bytes read, 0 on failure
+static uint32_t read_varint32(const uint8_t *src, const uint8_t *end, uint32_t *out) {
+  uint32_t value = 0;
+
+  for (uint32_t i = 0; i < 5 && src + i < end; ++i) {
+    value |= (uint32_t)(src[i] & 0x7f) << (7 * i);
+    if ((src[i] & 0x80) == 0) {
+      *out = value;
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+// Back references may overlap the bytes they produce, those have to go byte by byte
+static void copy_match(uint8_t *out, uint32_t offset, uint32_t count) {
+  const uint8_t *match = out - offset;
+  if (offset >= count) {
+    memcpy(out, match, count);
+  } else {
+    for (uint32_t i = 0; i < count; ++i) {
+      out[i] = match[i];
+    }
+  }
+}
+
+static bool lzss_decompress(uint8_t *dest, uint32_t dest_bytes, const uint8_t *src,
+                            uint32_t src_bytes) {
+  const uint8_t *in = src + LZSS_HEADER_BYTES;
+  const uint8_t *in_end = src + src_bytes;
+  uint8_t *out = dest;
+  uint8_t *out_end = dest + dest_bytes;
+
+  // Each command byte describes the next 8 items, set bits are back references
+  for (;;) {
+    if (in >= in_end) {
+      return false;
+    }
+    uint8_t commands = *in++;
+
+    for (int i = 0; i < 8; ++i, commands >>= 1) {
+      if (commands & 1) {
+        if (in_end - in < 2) {
+          return false;
+        }
+        uint32_t position = ((uint32_t)in[0] << LZSS_LOOKSHIFT) | (in[1] >> LZSS_LOOKSHIFT);
+        uint32_t count = (in[1] & 0x0f) + 1;
+        in += 2;
+
+        if (count == 1) {
+          return out == out_end; // End marker
+        }
+
+        uint32_t offset = position + 1;
+        if (offset > (uint32_t)(out - dest) || count > (uint32_t)(out_end - out)) {
+          return false;
+        }
+        copy_match(out, offset, count);
+        out += count;
+      } else {
+        if (in >= in_end || out >= out_end) {
+          return false;
+        }
+        *out++ = *in++;
+      }
+    }
+  }
+}
+
+static bool snappy_decompress(uint8_t *dest, uint32_t dest_bytes, const uint8_t *src,
+                              uint32_t src_bytes) {
+  const uint8_t *in_end = src + src_bytes;
+  uint32_t length;
+  uint32_t varint_bytes = read_varint32(src + SNAPPY_HEADER_BYTES, in_end, &length);
+
+  if (varint_bytes == 0 || length != dest_bytes) {
+    return false;
+  }
+
+  const uint8_t *in = src + SNAPPY_HEADER_BYTES + varint_bytes;
+  uint8_t *out = dest;
+  uint8_t *out_end = dest + dest_bytes;
+
+  while (in < in_end) {
+    uint8_t tag = *in++;
+    uint32_t count;
+    uint32_t offset;
+
+    switch (tag & 3) {
+    case 0: // Literal, long lengths are stored in the following 1-4 bytes
+      count = tag >> 2;
+      if (count >= 60) {
+        uint32_t extra = count - 59;
+        if ((uint32_t)(in_end - in) < extra) {
+          return false;
+        }
+        count = 0;
+        for (uint32_t i = 0; i < extra; ++i) {
+          count |= (uint32_t)in[i] << (8 * i);
+        }
+        in += extra;
+      }
+      count += 1;
+      if (count > (uint32_t)(in_end - in) || count > (uint32_t)(out_end - out)) {
+        return false;
+      }
+      memcpy(out, in, count);
+      in += count;
+      out += count;
+      continue;
+    case 1:
+      if (in >= in_end) {
+        return false;
+      }
+      count = 4 + ((tag >> 2) & 7);
+      offset = ((uint32_t)(tag >> 5) << 8) | *in++;
+      break;
+    case 2:
+      if (in_end - in < 2) {
+        return false;
+      }
+      count = 1 + (tag >> 2);
+      offset = in[0] | (in[1] << 8);
+      in += 2;
+      break;
+    default:
+      if (in_end - in < 4) {
+        return false;
+      }
+      count = 1 + (tag >> 2);
+      offset = read_le32(in);
+      in += 4;
+      break;
+    }
+
+    if (offset == 0 || offset > (uint32_t)(out - dest) || count > (uint32_t)(out_end - out)) {
+      return false;
+    }
+    copy_match(out, offset, count);
+    out += count;
+  }
+
+  return out == out_end;
+}
+
+uint32_t dg_decompressed_size(const void *_src, uint32_t src_bytes) {
+  const uint8_t *src = _src;
+
+  if (is_lzss(src, src_bytes)) {
+    return read_le32(src + 4);
+  } else if (is_snappy(src, src_bytes)) {
+    uint32_t length;
+    if (read_varint32(src + SNAPPY_HEADER_BYTES, src + src_bytes, &length) != 0) {
+      return length;
+    }
+  }
+
+  return 0;
+}
+
+bool dg_decompress(void *dest, uint32_t dest_bytes, const void *_src, uint32_t src_bytes) {
+  const uint8_t *src = _src;
+
+  if (is_lzss(src, src_bytes)) {
+    return read_le32(src + 4) == dest_bytes && lzss_decompress(dest, dest_bytes, src, src_bytes);
+  } else if (is_snappy(src, src_bytes)) {
+    return snappy_decompress(dest, dest_bytes, src, src_bytes);
+  }
+
+  return false;
+}
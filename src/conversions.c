@@ -37,7 +37,7 @@ static float bitcellcoord_to_float(dg_bitcellcoord value, bool is_int, bool lp)
   return out;
 }
 
-static float bitcoord_to_float(dg_bitcoord value) {
+float dg_bitcoord_to_float(dg_bitcoord value) {
   float out = 0;
 
   if (value.has_int)
@@ -51,7 +51,7 @@ static float bitcoord_to_float(dg_bitcoord value) {
 
 float dg_prop_to_float(dg_sendprop *prop, dg_prop_value_inner value) {
   if (prop->flag_coord) {
-    return bitcoord_to_float(value.bitcoord_val);
+    return dg_bitcoord_to_float(value.bitcoord_val);
   } else if (prop->flag_coordmp) {
     return bitcoordmp_to_float(value.bitcoordmp_val, false, false);
   } else if (prop->flag_coordmplp) {
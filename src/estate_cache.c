@@ -0,0 +1,551 @@
+#include "demogobbler.h"
+#include "demogobbler/alignof_wrapper.h"
+#include "demogobbler/allocator.h"
+#include "demogobbler/bitwriter.h"
+#include "demogobbler/hashtable.h"
+#include "demogobbler/utils.h"
+#include "parser_entity_state.h"
+#include "threads.h"
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Entry payload layout, all integers are little endian uint32:
+//   serverclass count, table count, table names
+//   for each serverclass: dt_name, prop count and the props
+//   for each prop: proptype, flags (bits in CACHE_PROP_FLAGS order), prop_numbits, priority,
+//   array_num_elements, low and high value as float bits, owner table, name. Array props are
+//   followed by their element prop in the same format
+static const char CACHE_MAGIC[4] = {'D', 'G', 'E', 'C'};
+enum { CACHE_FORMAT_VERSION = 2 };
+// Seven integers, the owner table and at least the terminator of the name
+enum { SERIALIZED_PROP_MIN_BYTES = 8 * 4 + 1 };
+
+#define CACHE_PROP_FLAGS(X)                                                                        \
+  X(flag_unsigned)                                                                                 \
+  X(flag_coord)                                                                                    \
+  X(flag_noscale)                                                                                  \
+  X(flag_rounddown)                                                                                \
+  X(flag_roundup)                                                                                  \
+  X(flag_normal)                                                                                   \
+  X(flag_exclude)                                                                                  \
+  X(flag_xyze)                                                                                     \
+  X(flag_insidearray)                                                                              \
+  X(flag_proxyalwaysyes)                                                                           \
+  X(flag_changesoften)                                                                             \
+  X(flag_isvectorelem)                                                                             \
+  X(flag_collapsible)                                                                              \
+  X(flag_coordmp)                                                                                  \
+  X(flag_coordmplp)                                                                                \
+  X(flag_coordmpint)                                                                               \
+  X(flag_cellcoord)                                                                                \
+  X(flag_cellcoordlp)                                                                              \
+  X(flag_cellcoordint)
+
+typedef struct {
+  uint64_t key;
+  const uint8_t *payload;
+  uint32_t payload_bytes;
+  dg_serverclass_data *class_datas;
+  size_t serverclass_count;
+} cache_entry;
+
+// Parsers on different threads can share a cache, lock guards the arena and the entries. Entries
+// are never removed and their class_datas live in the arena, so they stay valid after unlocking
+struct dg_estate_cache {
+  dg_mutex lock;
+  dg_arena memory;
+  dg_alloc_state allocator;
+  cache_entry *entries;
+  size_t entry_count;
+  size_t entry_capacity;
+};
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  size_t offset;
+  bool overflow;
+} byte_reader;
+
+static const uint8_t *read_bytes(byte_reader *reader, size_t bytes) {
+  if (reader->overflow || reader->size - reader->offset < bytes) {
+    reader->overflow = true;
+    return NULL;
+  }
+
+  const uint8_t *ptr = reader->data + reader->offset;
+  reader->offset += bytes;
+  return ptr;
+}
+
+static uint32_t read_uint32(byte_reader *reader) {
+  const uint8_t *ptr = read_bytes(reader, 4);
+  if (ptr == NULL) {
+    return 0;
+  }
+
+  return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+static float read_float(byte_reader *reader) {
+  uint32_t bits = read_uint32(reader);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static uint64_t read_uint64(byte_reader *reader) {
+  uint64_t low = read_uint32(reader);
+  uint64_t high = read_uint32(reader);
+  return low | (high << 32);
+}
+
+// Strings are not copied, the returned pointer points into the reader's buffer
+static const char *read_string(byte_reader *reader) {
+  const uint8_t *start = reader->data + reader->offset;
+  const uint8_t *end = NULL;
+
+  if (!reader->overflow) {
+    end = memchr(start, '\0', reader->size - reader->offset);
+  }
+
+  if (end == NULL) {
+    reader->overflow = true;
+    return "";
+  }
+
+  reader->offset += end - start + 1;
+  return (const char *)start;
+}
+
+uint64_t dg_estate_cache_key(const dg_datatables_parsed *message, const dg_demver_data *version) {
+  // Flattening also depends on the protocol and game through the prop sort order
+  uint64_t seed = version->demo_protocol | (version->game << 8) |
+                  ((uint64_t)version->network_protocol << 16);
+  return XXH64(message->_raw_buffer, message->_raw_buffer_bytes, seed);
+}
+
+dg_estate_cache *dg_estate_cache_create(void) {
+  dg_estate_cache *thisptr =
+      dg_alloc_allocate(dg_heap_allocator(), sizeof(dg_estate_cache), alignof(dg_estate_cache));
+  memset(thisptr, 0, sizeof(dg_estate_cache));
+  dg_mutex_init(&thisptr->lock);
+  thisptr->memory = dg_arena_create(1 << 20);
+  thisptr->allocator = dg_arena_create_allocator(&thisptr->memory);
+
+  return thisptr;
+}
+
+void dg_estate_cache_free(dg_estate_cache *thisptr) {
+  if (thisptr == NULL) {
+    return;
+  }
+
+  dg_mutex_destroy(&thisptr->lock);
+  dg_arena_free(&thisptr->memory);
+  if (thisptr->entries) {
+    dg_alloc_free(dg_heap_allocator(), thisptr->entries,
+                  sizeof(cache_entry) * thisptr->entry_capacity);
+  }
+  dg_alloc_free(dg_heap_allocator(), thisptr, sizeof(dg_estate_cache));
+}
+
+size_t dg_estate_cache_entry_count(const dg_estate_cache *thisptr) {
+  dg_mutex *lock = (dg_mutex *)&thisptr->lock;
+  dg_mutex_lock(lock);
+  size_t count = thisptr->entry_count;
+  dg_mutex_unlock(lock);
+  return count;
+}
+
+// Call with the lock held
+static cache_entry *find_entry(const dg_estate_cache *thisptr, uint64_t key) {
+  for (size_t i = 0; i < thisptr->entry_count; ++i) {
+    if (thisptr->entries[i].key == key) {
+      return thisptr->entries + i;
+    }
+  }
+
+  return NULL;
+}
+
+dg_serverclass_data *dg_estate_cache_find(dg_estate_cache *thisptr, uint64_t key,
+                                          size_t serverclass_count) {
+  dg_mutex_lock(&thisptr->lock);
+  cache_entry *entry = find_entry(thisptr, key);
+  dg_serverclass_data *class_datas = NULL;
+  if (entry != NULL && entry->serverclass_count == serverclass_count) {
+    class_datas = entry->class_datas;
+  }
+  dg_mutex_unlock(&thisptr->lock);
+
+  return class_datas;
+}
+
+static bool read_prop(byte_reader *reader, dg_sendprop *prop, dg_sendtable *tables,
+                      uint32_t table_count) {
+  memset(prop, 0, sizeof(dg_sendprop));
+  uint32_t proptype = read_uint32(reader);
+  uint32_t flags = read_uint32(reader);
+  prop->prop_numbits = read_uint32(reader);
+  prop->priority = read_uint32(reader);
+  prop->array_num_elements = read_uint32(reader);
+  float low_value = read_float(reader);
+  float high_value = read_float(reader);
+  uint32_t table_index = read_uint32(reader);
+  const char *name = read_string(reader);
+
+  if (reader->overflow || table_index >= table_count || proptype >= sendproptype_invalid) {
+    return false;
+  }
+
+  uint32_t bit = 0;
+#define READ_FLAG(flag) prop->flag = (flags >> bit++) & 1;
+  CACHE_PROP_FLAGS(READ_FLAG)
+#undef READ_FLAG
+
+  prop->proptype = proptype;
+  if (prop->proptype != sendproptype_array) {
+    // Arrays keep the element prop in the same union, the caller reads it
+    prop->prop_.low_value = low_value;
+    prop->prop_.high_value = high_value;
+  }
+  prop->name = name;
+  prop->baseclass = tables + table_index;
+
+  if (prop->proptype == sendproptype_datatable || prop->flag_exclude) {
+    return false; // Never part of a flattened serverclass
+  }
+
+  return true;
+}
+
+// Build the serverclass data for an entry, everything except the strings lives in the arena
+static bool deserialize_entry(dg_estate_cache *thisptr, cache_entry *entry) {
+  byte_reader reader;
+  memset(&reader, 0, sizeof(reader));
+  reader.data = entry->payload;
+  reader.size = entry->payload_bytes;
+
+  uint32_t serverclass_count = read_uint32(&reader);
+  uint32_t table_count = read_uint32(&reader);
+
+  // Bound the counts by the payload size before allocating anything
+  if (reader.overflow || serverclass_count > entry->payload_bytes ||
+      table_count > entry->payload_bytes) {
+    return false;
+  }
+
+  dg_sendtable *tables = dg_alloc_allocate(
+      &thisptr->allocator, sizeof(dg_sendtable) * table_count, alignof(dg_sendtable));
+  memset(tables, 0, sizeof(dg_sendtable) * table_count);
+
+  for (uint32_t i = 0; i < table_count; ++i) {
+    tables[i].name = read_string(&reader);
+  }
+
+  dg_serverclass_data *class_datas =
+      dg_alloc_allocate(&thisptr->allocator, sizeof(dg_serverclass_data) * serverclass_count,
+                        alignof(dg_serverclass_data));
+  memset(class_datas, 0, sizeof(dg_serverclass_data) * serverclass_count);
+
+  for (uint32_t i = 0; i < serverclass_count && !reader.overflow; ++i) {
+    dg_serverclass_data *class_data = class_datas + i;
+    class_data->dt_name = read_string(&reader);
+    uint32_t prop_count = read_uint32(&reader);
+
+    if (reader.overflow || prop_count > (reader.size - reader.offset) / SERIALIZED_PROP_MIN_BYTES) {
+      return false;
+    }
+
+    class_data->props = dg_alloc_allocate(&thisptr->allocator, sizeof(dg_sendprop) * prop_count,
+                                          alignof(dg_sendprop));
+    class_data->prop_count = prop_count;
+
+    for (uint32_t prop_index = 0; prop_index < prop_count; ++prop_index) {
+      dg_sendprop *prop = class_data->props + prop_index;
+      if (!read_prop(&reader, prop, tables, table_count)) {
+        return false;
+      }
+
+      if (prop->proptype == sendproptype_array) {
+        prop->array_prop =
+            dg_alloc_allocate(&thisptr->allocator, sizeof(dg_sendprop), alignof(dg_sendprop));
+        if (!read_prop(&reader, prop->array_prop, tables, table_count) ||
+            prop->array_prop->proptype == sendproptype_array) {
+          return false;
+        }
+      }
+    }
+
+    dg_build_name_index(class_data, &thisptr->allocator);
+  }
+
+  if (reader.overflow || reader.offset != reader.size) {
+    return false;
+  }
+
+  entry->class_datas = class_datas;
+  entry->serverclass_count = serverclass_count;
+
+  return true;
+}
+
+// Payload bytes are copied into the arena, returns false if the payload is malformed. Call with
+// the lock held
+static bool add_entry(dg_estate_cache *thisptr, uint64_t key, const void *payload,
+                      uint32_t payload_bytes) {
+  cache_entry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.key = key;
+  entry.payload_bytes = payload_bytes;
+  uint8_t *payload_copy = dg_alloc_allocate(&thisptr->allocator, payload_bytes, 1);
+  memcpy(payload_copy, payload, payload_bytes);
+  entry.payload = payload_copy;
+
+  if (!deserialize_entry(thisptr, &entry)) {
+    return false;
+  }
+
+  if (thisptr->entry_count == thisptr->entry_capacity) {
+    size_t capacity = MAX(thisptr->entry_capacity * 2, 4);
+    thisptr->entries = dg_alloc_reallocate(
+        dg_heap_allocator(), thisptr->entries, sizeof(cache_entry) * thisptr->entry_capacity,
+        sizeof(cache_entry) * capacity, alignof(cache_entry));
+    thisptr->entry_capacity = capacity;
+  }
+
+  thisptr->entries[thisptr->entry_count++] = entry;
+
+  return true;
+}
+
+static void write_float_bits(dg_bitwriter *writer, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  dg_bitwriter_write_uint32(writer, bits);
+}
+
+static void write_prop(dg_bitwriter *writer, dg_hashtable *table_ids, const dg_sendprop *prop) {
+  uint32_t flags = 0;
+  uint32_t bit = 0;
+#define WRITE_FLAG(flag) flags |= (uint32_t)prop->flag << bit++;
+  CACHE_PROP_FLAGS(WRITE_FLAG)
+#undef WRITE_FLAG
+
+  dg_bitwriter_write_uint32(writer, prop->proptype);
+  dg_bitwriter_write_uint32(writer, flags);
+  dg_bitwriter_write_uint32(writer, prop->prop_numbits);
+  dg_bitwriter_write_uint32(writer, prop->priority);
+  dg_bitwriter_write_uint32(writer, prop->array_num_elements);
+  bool has_values = prop->proptype != sendproptype_array;
+  write_float_bits(writer, has_values ? prop->prop_.low_value : 0);
+  write_float_bits(writer, has_values ? prop->prop_.high_value : 0);
+  dg_bitwriter_write_uint32(writer, dg_hashtable_get(table_ids, prop->baseclass->name).value);
+  dg_bitwriter_write_cstring(writer, prop->name);
+}
+
+static bool add_table(dg_hashtable *table_ids, const char **table_names, uint32_t *table_count,
+                      size_t max_tables, const dg_sendprop *prop) {
+  const char *name = prop->baseclass->name;
+  if (dg_hashtable_get(table_ids, name).str != NULL) {
+    return true;
+  } else if (*table_count == max_tables) {
+    return false;
+  }
+
+  dg_hashtable_entry entry;
+  entry.str = name;
+  entry.value = *table_count;
+  dg_hashtable_insert(table_ids, entry);
+  table_names[(*table_count)++] = name;
+
+  return true;
+}
+
+void dg_estate_cache_insert(dg_estate_cache *thisptr, uint64_t key, const estate *entity_state,
+                            dg_alloc_state *allocator) {
+  dg_mutex_lock(&thisptr->lock);
+  bool exists = find_entry(thisptr, key) != NULL;
+  dg_mutex_unlock(&thisptr->lock);
+  if (exists) {
+    return;
+  }
+
+  // Every flattened prop is owned by one of the sendtables
+  const size_t max_tables = entity_state->sendtable_count;
+  const uint32_t names_bytes = sizeof(const char *) * MAX(max_tables, 1);
+  const char **table_names =
+      dg_alloc_allocate(allocator, names_bytes, alignof(const char *));
+  dg_hashtable table_ids = dg_hashtable_create_ex(max_tables, allocator);
+  uint32_t table_count = 0;
+
+  for (size_t i = 0; i < entity_state->serverclass_count; ++i) {
+    const dg_serverclass_data *class_data = entity_state->class_datas + i;
+    for (size_t prop_index = 0; prop_index < class_data->prop_count; ++prop_index) {
+      const dg_sendprop *prop = class_data->props + prop_index;
+      bool added = add_table(&table_ids, table_names, &table_count, max_tables, prop);
+      if (added && prop->proptype == sendproptype_array) {
+        added = add_table(&table_ids, table_names, &table_count, max_tables, prop->array_prop);
+      }
+      if (!added) {
+        goto end;
+      }
+    }
+  }
+
+  dg_bitwriter writer;
+  dg_bitwriter_init_ex(&writer, 1 << 20, allocator);
+  dg_bitwriter_write_uint32(&writer, entity_state->serverclass_count);
+  dg_bitwriter_write_uint32(&writer, table_count);
+
+  for (uint32_t i = 0; i < table_count; ++i) {
+    dg_bitwriter_write_cstring(&writer, table_names[i]);
+  }
+
+  for (size_t i = 0; i < entity_state->serverclass_count; ++i) {
+    const dg_serverclass_data *class_data = entity_state->class_datas + i;
+    dg_bitwriter_write_cstring(&writer, class_data->dt_name);
+    dg_bitwriter_write_uint32(&writer, class_data->prop_count);
+
+    for (size_t prop_index = 0; prop_index < class_data->prop_count; ++prop_index) {
+      const dg_sendprop *prop = class_data->props + prop_index;
+      write_prop(&writer, &table_ids, prop);
+      if (prop->proptype == sendproptype_array) {
+        write_prop(&writer, &table_ids, prop->array_prop);
+      }
+    }
+  }
+
+  if (!writer.error) {
+    // Serialized without the lock, another parser may have added the same key in the meantime
+    dg_mutex_lock(&thisptr->lock);
+    if (find_entry(thisptr, key) == NULL) {
+      add_entry(thisptr, key, writer.ptr, writer.bitoffset / 8);
+    }
+    dg_mutex_unlock(&thisptr->lock);
+  }
+  dg_bitwriter_free(&writer);
+
+end:
+  dg_hashtable_free(&table_ids);
+  dg_alloc_free(allocator, table_names, names_bytes);
+}
+
+dg_parse_result dg_estate_cache_save(const dg_estate_cache *thisptr, const char *filepath) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+
+  dg_mutex *lock = (dg_mutex *)&thisptr->lock;
+  dg_mutex_lock(lock);
+  dg_bitwriter writer;
+  dg_bitwriter_init(&writer, 1 << 20);
+  dg_bitwriter_write_bits(&writer, CACHE_MAGIC, sizeof(CACHE_MAGIC) * 8);
+  dg_bitwriter_write_uint32(&writer, CACHE_FORMAT_VERSION);
+  dg_bitwriter_write_uint32(&writer, thisptr->entry_count);
+
+  for (size_t i = 0; i < thisptr->entry_count; ++i) {
+    const cache_entry *entry = thisptr->entries + i;
+    dg_bitwriter_write_uint(&writer, entry->key, 64);
+    dg_bitwriter_write_uint32(&writer, entry->payload_bytes);
+    dg_bitwriter_write_bits(&writer, entry->payload, entry->payload_bytes * 8);
+  }
+  dg_mutex_unlock(lock);
+
+  FILE *file = fopen(filepath, "wb");
+  if (file == NULL) {
+    result.error = true;
+    result.error_message = "Unable to open estate cache file for writing";
+  } else {
+    size_t bytes = writer.bitoffset / 8;
+    if (writer.error || fwrite(writer.ptr, 1, bytes, file) != bytes) {
+      result.error = true;
+      result.error_message = "Unable to write estate cache file";
+    }
+    fclose(file);
+  }
+
+  dg_bitwriter_free(&writer);
+  return result;
+}
+
+dg_parse_result dg_estate_cache_load(dg_estate_cache *thisptr, const char *filepath) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+  uint8_t *buffer = NULL;
+  long size = 0;
+
+  FILE *file = fopen(filepath, "rb");
+  if (file == NULL) {
+    result.error = true;
+    result.error_message = "Unable to open estate cache file";
+    goto end;
+  }
+
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if (size < 0 || size > UINT32_MAX) {
+    result.error = true;
+    result.error_message = "Unable to read estate cache file";
+    goto end;
+  }
+
+  buffer = dg_alloc_allocate(dg_heap_allocator(), MAX(size, 1), 1);
+  if (fread(buffer, 1, size, file) != (size_t)size) {
+    result.error = true;
+    result.error_message = "Unable to read estate cache file";
+    goto end;
+  }
+
+  byte_reader reader;
+  memset(&reader, 0, sizeof(reader));
+  reader.data = buffer;
+  reader.size = size;
+
+  const uint8_t *magic = read_bytes(&reader, sizeof(CACHE_MAGIC));
+  uint32_t version = read_uint32(&reader);
+  uint32_t entry_count = read_uint32(&reader);
+
+  if (reader.overflow || memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+    result.error = true;
+    result.error_message = "Not an estate cache file";
+    goto end;
+  }
+
+  if (version != CACHE_FORMAT_VERSION) {
+    result.error = true;
+    result.error_message = "Estate cache file has an unsupported format version";
+    goto end;
+  }
+
+  dg_mutex_lock(&thisptr->lock);
+  for (uint32_t i = 0; i < entry_count && !result.error; ++i) {
+    uint64_t key = read_uint64(&reader);
+    uint32_t payload_bytes = read_uint32(&reader);
+    const uint8_t *payload = read_bytes(&reader, payload_bytes);
+
+    if (reader.overflow) {
+      result.error = true;
+      result.error_message = "Estate cache file is truncated";
+    } else if (find_entry(thisptr, key) == NULL &&
+               !add_entry(thisptr, key, payload, payload_bytes)) {
+      result.error = true;
+      result.error_message = "Estate cache file has a malformed entry";
+    }
+  }
+  dg_mutex_unlock(&thisptr->lock);
+
+end:
+  if (file) {
+    fclose(file);
+  }
+  if (buffer) {
+    dg_alloc_free(dg_heap_allocator(), buffer, MAX(size, 1));
+  }
+  return result;
+}
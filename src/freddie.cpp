@@ -7,71 +7,10 @@
 
 using namespace freddie;
 
-typedef void *(*func_dg_alloc)(void *allocator, uint32_t size, uint32_t alignment);
-typedef void *(*func_dg_realloc)(void *allocator, void *ptr, uint32_t prev_size, uint32_t size,
-                                 uint32_t alignment);
-typedef void (*func_dg_clear)(void *allocator);
-typedef void (*func_dg_free)(void *allocator);
-typedef void (*func_dg_attach)(void *allocator, void *ptr, uint32_t size);
-
-static void *mallocator_allocate(void *alloc, uint32_t size, uint32_t alignment) {
-  mallocator *arena = (mallocator *)alloc;
-  void *ptr = malloc(size);
-  arena->pointers.push_back(ptr);
-  return ptr;
-}
-
-static void *mallocator_reallocate(void *allocator, void *ptr, uint32_t prev_size, uint32_t size,
-                                   uint32_t alignment) {
-  mallocator *arena = (mallocator *)allocator;
-  for (size_t i = 0; i < arena->pointers.size(); ++i) {
-    if (ptr == arena->pointers[i]) {
-      return arena->pointers[i] = realloc(ptr, size);
-    }
-  }
-
-  void *rval = malloc(size);
-  arena->pointers.push_back(rval);
-  return rval;
-}
-
-static void mallocator_clear(void *allocator) {
-  mallocator *arena = (mallocator *)allocator;
-  for (auto ptr : arena->pointers)
-    ::free(ptr);
-  arena->pointers.clear();
-}
-
-static void mallocator_attach(void *allocator, void *ptr, uint32_t size) {
-  mallocator *arena = (mallocator *)allocator;
-  arena->pointers.push_back(ptr);
-}
-
-mallocator::mallocator() {}
-
-mallocator::~mallocator() {
-  for (auto ptr : pointers)
-    ::free(ptr);
-}
-
-void mallocator::release() { pointers.clear(); }
-
-void *mallocator::alloc(uint32_t size) { 
-  void* ptr = malloc(size); 
-  pointers.push_back(ptr); 
-  return ptr;
-}
-
-void mallocator::attach(void *ptr) { pointers.push_back(ptr); }
-
-void mallocator::free(void *ptr) {
-  pointers.erase(std::remove(pointers.begin(), pointers.end(), ptr), pointers.end());
-  ::free(ptr);
-}
-
 demo_t::demo_t() {
   const size_t INITIAL_ARENA_SIZE = 1 << 20;
   arena = dg_arena_create(INITIAL_ARENA_SIZE);
+  allocator = dg_arena_create_allocator(&arena);
 }
 
 demo_t::~demo_t() { dg_arena_free(&arena); }
@@ -89,8 +28,7 @@ static void handle_version(parser_state *_state, dg_demver_data data) {
 #define HANDLE_PACKET(type)                                                                        \
   static void handle_##type(parser_state *_state, type *packet) {                                  \
     demo_t *state = (demo_t *)_state->client_state;                                                \
-    auto copy = state->copy_packet(packet);                                                        \
-    state->packets.push_back(copy);                                                                \
+    state->packets.push_back(*packet);                                                             \
   }
 
 HANDLE_PACKET(dg_consolecmd);
@@ -107,7 +45,7 @@ static void noop(void *allocator) {}
 dg_parse_result demo_t::parse_demo(demo_t *output, void *stream, dg_input_interface interface) {
   dg_settings settings;
   dg_settings_init(&settings);
-  settings.permanent_alloc_state.allocator = &output->arena;
+  settings.permanent_alloc_state = output->allocator;
   settings.permanent_alloc_state.clear = noop;
   settings.client_state = output;
   settings.header_handler = handle_header;
@@ -122,6 +60,7 @@ dg_parse_result demo_t::parse_demo(demo_t *output, void *stream, dg_input_interf
   settings.synctick_handler = handle_dg_synctick;
   settings.usercmd_handler = handle_dg_usercmd;
   settings.parse_packetentities = true;
+  settings.record_prop_spans = true;
   settings.packet_alloc_type = dg_alloc_permanent;
 
   return dg_parse(&settings, stream, interface);
@@ -142,44 +81,60 @@ dg_parse_result demo_t::parse_demo(demo_t *output, const char *filepath) {
   return result;
 }
 
+bool freddie::write_packet(dg_writer *writer, demo_packet *demo_packet) {
+  packet_view view;
+  view.type = demo_packet->packet.index();
+  view.data = std::visit([](auto &packet) { return (void *)&packet; }, demo_packet->packet);
+  return write_packet(writer, view);
+}
+
+bool freddie::write_packet(dg_writer *writer, packet_view packet) {
+  packet_parsed *packet_ptr = packet.get_if<packet_parsed>();
+  dg_datatables_parsed *dt_ptr = packet.get_if<dg_datatables_parsed>();
+  dg_stringtables_parsed *st_ptr = packet.get_if<dg_stringtables_parsed>();
+  dg_consolecmd *cmd_ptr = packet.get_if<dg_consolecmd>();
+  dg_usercmd *user_ptr = packet.get_if<dg_usercmd>();
+  dg_stop *stop_ptr = packet.get_if<dg_stop>();
+  dg_synctick *sync_ptr = packet.get_if<dg_synctick>();
+  dg_customdata *custom_ptr = packet.get_if<dg_customdata>();
+
+  if (packet_ptr) {
+    dg_write_packet_parsed(writer, packet_ptr);
+  } else if (dt_ptr) {
+    dg_write_datatables_parsed(writer, dt_ptr);
+  } else if (st_ptr) {
+    dg_write_stringtables_parsed(writer, st_ptr);
+  } else if (cmd_ptr) {
+    dg_write_consolecmd(writer, cmd_ptr);
+  } else if (user_ptr) {
+    dg_write_usercmd(writer, user_ptr);
+  } else if (stop_ptr) {
+    dg_write_stop(writer, stop_ptr);
+  } else if (sync_ptr) {
+    dg_write_synctick(writer, sync_ptr);
+  } else if (custom_ptr) {
+    dg_write_customdata(writer, custom_ptr);
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
 dg_parse_result demo_t::write_demo(void *stream, dg_output_interface interface, bool expect_equal) {
   dg_parse_result result;
   std::memset(&result, 0, sizeof(result));
   dg_writer writer;
   dg_writer_init(&writer);
   writer.expect_equal = expect_equal;
+  // Everything in freddie that changes a message marks it dirty
+  writer.copy_clean_messages = true;
   writer.version = demver_data;
   dg_writer_open(&writer, stream, interface);
   dg_write_header(&writer, &header);
 
   for (size_t i = 0; i < packets.size(); ++i) {
-    auto *packet = &packets[i]->packet;
-    packet_parsed *packet_ptr = std::get_if<packet_parsed>(packet);
-    dg_datatables_parsed *dt_ptr = std::get_if<dg_datatables_parsed>(packet);
-    dg_stringtables_parsed *st_ptr = std::get_if<dg_stringtables_parsed>(packet);
-    dg_consolecmd *cmd_ptr = std::get_if<dg_consolecmd>(packet);
-    dg_usercmd *user_ptr = std::get_if<dg_usercmd>(packet);
-    dg_stop *stop_ptr = std::get_if<dg_stop>(packet);
-    dg_synctick *sync_ptr = std::get_if<dg_synctick>(packet);
-    dg_customdata *custom_ptr = std::get_if<dg_customdata>(packet);
-
-    if (packet_ptr) {
-      dg_write_packet_parsed(&writer, packet_ptr);
-    } else if (dt_ptr) {
-      dg_write_datatables_parsed(&writer, dt_ptr);
-    } else if (st_ptr) {
-      dg_write_stringtables_parsed(&writer, st_ptr);
-    } else if (cmd_ptr) {
-      dg_write_consolecmd(&writer, cmd_ptr);
-    } else if (user_ptr) {
-      dg_write_usercmd(&writer, user_ptr);
-    } else if (stop_ptr) {
-      dg_write_stop(&writer, stop_ptr);
-    } else if (sync_ptr) {
-      dg_write_synctick(&writer, sync_ptr);
-    } else if (custom_ptr) {
-      dg_write_customdata(&writer, custom_ptr);
-    } else {
+    if (!write_packet(&writer, packets[i])) {
       result.error = true;
       result.error_message = "unknown demo packet";
       break;
@@ -208,8 +163,8 @@ dg_parse_result demo_t::write_demo(const char *filepath) {
 
 dg_datatables_parsed* demo_t::get_datatables() const {
   for (size_t i = 0; i < packets.size(); ++i) {
-    auto *packet = &packets[i]->packet;
-    dg_datatables_parsed *dt_ptr = std::get_if<dg_datatables_parsed>(packet);
+    // Views are not const, callers hand the datatables on to functions taking mutable pointers
+    dg_datatables_parsed *dt_ptr = packets[i].get_if<dg_datatables_parsed>();
     if (dt_ptr) {
       return dt_ptr;
     }
@@ -217,18 +172,32 @@ dg_datatables_parsed* demo_t::get_datatables() const {
   return nullptr;
 }
 
-static void fix_svc_serverinfo(const char *gamedir, demo_t *demo) {
+demo_memory_usage demo_t::memory_usage() const {
+  demo_memory_usage usage;
+  usage.packets = packets.memory_usage();
+  usage.data = dg_arena_get_stats(&arena);
+  return usage;
+}
+
+static void fix_serverinfo(packet_net_message *msg, const dg_header *target,
+                           dg_alloc_state *allocator) {
+  size_t len = strlen(target->game_directory);
+  char *dest = (char *)dg_alloc_allocate(allocator, len + 1, 1);
+  memcpy(dest, target->game_directory, len + 1);
+  msg->message_svc_serverinfo->game_dir = dest;
+  msg->message_svc_serverinfo->network_protocol = target->net_protocol;
+  msg->dirty = true;
+}
+
+static void fix_svc_serverinfo(const dg_header *target, demo_t *demo) {
   for (size_t i = 0; i < demo->packets.size(); ++i) {
-    packet_parsed *ptr = std::get_if<packet_parsed>(&demo->packets[i]->packet);
+    packet_parsed *ptr = demo->packets[i].get_if<packet_parsed>();
     if (ptr) {
-      for (size_t msg_index = 0; msg_index < ptr->message_count; ++msg_index) {
-        packet_net_message *msg = ptr->messages + msg_index;
+      packet_net_message *msg = ptr->first_message;
+      for (size_t msg_index = 0; msg_index < ptr->message_count;
+           ++msg_index, msg = dg_netmessage_next(msg)) {
         if (msg->mtype == svc_serverinfo) {
-          size_t len = strlen(gamedir);
-          char *dest = (char *)dg_arena_allocate(&demo->arena, len + 1, 1);
-          memcpy(dest, gamedir, len + 1);
-          msg->message_svc_serverinfo->game_dir = dest;
-          msg->message_svc_serverinfo->network_protocol = demo->header.net_protocol;
+          fix_serverinfo(msg, target, &demo->allocator);
           return;
         }
       }
@@ -249,30 +218,34 @@ void freddie::finalize_stream(dg_bitstream *stream, const dg_bitwriter *writer)
   stream->data = writer->ptr;
 }
 
+void freddie::encode_packetentities(packet_net_message *msg, const dg_demver_data *version,
+                                   dg_alloc_state *allocator) {
+  write_packetentities_args args;
+  memset(&args, 0, sizeof(args));
+  args.is_delta = msg->message_svc_packet_entities.is_delta;
+  args.version = version;
+  args.data = &msg->message_svc_packet_entities.parsed->data;
+  uint32_t bits = dg_bitstream_bits_left(&msg->message_svc_packet_entities.data);
+  // The allocator owns the written bits, so the bitwriter is not freed
+  dg_bitwriter bitwriter;
+  dg_bitwriter_init_ex(&bitwriter, bits, allocator);
+  auto stream = freddie::get_start_state(&bitwriter);
+  dg_bitwriter_write_packetentities(&bitwriter, args);
+  freddie::finalize_stream(&stream, &bitwriter);
+  msg->message_svc_packet_entities.data = stream;
+  msg->dirty = true;
+}
+
 static void fix_packets(demo_t *demo) {
   for (size_t i = 0; i < demo->packets.size(); ++i) {
-    auto *packet = &demo->packets[i]->packet;
-    packet_parsed *ptr = std::get_if<packet_parsed>(packet);
+    packet_parsed *ptr = demo->packets[i].get_if<packet_parsed>();
 
     if (ptr) {
-      for (size_t msg_index = 0; msg_index < ptr->message_count; ++msg_index) {
-        packet_net_message *msg = ptr->messages + msg_index;
-
+      packet_net_message *msg = ptr->first_message;
+      for (size_t msg_index = 0; msg_index < ptr->message_count;
+           ++msg_index, msg = dg_netmessage_next(msg)) {
         if (msg->mtype == svc_packet_entities) {
-          write_packetentities_args args;
-          memset(&args, 0, sizeof(args));
-          args.is_delta = msg->message_svc_packet_entities.is_delta;
-          args.version = &demo->demver_data;
-          args.data = &msg->message_svc_packet_entities.parsed->data;
-          uint32_t bits = dg_bitstream_bits_left(&msg->message_svc_packet_entities.data);
-          dg_bitwriter bitwriter;
-          dg_bitwriter_init(&bitwriter, bits);
-          auto stream = freddie::get_start_state(&bitwriter);
-          dg_bitwriter_write_packetentities(&bitwriter, args);
-          freddie::finalize_stream(&stream, &bitwriter);
-          demo->packets[i]->memory.attach(
-              bitwriter.ptr); // transfer the bitwriter memory over to the packet
-          msg->message_svc_packet_entities.data = stream;
+          encode_packetentities(msg, &demo->demver_data, &demo->allocator);
         }
       }
     }
@@ -287,10 +260,9 @@ dg_parse_result freddie::convert_demo(const demo_t *example, demo_t *demo) {
   demo->header.net_protocol = example->header.net_protocol;
   demo->header.demo_protocol = example->header.demo_protocol;
   memcpy(demo->header.game_directory, example->header.game_directory, 260);
-  fix_svc_serverinfo(example->header.game_directory, demo);
+  fix_svc_serverinfo(&demo->header, demo);
 
-  auto allocator = dg_arena_create_allocator(&demo->arena);
-  freddie::datatable_change_info info(allocator);
+  freddie::datatable_change_info info(demo->allocator);
   info.init(demo, example);
   result = info.convert_demo(demo);
 
@@ -302,6 +274,73 @@ dg_parse_result freddie::convert_demo(const demo_t *example, demo_t *demo) {
   return result;
 }
 
+static dg_parse_result convert_streaming(const demo_t *example, const char *input_path,
+                                         const char *output_path, dg_arena *info_arena) {
+  datatable_change_info info(dg_arena_create_allocator(info_arena));
+  demo_stream_t stream;
+  info.message_allocator = stream.allocator;
+  stream.output_version = &example->demver_data;
+
+  stream.add_header_transform([example](demo_stream_t *, dg_header *header) {
+    header->net_protocol = example->header.net_protocol;
+    header->demo_protocol = example->header.demo_protocol;
+    memcpy(header->game_directory, example->header.game_directory, 260);
+  });
+
+  stream.add_packet_transform([&info, example](demo_stream_t *stream, demo_packet *packet) {
+    dg_datatables_parsed *dt_ptr = std::get_if<dg_datatables_parsed>(&packet->packet);
+    if (dt_ptr && !stream->result.error) {
+      stream->result = info.init(dt_ptr, &stream->demver_data, example);
+      packet->packet = info.target_datatable;
+    }
+    return true;
+  });
+
+  stream.add_netmessage_transform(
+      svc_serverinfo, [](demo_stream_t *stream, packet_parsed *, packet_net_message *msg) {
+        fix_serverinfo(msg, &stream->header, &stream->allocator);
+      });
+
+  auto convert = [&info](demo_stream_t *stream, packet_parsed *, packet_net_message *msg) {
+    if (stream->result.error) {
+      return;
+    }
+
+    if (info.input_estate.class_datas == nullptr) {
+      stream->result.error = true;
+      stream->result.error_message = "missing datatable";
+      return;
+    }
+
+    stream->result = info.convert_netmessage(msg);
+    if (!stream->result.error && msg->mtype == svc_packet_entities) {
+      encode_packetentities(msg, stream->output_version, &stream->allocator);
+    }
+  };
+  stream.add_netmessage_transform(svc_packet_entities, convert);
+  stream.add_netmessage_transform(svc_create_stringtable, convert);
+  stream.add_netmessage_transform(svc_update_stringtable, convert);
+
+  stream.open(output_path);
+  dg_parse_result result = stream.parse(input_path);
+  dg_parse_result close_result = stream.close();
+  if (!result.error) {
+    result = close_result;
+  }
+
+  return result;
+}
+
+dg_parse_result freddie::convert_demo(const demo_t *example, const char *input_path,
+                                      const char *output_path) {
+  // Holds the flattened datatables of both demos for the whole conversion
+  dg_arena info_arena = dg_arena_create(1 << 20);
+  dg_parse_result result = convert_streaming(example, input_path, output_path, &info_arena);
+  dg_arena_free(&info_arena);
+
+  return result;
+}
+
 void *memory_stream::get_ptr() {
   std::uint8_t *ptr = (std::uint8_t *)this->buffer;
   return ptr + this->offset;
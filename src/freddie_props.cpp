@@ -170,7 +170,8 @@ dg_parse_result datatable_change_info::convert_props(dg_ent_update *update,
     prop_ptr->prop_index = status.index; // remap the index
     // TODO: add conversion logic for props
     if (status.flags_changed) {
-      init_value(newprop, &prop_ptr->value, &this->allocator);
+      init_value(newprop, &prop_ptr->value, &this->message_allocator);
+      prop_ptr->dirty = true;
     }
   }
 
@@ -239,13 +240,6 @@ static int32_t get_dt(const estate *state, const char *name, int32_t initial_gue
   }
 }
 
-static bool prop_equal(const dg_sendprop *prop1, const char *prop_name) {
-  char prop1_name[64];
-  dg_sendprop_name(prop1_name, sizeof(prop1_name), prop1);
-
-  return strcmp(prop1_name, prop_name) == 0;
-}
-
 static bool prop_attributes_equal(const dg_sendprop *prop1, const dg_sendprop *prop2) {
   bool equal = true;
 #define COMPARE_ELEMENT(x)                                                                         \
@@ -277,43 +271,27 @@ static bool prop_attributes_equal(const dg_sendprop *prop1, const dg_sendprop *p
   return equal;
 }
 
-static dg_sendprop *find_prop(const dg_serverclass_data *data, const char *name,
-                              size_t initial_index) {
-  if (initial_index < data->prop_count) {
-    if (prop_equal(data->props + initial_index, name)) {
-      return data->props + initial_index;
-    }
-  }
-
-  for (size_t i = 0; i < data->prop_count; ++i) {
-    if (prop_equal(data->props + i, name))
-      return data->props + i;
-  }
-
-  return nullptr;
-}
-
 static bool compare_sendtable_props(freddie::datatable_change_info *info,
-                                    const dg_serverclass_data *data1,
-                                    const dg_serverclass_data *data2) {
-  char buffer[64];
+                                    const estate *input_state, uint32_t input_dt,
+                                    const estate *target_state, uint32_t target_dt) {
   bool changes = false;
+  const dg_serverclass_data *data1 = input_state->class_datas + input_dt;
+  const dg_serverclass_data *data2 = target_state->class_datas + target_dt;
   for (size_t i = 0; i < data1->prop_count; ++i) {
     dg_sendprop *first_prop = data1->props + i;
-    dg_sendprop_name(buffer, sizeof(buffer), first_prop);
-    dg_sendprop *prop = find_prop(data2, buffer, i);
+    dg_prop_handle handle = dg_estate_find_sendprop(target_state, target_dt, first_prop);
     freddie::prop_status status;
-    size_t index = prop ? prop - data2->props : 0;
 
-    if (!prop) {
+    if (handle.prop_index == DG_PROP_HANDLE_INVALID) {
       status.flags_changed = true;
       status.exists = false;
       status.index = 0;
       status.target = nullptr;
     } else {
+      dg_sendprop *prop = data2->props + handle.prop_index;
       status.flags_changed = !prop_attributes_equal(first_prop, prop);
       status.exists = true;
-      status.index = index;
+      status.index = handle.prop_index;
       status.target = prop;
     }
 
@@ -332,8 +310,7 @@ static void compare_sendtables(freddie::datatable_change_info *info, const estat
     if (dt == -1) {
       info->add_datatable(0, true, false);
     } else {
-      bool changes = compare_sendtable_props(info, input_state->class_datas + i,
-                                             target_state->class_datas + dt);
+      bool changes = compare_sendtable_props(info, input_state, i, target_state, dt);
       info->add_datatable((uint32_t)dt, changes, true);
     }
   }
@@ -346,41 +323,61 @@ void dg_init_baseline(dg_ent_update *baseline, const dg_serverclass_data *target
   baseline->prop_value_array =
       (prop_value *)dg_alloc_allocate(allocator, props_size, alignof(prop_value));
   baseline->prop_value_array_size = target_datatable->prop_count;
+  baseline->prop_source = NULL;
   baseline->new_way = false;
   for (size_t i = 0; i < target_datatable->prop_count; ++i) {
     dg_sendprop *prop = target_datatable->props + i;
     prop_value *value = baseline->prop_value_array + i;
+    memset(value, 0, sizeof(*value));
     value->prop_index = i;
 
     init_value(prop, &value->value, allocator);
   }
 }
 
+dg_parse_result datatable_change_info::convert_netmessage(packet_net_message *netmsg) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+
+  if (netmsg->mtype == svc_packet_entities) {
+    result = convert_updates(&netmsg->message_svc_packet_entities.parsed->data);
+    netmsg->dirty = true;
+  } else if (netmsg->mtype == svc_create_stringtable &&
+             strcmp("instancebaseline", netmsg->message_svc_create_stringtable.name) == 0) {
+    auto msg = &netmsg->message_svc_create_stringtable;
+    result = convert_instancebaselines(&msg->stringtable, &msg->data);
+    // The converted entries are written out uncompressed
+    msg->flags &= ~1u;
+    msg->stringtable.flags &= ~1u;
+    netmsg->dirty = true;
+  } else if (netmsg->mtype == svc_update_stringtable &&
+             netmsg->message_svc_update_stringtable.table_id == 5) {
+    auto msg = &netmsg->message_svc_update_stringtable;
+    result = convert_instancebaselines(&msg->parsed_sentry, &msg->data);
+    netmsg->dirty = true;
+  }
+
+  return result;
+}
+
 dg_parse_result datatable_change_info::convert_demo(freddie::demo_t *input) {
   dg_parse_result result;
   memset(&result, 0, sizeof(result));
 
   for (size_t i = 0; i < input->packets.size() && !result.error; ++i) {
-    packet_parsed *packet_ptr = std::get_if<packet_parsed>(&input->packets[i]->packet);
-    dg_datatables_parsed *dt_ptr = std::get_if<dg_datatables_parsed>(&input->packets[i]->packet);
+    packet_parsed *packet_ptr = input->packets[i].get_if<packet_parsed>();
+    dg_datatables_parsed *dt_ptr = input->packets[i].get_if<dg_datatables_parsed>();
     if (packet_ptr) {
-      for (size_t msg_index = 0; msg_index < packet_ptr->message_count; ++msg_index) {
-        auto *netmsg = packet_ptr->messages + msg_index;
+      auto *netmsg = packet_ptr->first_message;
+      for (size_t msg_index = 0; msg_index < packet_ptr->message_count && !result.error;
+           ++msg_index, netmsg = dg_netmessage_next(netmsg)) {
+        result = convert_netmessage(netmsg);
         if (netmsg->mtype == svc_packet_entities) {
-          result = convert_updates(&netmsg->message_svc_packet_entities.parsed->data);
           break;
-        } else if(netmsg->mtype == svc_create_stringtable && 
-        strcmp("instancebaseline", netmsg->message_svc_create_stringtable.name) == 0) {
-          auto msg = &netmsg->message_svc_create_stringtable;
-          result = convert_instancebaselines(&msg->stringtable, &msg->data);
-        } else if (netmsg->mtype == svc_update_stringtable && 
-        netmsg->message_svc_update_stringtable.table_id == 5) {
-          auto msg = &netmsg->message_svc_update_stringtable;
-          result = convert_instancebaselines(&msg->parsed_sentry, &msg->data);
         }
       }
     } else if (dt_ptr) {
-      input->packets[i]->packet = this->target_datatable;
+      input->packets.set(i, this->target_datatable);
     }
   }
 
@@ -389,6 +386,7 @@ dg_parse_result datatable_change_info::convert_demo(freddie::demo_t *input) {
 
 datatable_change_info::datatable_change_info(dg_alloc_state allocator) {
   this->allocator = allocator;
+  this->message_allocator = allocator;
   memset(&input_estate, 0, sizeof(input_estate));
   memset(&target_estate, 0, sizeof(target_estate));
   baselines = NULL;
@@ -402,9 +400,14 @@ datatable_change_info::~datatable_change_info() {
 }
 
 dg_parse_result datatable_change_info::init(freddie::demo_t *input, const freddie::demo_t *target) {
+  return init(input->get_datatables(), &input->demver_data, target);
+}
+
+dg_parse_result datatable_change_info::init(dg_datatables_parsed *datatable1,
+                                            const dg_demver_data *input_version,
+                                            const freddie::demo_t *target) {
   dg_parse_result result;
   memset(&result, 0, sizeof(result));
-  dg_datatables_parsed *datatable1 = input->get_datatables();
   dg_datatables_parsed *datatable2 = target->get_datatables();
 
   if (datatable1 == nullptr) {
@@ -423,9 +426,10 @@ dg_parse_result datatable_change_info::init(freddie::demo_t *input, const freddi
   estate_init_args args2;
   args2.allocator = args1.allocator = &allocator;
   args2.flatten_datatables = args1.flatten_datatables = true;
+  args2.heap_allocator = args1.heap_allocator = NULL;
   args2.should_store_props = args1.should_store_props = false;
   args1.message = datatable1;
-  args1.version_data = &input->demver_data;
+  args1.version_data = input_version;
   args2.message = datatable2;
   args2.version_data = &target->demver_data;
 
@@ -464,7 +468,7 @@ static dg_parse_result convert_baseline(baseline_conversion_args* args, datatabl
   dg_parse_instancebaseline(&parse_args);
 
   auto status = info->get_datatable_status(parse_args.datatable_id);
-  auto data = dg_estate_serverclass_data(&info->target_estate, &info->target_demver, args->allocator, status.index);
+  auto data = dg_estate_serverclass_data(&info->target_estate, &info->target_demver, &info->allocator, status.index);
 
   if(status.index != parse_args.datatable_id) {
     char BUFFER[4];
@@ -474,14 +478,13 @@ static dg_parse_result convert_baseline(baseline_conversion_args* args, datatabl
   }
 
   dg_bitwriter writer;
-  dg_bitwriter_init(&writer, 1024);
+  dg_bitwriter_init_ex(&writer, 1024, args->allocator);
 #if 0
   writer.truth_data = args->value->userdata.data;
   writer.truth_data_offset = args->value->userdata.bitoffset;
   writer.truth_size_bits = args->value->userdata.bitsize;
 #endif
   dg_bitwriter_write_props(&writer, args->target_demver, &update);
-  dg_alloc_attach(args->allocator, writer.ptr, writer.bitsize / 8);
 
   return result;
 }
@@ -497,7 +500,7 @@ dg_parse_result datatable_change_info::convert_instancebaselines(dg_sentry* stri
   }
 
   baseline_conversion_args args;
-  args.allocator = &this->allocator;
+  args.allocator = &this->message_allocator;
   args.target_demver = &target_demver;
   args.input_estate = &input_estate;
 
@@ -521,7 +524,7 @@ dg_parse_result datatable_change_info::convert_instancebaselines(dg_sentry* stri
   write_args.input = stringtable;
   write_args.writer = &writer;
 
-  result = dg_write_stringtable_entry(&write_args);
+  result = dg_write_stringtable_entry_ex(&write_args, &target_demver);
 
   if(result.error) {
     dg_bitwriter_free(&writer);
@@ -534,7 +537,7 @@ dg_parse_result datatable_change_info::convert_instancebaselines(dg_sentry* stri
   }
 
   *data = dg_bitstream_create(writer.ptr, writer.bitoffset);
-  dg_alloc_attach(&this->allocator, writer.ptr, writer.bitsize / 8);
+  dg_alloc_attach(&this->message_allocator, writer.ptr, writer.bitsize / 8);
 
   return result;
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "demogobbler/freddie.hpp"
+#include <cassert>
+#include <cstdint>
+
+using namespace freddie;
+
+static_assert(sizeof(packet_store::header) == 8, "packet headers should stay 8 bytes");
+const size_t MAX_BLOCKS = 1 << 24;
+
+packet_store::packet_store() {
+  // Packet structs are at most a few hundred bytes, so every chunk holds hundreds of packets
+  const uint32_t CHUNK_SIZE = 1 << 16;
+  arena = dg_arena_create(CHUNK_SIZE);
+}
+
+packet_store::~packet_store() { dg_arena_free(&arena); }
+
+void *packet_store::allocate(header *dest, uint8_t type, uint32_t size, uint32_t alignment) {
+  void *memory = dg_arena_allocate(&arena, size, alignment);
+  // The arena always allocates from its current block
+  const dg_arena_block *block = &arena.blocks[arena.current_block];
+  assert(arena.current_block < MAX_BLOCKS);
+
+  dest->offset = (uint32_t)((uint8_t *)memory - (uint8_t *)block->data);
+  dest->block = (uint32_t)arena.current_block;
+  dest->type = type;
+  return memory;
+}
+
+packet_view packet_store::operator[](size_t index) const {
+  const header *packet = &headers[index];
+  packet_view view;
+  view.data = (uint8_t *)arena.blocks[packet->block].data + packet->offset;
+  view.type = packet->type;
+  return view;
+}
+
+void packet_store::clear() {
+  headers.clear();
+  dg_arena_clear(&arena);
+}
+
+packet_store_usage packet_store::memory_usage() const {
+  dg_arena_stats stats = dg_arena_get_stats(&arena);
+  packet_store_usage usage;
+  usage.packet_count = headers.size();
+  usage.header_bytes = headers.capacity() * sizeof(header);
+  usage.payload_bytes = stats.bytes_in_use;
+  usage.reserved_bytes = usage.header_bytes + stats.bytes_reserved;
+  return usage;
+}
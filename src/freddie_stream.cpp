@@ -0,0 +1,172 @@
+#include "demogobbler/freddie.hpp"
+#include "demogobbler/streams.h"
+#include <cstring>
+
+using namespace freddie;
+
+demo_stream_t::demo_stream_t() {
+  const size_t INITIAL_ARENA_SIZE = 1 << 16;
+  arena = dg_arena_create(INITIAL_ARENA_SIZE);
+  allocator = dg_arena_create_allocator(&arena);
+  dg_settings_init(&settings);
+  // Packets stay alive until they are written, so unchanged props can be copied
+  settings.record_prop_spans = true;
+  dg_writer_init(&writer);
+  writer.copy_clean_messages = true;
+  memset(&header, 0, sizeof(header));
+  memset(&demver_data, 0, sizeof(demver_data));
+  memset(&result, 0, sizeof(result));
+}
+
+demo_stream_t::~demo_stream_t() {
+  dg_writer_free(&writer);
+  dg_arena_free(&arena);
+}
+
+void demo_stream_t::add_header_transform(header_transform func) {
+  header_transforms.push_back(func);
+}
+
+void demo_stream_t::add_packet_transform(packet_transform func) {
+  packet_transforms.push_back(func);
+}
+
+void demo_stream_t::add_netmessage_transform(net_message_type type, netmessage_transform func) {
+  if ((uint32_t)type >= svc_invalid) {
+    if (!result.error) {
+      result.error = true;
+      result.error_message = "invalid netmessage type for transform";
+    }
+    return;
+  }
+
+  netmessage_transforms[type].push_back(func);
+  if (type == svc_packet_entities) {
+    settings.parse_packetentities = true;
+  }
+}
+
+void demo_stream_t::open(void *stream, dg_output_interface interface) {
+  dg_writer_open(&writer, stream, interface);
+}
+
+void demo_stream_t::open(const char *filepath) { dg_writer_open_file(&writer, filepath); }
+
+static demo_stream_t *get_stream(parser_state *state) {
+  demo_stream_t *stream = (demo_stream_t *)state->client_state;
+  stream->state = state;
+  return stream;
+}
+
+static void handle_version(parser_state *_state, dg_demver_data data) {
+  demo_stream_t *stream = get_stream(_state);
+  stream->demver_data = data;
+  stream->writer.version = stream->output_version ? *stream->output_version : data;
+}
+
+static void handle_header(parser_state *_state, struct dg_header *header) {
+  demo_stream_t *stream = get_stream(_state);
+  stream->header = *header;
+  for (auto &func : stream->header_transforms) {
+    func(stream, &stream->header);
+  }
+
+  if (!stream->header_written) {
+    dg_write_header(&stream->writer, &stream->header);
+    stream->header_written = true;
+  }
+}
+
+static void write_packet(demo_stream_t *stream, demo_packet *packet) {
+  bool keep = true;
+  for (size_t i = 0; i < stream->packet_transforms.size() && keep; ++i) {
+    keep = stream->packet_transforms[i](stream, packet);
+  }
+
+  if (keep && !stream->writer.error) {
+    freddie::write_packet(&stream->writer, packet);
+  }
+
+  dg_alloc_clear(&stream->allocator);
+}
+
+#define HANDLE_PACKET(type)                                                                        \
+  static void handle_##type(parser_state *_state, type *message) {                                 \
+    demo_packet packet;                                                                            \
+    packet.packet = *message;                                                                      \
+    write_packet(get_stream(_state), &packet);                                                     \
+  }
+
+HANDLE_PACKET(dg_consolecmd);
+HANDLE_PACKET(dg_customdata);
+HANDLE_PACKET(dg_datatables_parsed);
+HANDLE_PACKET(dg_stop);
+HANDLE_PACKET(dg_stringtables_parsed);
+HANDLE_PACKET(dg_synctick);
+HANDLE_PACKET(dg_usercmd);
+
+static void handle_packet_parsed(parser_state *_state, packet_parsed *message) {
+  demo_stream_t *stream = get_stream(_state);
+  packet_net_message *msg = message->first_message;
+  for (size_t i = 0; i < message->message_count; ++i, msg = dg_netmessage_next(msg)) {
+    for (auto &func : stream->netmessage_transforms[msg->mtype]) {
+      func(stream, message, msg);
+    }
+  }
+
+  demo_packet packet;
+  packet.packet = *message;
+  write_packet(stream, &packet);
+}
+
+dg_parse_result demo_stream_t::parse(void *stream, dg_input_interface interface) {
+  dg_settings parse_settings = settings;
+  parse_settings.client_state = this;
+  parse_settings.header_handler = handle_header;
+  parse_settings.demo_version_handler = handle_version;
+  parse_settings.consolecmd_handler = handle_dg_consolecmd;
+  parse_settings.customdata_handler = handle_dg_customdata;
+  parse_settings.datatables_parsed_handler = handle_dg_datatables_parsed;
+  parse_settings.stringtables_parsed_handler = handle_dg_stringtables_parsed;
+  parse_settings.packet_parsed_handler = handle_packet_parsed;
+  parse_settings.stop_handler = handle_dg_stop;
+  parse_settings.synctick_handler = handle_dg_synctick;
+  parse_settings.usercmd_handler = handle_dg_usercmd;
+  parse_settings.packet_alloc_type = dg_alloc_temp;
+
+  dg_parse_result parse_result = dg_parse(&parse_settings, stream, interface);
+  this->state = nullptr;
+
+  if (!parse_result.error && this->result.error) {
+    parse_result = this->result;
+  }
+
+  return parse_result;
+}
+
+dg_parse_result demo_stream_t::parse(const char *filepath) {
+  FILE *file = fopen(filepath, "rb");
+  dg_parse_result parse_result;
+
+  if (file == nullptr) {
+    parse_result.error = true;
+    parse_result.error_message = "unable to open file";
+  } else {
+    parse_result = parse(file, {dg_fstream_read, dg_fstream_seek});
+    fclose(file);
+  }
+
+  return parse_result;
+}
+
+dg_parse_result demo_stream_t::close() {
+  dg_writer_close(&writer);
+  dg_parse_result close_result = result;
+
+  if (!close_result.error && writer.error) {
+    close_result.error = true;
+    close_result.error_message = writer.error_message;
+  }
+
+  return close_result;
+}
@@ -1,40 +1,169 @@
 #include "demogobbler/hashtable.h"
+#include "demogobbler/alignof_wrapper.h"
 #define XXH_INLINE_ALL
 #include "xxhash.h"
+#include "demogobbler/utils.h"
 #include <stdlib.h>
 #include <string.h>
 
-static uint32_t get_hash(const char *str) {
-  // The length here is computed unnecessarily, could grab it when we parse the string
-  return XXH32(str, strlen(str), 0);
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DG_HASHTABLE_SSE2
+#endif
+
+enum { GROUP_WIDTH = 16 };
+enum { CTRL_EMPTY = 0x80 };
+
+// Bit i is set if control byte i of the group matches
+typedef uint32_t group_mask;
+
+static size_t slots_for_items(size_t items) {
+  // Keep the load factor at 7/8 at most
+  size_t slots = GROUP_WIDTH;
+  while (slots - slots / 8 < items)
+    slots <<= 1;
+  return slots;
+}
+
+static group_mask match_byte(const uint8_t *group, uint8_t value) {
+#ifdef DG_HASHTABLE_SSE2
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+  group_mask mask = 0;
+  for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+    mask |= (group_mask)(group[i] == value) << i;
+  }
+  return mask;
+#endif
+}
+
+static group_mask match_empty(const uint8_t *group) {
+#ifdef DG_HASHTABLE_SSE2
+  // Empty is the only control byte with the top bit set
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+  return match_byte(group, CTRL_EMPTY);
+#endif
+}
+
+static size_t lowest_bit(group_mask mask) { return dg_ctz64(mask); }
+
+// High bits pick the group, the low 7 bits go in the control byte
+static size_t hash_group(uint32_t hash) { return hash >> 7; }
+static uint8_t hash_ctrl(uint32_t hash) { return hash & 0x7f; }
+
+uint32_t dg_hashtable_hash(const char *str, size_t length) {
+  return (uint32_t)XXH3_64bits(str, length);
 }
 
-dg_hashtable dg_hashtable_create(size_t max_items) {
+// Control bytes go after the slots in the same allocation
+static uint32_t slots_bytes(size_t slots) { return slots * (sizeof(dg_hashtable_slot) + 1); }
+
+static void alloc_slots(dg_hashtable *thisptr, size_t slots) {
+  size_t slot_bytes = slots * sizeof(dg_hashtable_slot);
+  uint8_t *memory = dg_alloc_allocate(thisptr->allocator, slots_bytes(slots),
+                                      alignof(dg_hashtable_slot));
+  thisptr->slots = (dg_hashtable_slot *)memory;
+  thisptr->ctrl = memory + slot_bytes;
+  thisptr->max_items = slots;
+  memset(thisptr->ctrl, CTRL_EMPTY, slots);
+}
+
+dg_hashtable dg_hashtable_create(size_t max_items) { return dg_hashtable_create_ex(max_items, NULL); }
+
+dg_hashtable dg_hashtable_create_ex(size_t max_items, dg_alloc_state *allocator) {
   dg_hashtable table;
   memset(&table, 0, sizeof(table));
+  table.allocator = allocator != NULL ? allocator : dg_heap_allocator();
+  alloc_slots(&table, slots_for_items(max_items));
+
+  return table;
+}
 
-  table.max_items = 1; // User power of two sizes;
+// Groups are visited in triangular order, which covers all of them when the group count is a
+// power of two
+typedef struct {
+  size_t group;
+  size_t step;
+  size_t mask;
+} probe_seq;
 
-  while (table.max_items - 1 < max_items)
-    table.max_items <<= 1;
+static probe_seq probe_start(const dg_hashtable *thisptr, uint32_t hash) {
+  probe_seq seq;
+  seq.mask = thisptr->max_items / GROUP_WIDTH - 1;
+  seq.group = hash_group(hash) & seq.mask;
+  seq.step = 0;
+  return seq;
+}
 
-  const size_t array_size_bytes = table.max_items * sizeof(dg_hashtable_entry);
-  table.arr = malloc(array_size_bytes);
-  memset(table.arr, 0, array_size_bytes);
+static void probe_next(probe_seq *seq) {
+  ++seq->step;
+  seq->group = (seq->group + seq->step) & seq->mask;
+}
 
-  return table;
+static dg_hashtable_slot *find_slot(const dg_hashtable *thisptr, const char *str, size_t length,
+                                    uint32_t hash) {
+  const uint8_t ctrl = hash_ctrl(hash);
+
+  for (probe_seq seq = probe_start(thisptr, hash); seq.step <= seq.mask; probe_next(&seq)) {
+    const size_t offset = seq.group * GROUP_WIDTH;
+    const uint8_t *group = thisptr->ctrl + offset;
+    group_mask matches = match_byte(group, ctrl);
+
+    while (matches) {
+      dg_hashtable_slot *slot = thisptr->slots + offset + lowest_bit(matches);
+      if (slot->hash == hash && slot->length == length &&
+          memcmp(slot->entry.str, str, length) == 0) {
+        return slot;
+      }
+      matches &= matches - 1;
+    }
+
+    if (match_empty(group)) {
+      break;
+    }
+  }
+
+  return NULL;
 }
 
-dg_hashtable_entry dg_hashtable_get(dg_hashtable *thisptr, const char *str) {
-  uint32_t hash = get_hash(str);
-  size_t i = hash & (thisptr->max_items - 1);
-  while (thisptr->arr[i].str) {
-    if (strcmp(thisptr->arr[i].str, str) == 0) {
-      return thisptr->arr[i];
+// Place a key that is known not to be in the table
+static void place(dg_hashtable *thisptr, const dg_hashtable_slot *value) {
+  for (probe_seq seq = probe_start(thisptr, value->hash); seq.step <= seq.mask;
+       probe_next(&seq)) {
+    const size_t offset = seq.group * GROUP_WIDTH;
+    group_mask empty = match_empty(thisptr->ctrl + offset);
+    if (empty) {
+      size_t index = offset + lowest_bit(empty);
+      thisptr->ctrl[index] = hash_ctrl(value->hash);
+      thisptr->slots[index] = *value;
+      ++thisptr->item_count;
+      return;
     }
-    i += 1;
-    if (i == thisptr->max_items)
-      i = 0;
+  }
+}
+
+static void grow(dg_hashtable *thisptr) {
+  dg_hashtable old = *thisptr;
+  alloc_slots(thisptr, old.max_items * 2);
+  thisptr->item_count = 0;
+
+  // The stored hashes make rehashing free of string reads
+  for (size_t i = 0; i < old.max_items; ++i) {
+    if (old.ctrl[i] != CTRL_EMPTY) {
+      place(thisptr, old.slots + i);
+    }
+  }
+
+  dg_alloc_free(thisptr->allocator, old.slots, slots_bytes(old.max_items));
+}
+
+dg_hashtable_entry dg_hashtable_get_hashed(dg_hashtable *thisptr, const char *str, size_t length,
+                                           uint32_t hash) {
+  dg_hashtable_slot *slot = find_slot(thisptr, str, length, hash);
+  if (slot) {
+    return slot->entry;
   }
 
   dg_hashtable_entry not_found;
@@ -42,50 +171,81 @@ dg_hashtable_entry dg_hashtable_get(dg_hashtable *thisptr, const char *str) {
   return not_found;
 }
 
-bool dg_hashtable_insert(dg_hashtable *thisptr, dg_hashtable_entry entry) {
-  if (thisptr->item_count == thisptr->max_items - 1) {
-    return false; // Hash table is not resizable
+dg_hashtable_entry dg_hashtable_get(dg_hashtable *thisptr, const char *str) {
+  size_t length = strlen(str);
+  return dg_hashtable_get_hashed(thisptr, str, length, dg_hashtable_hash(str, length));
+}
+
+bool dg_hashtable_insert_hashed(dg_hashtable *thisptr, dg_hashtable_entry entry, size_t length,
+                                uint32_t hash) {
+  if (thisptr->item_count + 1 > thisptr->max_items - thisptr->max_items / 8) {
+    grow(thisptr);
   }
 
-  ++thisptr->item_count;
-  uint32_t hash = get_hash(entry.str);
-  size_t initial_index = hash & (thisptr->max_items - 1);
-  size_t i = initial_index;
-  while (thisptr->arr[i].str) {
-    if (strcmp(thisptr->arr[i].str, entry.str) == 0) {
-      return false;
+  const uint8_t ctrl = hash_ctrl(hash);
+
+  // Nothing is ever removed, so the first group with an empty slot ends the search for duplicates
+  // and is also where the new key goes
+  for (probe_seq seq = probe_start(thisptr, hash); seq.step <= seq.mask; probe_next(&seq)) {
+    const size_t offset = seq.group * GROUP_WIDTH;
+    const uint8_t *group = thisptr->ctrl + offset;
+    group_mask matches = match_byte(group, ctrl);
+
+    while (matches) {
+      dg_hashtable_slot *slot = thisptr->slots + offset + lowest_bit(matches);
+      if (slot->hash == hash && slot->length == length &&
+          memcmp(slot->entry.str, entry.str, length) == 0) {
+        return false;
+      }
+      matches &= matches - 1;
+    }
+
+    group_mask empty = match_empty(group);
+    if (empty) {
+      size_t index = offset + lowest_bit(empty);
+      thisptr->ctrl[index] = ctrl;
+      thisptr->slots[index].entry = entry;
+      thisptr->slots[index].hash = hash;
+      thisptr->slots[index].length = length;
+      ++thisptr->item_count;
+      return true;
     }
-    i += 1;
-    if (i == thisptr->max_items)
-      i = 0;
   }
 
-  thisptr->arr[i] = entry;
+  return false; // Unreachable, the load factor guarantees an empty slot
+}
 
-  return true;
+bool dg_hashtable_insert(dg_hashtable *thisptr, dg_hashtable_entry entry) {
+  size_t length = strlen(entry.str);
+  return dg_hashtable_insert_hashed(thisptr, entry, length, dg_hashtable_hash(entry.str, length));
 }
 
 void dg_hashtable_clear(dg_hashtable *thisptr) {
-  const size_t array_size_bytes = thisptr->max_items * sizeof(dg_hashtable_entry);
   thisptr->item_count = 0;
-  memset(thisptr->arr, 0, array_size_bytes);
+  memset(thisptr->ctrl, CTRL_EMPTY, thisptr->max_items);
 }
 
 void dg_hashtable_free(dg_hashtable *thisptr) {
-  free(thisptr->arr);
-  thisptr->arr = NULL;
+  if (thisptr->slots) {
+    dg_alloc_free(thisptr->allocator, thisptr->slots, slots_bytes(thisptr->max_items));
+  }
+  thisptr->slots = NULL;
+  thisptr->ctrl = NULL;
 }
 
-dg_pes dg_pes_create(size_t max_items) {
+dg_pes dg_pes_create(size_t max_items) { return dg_pes_create_ex(max_items, NULL); }
+
+dg_pes dg_pes_create_ex(size_t max_items, dg_alloc_state *allocator) {
   dg_pes set;
   memset(&set, 0, sizeof(set));
+  set.allocator = allocator != NULL ? allocator : dg_heap_allocator();
   set.max_items = 1;
 
   while (set.max_items - 1 < max_items)
     set.max_items <<= 1;
 
   const size_t array_size_bytes = set.max_items * sizeof(dg_pes_entry);
-  set.arr = malloc(array_size_bytes);
+  set.arr = dg_alloc_allocate(set.allocator, array_size_bytes, alignof(dg_pes_entry));
   memset(set.arr, 0, array_size_bytes);
 
   return set;
@@ -151,7 +311,9 @@ bool dg_pes_insert(dg_pes *thisptr, dg_sendprop *prop) {
 }
 
 void dg_pes_free(dg_pes *thisptr) {
-  free(thisptr->arr);
+  if (thisptr->arr) {
+    dg_alloc_free(thisptr->allocator, thisptr->arr, thisptr->max_items * sizeof(dg_pes_entry));
+  }
   thisptr->arr = NULL;
 }
 
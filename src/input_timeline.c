@@ -0,0 +1,101 @@
+#include "demogobbler.h"
+#include "demogobbler/alignof_wrapper.h"
+#include "demogobbler/input_timeline.h"
+#include "demogobbler/usercmd_types.h"
+#include "demogobbler/utils.h"
+#include <string.h>
+
+#define GROW_COLUMN(type, name)                                                                    \
+  columns->name = dg_alloc_reallocate(allocator, columns->name, columns->capacity * sizeof(type),  \
+                                      capacity * sizeof(type), alignof(type));
+
+#define FREE_COLUMN(type, name)                                                                    \
+  dg_alloc_free(allocator, columns->name, columns->capacity * sizeof(type));
+
+static void grow_usercmds(dg_input_timeline *thisptr, size_t capacity) {
+  dg_usercmd_columns *columns = &thisptr->usercmds;
+  dg_alloc_state *allocator = thisptr->allocator;
+  if (capacity > columns->capacity) {
+    DEMOGOBBLER_MACRO_USERCMD_COLUMNS(GROW_COLUMN);
+    columns->capacity = capacity;
+  }
+}
+
+static void grow_cmdinfo(dg_input_timeline *thisptr, size_t capacity) {
+  dg_cmdinfo_columns *columns = &thisptr->cmdinfo;
+  dg_alloc_state *allocator = thisptr->allocator;
+  if (capacity > columns->capacity) {
+    DEMOGOBBLER_MACRO_CMDINFO_COLUMNS(GROW_COLUMN);
+    columns->capacity = capacity;
+  }
+}
+
+void dg_input_timeline_init(dg_input_timeline *thisptr, dg_alloc_state *allocator) {
+  memset(thisptr, 0, sizeof(*thisptr));
+  thisptr->allocator = allocator ? allocator : dg_heap_allocator();
+}
+
+void dg_input_timeline_reserve(dg_input_timeline *thisptr, size_t usercmds, size_t cmdinfo) {
+  grow_usercmds(thisptr, thisptr->usercmds.count + usercmds);
+  grow_cmdinfo(thisptr, thisptr->cmdinfo.count + cmdinfo);
+}
+
+void dg_input_timeline_clear(dg_input_timeline *thisptr) {
+  thisptr->usercmds.count = 0;
+  thisptr->cmdinfo.count = 0;
+}
+
+void dg_input_timeline_free(dg_input_timeline *thisptr) {
+  dg_alloc_state *allocator = thisptr->allocator;
+  {
+    dg_usercmd_columns *columns = &thisptr->usercmds;
+    DEMOGOBBLER_MACRO_USERCMD_COLUMNS(FREE_COLUMN);
+  }
+  {
+    dg_cmdinfo_columns *columns = &thisptr->cmdinfo;
+    DEMOGOBBLER_MACRO_CMDINFO_COLUMNS(FREE_COLUMN);
+  }
+  dg_input_timeline_init(thisptr, allocator);
+}
+
+void dg_input_timeline_add_usercmd(dg_input_timeline *thisptr, const dg_usercmd_parsed *cmd) {
+  dg_usercmd_columns *columns = &thisptr->usercmds;
+  if (columns->count == columns->capacity) {
+    grow_usercmds(thisptr, MAX(columns->capacity * 2, 256));
+  }
+
+  size_t i = columns->count++;
+  columns->tick[i] = cmd->orig->preamble.tick;
+  columns->slot[i] = cmd->orig->preamble.slot;
+  columns->command_number[i] = cmd->command_number;
+  columns->tick_count[i] = cmd->tick_count;
+  columns->viewangles[i].x = cmd->viewangle.x;
+  columns->viewangles[i].y = cmd->viewangle.y;
+  columns->viewangles[i].z = cmd->viewangle.z;
+  columns->forwardmove[i] = cmd->movement.forward;
+  columns->sidemove[i] = cmd->movement.side;
+  columns->upmove[i] = cmd->movement.up;
+  columns->buttons[i] = cmd->buttons;
+  columns->impulse[i] = cmd->impulse;
+  columns->weapon_select[i] = cmd->weapon_select;
+  columns->mouse_dx[i] = (int16_t)cmd->mouse_dx;
+  columns->mouse_dy[i] = (int16_t)cmd->mouse_dy;
+}
+
+void dg_input_timeline_add_cmdinfo(dg_input_timeline *thisptr, const dg_packet *packet) {
+  dg_cmdinfo_columns *columns = &thisptr->cmdinfo;
+  if (columns->count + packet->cmdinfo_size > columns->capacity) {
+    grow_cmdinfo(thisptr, MAX(columns->capacity * 2, 256));
+  }
+
+  for (size_t slot = 0; slot < packet->cmdinfo_size; ++slot) {
+    const dg_cmdinfo *cmdinfo = packet->cmdinfo + slot;
+    size_t i = columns->count++;
+    columns->tick[i] = packet->preamble.tick;
+    columns->slot[i] = slot;
+    columns->interp_flags[i] = cmdinfo->interp_flags;
+    columns->view_origin[i] = cmdinfo->view_origin;
+    columns->view_angles[i] = cmdinfo->view_angles;
+    columns->local_viewangles[i] = cmdinfo->local_viewangles;
+  }
+}
@@ -5,17 +5,23 @@
 #include "demogobbler.h"
 #include "demogobbler/filereader.h"
 #include "demogobbler/packettypes.h"
+#include "demogobbler/usercmd_types.h"
 #include "demogobbler/hashtable.h"
+#include "alloc_telemetry.h"
 #include "parser_datatables.h"
 #include "parser_netmessages.h"
 #include "parser_stringtables.h"
 #include "demogobbler/utils.h"
 #include "demogobbler/version_utils.h"
+#include "threads.h"
 #include <stddef.h>
 #include <string.h>
 
 #define thisreader &thisptr->m_reader
 
+// About five hours at 66 ticks per second
+enum { MAX_RESERVED_TICKS = 1 << 20 };
+
 // Optimization, read the cmdinfo bit as a uin32_t array instead of picking the individual words out
 // Should be fine I think, but I'll check that the size and alignment match here just in case
 // Assumes little endian I suppose but probably so does many other parts of this codebase
@@ -46,23 +52,76 @@ static void set_allocator_funcs(dg_alloc_state* state)
     state->clear = (func_dg_clear)dg_arena_clear;
   if(state->realloc == NULL)
     state->realloc = (func_dg_realloc)dg_arena_reallocate;
+  if(state->dealloc == NULL && state->alloc == (func_dg_alloc)dg_arena_allocate)
+    state->dealloc = (func_dg_dealloc)dg_arena_deallocate;
+}
+
+// Arenas kept between dg_parse calls when reuse_thread_arenas is set
+typedef struct {
+  dg_arena temp;
+  dg_arena permanent;
+  bool in_use; // Nested dg_parse calls on the same thread get fresh arenas
+} thread_arenas;
+
+static DG_THREAD_LOCAL thread_arenas cached_arenas;
+
+static bool is_arena(const dg_alloc_state *state) {
+  return state->alloc == (func_dg_alloc)dg_arena_allocate;
+}
+
+static void fill_memory_stats(dg_parser *parser, dg_memory_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (is_arena(&parser->m_settings.temp_alloc_state))
+    stats->temp = dg_arena_get_stats(parser->m_settings.temp_alloc_state.allocator);
+  if (is_arena(&parser->m_settings.permanent_alloc_state))
+    stats->permanent = dg_arena_get_stats(parser->m_settings.permanent_alloc_state.allocator);
+  stats->packet_bytes = parser->packet_bytes;
+}
+
+static void borrow_cached_arena(dg_arena *arena, uint32_t first_block_size, uint32_t flags) {
+  if (arena->first_block_size == 0) {
+    *arena = dg_arena_create_ex(first_block_size, flags);
+  }
+  // Stats are reported per demo
+  arena->flags = flags;
+  arena->peak_bytes = 0;
+  arena->bytes_cleared = 0;
+}
+
+static void return_cached_arena(dg_arena *arena, uint64_t retain_bytes) {
+  dg_arena_clear(arena);
+  dg_arena_trim(arena, retain_bytes);
 }
 
 dg_parse_result dg_parse(dg_settings *settings, void *stream, dg_input_interface dg_input_interface) {
   const uint32_t INITIAL_SIZE = 1 << 17;
-  dg_arena temp_arena = dg_arena_create(INITIAL_SIZE);
-  dg_arena permanent_arena = dg_arena_create(INITIAL_SIZE);
+  const uint64_t DEFAULT_RETAIN_BYTES = 1 << 24;
+  bool reuse_arenas = settings->reuse_thread_arenas && !cached_arenas.in_use;
+  dg_arena local_temp_arena, local_permanent_arena;
+  dg_arena *temp_arena = &local_temp_arena;
+  dg_arena *permanent_arena = &local_permanent_arena;
+
+  if (reuse_arenas) {
+    cached_arenas.in_use = true;
+    temp_arena = &cached_arenas.temp;
+    permanent_arena = &cached_arenas.permanent;
+    borrow_cached_arena(temp_arena, INITIAL_SIZE, settings->arena_flags);
+    borrow_cached_arena(permanent_arena, INITIAL_SIZE, settings->arena_flags);
+  } else {
+    local_temp_arena = dg_arena_create_ex(INITIAL_SIZE, settings->arena_flags);
+    local_permanent_arena = dg_arena_create_ex(INITIAL_SIZE, settings->arena_flags);
+  }
 
   if(settings->permanent_alloc_state.allocator == NULL)
   {
-    settings->permanent_alloc_state.allocator = &permanent_arena;
+    settings->permanent_alloc_state.allocator = permanent_arena;
   }
 
   set_allocator_funcs(&settings->permanent_alloc_state);
 
   if(settings->temp_alloc_state.allocator == NULL)
   {
-    settings->temp_alloc_state.allocator = &temp_arena;
+    settings->temp_alloc_state.allocator = temp_arena;
   }
 
   set_allocator_funcs(&settings->temp_alloc_state);
@@ -75,12 +134,32 @@ dg_parse_result dg_parse(dg_settings *settings, void *stream, dg_input_interface
   out.error = dg_parser.error;
   out.error_message = dg_parser.error_message;
 
-  dg_arena_free(&permanent_arena);
-  dg_arena_free(&temp_arena);
+  if (settings->memory_stats) {
+    fill_memory_stats(&dg_parser, settings->memory_stats);
+  }
+
+  if (reuse_arenas) {
+    uint64_t retain_bytes = settings->arena_retain_bytes;
+    if (retain_bytes == 0)
+      retain_bytes = DEFAULT_RETAIN_BYTES;
+    return_cached_arena(permanent_arena, retain_bytes);
+    return_cached_arena(temp_arena, retain_bytes);
+    cached_arenas.in_use = false;
+  } else {
+    dg_arena_free(permanent_arena);
+    dg_arena_free(temp_arena);
+  }
 
   return out;
 }
 
+void dg_release_thread_arenas(void) {
+  if (!cached_arenas.in_use) {
+    dg_arena_free(&cached_arenas.temp);
+    dg_arena_free(&cached_arenas.permanent);
+  }
+}
+
 dg_parse_result dg_parse_file(dg_settings *settings, const char *filepath) {
   dg_parse_result out;
   memset(&out, 0, sizeof(out));
@@ -122,7 +201,10 @@ dg_parse_result dg_parse_buffer(dg_settings *settings, void *buffer, size_t size
   return out;
 }
 
-void dg_settings_init(dg_settings *settings) { memset(settings, 0, sizeof(dg_settings)); }
+void dg_settings_init(dg_settings *settings) {
+  memset(settings, 0, sizeof(dg_settings));
+  settings->flatten_threads = 1;
+}
 
 dg_alloc_state* dg_parser_temp_allocator(dg_parser *thisptr)
 {
@@ -134,11 +216,55 @@ dg_alloc_state* dg_parser_perm_allocator(dg_parser *thisptr)
   return &thisptr->m_settings.permanent_alloc_state;
 }
 
+dg_alloc_state* dg_parser_heap_allocator(dg_parser *thisptr) {
+  if (thisptr->m_settings.heap_alloc_state.alloc == NULL)
+    return dg_heap_allocator();
+  return &thisptr->m_settings.heap_alloc_state;
+}
+
 dg_alloc_state* dg_parser_packet_allocator(dg_parser *thisptr) {
-  if(thisptr->m_settings.packet_alloc_type == dg_alloc_permanent) {
-    return &thisptr->m_settings.permanent_alloc_state;
+  return &thisptr->packet_alloc_state;
+}
+
+static void *count_packet_alloc(dg_parser *thisptr, uint32_t size, uint32_t alignment) {
+  thisptr->packet_bytes += size;
+  return dg_alloc_allocate(thisptr->packet_alloc_target, size, alignment);
+}
+
+static void *count_packet_realloc(dg_parser *thisptr, void *ptr, uint32_t prev_size, uint32_t size,
+                                  uint32_t alignment) {
+  if (size > prev_size)
+    thisptr->packet_bytes += size - prev_size;
+  return dg_alloc_reallocate(thisptr->packet_alloc_target, ptr, prev_size, size, alignment);
+}
+
+static void count_packet_clear(dg_parser *thisptr) { dg_alloc_clear(thisptr->packet_alloc_target); }
+
+static void count_packet_dealloc(dg_parser *thisptr, void *ptr, uint32_t size) {
+  dg_alloc_free(thisptr->packet_alloc_target, ptr, size);
+}
+
+static void count_packet_attach(dg_parser *thisptr, void *ptr, uint32_t size) {
+  dg_alloc_attach(thisptr->packet_alloc_target, ptr, size);
+}
+
+static void init_packet_allocator(dg_parser *thisptr) {
+  if (thisptr->m_settings.packet_alloc_type == dg_alloc_permanent) {
+    thisptr->packet_alloc_target = &thisptr->m_settings.permanent_alloc_state;
   } else {
-    return &thisptr->m_settings.temp_alloc_state;
+    thisptr->packet_alloc_target = &thisptr->m_settings.temp_alloc_state;
+  }
+
+  // Only pay for the extra indirection when someone is looking at the numbers
+  if (thisptr->m_settings.memory_stats) {
+    thisptr->packet_alloc_state.allocator = thisptr;
+    thisptr->packet_alloc_state.alloc = (func_dg_alloc)count_packet_alloc;
+    thisptr->packet_alloc_state.realloc = (func_dg_realloc)count_packet_realloc;
+    thisptr->packet_alloc_state.clear = (func_dg_clear)count_packet_clear;
+    thisptr->packet_alloc_state.attach = (func_dg_attach)count_packet_attach;
+    thisptr->packet_alloc_state.dealloc = (func_dg_dealloc)count_packet_dealloc;
+  } else {
+    thisptr->packet_alloc_state = *thisptr->packet_alloc_target;
   }
 }
 
@@ -166,6 +292,7 @@ void dg_parser_init(dg_parser *thisptr, dg_settings *settings) {
   thisptr->m_settings = *settings;
   thisptr->_parser_funcs = settings->funcs;
   init_parsing_funcs(thisptr);
+  init_packet_allocator(thisptr);
 }
 
 void dg_parser_parse(dg_parser *thisptr, void *stream, dg_input_interface input) {
@@ -182,18 +309,25 @@ void dg_parser_update_l4d2_version(dg_parser *thisptr, int l4d2_version) {
   thisptr->demo_version.l4d2_version = l4d2_version;
   thisptr->demo_version.l4d2_version_finalized = true;
   version_update_build_info(&thisptr->demo_version);
+  dg_netmessage_dispatch_init(thisptr);
   if (thisptr->m_settings.demo_version_handler) {
     thisptr->m_settings.demo_version_handler(&thisptr->state, thisptr->demo_version);
   }
 }
 
 dg_parse_result dg_parser_add_stringtable(dg_parser *thisptr, dg_sentry* table) {
+  return dg_parser_add_stringtable_ex(thisptr, "", table);
+}
+
+dg_parse_result dg_parser_add_stringtable_ex(dg_parser *thisptr, const char *name,
+                                             dg_sentry *table) {
   dg_parse_result result;
   memset(&result, 0, sizeof(result));
 
   if(thisptr->state.stringtables_count >= MAX_STRINGTABLES) {
     result.error = true;
     result.error_message = "demo had too many stringtables";
+    return result;
   }
 
   dg_stringtable_data* data = thisptr->state.stringtables + thisptr->state.stringtables_count;
@@ -203,6 +337,12 @@ dg_parse_result dg_parser_add_stringtable(dg_parser *thisptr, dg_sentry* table)
   data->user_data_size_bits = table->user_data_size_bits;
   ++thisptr->state.stringtables_count;
 
+  if (thisptr->m_settings.track_stringtables) {
+    uint32_t table_id = thisptr->state.stringtables_count - 1;
+    dg_parser_track_stringtable(thisptr, table_id, name);
+    result = dg_parser_update_stringtable(thisptr, table_id, table);
+  }
+
   return result;
 }
 
@@ -238,6 +378,17 @@ void _parse_header(dg_parser *thisptr) {
       header.game_directory[259] = '\0';
 
   thisptr->demo_version = dg_get_demo_version(&header);
+  thisptr->user_messages =
+      dg_user_message_registry_get(&thisptr->demo_version, header.game_directory);
+  dg_netmessage_dispatch_init(thisptr);
+
+  if (thisptr->m_settings.input_timeline && header.tick_count > 0) {
+    // Roughly one usercmd and packet per tick. The header is not trusted, so the reservation is
+    // capped and longer demos grow the timeline as they go
+    size_t ticks = MIN((size_t)header.tick_count + 1, (size_t)MAX_RESERVED_TICKS);
+    dg_input_timeline_reserve(thisptr->m_settings.input_timeline, ticks,
+                              ticks * thisptr->demo_version.cmdinfo_size);
+  }
 
   if (thisptr->m_settings.demo_version_handler) {
     thisptr->m_settings.demo_version_handler(&thisptr->state, thisptr->demo_version);
@@ -255,6 +406,12 @@ bool _parse_anymessage(dg_parser *thisptr) {
   if(thisptr->m_settings.temp_alloc_state.allocator != thisptr->m_settings.permanent_alloc_state.allocator)
     dg_alloc_clear(dg_parser_temp_allocator(thisptr));
 
+  if (type == 8 && thisptr->demo_version.demo_protocol < 4) {
+    DG_TRACK_MESSAGE(dg_type_stringtables);
+  } else {
+    DG_TRACK_MESSAGE(type);
+  }
+
   switch (type) {
   case dg_type_consolecmd:
     thisptr->_parser_funcs.parse_consolecmd(thisptr);
@@ -293,16 +450,24 @@ bool _parse_anymessage(dg_parser *thisptr) {
     break;
   }
 
+  DG_TRACK_MESSAGE(0);
+
   return type != dg_type_stop && !thisptr->m_reader.eof &&
          !thisptr->error; // Return false when done parsing demo, or when at eof
 }
 
 static void parser_free_state(dg_parser *thisptr) {
   dg_estate_free(&thisptr->state.entity_state);
+  dg_parser_free_stringtables(thisptr);
+  if (thisptr->state.game_event_list) {
+    dg_game_event_list_free((dg_game_event_list *)thisptr->state.game_event_list);
+    thisptr->state.game_event_list = NULL;
+  }
 }
 
 #define PARSE_PREAMBLE()                                                                           \
   message.preamble.tick = dg_filereader_readint32(thisreader);                                     \
+  message.preamble.slot = 0;                                                                       \
   if (thisptr->demo_version.has_slot_in_preamble)                                                  \
     message.preamble.slot = dg_filereader_readbyte(thisreader);
 
@@ -329,12 +494,27 @@ void _parser_mainloop(dg_parser *thisptr) {
   NULL_CHECK(usercmd);
   NULL_CHECK(flattened_props);
 
-  if (settings->parse_packetentities || settings->packetentities_parsed_handler) {
+  if (settings->parse_packetentities || settings->packetentities_parsed_handler ||
+      settings->temp_entities_parsed_handler) {
     settings->parse_packetentities = true; // Entity state init handler => we should store ents
     should_parse = true;
     thisptr->parse_netmessages = true;
   }
 
+  if (settings->input_timeline) {
+    should_parse = true;
+  }
+
+  if (settings->track_stringtables) {
+    should_parse = true;
+    thisptr->parse_netmessages = true;
+  }
+
+  if (settings->game_event_handler) {
+    should_parse = true;
+    thisptr->parse_netmessages = true;
+  }
+
   if (!thisptr->demo_version.l4d2_version_finalized && settings->demo_version_handler) {
     should_parse = true;
   }
@@ -356,6 +536,7 @@ void _parser_mainloop(dg_parser *thisptr) {
 
 #define READ_MESSAGE_DATA()                                                                        \
   {                                                                                                \
+    DG_TRACK_ALLOC(message_data, message.size_bytes);                                              \
     size_t read_bytes = dg_filereader_readdata(thisreader, block, message.size_bytes);             \
     if (read_bytes != message.size_bytes) {                                                        \
       thisptr->error = true;                                                                       \
@@ -443,7 +624,8 @@ void _parse_datatables(dg_parser *thisptr) {
 static void _parse_cmdinfo(dg_parser *thisptr, dg_packet *packet, size_t i) {
   bool should_parse_netmessages =
       !thisptr->demo_version.l4d2_version_finalized || thisptr->parse_netmessages;
-  if (thisptr->m_settings.packet_handler || should_parse_netmessages) {
+  if (thisptr->m_settings.packet_handler || should_parse_netmessages ||
+      thisptr->m_settings.input_timeline) {
     dg_filereader_readdata(thisreader, packet->cmdinfo_raw[i].data,
                            sizeof(packet->cmdinfo_raw[i].data));
   } else {
@@ -463,6 +645,10 @@ void _parse_packet(dg_parser *thisptr, enum dg_type type) {
     _parse_cmdinfo(thisptr, &message, i);
   }
 
+  if (thisptr->m_settings.input_timeline && type == dg_type_packet) {
+    dg_input_timeline_add_cmdinfo(thisptr->m_settings.input_timeline, &message);
+  }
+
   message.in_sequence = dg_filereader_readint32(thisreader);
   message.out_sequence = dg_filereader_readint32(thisreader);
   message.size_bytes = _parser_read_length(thisptr);
@@ -502,6 +688,7 @@ void _parse_stop(dg_parser *thisptr) {
       size_t new_reserve_size = bytes_reserved + bytes_per_read;
       dg_alloc_state* a = dg_parser_packet_allocator(thisptr);
       ptr = dg_alloc_reallocate(a, ptr, bytes_reserved, new_reserve_size, 1);
+      DG_TRACK_ALLOC(message_data, bytes_per_read);
       bytes_reserved = new_reserve_size;
 
       bytesReadIt = dg_filereader_readdata(thisreader, (uint8_t *)ptr + bytes, bytes_per_read);
@@ -557,7 +744,7 @@ void _parse_usercmd(dg_parser *thisptr) {
   message.cmd = dg_filereader_readint32(thisreader);
   message.size_bytes = dg_filereader_readint32(thisreader);
 
-  if (thisptr->m_settings.usercmd_handler) {
+  if (thisptr->m_settings.usercmd_handler || thisptr->m_settings.input_timeline) {
     if (message.size_bytes > 0) {
       dg_alloc_state* a = dg_parser_packet_allocator(thisptr);
       void *block = dg_alloc_allocate(a, message.size_bytes, 1);
@@ -565,7 +752,19 @@ void _parse_usercmd(dg_parser *thisptr) {
     } else {
       message.data = NULL;
     }
-    if (!thisptr->error) {
+
+    if (!thisptr->error && thisptr->m_settings.input_timeline && message.size_bytes > 0) {
+      dg_usercmd_parsed parsed;
+      dg_parse_result result = dg_parser_parse_usercmd(&thisptr->demo_version, &message, &parsed);
+      if (result.error) {
+        thisptr->error = true;
+        thisptr->error_message = result.error_message;
+      } else {
+        dg_input_timeline_add_usercmd(thisptr->m_settings.input_timeline, &parsed);
+      }
+    }
+
+    if (!thisptr->error && thisptr->m_settings.usercmd_handler) {
       thisptr->m_settings.usercmd_handler(&thisptr->state, &message);
     }
   } else {
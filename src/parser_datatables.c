@@ -1,11 +1,14 @@
 #include "parser_datatables.h"
+#include "alloc_telemetry.h"
 #include "demogobbler/alignof_wrapper.h"
 #include "demogobbler/allocator.h"
 #include "demogobbler.h"
 #include "demogobbler/bitstream.h"
 #include "demogobbler/bitwriter.h"
 #include "demogobbler/datatable_types.h"
+#include "demogobbler/hashtable.h"
 #include "parser_entity_state.h"
+#include "writer.h"
 #include "demogobbler/utils.h"
 #include <string.h>
 
@@ -81,12 +84,31 @@ static char *parse_cstring(dg_alloc_state *a, dg_bitstream *stream) {
     stream->overflow = true;
   } else if (!stream->overflow) {
     rval = dg_alloc_allocate(a, size, 1);
+    DG_TRACK_ALLOC(datatables, size);
     memcpy(rval, STRINGBUF, size);
   }
 
   return rval;
 }
 
+// Also computes the length and hash of the string for hashtable lookups
+static char *parse_cstring_hashed(dg_alloc_state *a, dg_bitstream *stream, uint16_t *length,
+                                  uint32_t *hash) {
+  char *rval = parse_cstring(a, stream);
+  *length = 0;
+  *hash = 0;
+
+  if (rval != NULL) {
+    size_t len = strlen(rval);
+    if (len <= UINT16_MAX) {
+      *length = len;
+      *hash = dg_hashtable_hash(rval, len);
+    }
+  }
+
+  return rval;
+}
+
 static unsigned get_flags_from_sendprop(writer *thisptr, dg_sendprop *prop) {
   unsigned flags = 0;
   // hopefully the compiler wizards can generate branchless code from this
@@ -217,7 +239,6 @@ static void parse_sendprop(datatable_parser *thisptr, dg_alloc_state *a, dg_bits
   } else if (prop->flag_exclude) {
     prop->exclude_name = parse_cstring(a, stream);
   } else if (prop->proptype == sendproptype_array) {
-    prop->baseclass = table;
     prop->array_num_elements = dg_bitstream_read_uint(stream, 10);
     prop->array_prop = (prop - 1); // The insidearray prop should be in the previous element
 
@@ -226,7 +247,6 @@ static void parse_sendprop(datatable_parser *thisptr, dg_alloc_state *a, dg_bits
       thisptr->error_message = "Array prop not preceded by insidearray prop";
     }
   } else {
-    prop->baseclass = table;
     prop->prop_.low_value = dg_bitstream_read_float(stream);
     prop->prop_.high_value = dg_bitstream_read_float(stream);
     prop->prop_numbits =
@@ -250,7 +270,7 @@ static void parse_sendtable(datatable_parser *thisptr, dg_alloc_state *a, dg_bit
                             dg_sendtable *ptable) {
   memset(ptable, 0, sizeof(dg_sendtable));
   ptable->needs_decoder = dg_bitstream_read_bit(stream);
-  ptable->name = parse_cstring(a, stream);
+  ptable->name = parse_cstring_hashed(a, stream, &ptable->name_length, &ptable->name_hash);
 
   if (ptable->name == NULL) {
     thisptr->error = true;
@@ -261,6 +281,7 @@ static void parse_sendtable(datatable_parser *thisptr, dg_alloc_state *a, dg_bit
   ptable->prop_count = dg_bitstream_read_uint(stream, thisptr->demo_version->datatable_propcount_bits);
   ptable->props =
       dg_alloc_allocate(a, ptable->prop_count * sizeof(dg_sendprop), alignof(dg_sendprop));
+  DG_TRACK_ALLOC(datatables, ptable->prop_count * sizeof(dg_sendprop));
 
   for (size_t i = 0; i < ptable->prop_count && !ERROR_SET; ++i) {
     parse_sendprop(thisptr, a, stream, ptable, ptable->props + i, i);
@@ -278,7 +299,38 @@ static void parse_serverclass(datatable_parser *thisptr, dg_alloc_state *a, dg_b
   memset(pclass, 0, sizeof(dg_serverclass));
   pclass->serverclass_id = dg_bitstream_read_uint(stream, 16);
   pclass->serverclass_name = parse_cstring(a, stream);
-  pclass->datatable_name = parse_cstring(a, stream);
+  pclass->datatable_name = parse_cstring_hashed(a, stream, &pclass->datatable_name_length,
+                                                &pclass->datatable_name_hash);
+}
+
+// The sendtable array can move while it is being parsed, so the table pointers are only filled in
+// once all of them are in place. Datatable props are resolved to the table they refer to here so
+// that the entity state doesn't have to look them up by name again
+static void resolve_sendtables(datatables *output, dg_alloc_state *allocator) {
+  dg_hashtable names = dg_hashtable_create_ex(output->sendtable_count * 2, allocator);
+
+  for (size_t i = 0; i < output->sendtable_count; ++i) {
+    dg_sendtable *table = output->sendtables + i;
+    dg_hashtable_entry entry;
+    entry.str = table->name;
+    entry.value = i;
+    dg_hashtable_insert_hashed(&names, entry, table->name_length, table->name_hash);
+  }
+
+  for (size_t i = 0; i < output->sendtable_count; ++i) {
+    dg_sendtable *table = output->sendtables + i;
+    for (size_t prop_index = 0; prop_index < table->prop_count; ++prop_index) {
+      dg_sendprop *prop = table->props + prop_index;
+      if (prop->proptype == sendproptype_datatable) {
+        dg_hashtable_entry entry = dg_hashtable_get(&names, prop->dtname);
+        prop->baseclass = entry.str != NULL ? output->sendtables + entry.value : NULL;
+      } else if (!prop->flag_exclude) {
+        prop->baseclass = table;
+      }
+    }
+  }
+
+  dg_hashtable_free(&names);
 }
 
 #undef ERROR_SET
@@ -323,8 +375,8 @@ void dg_write_datatables_parsed(writer *thisptr, dg_datatables_parsed *datatable
 
   if (!thisptr->error) {
     dg_write_preamble(thisptr, datatables->preamble);
-    thisptr->output_funcs.write(thisptr->_stream, &bytes, 4);
-    thisptr->output_funcs.write(thisptr->_stream, writer.ptr, bytes);
+    dg_write_int32(thisptr, bytes);
+    dg_write_data(thisptr, writer.ptr, bytes);
   }
 
   dg_bitwriter_free(&writer);
@@ -345,22 +397,31 @@ dg_datatables_parsed_rval dg_parse_datatables(dg_demver_data *version_data,
   dg_bitstream stream = dg_bitstream_create(input->data, input->size_bytes * 8);
 
   size_t array_size = 1024; // a guess at what the array size could be
-  output.sendtables = malloc(array_size * sizeof(dg_sendtable));
+  output.sendtables = dg_alloc_allocate(allocator, array_size * sizeof(dg_sendtable),
+                                        alignof(dg_sendtable));
+  DG_TRACK_ALLOC(datatables, array_size * sizeof(dg_sendtable));
 
   while (dg_bitstream_read_bit(&stream)) {
     if (output.sendtable_count >= array_size) {
+      output.sendtables = dg_alloc_reallocate(allocator, output.sendtables,
+                                              array_size * sizeof(dg_sendtable),
+                                              array_size * 2 * sizeof(dg_sendtable),
+                                              alignof(dg_sendtable));
+      DG_TRACK_ALLOC(datatables, array_size * sizeof(dg_sendtable));
       array_size <<= 1;
-      output.sendtables = realloc(output.sendtables, array_size * sizeof(dg_sendtable));
     }
     parse_sendtable(&dparser, allocator, &stream, output.sendtables + output.sendtable_count);
     ++output.sendtable_count;
   }
-  //printf("sendtable count %lu\n", output.sendtable_count);
-  dg_alloc_attach(allocator, output.sendtables, array_size * sizeof(dg_sendtable));
+
+  if (!dparser.error && !stream.overflow) {
+    resolve_sendtables(&output, allocator);
+  }
 
   output.serverclass_count = dg_bitstream_read_uint(&stream, 16);
   output.serverclasses = dg_alloc_allocate(
       allocator, output.serverclass_count * sizeof(dg_serverclass), alignof(dg_serverclass));
+  DG_TRACK_ALLOC(datatables, output.serverclass_count * sizeof(dg_serverclass));
 
   for (size_t i = 0; i < output.serverclass_count && !dparser.error; ++i) {
     parse_serverclass(&dparser, allocator, &stream, output.serverclasses + i);
@@ -1,77 +1,240 @@
 #include "parser_entity_state.h"
+#include "alloc_telemetry.h"
 #include "demogobbler/alignof_wrapper.h"
 #include "demogobbler/allocator.h"
 #include "demogobbler.h"
 #include "demogobbler/hashtable.h"
 #include "demogobbler/utils.h"
+#include "threads.h"
+#define XXH_INLINE_ALL
+#include "xxhash.h"
 #include <string.h>
 
-static void free_inner_value(dg_prop_value_inner *value, dg_sendprop *prop);
+static void free_inner_value(dg_alloc_state *allocator, dg_prop_value_inner *value,
+                             dg_sendprop *prop);
 
-dg_eproparr dg_eproparr_init(uint16_t prop_count) {
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+// Storage switches to dense once more than 1 / DENSE_FILL_DIVISOR of the props are set
+enum { DENSE_FILL_DIVISOR = 4 };
+enum { MIN_SPARSE_CAPACITY = 4 };
+// Eager flattening picks at most one thread per this many serverclasses
+enum { MIN_CLASSES_PER_THREAD = 32 };
+
+static size_t eproparr_words(const dg_eproparr *thisptr) { return (thisptr->prop_count + 63) / 64; }
+
+static bool eproparr_has(const dg_eproparr *thisptr, uint16_t index) {
+  return (thisptr->present[index / 64] >> (index & 63)) & 1;
+}
+
+// Number of set props before index
+static uint16_t eproparr_rank(const dg_eproparr *thisptr, uint16_t index) {
+  uint64_t below = (UINT64_C(1) << (index & 63)) - 1;
+  return thisptr->word_ranks[index / 64] + dg_popcount64(thisptr->present[index / 64] & below);
+}
+
+// Prop index of the nth set prop
+static uint16_t eproparr_select(const dg_eproparr *thisptr, uint16_t n) {
+  size_t word = 0;
+  const size_t words = eproparr_words(thisptr);
+  while (word + 1 < words && thisptr->word_ranks[word + 1] <= n) {
+    ++word;
+  }
+
+  uint64_t bits = thisptr->present[word];
+  for (uint16_t i = thisptr->word_ranks[word]; i < n; ++i) {
+    bits &= bits - 1;
+  }
+
+  return word * 64 + dg_ctz64(bits);
+}
+
+static dg_prop_value_inner *eproparr_slot(const dg_eproparr *thisptr, uint16_t index) {
+  if (thisptr->dense) {
+    return thisptr->values + index;
+  } else {
+    return thisptr->values + eproparr_rank(thisptr, index);
+  }
+}
+
+static uint32_t eproparr_present_bytes(const dg_eproparr *thisptr) {
+  return (sizeof(uint64_t) + sizeof(uint16_t)) * eproparr_words(thisptr);
+}
+
+static void eproparr_make_dense(dg_eproparr *thisptr) {
+  dg_prop_value_inner *values =
+      dg_alloc_allocate(thisptr->allocator, sizeof(dg_prop_value_inner) * thisptr->prop_count,
+                        alignof(dg_prop_value_inner));
+  memset(values, 0, sizeof(dg_prop_value_inner) * thisptr->prop_count);
+  DG_TRACK_ALLOC(eproparr, sizeof(dg_prop_value_inner) * thisptr->prop_count);
+
+  const size_t words = eproparr_words(thisptr);
+  size_t packed_index = 0;
+
+  for (size_t word = 0; word < words; ++word) {
+    uint64_t bits = thisptr->present[word];
+    while (bits) {
+      size_t index = word * 64 + dg_ctz64(bits);
+      values[index] = thisptr->values[packed_index++];
+      bits &= bits - 1;
+    }
+  }
+
+  dg_alloc_free(thisptr->allocator, thisptr->values,
+                sizeof(dg_prop_value_inner) * thisptr->value_capacity);
+  DG_TRACK_FREE(eproparr, sizeof(dg_prop_value_inner) * thisptr->value_capacity);
+  thisptr->values = values;
+  thisptr->value_capacity = thisptr->prop_count;
+  thisptr->dense = true;
+}
+
+dg_eproparr dg_eproparr_init(uint16_t prop_count) { return dg_eproparr_init_ex(prop_count, NULL); }
+
+dg_eproparr dg_eproparr_init_ex(uint16_t prop_count, dg_alloc_state *allocator) {
   dg_eproparr output;
   memset(&output, 0, sizeof(output));
   output.prop_count = prop_count;
+  output.allocator = allocator != NULL ? allocator : dg_heap_allocator();
 
   return output;
 }
 
-dg_prop_value_inner *dg_eproparr_get(dg_eproparr *thisptr, uint16_t index, bool *new_prop) {
-  if (!thisptr->next_prop_indices) {
-    thisptr->next_prop_indices = malloc(sizeof(uint16_t) * (thisptr->prop_count + 1));
-    thisptr->values = malloc(sizeof(dg_prop_value_inner) * thisptr->prop_count);
-    thisptr->next_prop_indices[0] = thisptr->prop_count;
-    memset(thisptr->next_prop_indices + 1, 0, sizeof(uint16_t) * thisptr->prop_count);
-    memset(thisptr->values, 0, sizeof(dg_prop_value_inner) * thisptr->prop_count);
-  }
-
-  uint16_t *prop_index_ptr = thisptr->next_prop_indices + index + 1;
-  if (*prop_index_ptr == 0) {
-    uint16_t *prev_ptr = prop_index_ptr;
-    // First index always either points to first element
-    // or is the end-of-array index so no need to bounds check
-    while (*prev_ptr == 0) {
-      --prev_ptr;
-    }
-    *prop_index_ptr = *prev_ptr;
-    *prev_ptr = index;
-    *new_prop = true;
+// Kept out of line so that the lookup of an existing prop stays small
+static NOINLINE dg_prop_value_inner *eproparr_insert(dg_eproparr *thisptr, uint16_t index) {
+  const size_t words = eproparr_words(thisptr);
+  if (!thisptr->present) {
+    size_t bytes = eproparr_present_bytes(thisptr);
+    thisptr->present = dg_alloc_allocate(thisptr->allocator, bytes, alignof(uint64_t));
+    DG_TRACK_ALLOC(eproparr, bytes);
+    memset(thisptr->present, 0, bytes);
+    thisptr->word_ranks = (uint16_t *)(thisptr->present + words);
+  }
+
+  if (!thisptr->dense && (thisptr->value_count + 1) * DENSE_FILL_DIVISOR > thisptr->prop_count) {
+    eproparr_make_dense(thisptr);
+  }
+
+  thisptr->present[index / 64] |= UINT64_C(1) << (index & 63);
+  for (size_t word = index / 64 + 1; word < words; ++word) {
+    ++thisptr->word_ranks[word];
+  }
+  ++thisptr->value_count;
+
+  dg_prop_value_inner *value;
+
+  if (thisptr->dense) {
+    value = thisptr->values + index;
   } else {
+    if (thisptr->value_count > thisptr->value_capacity) {
+      size_t capacity = MAX(thisptr->value_capacity * 2, MIN_SPARSE_CAPACITY);
+      capacity = MIN(capacity, thisptr->prop_count);
+      thisptr->values = dg_alloc_reallocate(
+          thisptr->allocator, thisptr->values, sizeof(dg_prop_value_inner) * thisptr->value_capacity,
+          sizeof(dg_prop_value_inner) * capacity, alignof(dg_prop_value_inner));
+      DG_TRACK_ALLOC(eproparr, sizeof(dg_prop_value_inner) * (capacity - thisptr->value_capacity));
+      thisptr->value_capacity = capacity;
+    }
+
+    // Shift the props after this one to make room in the packed array
+    uint16_t packed_index = eproparr_rank(thisptr, index);
+    value = thisptr->values + packed_index;
+    memmove(value + 1, value,
+            sizeof(dg_prop_value_inner) * (thisptr->value_count - 1 - packed_index));
+  }
+
+  memset(value, 0, sizeof(dg_prop_value_inner));
+  return value;
+}
+
+dg_prop_value_inner *dg_eproparr_get(dg_eproparr *thisptr, uint16_t index, bool *new_prop) {
+  if (thisptr->present && eproparr_has(thisptr, index)) {
     *new_prop = false;
+    return eproparr_slot(thisptr, index);
   }
 
-  return thisptr->values + index;
+  *new_prop = true;
+  return eproparr_insert(thisptr, index);
+}
+
+dg_prop_value_inner *dg_eproparr_find(const dg_eproparr *thisptr, dg_prop_handle handle) {
+  if (!thisptr->present || handle.prop_index >= thisptr->prop_count ||
+      !eproparr_has(thisptr, handle.prop_index)) {
+    return NULL;
+  }
+
+  dg_prop_value_inner *value = eproparr_slot(thisptr, handle.prop_index);
+
+  if (handle.array_index >= 0) {
+    if (value->arr_val == NULL || (size_t)handle.array_index >= value->arr_val->array_size) {
+      return NULL;
+    }
+    return value->arr_val->values + handle.array_index;
+  }
+
+  return value;
 }
 
 void dg_eproparr_free(dg_eproparr *thisptr) {
-  free(thisptr->next_prop_indices);
-  free(thisptr->values);
+  if (thisptr->values) {
+    dg_alloc_free(thisptr->allocator, thisptr->values,
+                  sizeof(dg_prop_value_inner) * thisptr->value_capacity);
+    DG_TRACK_FREE(eproparr, sizeof(dg_prop_value_inner) * thisptr->value_capacity);
+  }
+  if (thisptr->present) {
+    dg_alloc_free(thisptr->allocator, thisptr->present, eproparr_present_bytes(thisptr));
+    DG_TRACK_FREE(eproparr, eproparr_present_bytes(thisptr));
+  }
+}
+
+uint16_t dg_eproparr_index(const dg_eproparr *thisptr, const dg_prop_value_inner *value) {
+  if (thisptr->dense) {
+    return value - thisptr->values;
+  } else {
+    return eproparr_select(thisptr, value - thisptr->values);
+  }
 }
 
 dg_prop_value_inner *dg_eproparr_next(const dg_eproparr *thisptr, dg_prop_value_inner *current) {
-  if (!thisptr->next_prop_indices) {
+  if (thisptr->value_count == 0) {
     return NULL;
   }
 
-  size_t index;
-  if (current == NULL) {
-    index = 0;
-  } else {
-    index = (current - thisptr->values) + 1;
+  if (!thisptr->dense) {
+    // Packed values are already in prop index order
+    size_t next = current == NULL ? 0 : (current - thisptr->values) + 1;
+    return next < thisptr->value_count ? thisptr->values + next : NULL;
   }
-  uint16_t next_index = thisptr->next_prop_indices[index];
-  if (next_index == thisptr->prop_count) {
-    return NULL;
-  } else {
-    return thisptr->values + next_index;
+
+  size_t index = current == NULL ? 0 : (current - thisptr->values) + 1;
+  const size_t words = eproparr_words(thisptr);
+
+  for (size_t word = index / 64; word < words; ++word) {
+    uint64_t bits = thisptr->present[word];
+    if (word == index / 64) {
+      bits &= ~((UINT64_C(1) << (index & 63)) - 1);
+    }
+
+    if (bits) {
+      return thisptr->values + word * 64 + dg_ctz64(bits);
+    }
   }
+
+  return NULL;
 }
 
-dg_eproplist dg_eproplist_init(void) {
+dg_eproplist dg_eproplist_init(void) { return dg_eproplist_init_ex(NULL); }
+
+dg_eproplist dg_eproplist_init_ex(dg_alloc_state *allocator) {
   dg_eproplist list;
   memset(&list, 0, sizeof(dg_eproplist));
-  list.head = malloc(sizeof(dg_epropnode));
+  list.allocator = allocator != NULL ? allocator : dg_heap_allocator();
+  list.head = dg_alloc_allocate(list.allocator, sizeof(dg_epropnode), alignof(dg_epropnode));
   memset(list.head, 0, sizeof(dg_epropnode));
+  DG_TRACK_ALLOC(eproplist, sizeof(dg_epropnode));
   list.head->index = -1;
   return list;
 }
@@ -96,8 +259,9 @@ dg_epropnode *dg_eproplist_get(dg_eproplist *thisptr, dg_epropnode *initial_gues
     *new_prop = false;
   } else {
     // Did not match, insert a new node either in the middle or back of the list
-    rval = malloc(sizeof(dg_epropnode));
+    rval = dg_alloc_allocate(thisptr->allocator, sizeof(dg_epropnode), alignof(dg_epropnode));
     memset(rval, 0, sizeof(dg_epropnode));
+    DG_TRACK_ALLOC(eproplist, sizeof(dg_epropnode));
     rval->next = current->next;
     current->next = rval;
     *new_prop = true;
@@ -116,27 +280,36 @@ static void dg_eproplist_freeprops(dg_eproplist *thisptr, dg_serverclass_data *d
   dg_epropnode *node = thisptr->head;
   // Free the sentinel node from the beginning
   dg_epropnode *temp = node->next;
-  free(node);
+  dg_alloc_free(thisptr->allocator, node, sizeof(dg_epropnode));
+  DG_TRACK_FREE(eproplist, sizeof(dg_epropnode));
   node = temp;
 
   while (node) {
     temp = node->next;
     dg_sendprop *prop = data->props + node->index;
-    free_inner_value(&node->value, prop);
-    free(node);
+    free_inner_value(thisptr->allocator, &node->value, prop);
+    dg_alloc_free(thisptr->allocator, node, sizeof(dg_epropnode));
+    DG_TRACK_FREE(eproplist, sizeof(dg_epropnode));
     node = temp;
   }
 }
 #else
 static void dg_eproparr_freeprops(dg_eproparr *thisptr, dg_serverclass_data *data) {
-  dg_prop_value_inner *value = dg_eproparr_next(thisptr, NULL);
-
-  while (value) {
-    size_t index = value - thisptr->values;
-    dg_sendprop *prop = data->props + index;
-    dg_prop_value_inner *next = dg_eproparr_next(thisptr, value);
-    free_inner_value(value, prop);
-    value = next;
+  if (!thisptr->present)
+    return;
+
+  const size_t words = eproparr_words(thisptr);
+  size_t packed_index = 0;
+
+  for (size_t word = 0; word < words; ++word) {
+    uint64_t bits = thisptr->present[word];
+    while (bits) {
+      size_t index = word * 64 + dg_ctz64(bits);
+      dg_prop_value_inner *value =
+          thisptr->dense ? thisptr->values + index : thisptr->values + packed_index++;
+      free_inner_value(thisptr->allocator, value, data->props + index);
+      bits &= bits - 1;
+    }
   }
 }
 #endif
@@ -146,154 +319,267 @@ void dg_eproplist_free(dg_eproplist *thisptr) {
 
   while (node) {
     dg_epropnode *temp = node->next;
-    free(node);
+    dg_alloc_free(thisptr->allocator, node, sizeof(dg_epropnode));
+    DG_TRACK_FREE(eproplist, sizeof(dg_epropnode));
     node = temp;
   }
 }
 
 typedef struct {
   size_t max_props;
-  dg_pes excluded_props;
-  dg_hashtable dts_with_excludes;
   size_t dt_index;
   size_t serverclass_index;
-  size_t flattenedprop_index;
-  uint16_t baseclass_array[1024];
   size_t baseclass_count;
-  size_t baseclass_index;
 } propdata;
 
 typedef struct {
   estate_init_args args;
+  uint32_t flatten_threads;
   estate *entity_state;
   entity_parse_scrap *ent_scrap;
   dg_alloc_state* allocator;
+  dg_alloc_state *heap_allocator;
   const char *error_message;
   bool error;
 } estate_init_state;
 
-static void add_baseclass(propdata *data, size_t dt_index) {
-  ++data->baseclass_count;
-
-  if (data->baseclass_count > 1024) {
-    abort();
+static void add_baseclass(estate_init_state *thisptr, propdata *data, uint32_t dt_index) {
+  dg_flatten_scratch *scratch = &thisptr->ent_scrap->scratch;
+  if (data->baseclass_count == scratch->baseclass_capacity) {
+    size_t capacity = MAX(scratch->baseclass_capacity * 2, 64);
+    scratch->baseclasses = dg_alloc_reallocate(
+        thisptr->heap_allocator, scratch->baseclasses, sizeof(uint32_t) * scratch->baseclass_capacity,
+        sizeof(uint32_t) * capacity, alignof(uint32_t));
+    scratch->baseclass_capacity = capacity;
   }
 
-  memmove(data->baseclass_array + data->baseclass_index + 1,
-          data->baseclass_array + data->baseclass_index,
-          sizeof(size_t) * data->baseclass_count - data->baseclass_index);
-  data->baseclass_array[data->baseclass_index] = dt_index;
-}
-
-static uint16_t get_baseclass_from_array(propdata *data, size_t index) {
-  return data->baseclass_array[index];
-}
-
-// Returns true if either dg_hashtable gets completely full
-static bool add_exclude(propdata *data, dg_sendprop *prop) {
-  dg_pes_insert(&data->excluded_props, prop);
-  dg_hashtable_entry entry;
-  entry.str = prop->exclude_name;
-  entry.value = 0;
-  dg_hashtable_insert(&data->dts_with_excludes, entry);
-  return data->excluded_props.item_count != data->excluded_props.max_items &&
-         data->dts_with_excludes.item_count != data->dts_with_excludes.max_items;
+  scratch->baseclasses[data->baseclass_count++] = dt_index;
 }
 
-static bool does_datatable_have_excludes(propdata *data, dg_sendtable *table) {
-  dg_hashtable_entry entry = dg_hashtable_get(&data->dts_with_excludes, table->name);
-  return entry.str != NULL;
+static uint32_t prop_id(estate_init_state *thisptr, size_t dt_index, size_t prop_index) {
+  return thisptr->ent_scrap->index.prop_offsets[dt_index] + prop_index;
 }
 
-static bool is_prop_excluded(propdata *data, dg_sendtable *table, dg_sendprop *prop) {
-  return dg_pes_has(&data->excluded_props, table, prop);
+static bool is_prop_excluded(estate_init_state *thisptr, uint32_t id) {
+  const dg_flatten_scratch *scratch = &thisptr->ent_scrap->scratch;
+  return scratch->excluded_stamps[id] == scratch->stamp;
 }
 
 static void create_dt_hashtable(estate_init_state *thisptr) {
   dg_sendtable *sendtables = thisptr->entity_state->sendtables;
   const size_t sendtable_count = thisptr->entity_state->sendtable_count;
-  const float FILL_RATE = 0.9f;
-  const size_t buckets = (size_t)(sendtable_count / FILL_RATE);
 
-  if (thisptr->ent_scrap->dt_hashtable.arr != NULL) {
+  if (thisptr->ent_scrap->dt_hashtable.slots != NULL) {
     dg_hashtable_clear(&thisptr->ent_scrap->dt_hashtable);
   } else {
-    thisptr->ent_scrap->dt_hashtable = dg_hashtable_create(buckets);
+    thisptr->ent_scrap->dt_hashtable =
+        dg_hashtable_create_ex(sendtable_count, thisptr->heap_allocator);
   }
 
   for (size_t i = 0; i < sendtable_count && !thisptr->error; ++i) {
+    dg_sendtable *table = sendtables + i;
     dg_hashtable_entry entry;
-    entry.str = sendtables[i].name;
+    entry.str = table->name;
     entry.value = i;
+    bool inserted;
 
-    if (!dg_hashtable_insert(&thisptr->ent_scrap->dt_hashtable, entry)) {
+    // Parsed datatables come with the name hashed already
+    if (table->name_length != 0) {
+      inserted = dg_hashtable_insert_hashed(&thisptr->ent_scrap->dt_hashtable, entry,
+                                            table->name_length, table->name_hash);
+    } else {
+      inserted = dg_hashtable_insert(&thisptr->ent_scrap->dt_hashtable, entry);
+    }
+
+    if (!inserted) {
       thisptr->error = true;
-      thisptr->error_message = "Hashtable collision with datatable names or ran out of space";
+      thisptr->error_message = "Duplicate datatable name";
     }
   }
 }
 
-static size_t get_baseclass(estate_init_state *thisptr, propdata *data, dg_sendprop *prop) {
+static int32_t find_sendtable(estate_init_state *thisptr, const dg_sendtable *table,
+                              const char *name) {
   dg_sendtable *sendtables = thisptr->entity_state->sendtables;
-  if (prop->baseclass == NULL) {
-    dg_hashtable_entry entry = dg_hashtable_get(&thisptr->ent_scrap->dt_hashtable, prop->dtname);
+  if (table >= sendtables && table < sendtables + thisptr->entity_state->sendtable_count) {
+    return table - sendtables;
+  }
 
-    if (entry.str == NULL) {
-      // No entry found
-      thisptr->error = true;
-      thisptr->error_message = "Was unable to find datatable pointed to by sendprop";
-      return 0;
+  dg_hashtable_entry entry = dg_hashtable_get(&thisptr->ent_scrap->dt_hashtable, name);
+  return entry.str != NULL ? (int32_t)entry.value : -1;
+}
+
+// Resolve every datatable and exclude prop to integer ids so that flattening a serverclass does
+// no string hashing or comparisons. Parsed datatables already point datatable props at their
+// table, the names are only looked up for props that don't
+static void build_flatten_index(estate_init_state *thisptr) {
+  dg_flatten_index *index = &thisptr->ent_scrap->index;
+  dg_sendtable *sendtables = thisptr->entity_state->sendtables;
+  const size_t sendtable_count = thisptr->entity_state->sendtable_count;
+
+  dg_alloc_state *heap = thisptr->heap_allocator;
+  index->prop_offsets =
+      dg_alloc_allocate(heap, sizeof(uint32_t) * (sendtable_count + 1), alignof(uint32_t));
+  index->prop_count = 0;
+  for (size_t i = 0; i < sendtable_count; ++i) {
+    index->prop_offsets[i] = index->prop_count;
+    index->prop_count += sendtables[i].prop_count;
+  }
+  index->prop_offsets[sendtable_count] = index->prop_count;
+
+  index->datatable_ids =
+      dg_alloc_allocate(heap, sizeof(int32_t) * MAX(index->prop_count, 1), alignof(int32_t));
+  index->exclude_offsets =
+      dg_alloc_allocate(heap, sizeof(uint32_t) * (index->prop_count + 1), alignof(uint32_t));
+  size_t target_count = 0;
+
+  // First pass resolves tables and counts the excluded props, second one fills them in
+  for (size_t i = 0; i < sendtable_count; ++i) {
+    dg_sendtable *table = sendtables + i;
+    for (size_t prop_index = 0; prop_index < table->prop_count; ++prop_index) {
+      dg_sendprop *prop = table->props + prop_index;
+      uint32_t id = index->prop_offsets[i] + prop_index;
+      index->datatable_ids[id] = -1;
+      index->exclude_offsets[id] = target_count;
+
+      if (prop->proptype == sendproptype_datatable) {
+        index->datatable_ids[id] = find_sendtable(thisptr, prop->baseclass, prop->dtname);
+      } else if (prop->flag_exclude) {
+        int32_t excluded_table = find_sendtable(thisptr, NULL, prop->exclude_name);
+        if (excluded_table != -1) {
+          dg_sendtable *target = sendtables + excluded_table;
+          for (size_t target_index = 0; target_index < target->prop_count; ++target_index) {
+            if (strcmp(target->props[target_index].name, prop->name) == 0) {
+              ++target_count;
+            }
+          }
+        }
+      }
     }
-    prop->baseclass = sendtables + entry.value;
   }
-  return prop->baseclass - sendtables;
+  index->exclude_offsets[index->prop_count] = target_count;
+  index->exclude_target_count = target_count;
+  index->exclude_targets =
+      dg_alloc_allocate(heap, sizeof(uint32_t) * MAX(target_count, 1), alignof(uint32_t));
+
+  for (size_t i = 0; i < sendtable_count; ++i) {
+    dg_sendtable *table = sendtables + i;
+    for (size_t prop_index = 0; prop_index < table->prop_count; ++prop_index) {
+      dg_sendprop *prop = table->props + prop_index;
+      uint32_t id = index->prop_offsets[i] + prop_index;
+      if (!prop->flag_exclude || prop->proptype == sendproptype_datatable) {
+        continue;
+      }
+
+      int32_t excluded_table = find_sendtable(thisptr, NULL, prop->exclude_name);
+      if (excluded_table != -1) {
+        dg_sendtable *target = sendtables + excluded_table;
+        uint32_t *dest = index->exclude_targets + index->exclude_offsets[id];
+        for (size_t target_index = 0; target_index < target->prop_count; ++target_index) {
+          if (strcmp(target->props[target_index].name, prop->name) == 0) {
+            *dest++ = index->prop_offsets[excluded_table] + target_index;
+          }
+        }
+      }
+    }
+  }
+}
+
+static void flatten_index_free(dg_flatten_index *thisptr, uint32_t sendtable_count,
+                               dg_alloc_state *heap) {
+  if (thisptr->prop_offsets) {
+    dg_alloc_free(heap, thisptr->prop_offsets, sizeof(uint32_t) * (sendtable_count + 1));
+    dg_alloc_free(heap, thisptr->datatable_ids, sizeof(int32_t) * MAX(thisptr->prop_count, 1));
+    dg_alloc_free(heap, thisptr->exclude_offsets, sizeof(uint32_t) * (thisptr->prop_count + 1));
+    dg_alloc_free(heap, thisptr->exclude_targets,
+                  sizeof(uint32_t) * MAX(thisptr->exclude_target_count, 1));
+  }
+  memset(thisptr, 0, sizeof(*thisptr));
+}
+
+static void flatten_scratch_init(dg_flatten_scratch *thisptr, uint32_t prop_count,
+                                 dg_alloc_state *heap) {
+  memset(thisptr, 0, sizeof(*thisptr));
+  thisptr->stamp_count = MAX(prop_count, 1);
+  thisptr->excluded_stamps =
+      dg_alloc_allocate(heap, sizeof(uint32_t) * thisptr->stamp_count, alignof(uint32_t));
+  memset(thisptr->excluded_stamps, 0, sizeof(uint32_t) * thisptr->stamp_count);
+}
+
+static void flatten_scratch_free(dg_flatten_scratch *thisptr, dg_alloc_state *heap) {
+  if (thisptr->excluded_stamps) {
+    dg_alloc_free(heap, thisptr->excluded_stamps, sizeof(uint32_t) * thisptr->stamp_count);
+  }
+  if (thisptr->baseclasses) {
+    dg_alloc_free(heap, thisptr->baseclasses, sizeof(uint32_t) * thisptr->baseclass_capacity);
+  }
+  memset(thisptr, 0, sizeof(*thisptr));
+}
+
+// Start a new serverclass, which invalidates all previous exclusions
+static void flatten_scratch_next(dg_flatten_scratch *thisptr, uint32_t prop_count) {
+  ++thisptr->stamp;
+  if (thisptr->stamp == 0) {
+    memset(thisptr->excluded_stamps, 0, sizeof(uint32_t) * prop_count);
+    thisptr->stamp = 1;
+  }
+}
+
+static size_t get_baseclass(estate_init_state *thisptr, uint32_t id) {
+  int32_t dt_index = thisptr->ent_scrap->index.datatable_ids[id];
+  if (dt_index == -1) {
+    thisptr->error = true;
+    thisptr->error_message = "Was unable to find datatable pointed to by sendprop";
+    return 0;
+  }
+  return dt_index;
 }
 
 static void gather_excludes(estate_init_state *thisptr, propdata *data, size_t datatable_index) {
   dg_sendtable *table = thisptr->entity_state->sendtables + datatable_index;
+  const dg_flatten_index *index = &thisptr->ent_scrap->index;
+  dg_flatten_scratch *scratch = &thisptr->ent_scrap->scratch;
 
   for (size_t prop_index = 0; prop_index < table->prop_count; ++prop_index) {
     dg_sendprop *prop = table->props + prop_index;
+    uint32_t id = prop_id(thisptr, datatable_index, prop_index);
 
     if (prop->proptype == sendproptype_datatable) {
-      size_t baseclass_index = get_baseclass(thisptr, data, prop);
+      size_t baseclass_index = get_baseclass(thisptr, id);
 
       if (thisptr->error)
         return;
 
       gather_excludes(thisptr, data, baseclass_index);
     } else if (prop->flag_exclude) {
-      if (!add_exclude(data, prop)) {
-        thisptr->error = true;
-        thisptr->error_message = "Was unable to add exclude";
+      for (uint32_t i = index->exclude_offsets[id]; i < index->exclude_offsets[id + 1]; ++i) {
+        scratch->excluded_stamps[index->exclude_targets[i]] = scratch->stamp;
       }
     }
   }
 }
 
 static void gather_propdata(estate_init_state *thisptr, propdata *data, size_t datatable_index) {
-  dg_sendtable *sendtables = thisptr->entity_state->sendtables;
-  dg_sendtable *table = sendtables + datatable_index;
-  bool table_has_excludes = does_datatable_have_excludes(data, table);
+  dg_sendtable *table = thisptr->entity_state->sendtables + datatable_index;
 
   for (size_t prop_index = 0; prop_index < table->prop_count; ++prop_index) {
     dg_sendprop *prop = table->props + prop_index;
-    bool prop_excluded = table_has_excludes && is_prop_excluded(data, table, prop);
-    if (prop_excluded)
+    uint32_t id = prop_id(thisptr, datatable_index, prop_index);
+    if (is_prop_excluded(thisptr, id))
       continue;
 
     if (prop->proptype == sendproptype_datatable) {
-      size_t baseclass_index = get_baseclass(thisptr, data, prop);
+      size_t baseclass_index = get_baseclass(thisptr, id);
 
       if (thisptr->error)
         return;
 
+      gather_propdata(thisptr, data, baseclass_index);
+
+      // Props of non-collapsible baseclasses are sent before the table's own props, deepest
+      // baseclass first
       if (!prop->flag_collapsible) {
-        add_baseclass(data, baseclass_index);
-        gather_propdata(thisptr, data, baseclass_index);
-        ++data->baseclass_index;
-      } else {
-        gather_propdata(thisptr, data, baseclass_index);
+        add_baseclass(thisptr, data, baseclass_index);
       }
     } else if (!prop->flag_insidearray && !prop->flag_exclude) {
       ++data->max_props;
@@ -353,36 +639,79 @@ static void sort_props(estate_init_state *thisptr, dg_serverclass_data *class_da
   }
 }
 
-static void iterate_props(estate_init_state *thisptr, propdata *data, dg_sendtable *table) {
-  bool table_has_excludes = does_datatable_have_excludes(data, table);
+static void iterate_props(estate_init_state *thisptr, propdata *data, size_t datatable_index) {
+  dg_sendtable *table = thisptr->entity_state->sendtables + datatable_index;
+  dg_serverclass_data *class_data = thisptr->entity_state->class_datas + data->serverclass_index;
+
   for (size_t prop_index = 0; prop_index < table->prop_count; ++prop_index) {
     dg_sendprop *prop = table->props + prop_index;
+    uint32_t id = prop_id(thisptr, datatable_index, prop_index);
     if (prop->proptype == sendproptype_datatable) {
-      if (prop->flag_collapsible)
-        iterate_props(thisptr, data, prop->baseclass);
-    } else if (!prop->flag_exclude && !prop->flag_insidearray) {
-      bool prop_excluded = table_has_excludes && is_prop_excluded(data, table, prop);
-      if (!prop_excluded) {
-        size_t flattenedprop_index =
-            thisptr->entity_state->class_datas[data->serverclass_index].prop_count;
-        dg_sendprop *dest =
-            thisptr->entity_state->class_datas[data->serverclass_index].props + flattenedprop_index;
-        memcpy(dest, prop, sizeof(dg_sendprop));
-        ++thisptr->entity_state->class_datas[data->serverclass_index].prop_count;
+      if (prop->flag_collapsible) {
+        size_t baseclass_index = get_baseclass(thisptr, id);
+        if (thisptr->error)
+          return;
+        iterate_props(thisptr, data, baseclass_index);
       }
+    } else if (!prop->flag_exclude && !prop->flag_insidearray && !is_prop_excluded(thisptr, id)) {
+      memcpy(class_data->props + class_data->prop_count, prop, sizeof(dg_sendprop));
+      ++class_data->prop_count;
     }
   }
 }
 
 static void gather_props(estate_init_state *thisptr, propdata *data) {
-  dg_sendtable *sendtables = thisptr->entity_state->sendtables;
-  for (size_t i = 0; i < data->baseclass_count; ++i) {
-    uint16_t baseclass_index = get_baseclass_from_array(data, i);
-    dg_sendtable *table = sendtables + baseclass_index;
-    iterate_props(thisptr, data, table);
+  const uint32_t *baseclasses = thisptr->ent_scrap->scratch.baseclasses;
+  for (size_t i = 0; i < data->baseclass_count && !thisptr->error; ++i) {
+    iterate_props(thisptr, data, baseclasses[i]);
   }
 
-  iterate_props(thisptr, data, sendtables + data->dt_index);
+  iterate_props(thisptr, data, data->dt_index);
+}
+
+static uint32_t propname_hash(const char *table_name, const char *prop_name) {
+  // Same as hashing "table.prop" in one go, without building the string
+  XXH32_state_t state;
+  XXH32_reset(&state, 0);
+  XXH32_update(&state, table_name, strlen(table_name));
+  XXH32_update(&state, ".", 1);
+  XXH32_update(&state, prop_name, strlen(prop_name));
+  return XXH32_digest(&state);
+}
+
+static bool propname_equal(const dg_sendprop *prop, const char *name, size_t length) {
+  const char *table_name = prop->baseclass->name;
+  size_t table_length = strlen(table_name);
+  size_t prop_length = strlen(prop->name);
+
+  return length == table_length + 1 + prop_length && memcmp(name, table_name, table_length) == 0 &&
+         name[table_length] == '.' &&
+         memcmp(name + table_length + 1, prop->name, prop_length) == 0;
+}
+
+void dg_build_name_index(dg_serverclass_data *class_data, dg_alloc_state *allocator) {
+  size_t size = 1;
+  while (size < class_data->prop_count * 2)
+    size <<= 1;
+
+  size_t array_size = sizeof(dg_propname_entry) * size;
+  class_data->name_index =
+      dg_alloc_allocate(allocator, array_size, alignof(dg_propname_entry));
+  class_data->name_index_size = size;
+  memset(class_data->name_index, 0, array_size);
+
+  for (size_t i = 0; i < class_data->prop_count; ++i) {
+    dg_sendprop *prop = class_data->props + i;
+    uint32_t hash = propname_hash(prop->baseclass->name, prop->name);
+    size_t slot = hash & (size - 1);
+
+    while (class_data->name_index[slot].prop_index != 0) {
+      slot = (slot + 1) & (size - 1);
+    }
+
+    class_data->name_index[slot].hash = hash;
+    class_data->name_index[slot].prop_index = i + 1;
+  }
 }
 
 #define CHECK_ERR()                                                                                \
@@ -393,13 +722,16 @@ static void parse_serverclass(estate_init_state *thisptr, size_t i) {
   // Reset iteration state
   propdata data;
   memset(&data, 0, sizeof(propdata));
-  data.excluded_props = thisptr->ent_scrap->excluded_props;
-  data.dts_with_excludes = thisptr->ent_scrap->dts_with_excludes;
   data.serverclass_index = i;
 
   dg_serverclass *cls = thisptr->entity_state->serverclasses + i;
-  dg_hashtable_entry entry =
-      dg_hashtable_get(&thisptr->ent_scrap->dt_hashtable, cls->datatable_name);
+  dg_hashtable_entry entry;
+  if (cls->datatable_name_length != 0) {
+    entry = dg_hashtable_get_hashed(&thisptr->ent_scrap->dt_hashtable, cls->datatable_name,
+                                    cls->datatable_name_length, cls->datatable_name_hash);
+  } else {
+    entry = dg_hashtable_get(&thisptr->ent_scrap->dt_hashtable, cls->datatable_name);
+  }
   data.dt_index = entry.value;
 
   if (entry.str == NULL) {
@@ -408,8 +740,7 @@ static void parse_serverclass(estate_init_state *thisptr, size_t i) {
     goto end;
   }
 
-  data.dts_with_excludes.item_count = 0;
-  dg_pes_clear(&data.excluded_props);
+  flatten_scratch_next(&thisptr->ent_scrap->scratch, thisptr->ent_scrap->index.prop_count);
   gather_excludes(thisptr, &data, data.dt_index);
   CHECK_ERR();
   gather_propdata(thisptr, &data, data.dt_index);
@@ -426,10 +757,155 @@ static void parse_serverclass(estate_init_state *thisptr, size_t i) {
   CHECK_ERR();
   sort_props(thisptr, thisptr->entity_state->class_datas + i);
   CHECK_ERR();
+  dg_build_name_index(thisptr->entity_state->class_datas + i, thisptr->allocator);
 end:;
 }
 
+// Allocator shared between flattening threads
+typedef struct {
+  dg_alloc_state *inner;
+  dg_mutex mutex;
+} locked_allocator;
+
+static void *locked_alloc(void *allocator, uint32_t size, uint32_t alignment) {
+  locked_allocator *thisptr = allocator;
+  dg_mutex_lock(&thisptr->mutex);
+  void *ptr = dg_alloc_allocate(thisptr->inner, size, alignment);
+  dg_mutex_unlock(&thisptr->mutex);
+  return ptr;
+}
+
+static void *locked_realloc(void *allocator, void *ptr, uint32_t prev_size, uint32_t size,
+                            uint32_t alignment) {
+  locked_allocator *thisptr = allocator;
+  dg_mutex_lock(&thisptr->mutex);
+  void *out = dg_alloc_reallocate(thisptr->inner, ptr, prev_size, size, alignment);
+  dg_mutex_unlock(&thisptr->mutex);
+  return out;
+}
+
+static void locked_dealloc(void *allocator, void *ptr, uint32_t size) {
+  locked_allocator *thisptr = allocator;
+  dg_mutex_lock(&thisptr->mutex);
+  dg_alloc_free(thisptr->inner, ptr, size);
+  dg_mutex_unlock(&thisptr->mutex);
+}
+
+// Flattening only allocates, reallocates and frees
+static dg_alloc_state locked_allocator_init(locked_allocator *lock, dg_alloc_state *inner) {
+  lock->inner = inner;
+  dg_mutex_init(&lock->mutex);
+  dg_alloc_state out;
+  memset(&out, 0, sizeof(out));
+  out.allocator = lock;
+  out.alloc = locked_alloc;
+  out.realloc = locked_realloc;
+  out.dealloc = locked_dealloc;
+  return out;
+}
+
+typedef struct {
+  estate_init_state state;
+  entity_parse_scrap scrap;
+  size_t first;
+  size_t stride;
+  bool started;
+  dg_thread thread;
+} flatten_worker;
+
+static void flatten_worker_main(void *arg) {
+  flatten_worker *worker = arg;
+  const size_t count = worker->state.entity_state->serverclass_count;
+  for (size_t i = worker->first; i < count && !worker->state.error; i += worker->stride) {
+    parse_serverclass(&worker->state, i);
+  }
+}
+
+static uint32_t flatten_thread_count(uint32_t threads, size_t serverclass_count) {
+  if (threads == DG_FLATTEN_THREADS_AUTO) {
+    // Starting a thread is only worth it with enough classes to go around
+    threads = MIN(dg_hardware_concurrency(), serverclass_count / MIN_CLASSES_PER_THREAD);
+  }
+
+  return MAX(MIN(threads, serverclass_count), 1);
+}
+
+// Flatten all serverclasses, each thread has its own exclude scratch and writes its results
+// into the preallocated class_datas
+static void flatten_serverclasses(estate_init_state *thisptr) {
+  const size_t count = thisptr->entity_state->serverclass_count;
+  const uint32_t thread_count = flatten_thread_count(thisptr->flatten_threads, count);
+
+  if (thread_count == 1) {
+    for (size_t i = 0; i < count; ++i) {
+      parse_serverclass(thisptr, i);
+    }
+    return;
+  }
+
+  // The scratch of each worker grows from the heap allocator, which need not be thread safe either
+  locked_allocator lock, heap_lock;
+  dg_alloc_state allocator = locked_allocator_init(&lock, thisptr->allocator);
+  dg_alloc_state heap = locked_allocator_init(&heap_lock, thisptr->heap_allocator);
+
+  const uint32_t workers_bytes = sizeof(flatten_worker) * thread_count;
+  flatten_worker *workers =
+      dg_alloc_allocate(thisptr->heap_allocator, workers_bytes, alignof(flatten_worker));
+  memset(workers, 0, workers_bytes);
+
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    flatten_worker *worker = workers + i;
+    worker->state = *thisptr;
+    worker->state.allocator = &allocator;
+    worker->state.heap_allocator = &heap;
+    worker->first = i;
+    worker->stride = thread_count;
+
+    if (i == 0) {
+      worker->state.ent_scrap = thisptr->ent_scrap;
+    } else {
+      // The hashtable and index are read only, only the scratch is per thread
+      worker->scrap.dt_hashtable = thisptr->ent_scrap->dt_hashtable;
+      worker->scrap.index = thisptr->ent_scrap->index;
+      flatten_scratch_init(&worker->scrap.scratch, worker->scrap.index.prop_count, &heap);
+      worker->state.ent_scrap = &worker->scrap;
+      worker->started = dg_thread_create(&worker->thread, flatten_worker_main, worker);
+    }
+  }
+
+  flatten_worker_main(workers);
+
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    flatten_worker *worker = workers + i;
+    if (worker->started) {
+      dg_thread_join(worker->thread);
+    } else {
+      flatten_worker_main(worker);
+    }
+    flatten_scratch_free(&worker->scrap.scratch, &heap);
+  }
+
+  for (uint32_t i = 0; i < thread_count && !thisptr->error; ++i) {
+    thisptr->error = workers[i].state.error;
+    thisptr->error_message = workers[i].state.error_message;
+  }
+
+  dg_alloc_free(thisptr->heap_allocator, workers, workers_bytes);
+  dg_mutex_destroy(&lock.mutex);
+  dg_mutex_destroy(&heap_lock.mutex);
+}
+
 dg_parse_result dg_estate_init(estate *thisptr, estate_init_args args) {
+  return dg_estate_init_ex(thisptr, args, NULL, 0);
+}
+
+dg_parse_result dg_estate_init_cached(estate *thisptr, estate_init_args args,
+                                      dg_estate_cache *cache) {
+  return dg_estate_init_ex(thisptr, args, cache, 0);
+}
+
+dg_parse_result dg_estate_init_ex(estate *thisptr, estate_init_args args, dg_estate_cache *cache,
+                                  uint32_t flatten_threads) {
   dg_parse_result result;
   if (thisptr->edicts != NULL) {
     result.error = true;
@@ -439,6 +915,7 @@ dg_parse_result dg_estate_init(estate *thisptr, estate_init_args args) {
 
   memset(thisptr, 0, sizeof(*thisptr));
   thisptr->should_store_props = args.should_store_props;
+  thisptr->heap_allocator = args.heap_allocator != NULL ? args.heap_allocator : dg_heap_allocator();
   thisptr->sendtables = args.message->sendtables;
   thisptr->serverclasses = args.message->serverclasses;
   thisptr->serverclass_count = args.message->serverclass_count;
@@ -446,32 +923,54 @@ dg_parse_result dg_estate_init(estate *thisptr, estate_init_args args) {
   thisptr->edicts =
       dg_alloc_allocate(args.allocator, sizeof(dg_edict) * MAX_EDICTS, alignof(dg_edict));
   memset(thisptr->edicts, 0, sizeof(dg_edict) * MAX_EDICTS);
+  thisptr->live_edicts =
+      dg_alloc_allocate(args.allocator, sizeof(uint16_t) * MAX_EDICTS * 2, alignof(uint16_t));
+  thisptr->live_slots = thisptr->live_edicts + MAX_EDICTS;
+  thisptr->live_count = 0;
+
+  // The cache can only be keyed when the raw datatables are available
+  const bool use_cache = cache != NULL && args.message->_raw_buffer != NULL;
+  uint64_t cache_key = 0;
+
+  if (use_cache) {
+    cache_key = dg_estate_cache_key(args.message, args.version_data);
+    dg_serverclass_data *cached =
+        dg_estate_cache_find(cache, cache_key, thisptr->serverclass_count);
+    if (cached) {
+      thisptr->class_datas = cached;
+      result.error = false;
+      result.error_message = NULL;
+      return result;
+    }
+  }
 
   estate_init_state state;
   memset(&state, 0, sizeof(state));
   state.args = args;
+  state.flatten_threads = flatten_threads;
   state.entity_state = thisptr;
   state.ent_scrap = &thisptr->scrap;
   state.allocator = args.allocator;
+  state.heap_allocator = thisptr->heap_allocator;
 
   create_dt_hashtable(&state);
 
   if (!state.error) {
-    if (thisptr->scrap.excluded_props.arr == NULL) {
-      thisptr->scrap.excluded_props = dg_pes_create(256);
-    }
-    if (thisptr->scrap.dts_with_excludes.arr == NULL) {
-      thisptr->scrap.dts_with_excludes = dg_hashtable_create(256);
-    }
+    build_flatten_index(&state);
+    flatten_scratch_init(&thisptr->scrap.scratch, thisptr->scrap.index.prop_count,
+                         thisptr->heap_allocator);
     size_t array_size = sizeof(dg_serverclass_data) * thisptr->serverclass_count;
     thisptr->class_datas =
         dg_alloc_allocate(args.allocator, array_size, alignof(dg_serverclass_data));
     memset(thisptr->class_datas, 0, array_size);
 
-    if (args.flatten_datatables) {
-      for (size_t i = 0; i < thisptr->serverclass_count; ++i) {
-        parse_serverclass(&state, i);
-      }
+    // Everything is flattened on a cache miss so that the next demo gets a complete entry
+    if (args.flatten_datatables || use_cache) {
+      flatten_serverclasses(&state);
+    }
+
+    if (use_cache && !state.error) {
+      dg_estate_cache_insert(cache, cache_key, thisptr, thisptr->heap_allocator);
     }
   }
 
@@ -481,21 +980,31 @@ dg_parse_result dg_estate_init(estate *thisptr, estate_init_args args) {
   return result;
 }
 
-static void free_inner_value(dg_prop_value_inner *value, dg_sendprop *prop) {
+static void free_inner_value(dg_alloc_state *allocator, dg_prop_value_inner *value,
+                             dg_sendprop *prop) {
   dg_sendproptype prop_type = prop->proptype;
   if (prop_type == sendproptype_vector3) {
-    free(value->v3_val);
+    dg_alloc_free(allocator, value->v3_val, sizeof(dg_vector3_value));
+    DG_TRACK_FREE(alloc_inner_value, sizeof(dg_vector3_value));
   } else if (prop_type == sendproptype_vector2) {
-    free(value->v2_val);
+    dg_alloc_free(allocator, value->v2_val, sizeof(dg_vector2_value));
+    DG_TRACK_FREE(alloc_inner_value, sizeof(dg_vector2_value));
   } else if (prop_type == sendproptype_string) {
-    free(value->str_val->str);
-    free(value->str_val);
+    if (value->str_val->str) {
+      dg_alloc_free(allocator, value->str_val->str, value->str_val->len);
+      DG_TRACK_FREE(alloc_inner_value, value->str_val->len);
+    }
+    dg_alloc_free(allocator, value->str_val, sizeof(dg_string_value));
+    DG_TRACK_FREE(alloc_inner_value, sizeof(dg_string_value));
   } else if (prop_type == sendproptype_array) {
     for (size_t i = 0; i < prop->array_num_elements; ++i) {
-      free_inner_value(value->arr_val->values + i, prop->array_prop);
+      free_inner_value(allocator, value->arr_val->values + i, prop->array_prop);
     }
-    free(value->arr_val->values);
-    free(value->arr_val);
+    dg_alloc_free(allocator, value->arr_val->values,
+                  sizeof(dg_prop_value_inner) * prop->array_num_elements);
+    dg_alloc_free(allocator, value->arr_val, sizeof(dg_array_value));
+    DG_TRACK_FREE(alloc_inner_value, sizeof(dg_prop_value_inner) * prop->array_num_elements);
+    DG_TRACK_FREE(alloc_inner_value, sizeof(dg_array_value));
   }
 }
 
@@ -514,17 +1023,48 @@ static void free_props(dg_edict *ent, dg_serverclass_data *data) {
 }
 #endif
 
+static void live_add(estate *thisptr, int index) {
+  thisptr->live_slots[index] = thisptr->live_count;
+  thisptr->live_edicts[thisptr->live_count] = index;
+  ++thisptr->live_count;
+}
+
+static void live_remove(estate *thisptr, int index) {
+  // Move the last live edict into the removed slot
+  uint16_t slot = thisptr->live_slots[index];
+  uint16_t last = thisptr->live_edicts[thisptr->live_count - 1];
+  thisptr->live_edicts[slot] = last;
+  thisptr->live_slots[last] = slot;
+  --thisptr->live_count;
+}
+
+dg_edict *dg_estate_next_live(const estate *thisptr, const dg_edict *current) {
+  uint32_t slot;
+  if (current == NULL) {
+    slot = 0;
+  } else {
+    slot = thisptr->live_slots[current - thisptr->edicts] + 1;
+  }
+
+  if (slot >= thisptr->live_count) {
+    return NULL;
+  } else {
+    return thisptr->edicts + thisptr->live_edicts[slot];
+  }
+}
+
 void dg_estate_free(estate *thisptr) {
-  if (thisptr->should_store_props) {
-    for (size_t i = 0; i < MAX_EDICTS; ++i) {
-      dg_edict *ent = thisptr->edicts + i;
+  for (uint32_t i = 0; i < thisptr->live_count; ++i) {
+    dg_edict *ent = thisptr->edicts + thisptr->live_edicts[i];
+    if (thisptr->should_store_props) {
       free_props(ent, thisptr->class_datas + ent->datatable_id);
     }
-    memset(thisptr->edicts, 0, sizeof(dg_edict) * MAX_EDICTS);
+    memset(ent, 0, sizeof(dg_edict));
   }
+  thisptr->live_count = 0;
   dg_hashtable_free(&thisptr->scrap.dt_hashtable);
-  dg_hashtable_free(&thisptr->scrap.dts_with_excludes);
-  dg_pes_free(&thisptr->scrap.excluded_props);
+  flatten_index_free(&thisptr->scrap.index, thisptr->sendtable_count, thisptr->heap_allocator);
+  flatten_scratch_free(&thisptr->scrap.scratch, thisptr->heap_allocator);
 }
 
 void dg_parser_init_estate(dg_parser *thisptr, dg_datatables_parsed *message) {
@@ -534,8 +1074,11 @@ void dg_parser_init_estate(dg_parser *thisptr, dg_datatables_parsed *message) {
   args.message = message;
   args.version_data = &thisptr->demo_version;
   args.allocator = dg_parser_perm_allocator(thisptr);
+  args.heap_allocator = dg_parser_heap_allocator(thisptr);
 
-  dg_parse_result result = dg_estate_init(&thisptr->state.entity_state, args);
+  dg_parse_result result =
+      dg_estate_init_ex(&thisptr->state.entity_state, args, thisptr->m_settings.estate_cache,
+                        thisptr->m_settings.flatten_threads);
 
   if (result.error) {
     thisptr->error = true;
@@ -553,6 +1096,7 @@ dg_serverclass_data *dg_estate_serverclass_data(estate *thisptr, const dg_demver
   state.args.version_data = demver_data;
   state.ent_scrap = &thisptr->scrap;
   state.allocator = allocator;
+  state.heap_allocator = thisptr->heap_allocator;
   state.entity_state = thisptr;
 
   if (state.entity_state->class_datas[index].dt_name == NULL) {
@@ -562,8 +1106,114 @@ dg_serverclass_data *dg_estate_serverclass_data(estate *thisptr, const dg_demver
   return state.entity_state->class_datas + index;
 }
 
-static void copy_into_inner_value(dg_prop_value_inner *dest, const dg_prop_value_inner *src,
-                                  dg_sendproptype prop_type) {
+static dg_prop_handle invalid_handle(uint32_t serverclass) {
+  dg_prop_handle handle;
+  handle.serverclass = serverclass;
+  handle.prop_index = DG_PROP_HANDLE_INVALID;
+  handle.array_index = -1;
+  return handle;
+}
+
+static const dg_serverclass_data *get_indexed_class(const estate *thisptr, uint32_t serverclass) {
+  if (serverclass >= thisptr->serverclass_count || thisptr->class_datas == NULL) {
+    return NULL;
+  }
+
+  const dg_serverclass_data *class_data = thisptr->class_datas + serverclass;
+  if (class_data->name_index == NULL) {
+    return NULL;
+  }
+
+  return class_data;
+}
+
+dg_prop_handle dg_estate_find_prop(const estate *thisptr, uint32_t serverclass, const char *name) {
+  dg_prop_handle handle = invalid_handle(serverclass);
+  const dg_serverclass_data *class_data = get_indexed_class(thisptr, serverclass);
+
+  if (class_data == NULL) {
+    return handle;
+  }
+
+  size_t length = strlen(name);
+  int32_t array_index = -1;
+
+  // "table.prop[3]" refers to the 4th element of the array prop "table.prop"
+  if (length > 0 && name[length - 1] == ']') {
+    const char *bracket = memchr(name, '[', length);
+    if (bracket == NULL || bracket + 2 > name + length - 1) {
+      return handle;
+    }
+
+    array_index = 0;
+    for (const char *c = bracket + 1; c < name + length - 1; ++c) {
+      if (*c < '0' || *c > '9' || array_index > INT16_MAX) {
+        return handle;
+      }
+      array_index = array_index * 10 + (*c - '0');
+    }
+    length = bracket - name;
+  }
+
+  uint32_t hash = XXH32(name, length, 0);
+  size_t mask = class_data->name_index_size - 1;
+
+  for (size_t slot = hash & mask; class_data->name_index[slot].prop_index != 0;
+       slot = (slot + 1) & mask) {
+    const dg_propname_entry *entry = class_data->name_index + slot;
+    const dg_sendprop *prop = class_data->props + entry->prop_index - 1;
+
+    if (entry->hash == hash && propname_equal(prop, name, length)) {
+      if (array_index != -1 && (prop->proptype != sendproptype_array ||
+                                array_index >= (int32_t)prop->array_num_elements)) {
+        return handle;
+      }
+      handle.prop_index = entry->prop_index - 1;
+      handle.array_index = array_index;
+      break;
+    }
+  }
+
+  return handle;
+}
+
+dg_prop_handle dg_estate_find_sendprop(const estate *thisptr, uint32_t serverclass,
+                                       const dg_sendprop *prop) {
+  dg_prop_handle handle = invalid_handle(serverclass);
+  const dg_serverclass_data *class_data = get_indexed_class(thisptr, serverclass);
+
+  if (class_data == NULL) {
+    return handle;
+  }
+
+  uint32_t hash = propname_hash(prop->baseclass->name, prop->name);
+  size_t mask = class_data->name_index_size - 1;
+
+  for (size_t slot = hash & mask; class_data->name_index[slot].prop_index != 0;
+       slot = (slot + 1) & mask) {
+    const dg_propname_entry *entry = class_data->name_index + slot;
+    const dg_sendprop *candidate = class_data->props + entry->prop_index - 1;
+
+    if (entry->hash == hash && strcmp(candidate->name, prop->name) == 0 &&
+        strcmp(candidate->baseclass->name, prop->baseclass->name) == 0) {
+      handle.prop_index = entry->prop_index - 1;
+      break;
+    }
+  }
+
+  return handle;
+}
+
+dg_sendprop *dg_estate_handle_prop(const estate *thisptr, dg_prop_handle handle) {
+  if (handle.prop_index == DG_PROP_HANDLE_INVALID || handle.serverclass >= thisptr->serverclass_count) {
+    return NULL;
+  }
+
+  return thisptr->class_datas[handle.serverclass].props + handle.prop_index;
+}
+
+static void copy_into_inner_value(dg_alloc_state *allocator, dg_prop_value_inner *dest,
+                                  const dg_prop_value_inner *src, dg_sendproptype prop_type) {
   if (prop_type == sendproptype_vector3) {
     memcpy(dest->v3_val, src->v3_val, sizeof(dg_vector3_value));
   } else if (prop_type == sendproptype_vector2) {
@@ -573,13 +1223,18 @@ static void copy_into_inner_value(dg_prop_value_inner *dest, const dg_prop_value
     size_t value_len = src->str_val->len;
 
     if (value_len == 0) {
-      free(dest->str_val->str);
+      if (dest->str_val->str) {
+        dg_alloc_free(allocator, dest->str_val->str, current_len);
+        DG_TRACK_FREE(alloc_inner_value, current_len);
+      }
       memset(dest->str_val, 0, sizeof(dg_string_value));
     } else {
       if (current_len < value_len) {
         // If new value too large, realloc the string
         // Also works in the null pointer case
-        dest->str_val->str = realloc(dest->str_val->str, value_len);
+        dest->str_val->str =
+            dg_alloc_reallocate(allocator, dest->str_val->str, current_len, value_len, 1);
+        DG_TRACK_ALLOC(alloc_inner_value, value_len - current_len);
         dest->str_val->len = value_len;
         current_len = value_len;
       }
@@ -590,37 +1245,43 @@ static void copy_into_inner_value(dg_prop_value_inner *dest, const dg_prop_value
   }
 }
 
-static void copy_into_prop(dg_prop_value_inner *dest, const prop_value *value, const dg_sendprop* prop) {
+static void copy_into_prop(dg_alloc_state *allocator, dg_prop_value_inner *dest,
+                           const prop_value *value, const dg_sendprop *prop) {
   dg_sendproptype prop_type = prop->proptype;
   if (prop_type != sendproptype_array) {
-    copy_into_inner_value(dest, &value->value, prop_type);
+    copy_into_inner_value(allocator, dest, &value->value, prop_type);
   } else {
     dg_sendproptype array_prop_type = prop->array_prop->proptype;
     for (size_t i = 0; i < value->value.arr_val->array_size; ++i) {
-      copy_into_inner_value(dest->arr_val->values + i, value->value.arr_val->values + i,
-                            array_prop_type);
+      copy_into_inner_value(allocator, dest->arr_val->values + i,
+                            value->value.arr_val->values + i, array_prop_type);
     }
   }
 }
 
-static void alloc_inner_value(dg_prop_value_inner *dest, dg_sendprop *prop) {
+static void *alloc_zeroed(dg_alloc_state *allocator, uint32_t size, uint32_t alignment) {
+  void *out = dg_alloc_allocate(allocator, size, alignment);
+  memset(out, 0, size);
+  DG_TRACK_ALLOC(alloc_inner_value, size);
+  return out;
+}
+
+static void alloc_inner_value(dg_alloc_state *allocator, dg_prop_value_inner *dest,
+                              dg_sendprop *prop) {
   if (prop->proptype == sendproptype_vector3) {
-    dest->v3_val = malloc(sizeof(dg_vector3_value));
-    memset(dest->v3_val, 0, sizeof(dg_vector3_value));
+    dest->v3_val = alloc_zeroed(allocator, sizeof(dg_vector3_value), alignof(dg_vector3_value));
   } else if (prop->proptype == sendproptype_vector2) {
-    dest->v2_val = malloc(sizeof(dg_vector2_value));
-    memset(dest->v2_val, 0, sizeof(dg_vector2_value));
+    dest->v2_val = alloc_zeroed(allocator, sizeof(dg_vector2_value), alignof(dg_vector2_value));
   } else if (prop->proptype == sendproptype_string) {
-    dest->str_val = malloc(sizeof(dg_string_value));
-    memset(dest->str_val, 0, sizeof(dg_string_value));
+    dest->str_val = alloc_zeroed(allocator, sizeof(dg_string_value), alignof(dg_string_value));
   } else if (prop->proptype == sendproptype_array) {
-    dest->arr_val = malloc(sizeof(dg_array_value));
-    memset(dest->arr_val, 0, sizeof(dg_array_value));
-    dest->arr_val->values = malloc(sizeof(dg_prop_value_inner) * prop->array_num_elements);
+    dest->arr_val = alloc_zeroed(allocator, sizeof(dg_array_value), alignof(dg_array_value));
+    dest->arr_val->values =
+        alloc_zeroed(allocator, sizeof(dg_prop_value_inner) * prop->array_num_elements,
+                     alignof(dg_prop_value_inner));
     dest->arr_val->array_size = prop->array_num_elements;
-    memset(dest->arr_val->values, 0, sizeof(dg_prop_value_inner) * prop->array_num_elements);
     for (size_t i = 0; i < prop->array_num_elements; ++i) {
-      alloc_inner_value(dest->arr_val->values + i, prop->array_prop);
+      alloc_inner_value(allocator, dest->arr_val->values + i, prop->array_prop);
     }
   }
 }
@@ -646,13 +1307,13 @@ static void update_props(dg_edict *ent, const dg_ent_update *update, dg_servercl
     size_t after = number_of_props(&ent->props);
 
     if (newprop) {
-      alloc_inner_value(&node->value, value->prop);
+      alloc_inner_value(ent->props.allocator, &node->value, value->prop);
     }
 
     if (strcmp(value->prop->name, "m_vecOrigin") == 0 && node->value.v3_val == NULL) {
       int temp = 0;
     }
-    copy_into_prop(&node->value, value);
+    copy_into_prop(ent->props.allocator, &node->value, value);
     if (strcmp(value->prop->name, "m_vecOrigin") == 0 && node->value.v3_val == NULL) {
       int temp = 0;
     }
@@ -664,7 +1325,7 @@ static dg_prop_value_inner *getinsert_prop(dg_edict *ent, uint16_t index, dg_sen
   dg_prop_value_inner *value = dg_eproparr_get(&ent->props, index, &newprop);
 
   if (newprop) {
-    alloc_inner_value(value, prop);
+    alloc_inner_value(ent->props.allocator, value, prop);
   }
 
   return value;
@@ -675,7 +1336,7 @@ static void update_props(dg_edict *ent, const dg_ent_update *update, dg_servercl
     const prop_value *value = update->prop_value_array + i;
     dg_sendprop* prop = data->props + value->prop_index;
     dg_prop_value_inner *dest = getinsert_prop(ent, prop - data->props, prop);
-    copy_into_prop(dest, value, prop);
+    copy_into_prop(ent->props.allocator, dest, value, prop);
   }
 }
 #endif
@@ -696,6 +1357,7 @@ dg_parse_result dg_estate_update(estate *entity_state, const dg_packetentities_d
     dg_edict *ent = entity_state->edicts + update->ent_index;
     if (update->update_type == 2) {
       dg_serverclass_data *data = entity_state->class_datas + update->datatable_id;
+      bool was_live = ent->exists;
       if (should_store_props) {
         bool init_props = false;
         if (ent->exists && ent->datatable_id != update->datatable_id) {
@@ -709,13 +1371,17 @@ dg_parse_result dg_estate_update(estate *entity_state, const dg_packetentities_d
 
         if (init_props) {
 #ifdef DEMOGOBBLER_USE_LINKED_LIST_PROPS
-          ent->props = dg_eproplist_init();
+          ent->props = dg_eproplist_init_ex(entity_state->heap_allocator);
 #else
-          ent->props = dg_eproparr_init(data->prop_count);
+          ent->props = dg_eproparr_init_ex(data->prop_count, entity_state->heap_allocator);
 #endif
         }
       }
 
+      if (!was_live) {
+        live_add(entity_state, update->ent_index);
+      }
+
       // Enter pvs
       ent->explicitly_deleted = false;
       ent->exists = true;
@@ -735,6 +1401,9 @@ dg_parse_result dg_estate_update(estate *entity_state, const dg_packetentities_d
       // Leave PVS
       ent->in_pvs = false;
     } else if (update->update_type == 3) {
+      if (ent->exists) {
+        live_remove(entity_state, update->ent_index);
+      }
       if (should_store_props) {
         free_props(ent, entity_state->class_datas + ent->datatable_id);
       }
@@ -744,6 +1413,9 @@ dg_parse_result dg_estate_update(estate *entity_state, const dg_packetentities_d
 
   for (size_t i = 0; i < data->explicit_deletes_count; ++i) {
     dg_edict *ent = entity_state->edicts + data->explicit_deletes[i];
+    if (ent->exists) {
+      live_remove(entity_state, data->explicit_deletes[i]);
+    }
     dg_serverclass_data *data = entity_state->class_datas + ent->datatable_id;
     if (should_store_props) {
       free_props(ent, data);
@@ -5,3 +5,14 @@
 #include "demogobbler/parser.h"
 #include <stdbool.h>
 
+
+// Build the "table.prop" index of a flattened serverclass
+void dg_build_name_index(dg_serverclass_data *class_data, dg_alloc_state *allocator);
+
+// Flattened serverclass cache internals, see estate_cache.c
+uint64_t dg_estate_cache_key(const dg_datatables_parsed *message, const dg_demver_data *version);
+dg_serverclass_data *dg_estate_cache_find(dg_estate_cache *thisptr, uint64_t key,
+                                          size_t serverclass_count);
+// Scratch memory used while serializing comes from allocator
+void dg_estate_cache_insert(dg_estate_cache *thisptr, uint64_t key, const estate *entity_state,
+                            dg_alloc_state *allocator);
@@ -0,0 +1,192 @@
+#include "demogobbler.h"
+#include "demogobbler/alignof_wrapper.h"
+#include "demogobbler/allocator.h"
+#include "demogobbler/bitstream.h"
+#include "demogobbler/hashtable.h"
+#include <string.h>
+
+enum { MAX_GAME_EVENT_KEYS = 256, MAX_GAME_EVENT_STRING = 1024 };
+
+static const char *copy_string(dg_alloc_state *allocator, const char *str, size_t bytes) {
+  char *dest = dg_alloc_allocate(allocator, bytes, 1);
+  memcpy(dest, str, bytes);
+  return dest;
+}
+
+dg_parse_result dg_parse_game_event_list(dg_game_event_list *out,
+                                         const struct dg_svc_game_event_list *message,
+                                         dg_alloc_state *allocator) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+  memset(out, 0, sizeof(*out));
+
+  size_t descriptor_bytes = DG_MAX_GAME_EVENTS * sizeof(dg_game_event_descriptor);
+  out->descriptors =
+      dg_alloc_allocate(allocator, descriptor_bytes, alignof(dg_game_event_descriptor));
+  memset(out->descriptors, 0, descriptor_bytes);
+  out->names = dg_hashtable_create_ex(message->events, allocator);
+
+  dg_bitstream stream = message->data;
+  struct dg_game_event_descriptor_key keys[MAX_GAME_EVENT_KEYS];
+  char buffer[MAX_GAME_EVENT_STRING];
+
+  for (uint32_t i = 0; i < message->events && !stream.overflow; ++i) {
+    uint32_t event_id = dg_bitstream_read_uint(&stream, 9);
+    size_t bytes = dg_bitstream_read_cstring(&stream, buffer, sizeof(buffer));
+    dg_game_event_descriptor *descriptor = out->descriptors + event_id;
+
+    if (descriptor->name != NULL) {
+      result.error = true;
+      result.error_message = "Duplicate event id in svc_game_event_list";
+      return result;
+    }
+
+    descriptor->event_id = event_id;
+    descriptor->name = copy_string(allocator, buffer, bytes);
+    descriptor->key_count = 0;
+    descriptor->wanted = true;
+
+    while (!stream.overflow) {
+      uint32_t type = dg_bitstream_read_uint(&stream, 3);
+      if (type == dg_game_event_key_local) {
+        break;
+      }
+
+      if (descriptor->key_count == MAX_GAME_EVENT_KEYS) {
+        result.error = true;
+        result.error_message = "Too many keys in game event descriptor";
+        return result;
+      }
+
+      bytes = dg_bitstream_read_cstring(&stream, buffer, sizeof(buffer));
+      keys[descriptor->key_count].type = type;
+      keys[descriptor->key_count].key_value = copy_string(allocator, buffer, bytes);
+      ++descriptor->key_count;
+    }
+
+    size_t key_bytes = descriptor->key_count * sizeof(struct dg_game_event_descriptor_key);
+    descriptor->keys =
+        dg_alloc_allocate(allocator, key_bytes, alignof(struct dg_game_event_descriptor_key));
+    memcpy(descriptor->keys, keys, key_bytes);
+
+    dg_hashtable_entry entry;
+    entry.str = descriptor->name;
+    entry.value = event_id;
+    dg_hashtable_insert(&out->names, entry);
+    ++out->descriptor_count;
+  }
+
+  if (stream.overflow) {
+    result.error = true;
+    result.error_message = "Bitstream overflowed while parsing svc_game_event_list";
+  }
+
+  return result;
+}
+
+void dg_game_event_list_free(dg_game_event_list *thisptr) {
+  if (thisptr->descriptors != NULL) {
+    dg_hashtable_free(&thisptr->names);
+    thisptr->descriptors = NULL;
+  }
+}
+
+void dg_game_event_list_set_wanted(dg_game_event_list *thisptr, const char *const *names,
+                                   uint32_t count) {
+  bool all = names == NULL;
+  for (uint32_t i = 0; i < DG_MAX_GAME_EVENTS; ++i) {
+    thisptr->descriptors[i].wanted = all;
+  }
+
+  for (uint32_t i = 0; i < count && !all; ++i) {
+    dg_hashtable_entry entry = dg_hashtable_get(&thisptr->names, names[i]);
+    if (entry.str != NULL) {
+      thisptr->descriptors[entry.value].wanted = true;
+    }
+  }
+}
+
+const dg_game_event_descriptor *dg_game_event_list_find(const dg_game_event_list *thisptr,
+                                                        const char *name) {
+  // The lookup does not modify the table
+  dg_hashtable_entry entry = dg_hashtable_get((dg_hashtable *)&thisptr->names, name);
+  if (entry.str == NULL) {
+    return NULL;
+  }
+
+  return thisptr->descriptors + entry.value;
+}
+
+int32_t dg_game_event_key_index(const dg_game_event_descriptor *descriptor, const char *key) {
+  for (size_t i = 0; i < descriptor->key_count; ++i) {
+    if (strcmp(descriptor->keys[i].key_value, key) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+dg_parse_result dg_parse_game_event(dg_game_event *out, const dg_game_event_list *list,
+                                    const struct dg_svc_game_event *message,
+                                    dg_alloc_state *allocator) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+  memset(out, 0, sizeof(*out));
+
+  dg_bitstream stream = message->data;
+  uint32_t event_id = dg_bitstream_read_uint(&stream, 9);
+  const dg_game_event_descriptor *descriptor = list->descriptors + event_id;
+
+  // Unknown and unwanted events are skipped, the length prefix makes that free
+  if (stream.overflow || descriptor->name == NULL || !descriptor->wanted) {
+    return result;
+  }
+
+  dg_game_event_value *values = dg_alloc_allocate(
+      allocator, descriptor->key_count * sizeof(dg_game_event_value), alignof(dg_game_event_value));
+  char buffer[MAX_GAME_EVENT_STRING];
+
+  for (size_t i = 0; i < descriptor->key_count; ++i) {
+    dg_game_event_value *value = values + i;
+    switch (descriptor->keys[i].type) {
+    case dg_game_event_key_string: {
+      size_t bytes = dg_bitstream_read_cstring(&stream, buffer, sizeof(buffer));
+      value->str_val = copy_string(allocator, buffer, bytes);
+      break;
+    }
+    case dg_game_event_key_float:
+      value->float_val = dg_bitstream_read_float(&stream);
+      break;
+    case dg_game_event_key_long:
+      value->int_val = dg_bitstream_read_sint(&stream, 32);
+      break;
+    case dg_game_event_key_short:
+      value->int_val = dg_bitstream_read_sint(&stream, 16);
+      break;
+    case dg_game_event_key_byte:
+      value->int_val = dg_bitstream_read_uint(&stream, 8);
+      break;
+    case dg_game_event_key_bool:
+      value->bool_val = dg_bitstream_read_bit(&stream);
+      break;
+    case dg_game_event_key_uint64:
+      value->uint64_val = dg_bitstream_read_uint(&stream, 64);
+      break;
+    default:
+      result.error = true;
+      result.error_message = "Bad key type in game event descriptor";
+      return result;
+    }
+  }
+
+  if (stream.overflow) {
+    result.error = true;
+    result.error_message = "Bitstream overflowed while parsing svc_game_event";
+    return result;
+  }
+
+  out->descriptor = descriptor;
+  out->values = values;
+  return result;
+}
@@ -1,4 +1,5 @@
 #include "parser_netmessages.h"
+#include "alloc_telemetry.h"
 #include "demogobbler/allocator.h"
 #include "demogobbler/bitstream.h"
 #include "demogobbler/bitwriter.h"
@@ -18,20 +19,13 @@
     variable = temp_string;                                                                        \
   }
 
-#ifdef DEBUG
-#define SEND_MESSAGE() message->offset = stream->bitoffset;
-#else
-#define SEND_MESSAGE()
-#endif
-
-typedef struct {
+typedef struct dg_netmessage_scrap {
   void *address;
   size_t size;
 } blk;
 
 static void handle_net_nop(dg_parser *thisptr, dg_bitstream *stream, packet_net_message *message,
                            blk *scrap) {
-  SEND_MESSAGE();
 }
 
 static void write_net_nop(dg_bitwriter *writer, dg_demver_data *version,
@@ -41,7 +35,6 @@ static void handle_net_disconnect(dg_parser *thisptr, dg_bitstream *stream,
                                   packet_net_message *message, blk *scrap) {
   struct dg_net_disconnect *ptr = &message->message_net_disconnect;
   COPY_STRING(ptr->text);
-  SEND_MESSAGE();
 }
 
 static void write_net_disconnect(dg_bitwriter *writer, dg_demver_data *version,
@@ -57,7 +50,6 @@ static void handle_net_file(dg_parser *thisptr, dg_bitstream *stream, packet_net
   ptr->transfer_id = dg_bitstream_read_uint32(stream);
   COPY_STRING(ptr->filename);
   ptr->file_requested = dg_bitstream_read_uint(stream, thisptr->demo_version.net_file_bits);
-  SEND_MESSAGE();
 }
 
 static void write_net_file(dg_bitwriter *writer, dg_demver_data *version,
@@ -72,11 +64,14 @@ static void handle_net_tick(dg_parser *thisptr, dg_bitstream *stream, packet_net
                             blk *scrap) {
   struct dg_net_tick *ptr = &message->message_net_tick;
   ptr->tick = dg_bitstream_read_uint32(stream);
-  if (thisptr->demo_version.has_nettick_times) {
-    ptr->host_frame_time = dg_bitstream_read_uint(stream, 16);
-    ptr->host_frame_time_std_dev = dg_bitstream_read_uint(stream, 16);
-  }
-  SEND_MESSAGE();
+  ptr->host_frame_time = dg_bitstream_read_uint(stream, 16);
+  ptr->host_frame_time_std_dev = dg_bitstream_read_uint(stream, 16);
+}
+
+static void handle_net_tick_no_times(dg_parser *thisptr, dg_bitstream *stream,
+                                     packet_net_message *message, blk *scrap) {
+  struct dg_net_tick *ptr = &message->message_net_tick;
+  ptr->tick = dg_bitstream_read_uint32(stream);
 }
 
 static void write_net_tick(dg_bitwriter *writer, dg_demver_data *version,
@@ -94,7 +89,6 @@ static void handle_net_stringcmd(dg_parser *thisptr, dg_bitstream *stream, packe
                                  blk *scrap) {
   struct dg_net_stringcmd *ptr = &message->message_net_stringcmd;
   COPY_STRING(ptr->command);
-  SEND_MESSAGE();
 }
 
 static void write_net_stringcmd(dg_bitwriter *writer, dg_demver_data *version,
@@ -112,12 +106,11 @@ static void handle_net_setconvar(dg_parser *thisptr, dg_bitstream *stream, packe
   ptr->convars =
       dg_alloc_allocate(arena, sizeof(struct dg_net_setconvar_convar) * ptr->count,
                         alignof(struct dg_net_setconvar_convar));
+  DG_TRACK_ALLOC(netmessage_body, sizeof(struct dg_net_setconvar_convar) * ptr->count);
   for (size_t i = 0; i < message->message_net_setconvar.count; ++i) {
     COPY_STRING(ptr->convars[i].name);
     COPY_STRING(ptr->convars[i].value);
   }
-
-  SEND_MESSAGE();
 }
 
 static void write_net_setconvar(dg_bitwriter *writer, dg_demver_data *version,
@@ -136,24 +129,26 @@ static void handle_net_signonstate(dg_parser *thisptr, dg_bitstream *stream,
   struct dg_net_signonstate *ptr = &message->message_net_signonstate;
   ptr->signon_state = dg_bitstream_read_uint(stream, 8);
   ptr->spawn_count = dg_bitstream_read_sint32(stream);
+  // Uncrafted: GameState.ClientSoundSequence = 1; reset sound sequence number after receiving
+  // SignOn sounds
+}
 
-  if (thisptr->demo_version.demo_protocol >= 4) {
-    ptr->NE_num_server_players = dg_bitstream_read_uint32(stream);
-    unsigned int length = dg_bitstream_read_uint32(stream) * 8;
-    ptr->NE_player_network_ids = dg_bitstream_fork_and_advance(stream, length);
-    ptr->NE_map_name_length = dg_bitstream_read_uint32(stream);
-    ptr->NE_map_name = scrap->address;
+static void handle_net_signonstate_protocol4(dg_parser *thisptr, dg_bitstream *stream,
+                                             packet_net_message *message, blk *scrap) {
+  handle_net_signonstate(thisptr, stream, message, scrap);
+  struct dg_net_signonstate *ptr = &message->message_net_signonstate;
+  ptr->NE_num_server_players = dg_bitstream_read_uint32(stream);
+  unsigned int length = dg_bitstream_read_uint32(stream) * 8;
+  ptr->NE_player_network_ids = dg_bitstream_fork_and_advance(stream, length);
+  ptr->NE_map_name_length = dg_bitstream_read_uint32(stream);
+  ptr->NE_map_name = scrap->address;
 
-    if (scrap->size < ptr->NE_map_name_length) {
-      thisptr->error = true;
-      thisptr->error_message = "Map name in net_signonstate has bad length";
-    } else {
-      dg_bitstream_read_fixed_string(stream, scrap->address, ptr->NE_map_name_length);
-    }
+  if (scrap->size < ptr->NE_map_name_length) {
+    thisptr->error = true;
+    thisptr->error_message = "Map name in net_signonstate has bad length";
+  } else {
+    dg_bitstream_read_fixed_string(stream, scrap->address, ptr->NE_map_name_length);
   }
-  // Uncrafted: GameState.ClientSoundSequence = 1; reset sound sequence number after receiving
-  // SignOn sounds
-  SEND_MESSAGE();
 }
 
 static void write_net_signonstate(dg_bitwriter *writer, dg_demver_data *version,
@@ -178,19 +173,20 @@ static void handle_svc_print(dg_parser *thisptr, dg_bitstream *stream, packet_ne
   struct dg_svc_print *ptr = &message->message_svc_print;
 
   COPY_STRING(ptr->message);
+}
 
-  if (thisptr->demo_version.game == l4d2 && thisptr->demo_version.l4d2_version == 2042) {
-    int l4d2_build = 0;
-    get_l4d2_build(ptr->message, &l4d2_build);
-
-    if (l4d2_build == 4710) {
-      dg_parser_update_l4d2_version(thisptr, 2091);
-    } else if (l4d2_build == 6403) {
-      dg_parser_update_l4d2_version(thisptr, 2147);
-    }
+// Only dispatched while the l4d2 build is unresolved, resolving it rebuilds the dispatch table
+static void handle_svc_print_l4d2_2042(dg_parser *thisptr, dg_bitstream *stream,
+                                       packet_net_message *message, blk *scrap) {
+  handle_svc_print(thisptr, stream, message, scrap);
+  int l4d2_build = 0;
+  get_l4d2_build(message->message_svc_print.message, &l4d2_build);
+
+  if (l4d2_build == 4710) {
+    dg_parser_update_l4d2_version(thisptr, 2091);
+  } else if (l4d2_build == 6403) {
+    dg_parser_update_l4d2_version(thisptr, 2147);
   }
-
-  SEND_MESSAGE();
 }
 
 static void write_svc_print(dg_bitwriter *writer, dg_demver_data *version,
@@ -199,32 +195,36 @@ static void write_svc_print(dg_bitwriter *writer, dg_demver_data *version,
   dg_bitwriter_write_cstring(writer, ptr->message);
 }
 
-static void handle_svc_serverinfo(dg_parser *thisptr, dg_bitstream *stream,
-                                  packet_net_message *message, blk *scrap) {
+// The flags are constant in each of the handlers below, so every one of them gets its own copy
+// without the version branches
+static inline void read_svc_serverinfo(dg_parser *thisptr, dg_bitstream *stream,
+                                       packet_net_message *message, blk *scrap, bool protocol4,
+                                       bool l4d2_2147, bool steampipe_format) {
   dg_alloc_state* arena = dg_parser_packet_allocator(thisptr);
   message->message_svc_serverinfo = dg_alloc_allocate(
       arena, sizeof(struct dg_svc_serverinfo), alignof(struct dg_svc_serverinfo));
+  DG_TRACK_ALLOC(netmessage_body, sizeof(struct dg_svc_serverinfo));
   struct dg_svc_serverinfo *ptr = message->message_svc_serverinfo;
   ptr->network_protocol = dg_bitstream_read_uint(stream, 16);
   ptr->server_count = dg_bitstream_read_uint32(stream);
   ptr->is_hltv = dg_bitstream_read_bit(stream);
   ptr->is_dedicated = dg_bitstream_read_bit(stream);
 
-  if (thisptr->demo_version.game == l4d2 && thisptr->demo_version.l4d2_version >= 2147)
+  if (l4d2_2147)
     ptr->unk_l4d_bit = dg_bitstream_read_bit(stream);
   else
     ptr->unk_l4d_bit = 0;
 
   ptr->client_crc = dg_bitstream_read_sint32(stream);
 
-  if (thisptr->demo_version.demo_protocol >= 4)
+  if (protocol4)
     ptr->stringtable_crc = dg_bitstream_read_uint32(stream);
   else
     ptr->stringtable_crc = 0;
 
   ptr->max_classes = dg_bitstream_read_uint(stream, 16);
 
-  if (thisptr->demo_version.game == steampipe) {
+  if (steampipe_format) {
     dg_bitstream_read_fixed_string(stream, ptr->map_md5, 16);
     ptr->map_crc = 0;
   } else {
@@ -241,15 +241,33 @@ static void handle_svc_serverinfo(dg_parser *thisptr, dg_bitstream *stream,
   COPY_STRING(ptr->sky_name);
   COPY_STRING(ptr->host_name);
 
-  if (thisptr->demo_version.game == l4d2 && thisptr->demo_version.l4d2_version >= 2147) {
+  if (l4d2_2147) {
     COPY_STRING(ptr->mission_name);
     COPY_STRING(ptr->mutation_name);
   }
 
-  if (thisptr->demo_version.game == steampipe)
+  if (steampipe_format)
     ptr->has_replay = dg_bitstream_read_bit(stream);
+}
 
-  SEND_MESSAGE();
+static void handle_svc_serverinfo(dg_parser *thisptr, dg_bitstream *stream,
+                                  packet_net_message *message, blk *scrap) {
+  read_svc_serverinfo(thisptr, stream, message, scrap, false, false, false);
+}
+
+static void handle_svc_serverinfo_steampipe(dg_parser *thisptr, dg_bitstream *stream,
+                                            packet_net_message *message, blk *scrap) {
+  read_svc_serverinfo(thisptr, stream, message, scrap, false, false, true);
+}
+
+static void handle_svc_serverinfo_protocol4(dg_parser *thisptr, dg_bitstream *stream,
+                                            packet_net_message *message, blk *scrap) {
+  read_svc_serverinfo(thisptr, stream, message, scrap, true, false, false);
+}
+
+static void handle_svc_serverinfo_l4d2_2147(dg_parser *thisptr, dg_bitstream *stream,
+                                            packet_net_message *message, blk *scrap) {
+  read_svc_serverinfo(thisptr, stream, message, scrap, true, true, false);
 }
 
 static void write_svc_serverinfo(dg_bitwriter *writer, dg_demver_data *version,
@@ -302,7 +320,6 @@ static void handle_svc_sendtable(dg_parser *thisptr, dg_bitstream *stream, packe
   ptr->needs_decoder = dg_bitstream_read_bit(stream);
   ptr->length = dg_bitstream_read_uint(stream, 16);
   ptr->data = dg_bitstream_fork_and_advance(stream, ptr->length);
-  SEND_MESSAGE();
 }
 
 static void write_svc_sendtable(dg_bitwriter *writer, dg_demver_data *version,
@@ -323,6 +340,7 @@ static void handle_svc_classinfo(dg_parser *thisptr, dg_bitstream *stream, packe
   if (!ptr->create_on_client) {
     ptr->server_classes = dg_alloc_allocate(
         arena, ptr->length * sizeof(struct dg_svc_classinfo_serverclass), 1);
+    DG_TRACK_ALLOC(netmessage_body, ptr->length * sizeof(struct dg_svc_classinfo_serverclass));
     for (unsigned int i = 0; i < ptr->length && !stream->overflow; ++i) {
       ptr->server_classes[i].class_id = dg_bitstream_read_uint(stream, bits);
       COPY_STRING(ptr->server_classes[i].class_name);
@@ -331,7 +349,6 @@ static void handle_svc_classinfo(dg_parser *thisptr, dg_bitstream *stream, packe
   } else {
     ptr->server_classes = NULL;
   }
-  SEND_MESSAGE();
 }
 
 static void write_svc_classinfo(dg_bitwriter *writer, dg_demver_data *version,
@@ -353,7 +370,6 @@ static void write_svc_classinfo(dg_bitwriter *writer, dg_demver_data *version,
 static void handle_svc_setpause(dg_parser *thisptr, dg_bitstream *stream, packet_net_message *message,
                                 blk *scrap) {
   message->message_svc_setpause.paused = dg_bitstream_read_bit(stream);
-  SEND_MESSAGE();
 }
 
 static void write_svc_setpause(dg_bitwriter *writer, dg_demver_data *version,
@@ -362,8 +378,9 @@ static void write_svc_setpause(dg_bitwriter *writer, dg_demver_data *version,
   dg_bitwriter_write_bit(writer, ptr->paused);
 }
 
-static void handle_svc_create_stringtable(dg_parser *thisptr, dg_bitstream *stream,
-                                          packet_net_message *message, blk *scrap) {
+static inline void read_svc_create_stringtable(dg_parser *thisptr, dg_bitstream *stream,
+                                               packet_net_message *message, blk *scrap,
+                                               bool steampipe_format, bool has_flags) {
   struct dg_svc_create_stringtable *ptr = &message->message_svc_create_stringtable;
   COPY_STRING(ptr->name);
   ptr->max_entries = dg_bitstream_read_uint(stream, 16);
@@ -371,7 +388,7 @@ static void handle_svc_create_stringtable(dg_parser *thisptr, dg_bitstream *stre
   ptr->num_entries = dg_bitstream_read_uint(stream, num_entries_bits);
   uint32_t data_length;
 
-  if (thisptr->demo_version.game == steampipe) {
+  if (steampipe_format) {
     data_length = dg_bitstream_read_varuint32(stream);
   } else {
     data_length =
@@ -388,7 +405,7 @@ static void handle_svc_create_stringtable(dg_parser *thisptr, dg_bitstream *stre
     ptr->user_data_size_bits = 0;
   }
 
-  if (thisptr->demo_version.network_protocol >= 15) {
+  if (has_flags) {
     ptr->flags = dg_bitstream_read_uint(stream, thisptr->demo_version.stringtable_flags_bits);
   } else {
     ptr->flags = 0;
@@ -397,35 +414,38 @@ static void handle_svc_create_stringtable(dg_parser *thisptr, dg_bitstream *stre
   ptr->data = dg_bitstream_fork_and_advance(stream, data_length);
 
   dg_parse_result result;
-  if((ptr->flags & 1) == 0 && thisptr->demo_version.demo_protocol <= 3) {
-    dg_sentry_parse_args args;
-    args.allocator = dg_parser_packet_allocator(thisptr);
-    args.flags = ptr->flags;
-    args.demver_data = &thisptr->demo_version;
-    args.max_entries = ptr->max_entries;
-    args.num_updated_entries = ptr->num_entries;
-    args.stream = ptr->data;
-    args.user_data_fixed_size = ptr->user_data_size;
-    args.user_data_size_bits = ptr->user_data_size_bits;
-    result = dg_parse_stringtable_entry(&args, &ptr->stringtable);
-
-    if(!result.error) {
-      result = dg_parser_add_stringtable(thisptr, &ptr->stringtable);
-    }
-
-  } else {
-    ptr->stringtable.dictionary_enabled = false;
-    ptr->stringtable.flags = ptr->flags;
-    ptr->stringtable.max_entries = ptr->max_entries;
-    ptr->stringtable.user_data_fixed_size = ptr->user_data_fixed_size;
-    ptr->stringtable.user_data_size_bits = ptr->user_data_size_bits;
-    result = dg_parser_add_stringtable(thisptr, &ptr->stringtable);
+  dg_sentry_parse_args args;
+  args.allocator = dg_parser_packet_allocator(thisptr);
+  args.flags = ptr->flags;
+  args.demver_data = &thisptr->demo_version;
+  args.max_entries = ptr->max_entries;
+  args.num_updated_entries = ptr->num_entries;
+  args.stream = ptr->data;
+  args.user_data_fixed_size = ptr->user_data_size;
+  args.user_data_size_bits = ptr->user_data_size_bits;
+  result = dg_parse_stringtable_entry(&args, &ptr->stringtable);
+
+  if(!result.error) {
+    result = dg_parser_add_stringtable_ex(thisptr, ptr->name, &ptr->stringtable);
   }
 
   thisptr->error = result.error;
   thisptr->error_message = result.error_message;
+}
+
+static void handle_svc_create_stringtable(dg_parser *thisptr, dg_bitstream *stream,
+                                          packet_net_message *message, blk *scrap) {
+  read_svc_create_stringtable(thisptr, stream, message, scrap, false, true);
+}
 
-  SEND_MESSAGE();
+static void handle_svc_create_stringtable_no_flags(dg_parser *thisptr, dg_bitstream *stream,
+                                                   packet_net_message *message, blk *scrap) {
+  read_svc_create_stringtable(thisptr, stream, message, scrap, false, false);
+}
+
+static void handle_svc_create_stringtable_steampipe(dg_parser *thisptr, dg_bitstream *stream,
+                                                    packet_net_message *message, blk *scrap) {
+  read_svc_create_stringtable(thisptr, stream, message, scrap, true, true);
 }
 
 static void write_svc_create_stringtable(dg_bitwriter *writer, dg_demver_data *version,
@@ -457,8 +477,8 @@ static void write_svc_create_stringtable(dg_bitwriter *writer, dg_demver_data *v
   dg_bitwriter_write_bitstream(writer, &ptr->data);
 }
 
-static void handle_svc_update_stringtable(dg_parser *thisptr, dg_bitstream *stream,
-                                          packet_net_message *message, blk *scrap) {
+static inline void read_svc_update_stringtable(dg_parser *thisptr, dg_bitstream *stream,
+                                               packet_net_message *message, uint32_t length_bits) {
   struct dg_svc_update_stringtable *ptr = &message->message_svc_update_stringtable;
   ptr->table_id =
       dg_bitstream_read_uint(stream, thisptr->demo_version.svc_update_stringtable_table_id_bits);
@@ -469,16 +489,10 @@ static void handle_svc_update_stringtable(dg_parser *thisptr, dg_bitstream *stre
     ptr->changed_entries = 1;
   }
 
-  uint32_t data_length;
-
-  if (thisptr->demo_version.network_protocol <= 7) {
-    data_length = dg_bitstream_read_uint(stream, 16);
-  } else {
-    data_length = dg_bitstream_read_uint(stream, 20);
-  }
+  uint32_t data_length = dg_bitstream_read_uint(stream, length_bits);
   ptr->data = dg_bitstream_fork_and_advance(stream, data_length);
 
-  if(ptr->table_id < thisptr->state.stringtables_count && thisptr->demo_version.demo_protocol <= 3) {
+  if(ptr->table_id < thisptr->state.stringtables_count) {
     dg_stringtable_data *data = thisptr->state.stringtables + ptr->table_id;
     dg_sentry_parse_args args;
     args.allocator = dg_parser_packet_allocator(thisptr);
@@ -489,13 +503,25 @@ static void handle_svc_update_stringtable(dg_parser *thisptr, dg_bitstream *stre
     args.stream = ptr->data;
     args.user_data_fixed_size = data->user_data_fixed_size;
     args.user_data_size_bits = data->user_data_size_bits;
-    
+
     dg_parse_result result = dg_parse_stringtable_entry(&args, &ptr->parsed_sentry);
+    if(!result.error) {
+      result = dg_parser_update_stringtable(thisptr, ptr->table_id, &ptr->parsed_sentry);
+    }
     thisptr->error = result.error;
     thisptr->error_message = result.error_message;
   }
+}
 
-  SEND_MESSAGE();
+static void handle_svc_update_stringtable(dg_parser *thisptr, dg_bitstream *stream,
+                                          packet_net_message *message, blk *scrap) {
+  read_svc_update_stringtable(thisptr, stream, message, 20);
+}
+
+// Network protocol 7 and older use a 16 bit length
+static void handle_svc_update_stringtable_protocol7(dg_parser *thisptr, dg_bitstream *stream,
+                                                    packet_net_message *message, blk *scrap) {
+  read_svc_update_stringtable(thisptr, stream, message, 16);
 }
 
 static void write_svc_update_stringtable(dg_bitwriter *writer, dg_demver_data *version,
@@ -525,18 +551,27 @@ static void handle_svc_voice_init(dg_parser *thisptr, dg_bitstream *stream,
 
   COPY_STRING(ptr->codec);
   ptr->quality = dg_bitstream_read_uint(stream, 8);
+  // The trailing value is not available on other versions
+}
+
+// Steampipe version uses shorts
+static void handle_svc_voice_init_steampipe(dg_parser *thisptr, dg_bitstream *stream,
+                                            packet_net_message *message, blk *scrap) {
+  handle_svc_voice_init(thisptr, stream, message, scrap);
+  struct dg_svc_voice_init *ptr = &message->message_svc_voice_init;
   if (ptr->quality == 255) {
-    // Steampipe version uses shorts
-    if (thisptr->demo_version.game == steampipe) {
-      ptr->unk = dg_bitstream_read_uint(stream, 16);
-    }
-    // Protocol 4 version uses floats?
-    else if (thisptr->demo_version.demo_protocol == 4) {
-      ptr->unk = dg_bitstream_read_float(stream);
-    }
-    // Not available on other versions
+    ptr->unk = dg_bitstream_read_uint(stream, 16);
+  }
+}
+
+// Protocol 4 version uses floats?
+static void handle_svc_voice_init_protocol4(dg_parser *thisptr, dg_bitstream *stream,
+                                            packet_net_message *message, blk *scrap) {
+  handle_svc_voice_init(thisptr, stream, message, scrap);
+  struct dg_svc_voice_init *ptr = &message->message_svc_voice_init;
+  if (ptr->quality == 255) {
+    ptr->unk = dg_bitstream_read_float(stream);
   }
-  SEND_MESSAGE();
 }
 
 static void write_svc_voice_init(dg_bitwriter *writer, dg_demver_data *version,
@@ -561,7 +596,6 @@ static void handle_svc_voice_data(dg_parser *thisptr, dg_bitstream *stream,
   ptr->proximity = dg_bitstream_read_uint(stream, 8);
   ptr->length = dg_bitstream_read_uint(stream, 16);
   ptr->data = dg_bitstream_fork_and_advance(stream, ptr->length);
-  SEND_MESSAGE();
 }
 
 static void write_svc_voice_data(dg_bitwriter *writer, dg_demver_data *version,
@@ -582,7 +616,6 @@ static void handle_svc_sounds(dg_parser *thisptr, dg_bitstream *stream, packet_n
     ptr->length = dg_bitstream_read_uint(stream, 16);
   }
   ptr->data = dg_bitstream_fork_and_advance(stream, ptr->length);
-  SEND_MESSAGE();
 }
 
 static void write_svc_sounds(dg_bitwriter *writer, dg_demver_data *version,
@@ -603,7 +636,6 @@ static void handle_svc_setview(dg_parser *thisptr, dg_bitstream *stream, packet_
                                blk *scrap) {
   struct dg_svc_setview *ptr = &message->message_svc_setview;
   ptr->entity_index = dg_bitstream_read_uint(stream, 11);
-  SEND_MESSAGE();
 }
 
 static void write_svc_setview(dg_bitwriter *writer, dg_demver_data *version,
@@ -617,7 +649,6 @@ static void handle_svc_fixangle(dg_parser *thisptr, dg_bitstream *stream, packet
   struct dg_svc_fixangle *ptr = &message->message_svc_fixangle;
   ptr->relative = dg_bitstream_read_bit(stream);
   ptr->angle = dg_bitstream_read_bitvector(stream, 16);
-  SEND_MESSAGE();
 }
 
 static void write_svc_fixangle(dg_bitwriter *writer, dg_demver_data *version,
@@ -631,7 +662,6 @@ static void handle_svc_crosshair_angle(dg_parser *thisptr, dg_bitstream *stream,
                                        packet_net_message *message, blk *scrap) {
   struct dg_svc_crosshair_angle *ptr = &message->message_svc_crosshair_angle;
   ptr->angle = dg_bitstream_read_bitvector(stream, 16);
-  SEND_MESSAGE();
 }
 
 static void write_svc_crosshair_angle(dg_bitwriter *writer, dg_demver_data *version,
@@ -652,7 +682,6 @@ static void handle_svc_bsp_decal(dg_parser *thisptr, dg_bitstream *stream, packe
     ptr->model_index = dg_bitstream_read_uint(stream, thisptr->demo_version.model_index_bits);
   }
   ptr->lowpriority = dg_bitstream_read_bit(stream);
-  SEND_MESSAGE();
 }
 
 static void write_svc_bsp_decal(dg_bitwriter *writer, dg_demver_data *version,
@@ -676,7 +705,10 @@ static void handle_svc_user_message(dg_parser *thisptr, dg_bitstream *stream,
   ptr->msg_type = dg_bitstream_read_uint(stream, 8);
   ptr->length = dg_bitstream_read_uint(stream, thisptr->demo_version.svc_user_message_bits);
   ptr->data = dg_bitstream_fork_and_advance(stream, ptr->length);
-  SEND_MESSAGE();
+  // Only the registry lookup happens here, payloads are decoded when first accessed
+  ptr->type = dg_user_message_type_get(&thisptr->user_messages, ptr->msg_type);
+  ptr->decoded = NULL;
+  ptr->allocator = dg_parser_packet_allocator(thisptr);
 }
 
 static void write_svc_user_message(dg_bitwriter *writer, dg_demver_data *version,
@@ -694,7 +726,6 @@ static void handle_svc_entity_message(dg_parser *thisptr, dg_bitstream *stream,
   ptr->class_id = dg_bitstream_read_uint(stream, 9);
   ptr->length = dg_bitstream_read_uint(stream, 11);
   ptr->data = dg_bitstream_fork_and_advance(stream, ptr->length);
-  SEND_MESSAGE();
 }
 
 static void write_svc_entity_message(dg_bitwriter *writer, dg_demver_data *version,
@@ -711,8 +742,22 @@ static void handle_svc_game_event(dg_parser *thisptr, dg_bitstream *stream,
   struct dg_svc_game_event *ptr = &message->message_svc_game_event;
   ptr->length = dg_bitstream_read_uint(stream, 11);
   ptr->data = dg_bitstream_fork_and_advance(stream, ptr->length);
+  ptr->event = NULL;
 
-  SEND_MESSAGE();
+  const dg_game_event_list *list = thisptr->state.game_event_list;
+  if (thisptr->m_settings.game_event_handler && list) {
+    dg_alloc_state *arena = dg_parser_packet_allocator(thisptr);
+    dg_game_event *event = dg_alloc_allocate(arena, sizeof(dg_game_event), alignof(dg_game_event));
+    dg_parse_result result = dg_parse_game_event(event, list, ptr, arena);
+
+    if (result.error) {
+      thisptr->error = true;
+      thisptr->error_message = result.error_message;
+    } else if (event->descriptor) {
+      ptr->event = event;
+      thisptr->m_settings.game_event_handler(&thisptr->state, event);
+    }
+  }
 }
 
 static void write_svc_game_event(dg_bitwriter *writer, dg_demver_data *version,
@@ -743,7 +788,6 @@ static void handle_svc_packet_entities(dg_parser *thisptr, dg_bitstream *stream,
   if (thisptr->m_settings.parse_packetentities) {
     dg_parser_handle_packetentities(thisptr, ptr);
   }
-  SEND_MESSAGE();
 }
 
 static void write_svc_packet_entities(dg_bitwriter *writer, dg_demver_data *version,
@@ -763,22 +807,37 @@ static void write_svc_packet_entities(dg_bitwriter *writer, dg_demver_data *vers
   dg_bitwriter_write_bitstream(writer, &ptr->data);
 }
 
+static void read_svc_temp_entities_data(dg_parser *thisptr, dg_bitstream *stream,
+                                        struct dg_svc_temp_entities *ptr, uint32_t data_length) {
+  ptr->data = dg_bitstream_fork_and_advance(stream, data_length);
+  ptr->parsed = NULL;
+
+  if (thisptr->m_settings.temp_entities_parsed_handler &&
+      thisptr->state.entity_state.class_datas) {
+    dg_parser_handle_temp_entities(thisptr, ptr);
+  }
+}
+
+// The length prefix is 17 bits by default, 18 bits on l4d2 and a varint on steampipe
 static void handle_svc_temp_entities(dg_parser *thisptr, dg_bitstream *stream,
                                      packet_net_message *message, blk *scrap) {
   struct dg_svc_temp_entities *ptr = &message->message_svc_temp_entities;
   ptr->num_entries = dg_bitstream_read_uint(stream, 8);
-  uint32_t data_length;
+  read_svc_temp_entities_data(thisptr, stream, ptr, dg_bitstream_read_uint(stream, 17));
+}
 
-  if (thisptr->demo_version.game == steampipe) {
-    data_length = dg_bitstream_read_varuint32(stream);
-  } else if (thisptr->demo_version.game == l4d2) {
-    data_length = dg_bitstream_read_uint(stream, 18);
-  } else {
-    data_length = dg_bitstream_read_uint(stream, 17);
-  }
-  ptr->data = dg_bitstream_fork_and_advance(stream, data_length);
+static void handle_svc_temp_entities_l4d2(dg_parser *thisptr, dg_bitstream *stream,
+                                          packet_net_message *message, blk *scrap) {
+  struct dg_svc_temp_entities *ptr = &message->message_svc_temp_entities;
+  ptr->num_entries = dg_bitstream_read_uint(stream, 8);
+  read_svc_temp_entities_data(thisptr, stream, ptr, dg_bitstream_read_uint(stream, 18));
+}
 
-  SEND_MESSAGE();
+static void handle_svc_temp_entities_steampipe(dg_parser *thisptr, dg_bitstream *stream,
+                                               packet_net_message *message, blk *scrap) {
+  struct dg_svc_temp_entities *ptr = &message->message_svc_temp_entities;
+  ptr->num_entries = dg_bitstream_read_uint(stream, 8);
+  read_svc_temp_entities_data(thisptr, stream, ptr, dg_bitstream_read_varuint32(stream));
 }
 
 static void write_svc_temp_entities(dg_bitwriter *writer, dg_demver_data *version,
@@ -801,7 +860,6 @@ static void handle_svc_prefetch(dg_parser *thisptr, dg_bitstream *stream, packet
                                 blk *scrap) {
   struct dg_svc_prefetch *ptr = &message->message_svc_prefetch;
   ptr->sound_index = dg_bitstream_read_uint(stream, thisptr->demo_version.svc_prefetch_bits);
-  SEND_MESSAGE();
 }
 
 static void write_svc_prefetch(dg_bitwriter *writer, dg_demver_data *version,
@@ -816,7 +874,6 @@ static void handle_svc_menu(dg_parser *thisptr, dg_bitstream *stream, packet_net
   ptr->menu_type = dg_bitstream_read_uint(stream, 16);
   uint32_t data_length = dg_bitstream_read_uint32(stream);
   ptr->data = dg_bitstream_fork_and_advance(stream, data_length);
-  SEND_MESSAGE();
 }
 
 static void write_svc_menu(dg_bitwriter *writer, dg_demver_data *version,
@@ -831,7 +888,28 @@ static void handle_svc_game_event_list(dg_parser *thisptr, dg_bitstream *stream,
   ptr->events = dg_bitstream_read_uint(stream, 9);
   ptr->length = dg_bitstream_read_uint(stream, 20);
   ptr->data = dg_bitstream_fork_and_advance(stream, ptr->length);
-  SEND_MESSAGE();
+  ptr->list = NULL;
+
+  if (thisptr->m_settings.game_event_handler) {
+    dg_alloc_state *allocator = dg_parser_perm_allocator(thisptr);
+    dg_game_event_list *list =
+        dg_alloc_allocate(allocator, sizeof(dg_game_event_list), alignof(dg_game_event_list));
+    dg_parse_result result = dg_parse_game_event_list(list, ptr, allocator);
+
+    if (result.error) {
+      dg_game_event_list_free(list);
+      thisptr->error = true;
+      thisptr->error_message = result.error_message;
+    } else {
+      dg_game_event_list_set_wanted(list, thisptr->m_settings.game_event_names,
+                                    thisptr->m_settings.game_event_names_count);
+      if (thisptr->state.game_event_list) {
+        dg_game_event_list_free((dg_game_event_list *)thisptr->state.game_event_list);
+      }
+      thisptr->state.game_event_list = list;
+      ptr->list = list;
+    }
+  }
 }
 
 static void write_svc_game_event_list(dg_bitwriter *writer, dg_demver_data *version,
@@ -847,7 +925,6 @@ static void handle_svc_get_cvar_value(dg_parser *thisptr, dg_bitstream *stream,
   struct dg_svc_get_cvar_value *ptr = &message->message_svc_get_cvar_value;
   ptr->cookie = dg_bitstream_read_sint32(stream);
   COPY_STRING(ptr->cvar_name);
-  SEND_MESSAGE();
 }
 
 static void write_svc_get_cvar_value(dg_bitwriter *writer, dg_demver_data *version,
@@ -860,7 +937,6 @@ static void write_svc_get_cvar_value(dg_bitwriter *writer, dg_demver_data *versi
 static void handle_net_splitscreen_user(dg_parser *thisptr, dg_bitstream *stream,
                                         packet_net_message *message, blk *scrap) {
   message->message_net_splitscreen_user.unk = dg_bitstream_read_bit(stream);
-  SEND_MESSAGE();
 }
 
 static void write_net_splitscreen_user(dg_bitwriter *writer, dg_demver_data *version,
@@ -875,7 +951,6 @@ static void handle_svc_splitscreen(dg_parser *thisptr, dg_bitstream *stream,
   ptr->remove_user = dg_bitstream_read_bit(stream);
   uint32_t data_length = dg_bitstream_read_uint(stream, 11);
   ptr->data = dg_bitstream_fork_and_advance(stream, data_length);
-  SEND_MESSAGE();
 }
 
 static void write_svc_splitscreen(dg_bitwriter *writer, dg_demver_data *version,
@@ -889,7 +964,6 @@ static void handle_svc_paintmap_data(dg_parser *thisptr, dg_bitstream *stream,
   struct dg_svc_paintmap_data *ptr = &message->message_svc_paintmap_data;
   uint32_t data_length = dg_bitstream_read_uint32(stream);
   ptr->data = dg_bitstream_fork_and_advance(stream, data_length);
-  SEND_MESSAGE();
 }
 
 static void write_svc_paintmap_data(dg_bitwriter *writer, dg_demver_data *version,
@@ -905,7 +979,6 @@ static void handle_svc_cmd_key_values(dg_parser *thisptr, dg_bitstream *stream,
   struct dg_svc_cmd_key_values *ptr = &message->message_svc_cmd_key_values;
   uint32_t data_length = dg_bitstream_read_uint32(stream);
   ptr->data = dg_bitstream_fork_and_advance(stream, data_length * 8);
-  SEND_MESSAGE();
 }
 
 static void write_svc_cmd_key_values(dg_bitwriter *writer, dg_demver_data *version,
@@ -916,49 +989,160 @@ static void write_svc_cmd_key_values(dg_bitwriter *writer, dg_demver_data *versi
   dg_bitwriter_write_bitstream(writer, &ptr->data);
 }
 
-static net_message_type version_get_message_type(dg_parser *thisptr, unsigned int value) {
-  net_message_type *list = thisptr->demo_version.netmessage_array;
-  size_t count = thisptr->demo_version.netmessage_count;
+typedef void (*func_write_netmessage)(dg_bitwriter *writer, dg_demver_data *version,
+                                      packet_net_message *message);
+
+#define DECLARE_HANDLER(message_type) [message_type] = handle_##message_type,
+#define DECLARE_WRITER(message_type) [message_type] = write_##message_type,
+
+static const func_dg_netmessage_handler HANDLERS[] = {
+    DEMOGOBBLER_MACRO_ALL_MESSAGES(DECLARE_HANDLER)};
+static const func_write_netmessage WRITERS[] = {DEMOGOBBLER_MACRO_ALL_MESSAGES(DECLARE_WRITER)};
+
+#undef DECLARE_HANDLER
+#undef DECLARE_WRITER
+
+static func_dg_netmessage_handler version_get_handler(dg_demver_data *version,
+                                                      net_message_type type) {
+  switch (type) {
+  case net_tick:
+    return version->has_nettick_times ? handle_net_tick : handle_net_tick_no_times;
+  case net_signonstate:
+    return version->demo_protocol >= 4 ? handle_net_signonstate_protocol4 : handle_net_signonstate;
+  case svc_print:
+    return version->game == l4d2 && version->l4d2_version == 2042 ? handle_svc_print_l4d2_2042
+                                                                   : handle_svc_print;
+  case svc_serverinfo:
+    if (version->game == l4d2 && version->l4d2_version >= 2147) {
+      return handle_svc_serverinfo_l4d2_2147;
+    } else if (version->demo_protocol >= 4) {
+      return handle_svc_serverinfo_protocol4;
+    } else if (version->game == steampipe) {
+      return handle_svc_serverinfo_steampipe;
+    } else {
+      return handle_svc_serverinfo;
+    }
+  case svc_create_stringtable:
+    if (version->game == steampipe) {
+      return handle_svc_create_stringtable_steampipe;
+    } else if (version->network_protocol >= 15) {
+      return handle_svc_create_stringtable;
+    } else {
+      return handle_svc_create_stringtable_no_flags;
+    }
+  case svc_update_stringtable:
+    return version->network_protocol <= 7 ? handle_svc_update_stringtable_protocol7
+                                          : handle_svc_update_stringtable;
+  case svc_voice_init:
+    if (version->game == steampipe) {
+      return handle_svc_voice_init_steampipe;
+    } else if (version->demo_protocol == 4) {
+      return handle_svc_voice_init_protocol4;
+    } else {
+      return handle_svc_voice_init;
+    }
+  case svc_temp_entities:
+    if (version->game == steampipe) {
+      return handle_svc_temp_entities_steampipe;
+    } else if (version->game == l4d2) {
+      return handle_svc_temp_entities_l4d2;
+    } else {
+      return handle_svc_temp_entities;
+    }
+  default:
+    return HANDLERS[type];
+  }
+}
+
+void dg_netmessage_dispatch_init(dg_parser *thisptr) {
+  dg_demver_data *version = &thisptr->demo_version;
+  dg_netmessage_dispatch *dispatch = &thisptr->netmessage_dispatch;
 
-  if (value >= count || list[value] == svc_invalid) {
-    thisptr->error = true;
-    thisptr->error_message = "Encountered bad net message type.\n";
-    return svc_invalid;
-  } else {
-    return list[value];
+  for (size_t i = 0; i < DG_NETMESSAGE_MAX_IDS; ++i) {
+    net_message_type type =
+        i < version->netmessage_count ? version->netmessage_array[i] : svc_invalid;
+    dispatch->types[i] = type;
+    dispatch->handlers[i] = type != svc_invalid ? version_get_handler(version, type) : NULL;
   }
 }
 
 void dg_bitwriter_write_netmessage(dg_bitwriter *writer, dg_demver_data *version,
                                    packet_net_message *message) {
-  int type_out = -1;
-  // Don't use the type index directly, we want to support writing to different protocols than the
-  // demo was read
-  for (int i = 0; i < version->netmessage_count; ++i) {
-    if (version->netmessage_array[i] == message->mtype) {
-      type_out = i;
-      break;
-    }
+  if (message->mtype >= svc_invalid) {
+    writer->error = true;
+    writer->error_message = "No handler for this type of message.";
+    return;
   }
 
-#define DECLARE_SWITCH_STATEMENT(message_type)                                                     \
-  case message_type:                                                                               \
-    write_##message_type(writer, version, message);                                                \
-    break;
-
-  // Only write if exists on this protocol
+  // Don't use the type index the message was read with, we want to support writing to different
+  // protocols than the demo was read. Only write if exists on this protocol
+  int type_out = version->netmessage_ids[message->mtype];
   if (type_out != -1) {
     dg_bitwriter_write_uint(writer, type_out, version->netmessage_type_bits);
+    WRITERS[message->mtype](writer, version, message);
+  }
+}
 
-    switch (message->mtype) {
-      DEMOGOBBLER_MACRO_ALL_MESSAGES(DECLARE_SWITCH_STATEMENT);
-    default:
-      writer->error = true;
-      writer->error_message = "No handler for this type of message.";
-      break;
+#define RECORD_ALIGNMENT 8
+#define RECORD_SIZE(message_type)                                                                  \
+  (offsetof(packet_net_message, message_##message_type) +                                          \
+   sizeof(((packet_net_message *)0)->message_##message_type) + RECORD_ALIGNMENT - 1) &             \
+      ~(size_t)(RECORD_ALIGNMENT - 1)
+#define DECLARE_RECORD_SIZE(message_type) [message_type] = RECORD_SIZE(message_type),
+
+static const uint32_t RECORD_BYTES[] = {DEMOGOBBLER_MACRO_ALL_MESSAGES(DECLARE_RECORD_SIZE)};
+
+#undef DECLARE_RECORD_SIZE
+#undef RECORD_SIZE
+
+// Records are written straight into packet memory, it only moves if the initial guess is too small
+typedef struct {
+  uint8_t *data;
+  uint32_t size;
+  uint32_t capacity;
+  uint32_t count;
+  dg_alloc_state *allocator;
+} record_buffer;
+
+uint32_t dg_netmessage_record_bytes(net_message_type type) {
+  return type < svc_invalid ? RECORD_BYTES[type] : sizeof(packet_net_message);
+}
+
+packet_net_message *dg_netmessage_next(const packet_net_message *message) {
+  return (packet_net_message *)((uint8_t *)message + RECORD_BYTES[message->mtype]);
+}
+
+// The parsed entity messages point back at their records, so point them at the moved copies
+static void repoint_records(record_buffer *thisptr) {
+  packet_net_message *message = (packet_net_message *)thisptr->data;
+  for (uint32_t i = 0; i < thisptr->count; ++i, message = dg_netmessage_next(message)) {
+    if (message->mtype == svc_packet_entities && message->message_svc_packet_entities.parsed) {
+      message->message_svc_packet_entities.parsed->orig = &message->message_svc_packet_entities;
+    } else if (message->mtype == svc_temp_entities && message->message_svc_temp_entities.parsed) {
+      message->message_svc_temp_entities.parsed->orig = &message->message_svc_temp_entities;
     }
   }
-#undef DECLARE_SWITCH_STATEMENT
+}
+
+static packet_net_message *push_record(record_buffer *thisptr, net_message_type type) {
+  uint32_t bytes = dg_netmessage_record_bytes(type);
+
+  if (thisptr->size + bytes > thisptr->capacity) {
+    uint32_t capacity = MAX(thisptr->capacity * 2, thisptr->size + bytes);
+    uint8_t *data = dg_alloc_allocate(thisptr->allocator, capacity, RECORD_ALIGNMENT);
+    DG_TRACK_ALLOC(parse_netmessages, capacity);
+    memcpy(data, thisptr->data, thisptr->size);
+    thisptr->data = data;
+    thisptr->capacity = capacity;
+    repoint_records(thisptr);
+  }
+
+  packet_net_message *message = (packet_net_message *)(thisptr->data + thisptr->size);
+  memset(message, 0, bytes);
+  message->mtype = type;
+  thisptr->size += bytes;
+  ++thisptr->count;
+  return message;
 }
 
 void parse_netmessages(dg_parser *thisptr, dg_packet *packet) {
@@ -980,10 +1164,24 @@ void parse_netmessages(dg_parser *thisptr, dg_packet *packet) {
   blk scrap_blk;
   scrap_blk.address = dg_alloc_allocate(arena, size, 1);
   scrap_blk.size = size;
+  DG_TRACK_ALLOC(parse_netmessages_scrap, size);
   unsigned int bits = thisptr->demo_version.netmessage_type_bits;
+  const dg_netmessage_dispatch *dispatch = &thisptr->netmessage_dispatch;
 
-  packet_net_message initial_array[64];
-  dg_vector_array packet_arr = dg_va_create(initial_array, packet_net_message);
+  if (thisptr->state.stringtable_changes_tick != packet->preamble.tick) {
+    thisptr->state.stringtable_changes_tick = packet->preamble.tick;
+    thisptr->state.stringtable_changes_count = 0;
+    thisptr->state.stringtable_changes_dropped = 0;
+  }
+
+  // Most messages take more bits on the wire than their record takes bytes
+  record_buffer records;
+  records.allocator = arena;
+  records.size = 0;
+  records.count = 0;
+  records.capacity = MAX(size * 2, 256);
+  records.data = dg_alloc_allocate(arena, records.capacity, RECORD_ALIGNMENT);
+  DG_TRACK_ALLOC(parse_netmessages, records.capacity);
 
   while (dg_bitstream_bits_left(&stream) > bits && !thisptr->error && !stream.overflow) {
     if (scrap_blk.address == NULL) {
@@ -992,8 +1190,16 @@ void parse_netmessages(dg_parser *thisptr, dg_packet *packet) {
       break;
     }
 
+    uint32_t bit_start = stream.bitoffset;
     unsigned int type_index = dg_bitstream_read_uint(&stream, bits);
-    net_message_type type = version_get_message_type(thisptr, type_index);
+    func_dg_netmessage_handler handler =
+        type_index < DG_NETMESSAGE_MAX_IDS ? dispatch->handlers[type_index] : NULL;
+    if (handler == NULL) {
+      thisptr->error = true;
+      thisptr->error_message = "Encountered bad net message type.\n";
+      break;
+    }
+    net_message_type type = dispatch->types[type_index];
 
 #ifdef DEBUG
     if (history_index < MAX_HISTORY) {
@@ -1003,25 +1209,14 @@ void parse_netmessages(dg_parser *thisptr, dg_packet *packet) {
 #endif
 
     // fprintf(stderr, "%d : %d\n", type_index, type);
-    packet_net_message *message = dg_va_push_back_empty(&packet_arr);
-    memset(message, 0, sizeof(packet_net_message));
-    message->mtype = type;
-
-#define DECLARE_SWITCH_STATEMENT(message_type)                                                     \
-  case message_type:                                                                               \
-    handle_##message_type(thisptr, &stream, message, &scrap_blk);                                  \
-    break;
-
-    switch (type) {
-      DEMOGOBBLER_MACRO_ALL_MESSAGES(DECLARE_SWITCH_STATEMENT);
-    default:
-      thisptr->error = true;
-      thisptr->error_message = "No handler for this type of message.";
-      break;
-    }
+    packet_net_message *message = push_record(&records, type);
+    DG_TRACK_NETMESSAGE(type);
+    message->bit_start = bit_start;
+    handler(thisptr, &stream, message, &scrap_blk);
+    message->bit_end = stream.bitoffset;
   }
 
-#undef DECLARE_SWITCH_STATEMENT
+  DG_TRACK_NETMESSAGE(svc_invalid);
 
   if (stream.overflow && !thisptr->error) {
     thisptr->error = true;
@@ -1031,11 +1226,10 @@ void parse_netmessages(dg_parser *thisptr, dg_packet *packet) {
   if (!thisptr->error) {
     packet_parsed parsed;
     memset(&parsed, 0, sizeof(parsed));
-    parsed.messages = dg_alloc_allocate(arena, packet_arr.count_elements * sizeof(packet_net_message), alignof(packet_net_message));
-    memcpy(parsed.messages, packet_arr.ptr, packet_arr.count_elements * sizeof(packet_net_message));
-
-    parsed.message_count = packet_arr.count_elements;
+    parsed.first_message = (packet_net_message *)records.data;
+    parsed.message_count = records.count;
     parsed.orig = *packet;
+    parsed.version = thisptr->demo_version;
     parsed.leftover_bits = stream;
 
     if (thisptr->m_settings.packet_parsed_handler) {
@@ -1051,7 +1245,6 @@ void parse_netmessages(dg_parser *thisptr, dg_packet *packet) {
   }
 
   // fprintf(stderr, "packet end:\n");
-  dg_va_free(&packet_arr);
 
 #ifdef DEBUG
   if (thisptr->error) {
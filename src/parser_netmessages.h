@@ -2,4 +2,6 @@
 
 #include "demogobbler/parser.h"
 
+// Resolves the handlers for thisptr->demo_version, call whenever it changes
+void dg_netmessage_dispatch_init(dg_parser *thisptr);
 void parse_netmessages(dg_parser *thisptr, dg_packet *packet);
@@ -1,4 +1,5 @@
 #include "parser_packetentities.h"
+#include "alloc_telemetry.h"
 #include "demogobbler.h"
 #include "demogobbler/allocator.h"
 #include "demogobbler/bitstream.h"
@@ -24,6 +25,8 @@ struct prop_parse_state {
   dg_vector_array prop_array;
   const char* error_message;
   bool error;
+  bool discard_props; // Read past the props without storing them in update
+  bool record_spans; // Fill in the prop bit spans, see dg_settings.record_prop_spans
 };
 
 typedef struct prop_parse_state prop_parse_state;
@@ -148,6 +151,7 @@ static void write_vector3(dg_bitwriter *thisptr, dg_prop_value_inner value) {
 
 static void read_vector3(prop_parse_state *state, dg_sendprop *prop, dg_prop_value_inner *value) {
   value->v3_val = dg_alloc_allocate(state->allocator, sizeof(dg_vector3_value), alignof(dg_vector3_value));
+  DG_TRACK_ALLOC(read_vector3, sizeof(dg_vector3_value));
   memset(value->v3_val, 0, sizeof(dg_vector3_value));
 
   read_float(state, prop, &value->v3_val->x);
@@ -168,6 +172,7 @@ static void write_vector2(dg_bitwriter *thisptr, dg_prop_value_inner value) {
 
 static void read_vector2(prop_parse_state *state, dg_sendprop *prop, dg_prop_value_inner *value) {
   value->v2_val = dg_alloc_allocate(state->allocator, sizeof(dg_vector2_value), alignof(dg_vector2_value));
+  DG_TRACK_ALLOC(read_vector2, sizeof(dg_vector2_value));
   memset(value->v2_val, 0, sizeof(dg_vector2_value));
 
   read_float(state, prop, &value->v2_val->x);
@@ -185,6 +190,8 @@ static void read_string(prop_parse_state *state, dg_sendprop *prop, dg_prop_valu
   value->str_val = dg_alloc_allocate(state->allocator, sizeof(dg_string_value), alignof(dg_string_value));
   size_t len = value->str_val->len = dg_bitstream_read_uint(state->stream, dt_max_string_bits);
   value->str_val->str = dg_alloc_allocate(state->allocator, len + 1, 1);
+  DG_TRACK_ALLOC(read_string, sizeof(dg_string_value));
+  DG_TRACK_ALLOC(read_string, len + 1);
   dg_bitstream_read_fixed_string(state->stream, value->str_val->str, len);
   value->str_val->str[len] = '\0'; // make sure we have zero terminated string
 }
@@ -208,6 +215,8 @@ static void read_array(prop_parse_state *state, dg_sendprop *props, uint32_t pro
   value->arr_val->values =
       dg_alloc_allocate(state->allocator, sizeof(dg_prop_value_inner) * value->arr_val->array_size,
                         alignof(dg_prop_value_inner));
+  DG_TRACK_ALLOC(read_array, sizeof(dg_array_value));
+  DG_TRACK_ALLOC(read_array, sizeof(dg_prop_value_inner) * value->arr_val->array_size);
 
   for (size_t i = 0; i < value->arr_val->array_size; ++i) {
     prop_value temp = read_prop(state, props, prop->array_prop);
@@ -257,6 +266,7 @@ static prop_value read_prop(prop_parse_state *state, dg_sendprop *props, dg_send
   prop_value value;
   memset(&value, 0, sizeof(value));
   value.prop_index = prop - props;
+  uint32_t bit_start = state->stream->bitoffset;
   value.value.proptype = prop->proptype;
   if (prop->proptype == sendproptype_array) {
     read_array(state, props, value.prop_index, &value.value);
@@ -275,9 +285,27 @@ static prop_value read_prop(prop_parse_state *state, dg_sendprop *props, dg_send
     state->error_message = "Got an unknown prop type in read_prop";
   }
 
+  if (state->record_spans) {
+    value.bit_start = bit_start;
+    value.bit_length = state->stream->bitoffset - bit_start;
+  }
+
   return value;
 }
 
+// Copy the original bits of props that have not been changed since they were parsed
+static void write_prop_value(dg_bitwriter *thisptr, const dg_ent_update *update,
+                             const prop_value *value) {
+  if (update->prop_source && !value->dirty && value->bit_length > 0) {
+    dg_bitstream span =
+        dg_bitstream_create((void *)update->prop_source, value->bit_start + value->bit_length);
+    dg_bitstream_advance(&span, value->bit_start);
+    dg_bitwriter_write_bitstream(thisptr, &span);
+  } else {
+    write_prop(thisptr, value->value);
+  }
+}
+
 static void write_props_prot4(dg_bitwriter *thisptr, const dg_demver_data* demver_data,
                               const dg_ent_update *update) {
   if (demver_data->game != l4d) {
@@ -289,7 +317,7 @@ static void write_props_prot4(dg_bitwriter *thisptr, const dg_demver_data* demve
     int prop_index = update->prop_value_array[i].prop_index;
     dg_bitwriter_write_field_index(thisptr, prop_index, last_prop_index, update->new_way);
     last_prop_index = prop_index;
-    write_prop(thisptr, update->prop_value_array[i].value);
+    write_prop_value(thisptr, update, update->prop_value_array + i);
   }
 
   dg_bitwriter_write_field_index(thisptr, -1, last_prop_index, update->new_way);
@@ -326,7 +354,7 @@ static void write_props_old(dg_bitwriter *thisptr, const dg_ent_update *update)
     uint32_t diffy = prop_index - (old_prop_index + 1);
     old_prop_index = prop_index;
     dg_bitwriter_write_ubitvar(thisptr, diffy);
-    write_prop(thisptr, update->prop_value_array[i].value);
+    write_prop_value(thisptr, update, update->prop_value_array + i);
     //printf("write prop %d.%d (datatable_id %u) : %u offset\n", update->ent_index, prop_index, update->datatable_id, thisptr->bitoffset);
   }
   dg_bitwriter_write_bit(thisptr, false);
@@ -362,16 +390,18 @@ void dg_bitwriter_write_props(dg_bitwriter *thisptr, const dg_demver_data* demve
 
 static void parse_props(prop_parse_state *state) {
   dg_va_clear(&state->prop_array);
+  state->update->prop_source = state->record_spans ? state->stream->data : NULL;
   if (state->demver_data->demo_protocol == 4) {
     parse_props_prot4(state);
   } else {
     parse_props_old(state);
   }
 
-  if (state->prop_array.count_elements > 0) {
+  if (state->prop_array.count_elements > 0 && !state->discard_props) {
     state->update->prop_value_array_size = state->prop_array.count_elements;
     size_t bytes = sizeof(prop_value) * state->prop_array.count_elements;
     state->update->prop_value_array = dg_alloc_allocate(state->allocator, bytes, alignof(prop_value));
+    DG_TRACK_ALLOC(parse_props, bytes);
     memcpy(state->update->prop_value_array, state->prop_array.ptr, bytes);
   }
 }
@@ -382,6 +412,7 @@ static void read_explicit_deletes(prop_parse_state *state, dg_packetentities_dat
     uint32_t ncount = dg_bitstream_read_ubitint(state->stream);
     uint32_t bytes = sizeof(int32_t) * ncount;
     output->explicit_deletes = dg_alloc_allocate(state->allocator, bytes, alignof(int));
+    DG_TRACK_ALLOC(explicit_deletes, bytes);
     output->explicit_deletes_count = ncount;
 
     for (uint32_t i = 0; i < ncount; ++i) {
@@ -397,6 +428,7 @@ static void read_explicit_deletes(prop_parse_state *state, dg_packetentities_dat
     if (max_updates >= 1) {
       size_t bytes = sizeof(int) * max_updates;
       output->explicit_deletes = dg_alloc_allocate(state->allocator, bytes, alignof(int));
+      DG_TRACK_ALLOC(explicit_deletes, bytes);
       memset(output->explicit_deletes, 0, bytes);
     }
 
@@ -482,11 +514,13 @@ dg_parse_result dg_parse_packetentities(dg_packetentities_parse_args* args) {
   state.permanent_allocator = args->permanent_allocator;
   state.entity_state = args->entity_state;
   state.demver_data = args->demver_data;
+  state.record_spans = args->record_prop_spans;
 
   args->output->ent_updates_count = 0;
   size_t ent_update_bytes = sizeof(dg_ent_update) * args->message->updated_entries;
   if(ent_update_bytes > 0) {
     args->output->ent_updates = dg_alloc_allocate(state.allocator, ent_update_bytes, alignof(dg_ent_update));
+    DG_TRACK_ALLOC(ent_updates, ent_update_bytes);
     memset(args->output->ent_updates, 0, ent_update_bytes);
   } else {
     args->output->ent_updates = NULL;
@@ -598,6 +632,7 @@ void dg_parser_handle_packetentities(dg_parser *thisptr, struct dg_svc_packet_en
   args.message = message;
   args.output = &output;
   args.permanent_allocator = dg_parser_perm_allocator(thisptr);
+  args.record_prop_spans = thisptr->m_settings.record_prop_spans;
 
   dg_parse_result result = dg_parse_packetentities(&args);
 
@@ -608,6 +643,7 @@ void dg_parser_handle_packetentities(dg_parser *thisptr, struct dg_svc_packet_en
 #endif
     dg_svc_packetentities_parsed* parsed_ptr;
     message->parsed = parsed_ptr = dg_alloc_allocate(args.allocator, sizeof(dg_svc_packetentities_parsed), alignof(dg_svc_packetentities_parsed)); 
+    DG_TRACK_ALLOC(ent_updates, sizeof(dg_svc_packetentities_parsed));
     memset(parsed_ptr, 0, sizeof(*parsed_ptr));
     parsed_ptr->data = output;
     parsed_ptr->orig = message;
@@ -622,6 +658,141 @@ void dg_parser_handle_packetentities(dg_parser *thisptr, struct dg_svc_packet_en
   }
 }
 
+dg_parse_result dg_parse_temp_entities(dg_temp_entities_parse_args *args) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+  memset(args->output, 0, sizeof(*args->output));
+  args->output->orig = args->message;
+
+  if (!args->entity_state->class_datas) {
+    result.error = true;
+    result.error_message = "Tried to parse temp entities with no flattened props";
+    return result;
+  }
+
+  dg_bitstream stream = args->message->data;
+  prop_parse_state state;
+  memset(&state, 0, sizeof(state));
+  state.allocator = args->allocator;
+  state.stream = &stream;
+  state.permanent_allocator = args->permanent_allocator;
+  state.entity_state = args->entity_state;
+  state.demver_data = args->demver_data;
+  state.record_spans = args->record_prop_spans;
+
+  size_t bytes = sizeof(dg_temp_entity) * args->message->num_entries;
+  if (bytes > 0) {
+    args->output->entities = dg_alloc_allocate(state.allocator, bytes, alignof(dg_temp_entity));
+    DG_TRACK_ALLOC(ent_updates, bytes);
+  }
+
+  prop_value props_array[64];
+  state.prop_array = dg_va_create(props_array, prop_value);
+
+  uint32_t serverclass_bits = Q_log2(args->entity_state->serverclass_count) + 1;
+  int class_id = -1;
+
+  for (uint32_t i = 0; i < args->message->num_entries && !state.error && !stream.overflow; ++i) {
+    dg_temp_entity *entity = args->output->entities + args->output->entities_count;
+    memset(entity, 0, sizeof(*entity));
+
+    if (dg_bitstream_read_bit(&stream)) {
+      entity->delay = dg_bitstream_read_sint(&stream, 8) / 100.0f;
+    }
+
+    // Class ids are sent off by one, entries without one reuse the previous entry's class
+    if (dg_bitstream_read_bit(&stream)) {
+      uint32_t sent_id = dg_bitstream_read_uint(&stream, serverclass_bits);
+      if (sent_id == 0 || sent_id > args->entity_state->serverclass_count) {
+        state.error = true;
+        state.error_message = "Invalid class ID in svc_temp_entities";
+        break;
+      }
+      class_id = sent_id - 1;
+    } else if (class_id == -1) {
+      state.error = true;
+      state.error_message = "First temp entity did not have a class";
+      break;
+    }
+
+    bool wanted = args->wanted_classes == NULL || args->wanted_classes[class_id];
+    entity->update.ent_index = -1;
+    entity->update.datatable_id = class_id;
+    state.update = &entity->update;
+    state.discard_props = !wanted;
+    parse_props(&state);
+
+    if (wanted) {
+      ++args->output->entities_count;
+    }
+  }
+
+  dg_va_free(&state.prop_array);
+  result.error = state.error;
+  result.error_message = state.error_message;
+
+  if (stream.overflow && !result.error) {
+    result.error = true;
+    result.error_message = "Stream overflowed in svc_temp_entities";
+  }
+
+  return result;
+}
+
+// Resolve the class names from the settings against the current serverclasses
+static const bool *temp_entity_wanted_classes(dg_parser *thisptr) {
+  const estate *entity_state = &thisptr->state.entity_state;
+  if (thisptr->m_settings.temp_entity_classes == NULL) {
+    return NULL;
+  }
+
+  if (thisptr->state.temp_entity_classes_count != entity_state->serverclass_count) {
+    uint32_t count = entity_state->serverclass_count;
+    bool *wanted = dg_alloc_allocate(dg_parser_perm_allocator(thisptr), count, alignof(bool));
+    for (uint32_t i = 0; i < count; ++i) {
+      wanted[i] = false;
+      for (uint32_t u = 0; u < thisptr->m_settings.temp_entity_classes_count; ++u) {
+        if (strcmp(entity_state->serverclasses[i].serverclass_name,
+                   thisptr->m_settings.temp_entity_classes[u]) == 0) {
+          wanted[i] = true;
+          break;
+        }
+      }
+    }
+    thisptr->state.temp_entity_classes = wanted;
+    thisptr->state.temp_entity_classes_count = count;
+  }
+
+  return thisptr->state.temp_entity_classes;
+}
+
+void dg_parser_handle_temp_entities(dg_parser *thisptr, struct dg_svc_temp_entities *message) {
+  dg_svc_temp_entities_parsed output;
+  dg_temp_entities_parse_args args;
+  args.allocator = dg_parser_packet_allocator(thisptr);
+  args.demver_data = &thisptr->demo_version;
+  args.entity_state = &thisptr->state.entity_state;
+  args.message = message;
+  args.output = &output;
+  args.permanent_allocator = dg_parser_perm_allocator(thisptr);
+  args.wanted_classes = temp_entity_wanted_classes(thisptr);
+  args.record_prop_spans = thisptr->m_settings.record_prop_spans;
+
+  dg_parse_result result = dg_parse_temp_entities(&args);
+
+  if (!result.error) {
+    dg_svc_temp_entities_parsed *parsed_ptr =
+        dg_alloc_allocate(args.allocator, sizeof(dg_svc_temp_entities_parsed),
+                          alignof(dg_svc_temp_entities_parsed));
+    *parsed_ptr = output;
+    message->parsed = parsed_ptr;
+    thisptr->m_settings.temp_entities_parsed_handler(&thisptr->state, parsed_ptr);
+  } else {
+    thisptr->error = result.error;
+    thisptr->error_message = result.error_message;
+  }
+}
+
 dg_parse_result dg_parse_instancebaseline(const dg_instancebaseline_args* args) {
   dg_bitstream stream = *args->stream;
   dg_parse_result result;
@@ -4,3 +4,4 @@
 #include "demogobbler/parser.h"
 
 void dg_parser_handle_packetentities(dg_parser *thisptr, struct dg_svc_packet_entities *message);
+void dg_parser_handle_temp_entities(dg_parser *thisptr, struct dg_svc_temp_entities *message);
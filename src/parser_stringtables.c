@@ -1,13 +1,18 @@
 #include "parser_stringtables.h"
+#include "alloc_telemetry.h"
 #include "demogobbler/alignof_wrapper.h"
 #include "demogobbler.h"
 #include "demogobbler/allocator.h"
 #include "demogobbler/bitstream.h"
+#include "demogobbler/compression.h"
+#include "demogobbler/hashtable.h"
 #include "demogobbler/streams.h"
 #include "demogobbler/utils.h"
 #include "writer.h"
 #include <string.h>
 
+enum { MAX_DECOMPRESSED_BYTES = 1 << 25 }; // Same limit as for demo messages
+
 static void write_stringtable_entry(dg_bitwriter *writer, dg_stringtable_entry *entry) {
   dg_bitwriter_write_cstring(writer, entry->name);
   dg_bitwriter_write_bit(writer, entry->has_data);
@@ -60,6 +65,7 @@ static const char *read_string(dg_bitstream *stream, dg_alloc_state *allocator)
   char BUFFER[1024];
   uint32_t bytes = dg_bitstream_read_cstring(stream, BUFFER, 1024);
   char *dest = dg_alloc_allocate(allocator, bytes, 1);
+  DG_TRACK_ALLOC(stringtables, bytes);
   memcpy(dest, BUFFER, bytes);
   return dest;
 }
@@ -85,6 +91,7 @@ dg_parse_result dg_parse_stringtables(dg_stringtables_parsed *message,
   message->tables_count = dg_bitstream_read_uint(&stream, 8);
   message->tables = dg_alloc_allocate(
       args.allocator, message->tables_count * sizeof(dg_stringtable), alignof(dg_stringtable));
+  DG_TRACK_ALLOC(stringtables, message->tables_count * sizeof(dg_stringtable));
   memset(message->tables, 0, message->tables_count * sizeof(dg_stringtable));
 
   for (uint8_t i = 0; i < message->tables_count; ++i) {
@@ -94,6 +101,7 @@ dg_parse_result dg_parse_stringtables(dg_stringtables_parsed *message,
     table->entries =
         dg_alloc_allocate(args.allocator, table->entries_count * sizeof(dg_stringtable_entry),
                           alignof(dg_stringtable_entry));
+    DG_TRACK_ALLOC(stringtables, table->entries_count * sizeof(dg_stringtable_entry));
     if(table->entries_count > 0) {
       memset(table->entries, 0, table->entries_count * sizeof(dg_stringtable_entry));
       for (uint16_t u = 0; u < table->entries_count; ++u) {
@@ -107,6 +115,7 @@ dg_parse_result dg_parse_stringtables(dg_stringtables_parsed *message,
       table->classes =
           dg_alloc_allocate(args.allocator, table->classes_count * sizeof(dg_stringtable_entry),
                             alignof(dg_stringtable_entry));
+      DG_TRACK_ALLOC(stringtables, table->classes_count * sizeof(dg_stringtable_entry));
       for (uint16_t u = 0; u < table->classes_count; ++u) {
         read_stringtable_entry(table->classes + u, &stream, args);
       }
@@ -166,6 +175,7 @@ static void parse_sentry(dg_sentry_parse_args *args, uint32_t entry_bits, int32_
     }
     size_t size = dg_bitstream_read_cstring(&args->stream, entry_string, sizeof(entry_string));
     value->stored_string = dg_alloc_allocate(args->allocator, size, 1);
+    DG_TRACK_ALLOC(parse_sentry, size);
     memcpy(value->stored_string, entry_string, size);
   }
 
@@ -181,6 +191,7 @@ static void parse_sentry(dg_sentry_parse_args *args, uint32_t entry_bits, int32_
     }
     value->userdata = dg_bitstream_fork_and_advance(&args->stream, bits);
   }
+
 }
 
 void dg_write_sentry_value(dg_sentry_write_args *args, const dg_sentry_value *_value, uint32_t entry_bits, bool fixed_size, uint32_t user_data_bits) {
@@ -211,11 +222,21 @@ void dg_write_sentry_value(dg_sentry_write_args *args, const dg_sentry_value *_v
 }
 
 dg_parse_result dg_write_stringtable_entry(dg_sentry_write_args *args) {
+  return dg_write_stringtable_entry_ex(args, NULL);
+}
+
+dg_parse_result dg_write_stringtable_entry_ex(dg_sentry_write_args *args,
+                                             const dg_demver_data *demver_data) {
   dg_parse_result result;
   const dg_sentry* input = args->input;
   memset(&result, 0, sizeof(result));
   uint32_t entry_bits = Q_log2(input->max_entries);
 
+  if (demver_data && demver_data->demo_protocol == 4) {
+    // Dictionary encoded tables are never parsed, so the entries are always plain strings
+    dg_bitwriter_write_bit(args->writer, false);
+  }
+
   for (size_t i = 0; i < input->values_length; ++i) {
     dg_write_sentry_value(args, input->values + i, entry_bits, input->user_data_fixed_size, input->user_data_size_bits);
   }
@@ -224,44 +245,89 @@ dg_parse_result dg_write_stringtable_entry(dg_sentry_write_args *args) {
 }
 
 
-dg_parse_result dg_parse_stringtable_entry(dg_sentry_parse_args *args, dg_sentry *out) {
+// Compressed tables start with the uncompressed and compressed sizes followed by the compressed
+// buffer. The entries are then parsed from the decompressed copy, which is kept in the allocator
+// since userdata streams point into it
+static dg_parse_result decompress_sentries(dg_sentry_parse_args *args) {
   dg_parse_result result;
   memset(&result, 0, sizeof(result));
-  memset(out, 0, sizeof(dg_stringtable));
+  dg_bitstream *stream = &args->stream;
+  uint32_t uncompressed_bytes = dg_bitstream_read_uint32(stream);
+  uint32_t compressed_bytes = dg_bitstream_read_uint32(stream);
 
-  if (args->flags & 1) {
-    //int32_t uncompressed_size = dg_bitstream_read_sint32(&args->stream);
-    //int32_t compressed_size = dg_bitstream_read_sint32(&args->stream);
+  if (stream->overflow || compressed_bytes > dg_bitstream_bits_left(stream) / 8 ||
+      uncompressed_bytes > MAX_DECOMPRESSED_BYTES) {
+    result.error = true;
+    result.error_message = "invalid compressed stringtable header";
+    return result;
+  }
 
-    // TODO: implement compression
+  const uint8_t *src;
+  if ((stream->bitoffset & 7) == 0) {
+    // Byte aligned, decompress straight from the packet
+    src = (const uint8_t *)stream->data + stream->bitoffset / 8;
+    dg_bitstream_advance(stream, compressed_bytes * 8);
+  } else {
+    uint8_t *copy = dg_alloc_allocate(args->allocator, MAX(compressed_bytes, 1), 1);
+    dg_bitstream_read_fixed_string(stream, copy, compressed_bytes);
+    DG_TRACK_ALLOC(stringtables, compressed_bytes);
+    src = copy;
+  }
 
+  // Padded so that bitstream reads near the end stay inside the allocation
+  uint8_t *dest = dg_alloc_allocate(args->allocator, uncompressed_bytes + 8, 8);
+  memset(dest + uncompressed_bytes, 0, 8);
+  DG_TRACK_ALLOC(stringtables, uncompressed_bytes + 8);
+
+  if (!dg_decompress(dest, uncompressed_bytes, src, compressed_bytes)) {
     result.error = true;
-    result.error_message = "compressed stringtable parsing not implemented";
-    goto end;
+    result.error_message = "unable to decompress stringtable";
+    return result;
   }
 
+  args->stream = dg_bitstream_create(dest, uncompressed_bytes * 8);
+  return result;
+}
+
+dg_parse_result dg_parse_stringtable_entry(dg_sentry_parse_args *args, dg_sentry *out) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+  memset(out, 0, sizeof(*out));
+  // Decompressed data is padded to a whole byte at the end
+  uint32_t allowed_leftover_bits = 0;
+
+  if (args->flags & 1) {
+    result = decompress_sentries(args);
+    if (result.error) {
+      goto end;
+    }
+    allowed_leftover_bits = 7;
+  }
+
+  out->flags = args->flags;
+  out->max_entries = args->max_entries;
+  out->user_data_fixed_size = args->user_data_fixed_size;
+  out->user_data_size_bits = args->user_data_size_bits;
+
   if (args->demver_data->demo_protocol == 4) {
     out->dictionary_enabled = dg_bitstream_read_bit(&args->stream);
 
-    // TODO: implement dictionary
-
-    result.error = true;
-    result.error_message = "dictionary decoding not implemented";
-    goto end;
+    if (out->dictionary_enabled) {
+      // Names are encoded with the game's dictionary, which is not supported. Leave the table
+      // unparsed
+      goto end;
+    }
   }
 
   int32_t entry_index = -1;
+  uint32_t entry_bits = Q_log2(args->max_entries);
   const uint32_t array_bytes = args->num_updated_entries * sizeof(dg_sentry_value);
   out->values = dg_alloc_allocate(args->allocator, array_bytes, alignof(dg_sentry_value));
+  DG_TRACK_ALLOC(parse_sentry, array_bytes);
   out->values_length = args->num_updated_entries;
-  out->flags = args->flags;
-  out->max_entries = args->max_entries;
-  out->user_data_fixed_size = args->user_data_fixed_size;
-  out->user_data_size_bits = args->user_data_size_bits;
 
   if(out->values)
     memset(out->values, 0, array_bytes);
-  uint32_t entry_bits = Q_log2(args->max_entries);
 
   for (size_t i = 0; i < args->num_updated_entries && !args->stream.overflow; ++i) {
     ++entry_index;
@@ -270,7 +336,7 @@ dg_parse_result dg_parse_stringtable_entry(dg_sentry_parse_args *args, dg_sentry
   }
 
 
-  if(dg_bitstream_bits_left(&args->stream) > 0) {
+  if(dg_bitstream_bits_left(&args->stream) > allowed_leftover_bits) {
     result.error = true;
     result.error_message = "stringtable parsing had bits left";
   }
@@ -283,3 +349,248 @@ dg_parse_result dg_parse_stringtable_entry(dg_sentry_parse_args *args, dg_sentry
 end:
   return result;
 }
+
+// Same as the engine, names can reuse a prefix of any of the last 32 names in the message
+enum { SENTRY_HISTORY_SIZE = 32, SENTRY_NAME_SIZE = 1024 };
+
+static uint32_t userdata_bytes(const dg_stringtable_item *item) {
+  return (item->userdata_bits + 7) / 8;
+}
+
+static void set_userdata(dg_parser *thisptr, dg_stringtable_item *item,
+                         const dg_sentry_value *value) {
+  dg_alloc_state *heap = dg_parser_heap_allocator(thisptr);
+  if (item->userdata) {
+    dg_alloc_free(heap, (void *)item->userdata, userdata_bytes(item));
+    DG_TRACK_FREE(stringtables, userdata_bytes(item));
+    item->userdata = NULL;
+    item->userdata_bits = 0;
+  }
+
+  if (!value->has_user_data) {
+    return;
+  }
+
+  dg_bitstream stream = value->userdata;
+  item->userdata_bits = dg_bitstream_bits_left(&stream);
+  uint8_t *dest = dg_alloc_allocate(heap, MAX(userdata_bytes(item), 1), 1);
+  DG_TRACK_ALLOC(stringtables, userdata_bytes(item));
+  dg_bitstream_read_fixed_string(&stream, dest, item->userdata_bits / 8);
+  if (item->userdata_bits % 8 != 0) {
+    dest[item->userdata_bits / 8] = dg_bitstream_read_uint(&stream, item->userdata_bits % 8);
+  }
+  item->userdata = dest;
+}
+
+static void record_change(parser_state *state, uint32_t table_id, uint32_t entry_index,
+                          uint32_t flags) {
+  if (state->stringtable_changes_count >= MAX_STRINGTABLE_CHANGES) {
+    ++state->stringtable_changes_dropped;
+    return;
+  }
+
+  dg_stringtable_change *change = state->stringtable_changes + state->stringtable_changes_count;
+  change->table_id = table_id;
+  change->entry_index = entry_index;
+  change->flags = flags;
+  ++state->stringtable_changes_count;
+}
+
+// Fills in the prefix reused from the history, truncated the same way as in the engine. The
+// reused index has already been checked against the history
+static void resolve_name(char *dest, const char **history, const dg_sentry_value *value) {
+  dest[0] = '\0';
+  if (value->reuse_previous_value) {
+    const char *prefix = history[value->reuse_str_index];
+    size_t length = MIN(strlen(prefix), value->reuse_length);
+    memcpy(dest, prefix, length);
+    dest[length] = '\0';
+  }
+
+  size_t used = strlen(dest);
+  size_t length = MIN(strlen(value->stored_string), SENTRY_NAME_SIZE - 1 - used);
+  memcpy(dest + used, value->stored_string, length);
+  dest[used + length] = '\0';
+}
+
+// Returns the index of the entry with the name
+static uint32_t add_item(dg_parser *thisptr, uint32_t table_id, const char *name) {
+  dg_stringtable_data *table = thisptr->state.stringtables + table_id;
+  dg_hashtable_entry existing = dg_hashtable_get(&table->item_names, name);
+  uint32_t index;
+
+  if (existing.str) {
+    // Adding a name that is already in the table updates the existing entry
+    index = existing.value;
+  } else {
+    index = table->items_count++;
+    size_t bytes = strlen(name) + 1;
+    char *copy = dg_alloc_allocate(dg_parser_perm_allocator(thisptr), bytes, 1);
+    DG_TRACK_ALLOC(stringtables, bytes);
+    memcpy(copy, name, bytes);
+    table->items[index].name = copy;
+
+    dg_hashtable_entry entry;
+    entry.str = copy;
+    entry.value = index;
+    dg_hashtable_insert(&table->item_names, entry);
+  }
+
+  return index;
+}
+
+dg_parse_result dg_parser_update_stringtable(dg_parser *thisptr, uint32_t table_id,
+                                             const dg_sentry *update) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+  dg_stringtable_data *table = thisptr->state.stringtables + table_id;
+
+  // Untracked, or a table that could not be parsed
+  if (table_id >= thisptr->state.stringtables_count || table->items == NULL ||
+      update->values == NULL) {
+    return result;
+  }
+
+  char name[SENTRY_NAME_SIZE];
+  const char *history[SENTRY_HISTORY_SIZE];
+  uint32_t history_count = 0;
+
+  for (uint32_t i = 0; i < update->values_length; ++i) {
+    const dg_sentry_value *value = update->values + i;
+    if (value->entry_index >= table->max_entries) {
+      result.error = true;
+      result.error_message = "stringtable entry index out of range";
+      break;
+    }
+
+    if (value->reuse_previous_value && value->reuse_str_index >= history_count) {
+      result.error = true;
+      result.error_message = "stringtable name reuses a string that does not exist";
+      break;
+    }
+
+    // Names of existing entries never change
+    uint32_t index = value->entry_index;
+    uint32_t flags = dg_stringtable_change_userdata;
+
+    if (index >= table->items_count) {
+      if (value->has_name) {
+        resolve_name(name, history, value);
+      } else {
+        name[0] = '\0';
+      }
+      index = add_item(thisptr, table_id, name);
+      flags |= dg_stringtable_change_added;
+    }
+
+    set_userdata(thisptr, table->items + index, value);
+    record_change(&thisptr->state, table_id, index, flags);
+
+    if (history_count == SENTRY_HISTORY_SIZE) {
+      memmove(history, history + 1, sizeof(history) - sizeof(history[0]));
+      --history_count;
+    }
+    history[history_count++] = table->items[index].name;
+  }
+
+  return result;
+}
+
+void dg_parser_track_stringtable(dg_parser *thisptr, uint32_t table_id, const char *name) {
+  dg_stringtable_data *table = thisptr->state.stringtables + table_id;
+  dg_alloc_state *heap = dg_parser_heap_allocator(thisptr);
+
+  if (thisptr->state.stringtable_changes == NULL) {
+    uint32_t bytes = MAX_STRINGTABLE_CHANGES * sizeof(dg_stringtable_change);
+    thisptr->state.stringtable_changes =
+        dg_alloc_allocate(heap, bytes, alignof(dg_stringtable_change));
+    DG_TRACK_ALLOC(stringtables, bytes);
+  }
+
+  size_t bytes = strlen(name) + 1;
+  char *copy = dg_alloc_allocate(dg_parser_perm_allocator(thisptr), bytes, 1);
+  DG_TRACK_ALLOC(stringtables, bytes);
+  memcpy(copy, name, bytes);
+  table->name = copy;
+
+  uint32_t items_bytes = MAX(table->max_entries, 1) * sizeof(dg_stringtable_item);
+  table->items = dg_alloc_allocate(heap, items_bytes, alignof(dg_stringtable_item));
+  DG_TRACK_ALLOC(stringtables, items_bytes);
+  memset(table->items, 0, items_bytes);
+  table->items_count = 0;
+  table->item_names = dg_hashtable_create_ex(MIN(table->max_entries, 256), heap);
+}
+
+void dg_parser_free_stringtables(dg_parser *thisptr) {
+  dg_alloc_state *heap = dg_parser_heap_allocator(thisptr);
+  for (uint32_t i = 0; i < thisptr->state.stringtables_count; ++i) {
+    dg_stringtable_data *table = thisptr->state.stringtables + i;
+    if (table->items == NULL) {
+      continue;
+    }
+
+    for (uint32_t u = 0; u < table->items_count; ++u) {
+      if (table->items[u].userdata) {
+        dg_alloc_free(heap, (void *)table->items[u].userdata, userdata_bytes(table->items + u));
+        DG_TRACK_FREE(stringtables, userdata_bytes(table->items + u));
+      }
+    }
+
+    uint32_t items_bytes = MAX(table->max_entries, 1) * sizeof(dg_stringtable_item);
+    dg_alloc_free(heap, table->items, items_bytes);
+    DG_TRACK_FREE(stringtables, items_bytes);
+    dg_hashtable_free(&table->item_names);
+    table->items = NULL;
+    table->items_count = 0;
+  }
+
+  if (thisptr->state.stringtable_changes) {
+    uint32_t bytes = MAX_STRINGTABLE_CHANGES * sizeof(dg_stringtable_change);
+    dg_alloc_free(heap, thisptr->state.stringtable_changes, bytes);
+    DG_TRACK_FREE(stringtables, bytes);
+    thisptr->state.stringtable_changes = NULL;
+  }
+}
+
+const dg_stringtable_item *dg_stringtable_get(const parser_state *state, uint32_t table_id,
+                                              uint32_t index) {
+  if (table_id >= state->stringtables_count) {
+    return NULL;
+  }
+
+  const dg_stringtable_data *table = state->stringtables + table_id;
+  if (table->items == NULL || index >= table->items_count) {
+    return NULL;
+  }
+
+  return table->items + index;
+}
+
+int32_t dg_stringtable_find(const parser_state *state, uint32_t table_id, const char *name) {
+  if (table_id >= state->stringtables_count || state->stringtables[table_id].items == NULL) {
+    return -1;
+  }
+
+  // Lookups do not modify the hashtable
+  dg_hashtable *names = (dg_hashtable *)&state->stringtables[table_id].item_names;
+  dg_hashtable_entry entry = dg_hashtable_get(names, name);
+  return entry.str ? (int32_t)entry.value : -1;
+}
+
+int32_t dg_stringtable_find_table(const parser_state *state, const char *table_name) {
+  for (uint32_t i = 0; i < state->stringtables_count; ++i) {
+    const char *name = state->stringtables[i].name;
+    if (name && strcmp(name, table_name) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+const dg_stringtable_change *dg_stringtable_changes(const parser_state *state, int32_t *tick,
+                                                   uint32_t *count) {
+  *tick = state->stringtable_changes_tick;
+  *count = state->stringtable_changes_count;
+  return state->stringtable_changes;
+}
@@ -4,3 +4,6 @@
 #include "demogobbler/parser.h"
 
 void dg_parser_parse_stringtables(dg_parser *thisptr, dg_stringtables *input);
+// Keep the current contents of the table, called when it's created
+void dg_parser_track_stringtable(dg_parser *thisptr, uint32_t table_id, const char *name);
+void dg_parser_free_stringtables(dg_parser *thisptr);
@@ -1,10 +1,20 @@
+#include "demogobbler/alignof_wrapper.h"
 #include "demogobbler/allocator.h"
+#include "demogobbler/io.h"
 #include "demogobbler/streams.h"
 #include "demogobbler/utils.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 void* dg_fstream_init(const char* filepath, const char* modes)
 {
   return fopen(filepath, modes);
@@ -31,6 +41,161 @@ size_t dg_fstream_write(void* stream, const void* src, size_t bytes)
   return out;
 }
 
+#ifndef _MSC_VER
+enum { MAX_CHUNKS = 16 };
+
+size_t dg_fstream_writev(void* stream, const dg_output_chunk* chunks, int count)
+{
+  // Anything still in the FILE buffer has to land before the chunks
+  if(fflush(stream) != 0 || count > MAX_CHUNKS)
+    return 0;
+
+  struct iovec iov[MAX_CHUNKS];
+  size_t total = 0;
+  for(int i = 0; i < count; ++i)
+  {
+    iov[i].iov_base = (void*)chunks[i].data;
+    iov[i].iov_len = chunks[i].bytes;
+    total += chunks[i].bytes;
+  }
+
+  int fd = fileno(stream);
+  size_t written = 0;
+  struct iovec* current = iov;
+
+  while(written < total)
+  {
+    ssize_t rval = writev(fd, current, count);
+    if(rval <= 0)
+      break;
+    written += rval;
+
+    // Skip over whatever the partial write covered
+    while(count > 0 && (size_t)rval >= current->iov_len)
+    {
+      rval -= current->iov_len;
+      ++current;
+      --count;
+    }
+    if(count > 0)
+    {
+      current->iov_base = (uint8_t*)current->iov_base + rval;
+      current->iov_len -= rval;
+    }
+  }
+
+  return written;
+}
+
+struct dg_mapped_output
+{
+  int fd;
+  uint8_t* map;
+  size_t capacity;
+  size_t size;
+};
+
+// Mappings grow by doubling, starting from this size
+enum { MAPPED_OUTPUT_MIN_CAPACITY = 1 << 20 };
+
+static bool mapped_output_reserve(dg_mapped_output* thisptr, size_t capacity)
+{
+  if(thisptr->map && munmap(thisptr->map, thisptr->capacity) != 0)
+    return false;
+  thisptr->map = NULL;
+
+  if(ftruncate(thisptr->fd, capacity) != 0)
+    return false;
+
+  void* map = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, thisptr->fd, 0);
+  if(map == MAP_FAILED)
+    return false;
+
+  thisptr->map = map;
+  thisptr->capacity = capacity;
+  return true;
+}
+
+dg_mapped_output* dg_mapped_output_open(const char* filepath)
+{
+  dg_mapped_output* thisptr =
+    dg_alloc_allocate(dg_heap_allocator(), sizeof(dg_mapped_output), alignof(dg_mapped_output));
+  if(!thisptr)
+    return NULL;
+
+  thisptr->fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  thisptr->map = NULL;
+  thisptr->capacity = 0;
+  thisptr->size = 0;
+
+  if(thisptr->fd == -1 || !mapped_output_reserve(thisptr, MAPPED_OUTPUT_MIN_CAPACITY))
+  {
+    if(thisptr->fd != -1)
+    {
+      close(thisptr->fd);
+      unlink(filepath);
+    }
+    dg_alloc_free(dg_heap_allocator(), thisptr, sizeof(dg_mapped_output));
+    return NULL;
+  }
+
+  return thisptr;
+}
+
+size_t dg_mapped_output_write(void* stream, const void* src, size_t bytes)
+{
+  dg_mapped_output* thisptr = stream;
+  if(thisptr->size + bytes > thisptr->capacity)
+  {
+    size_t capacity = MAX(thisptr->capacity * 2, thisptr->size + bytes);
+    if(!mapped_output_reserve(thisptr, capacity))
+      return 0;
+  }
+
+  memcpy(thisptr->map + thisptr->size, src, bytes);
+  thisptr->size += bytes;
+  return bytes;
+}
+
+bool dg_mapped_output_close(dg_mapped_output* thisptr)
+{
+  bool success = true;
+  if(thisptr->map && munmap(thisptr->map, thisptr->capacity) != 0)
+    success = false;
+  if(ftruncate(thisptr->fd, thisptr->size) != 0)
+    success = false;
+  if(close(thisptr->fd) != 0)
+    success = false;
+  dg_alloc_free(dg_heap_allocator(), thisptr, sizeof(dg_mapped_output));
+  return success;
+}
+#else
+size_t dg_fstream_writev(void* stream, const dg_output_chunk* chunks, int count)
+{
+  size_t written = 0;
+  for(int i = 0; i < count; ++i)
+  {
+    written += fwrite(chunks[i].data, 1, chunks[i].bytes, stream);
+  }
+  return written;
+}
+
+dg_mapped_output* dg_mapped_output_open(const char* filepath)
+{
+  return NULL;
+}
+
+size_t dg_mapped_output_write(void* stream, const void* src, size_t bytes)
+{
+  return 0;
+}
+
+bool dg_mapped_output_close(dg_mapped_output* thisptr)
+{
+  return false;
+}
+#endif
+
 void dg_buffer_stream_init(buffer_stream* thisptr, void* buffer, size_t size)
 {
   thisptr->buffer = buffer;
@@ -0,0 +1,93 @@
+#include "threads.h"
+#include <stdlib.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+typedef struct {
+  func_dg_thread func;
+  void *arg;
+} thread_start;
+
+#ifdef _MSC_VER
+static DWORD WINAPI thread_main(LPVOID param) {
+#else
+static void *thread_main(void *param) {
+#endif
+  thread_start start = *(thread_start *)param;
+  free(param);
+  start.func(start.arg);
+  return 0;
+}
+
+bool dg_thread_create(dg_thread *thread, func_dg_thread func, void *arg) {
+  thread_start *start = malloc(sizeof(thread_start));
+  start->func = func;
+  start->arg = arg;
+
+#ifdef _MSC_VER
+  *thread = CreateThread(NULL, 0, thread_main, start, 0, NULL);
+  bool success = *thread != NULL;
+#else
+  bool success = pthread_create(thread, NULL, thread_main, start) == 0;
+#endif
+
+  if (!success) {
+    free(start);
+  }
+
+  return success;
+}
+
+void dg_thread_join(dg_thread thread) {
+#ifdef _MSC_VER
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+#else
+  pthread_join(thread, NULL);
+#endif
+}
+
+void dg_mutex_init(dg_mutex *mutex) {
+#ifdef _MSC_VER
+  InitializeSRWLock(mutex);
+#else
+  pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void dg_mutex_lock(dg_mutex *mutex) {
+#ifdef _MSC_VER
+  AcquireSRWLockExclusive(mutex);
+#else
+  pthread_mutex_lock(mutex);
+#endif
+}
+
+void dg_mutex_unlock(dg_mutex *mutex) {
+#ifdef _MSC_VER
+  ReleaseSRWLockExclusive(mutex);
+#else
+  pthread_mutex_unlock(mutex);
+#endif
+}
+
+void dg_mutex_destroy(dg_mutex *mutex) {
+#ifdef _MSC_VER
+  (void)mutex; // SRW locks need no cleanup
+#else
+  pthread_mutex_destroy(mutex);
+#endif
+}
+
+uint32_t dg_hardware_concurrency(void) {
+#ifdef _MSC_VER
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (uint32_t)count : 1;
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Minimal threading wrappers, pthreads everywhere except MSVC
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+typedef HANDLE dg_thread;
+typedef SRWLOCK dg_mutex;
+#else
+#include <pthread.h>
+typedef pthread_t dg_thread;
+typedef pthread_mutex_t dg_mutex;
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#define DG_THREAD_LOCAL __declspec(thread)
+#else
+#define DG_THREAD_LOCAL _Thread_local
+#endif
+
+typedef void (*func_dg_thread)(void *arg);
+
+// Returns false if the thread could not be started
+bool dg_thread_create(dg_thread *thread, func_dg_thread func, void *arg);
+void dg_thread_join(dg_thread thread);
+void dg_mutex_init(dg_mutex *mutex);
+void dg_mutex_lock(dg_mutex *mutex);
+void dg_mutex_unlock(dg_mutex *mutex);
+void dg_mutex_destroy(dg_mutex *mutex);
+uint32_t dg_hardware_concurrency(void);
@@ -0,0 +1,195 @@
+#include "demogobbler.h"
+#include "demogobbler/alignof_wrapper.h"
+#include "demogobbler/user_message_types.h"
+#include "demogobbler/utils.h"
+#include <string.h>
+
+// User message payloads are at most 2^12 bits
+enum { MAX_USER_MESSAGE_STRING = 512 };
+
+static const char *read_string(dg_bitstream *stream, dg_alloc_state *allocator) {
+  char buffer[MAX_USER_MESSAGE_STRING];
+  size_t bytes = dg_bitstream_read_cstring(stream, buffer, sizeof(buffer));
+  if (stream->overflow) {
+    return "";
+  }
+
+  char *dest = dg_alloc_allocate(allocator, bytes, 1);
+  memcpy(dest, buffer, bytes);
+  return dest;
+}
+
+static uint8_t read_byte(dg_bitstream *stream) { return dg_bitstream_read_uint(stream, 8); }
+
+static bool decode_say_text(dg_bitstream *stream, dg_user_message *out,
+                            dg_alloc_state *allocator) {
+  struct dg_um_say_text *msg = &out->say_text;
+  msg->client = read_byte(stream);
+  msg->text = read_string(stream, allocator);
+  msg->chat = read_byte(stream) != 0;
+  return !stream->overflow;
+}
+
+static bool decode_say_text2(dg_bitstream *stream, dg_user_message *out,
+                             dg_alloc_state *allocator) {
+  struct dg_um_say_text2 *msg = &out->say_text2;
+  msg->client = read_byte(stream);
+  msg->chat = read_byte(stream) != 0;
+  msg->msg_name = read_string(stream, allocator);
+  for (size_t i = 0; i < ARRAYSIZE(msg->params); ++i) {
+    msg->params[i] = read_string(stream, allocator);
+  }
+  return !stream->overflow;
+}
+
+static bool decode_text_msg(dg_bitstream *stream, dg_user_message *out,
+                            dg_alloc_state *allocator) {
+  struct dg_um_text_msg *msg = &out->text_msg;
+  msg->dest = read_byte(stream);
+  msg->msg_name = read_string(stream, allocator);
+  for (size_t i = 0; i < ARRAYSIZE(msg->params); ++i) {
+    msg->params[i] = read_string(stream, allocator);
+  }
+  return !stream->overflow;
+}
+
+static bool decode_hud_msg(dg_bitstream *stream, dg_user_message *out, dg_alloc_state *allocator) {
+  struct dg_um_hud_msg *msg = &out->hud_msg;
+  msg->channel = read_byte(stream);
+  msg->x = dg_bitstream_read_float(stream);
+  msg->y = dg_bitstream_read_float(stream);
+  dg_bitstream_read_fixed_string(stream, msg->color1, sizeof(msg->color1));
+  dg_bitstream_read_fixed_string(stream, msg->color2, sizeof(msg->color2));
+  msg->effect = read_byte(stream);
+  msg->fade_in = dg_bitstream_read_float(stream);
+  msg->fade_out = dg_bitstream_read_float(stream);
+  msg->hold_time = dg_bitstream_read_float(stream);
+  msg->fx_time = dg_bitstream_read_float(stream);
+  msg->message = read_string(stream, allocator);
+  return !stream->overflow;
+}
+
+static bool decode_reset_hud(dg_bitstream *stream, dg_user_message *out,
+                             dg_alloc_state *allocator) {
+  out->reset_hud.reset = read_byte(stream);
+  return !stream->overflow;
+}
+
+static bool decode_shake(dg_bitstream *stream, dg_user_message *out, dg_alloc_state *allocator) {
+  struct dg_um_shake *msg = &out->shake;
+  msg->command = read_byte(stream);
+  msg->amplitude = dg_bitstream_read_float(stream);
+  msg->frequency = dg_bitstream_read_float(stream);
+  msg->duration = dg_bitstream_read_float(stream);
+  return !stream->overflow;
+}
+
+static bool decode_fade(dg_bitstream *stream, dg_user_message *out, dg_alloc_state *allocator) {
+  struct dg_um_fade *msg = &out->fade;
+  msg->duration = dg_bitstream_read_uint(stream, 16);
+  msg->hold_time = dg_bitstream_read_uint(stream, 16);
+  msg->flags = dg_bitstream_read_uint(stream, 16);
+  dg_bitstream_read_fixed_string(stream, msg->color, sizeof(msg->color));
+  return !stream->overflow;
+}
+
+// The origin is written with three WRITE_FLOATs
+static bool decode_damage(dg_bitstream *stream, dg_user_message *out,
+                                dg_alloc_state *allocator) {
+  struct dg_um_damage *msg = &out->damage;
+  msg->armor = read_byte(stream);
+  msg->damage_taken = read_byte(stream);
+  msg->bits_damage = dg_bitstream_read_sint32(stream);
+  msg->origin.x = dg_bitstream_read_float(stream);
+  msg->origin.y = dg_bitstream_read_float(stream);
+  msg->origin.z = dg_bitstream_read_float(stream);
+  return !stream->overflow;
+}
+
+#define TYPE(name, kind, decoder) {name, dg_user_message_##kind, decoder}
+
+// Ids are the registration order in the game's user message code, ids without a decoder are
+// left empty. Half-Life 2, its episodes and Portal share the same list
+static const dg_user_message_type hl2_types[] = {
+    [3] = TYPE("SayText", say_text, decode_say_text),
+    [4] = TYPE("TextMsg", text_msg, decode_text_msg),
+    [5] = TYPE("HudMsg", hud_msg, decode_hud_msg),
+    [6] = TYPE("ResetHUD", reset_hud, decode_reset_hud),
+    [10] = TYPE("Shake", shake, decode_shake),
+    [11] = TYPE("Fade", fade, decode_fade),
+    [15] = TYPE("Damage", damage, decode_damage),
+};
+
+static const dg_user_message_type portal2_types[] = {
+    [3] = TYPE("SayText", say_text, decode_say_text),
+    [4] = TYPE("SayText2", say_text2, decode_say_text2),
+    [5] = TYPE("TextMsg", text_msg, decode_text_msg),
+    [6] = TYPE("HudMsg", hud_msg, decode_hud_msg),
+    [7] = TYPE("ResetHUD", reset_hud, decode_reset_hud),
+    [11] = TYPE("Shake", shake, decode_shake),
+    [13] = TYPE("Fade", fade, decode_fade),
+    [17] = TYPE("Damage", damage, decode_damage),
+};
+
+#undef TYPE
+
+// Orange box and steampipe cover every Source mod, only these use the Half-Life 2 ids
+static const char *hl2_game_directories[] = {"hl2", "episodic", "ep2", "lostcoast", "portal"};
+
+dg_user_message_registry dg_user_message_registry_get(const dg_demver_data *version,
+                                                      const char *game_directory) {
+  dg_user_message_registry out;
+  memset(&out, 0, sizeof(out));
+
+  if (version->game == orangebox || version->game == steampipe) {
+    for (size_t i = 0; i < ARRAYSIZE(hl2_game_directories); ++i) {
+      if (strcmp(game_directory, hl2_game_directories[i]) == 0) {
+        out.types = hl2_types;
+        out.count = ARRAYSIZE(hl2_types);
+        break;
+      }
+    }
+  } else if (version->game == portal2) {
+    // The game is only detected as portal2 for Portal 2 and the mods built on its code
+    out.types = portal2_types;
+    out.count = ARRAYSIZE(portal2_types);
+  }
+
+  return out;
+}
+
+const dg_user_message_type *dg_user_message_type_get(const dg_user_message_registry *registry,
+                                                     uint32_t msg_type) {
+  if (msg_type >= registry->count || registry->types[msg_type].decode == NULL) {
+    return NULL;
+  }
+
+  return registry->types + msg_type;
+}
+
+dg_parse_result dg_user_message_decode(struct dg_svc_user_message *message,
+                                       const dg_user_message **out) {
+  dg_parse_result result;
+  memset(&result, 0, sizeof(result));
+  *out = message->decoded;
+
+  if (message->decoded != NULL || message->type == NULL) {
+    return result;
+  }
+
+  dg_user_message *decoded =
+      dg_alloc_allocate(message->allocator, sizeof(dg_user_message), alignof(dg_user_message));
+  memset(decoded, 0, sizeof(*decoded));
+  decoded->kind = message->type->kind;
+
+  dg_bitstream stream = message->data;
+  if (!message->type->decode(&stream, decoded, message->allocator)) {
+    result.error = true;
+    result.error_message = "Malformed user message";
+    return result;
+  }
+
+  message->decoded = decoded;
+  *out = decoded;
+  return result;
+}
@@ -30,13 +30,18 @@ dg_vector_array dg_va_create_(void *ptr, uint32_t ptr_bytes, uint32_t bytes_per_
   return out;
 }
 
+static dg_alloc_state *va_allocator(dg_vector_array *thisptr) {
+  return thisptr->a != NULL ? thisptr->a : dg_heap_allocator();
+}
+
 void *dg_va_push_back_empty(dg_vector_array *thisptr) {
   uint32_t new_size = (thisptr->count_elements + 1) * thisptr->bytes_per_element;
   if (new_size > thisptr->ptr_bytes) {
     uint32_t new_allocation_size = find_smallest_power_of_two_that_is_bigger(new_size);
     new_allocation_size = MAX(new_allocation_size, 64); // Allocate at least 64 bytes
     if (!thisptr->allocated_by_malloc) {
-      void *new_array = malloc(new_allocation_size);
+      void *new_array =
+          dg_alloc_allocate(va_allocator(thisptr), new_allocation_size, alignof(max_align_t));
 
       if (!new_array) {
         return NULL;
@@ -50,7 +55,8 @@ void *dg_va_push_back_empty(dg_vector_array *thisptr) {
       thisptr->ptr = new_array;
       thisptr->allocated_by_malloc = true;
     } else {
-      void *new_array = realloc(thisptr->ptr, new_allocation_size);
+      void *new_array = dg_alloc_reallocate(va_allocator(thisptr), thisptr->ptr, thisptr->ptr_bytes,
+                                            new_allocation_size, alignof(max_align_t));
       if (!new_array) {
         return NULL;
       }
@@ -73,7 +79,7 @@ void dg_va_clear(dg_vector_array *thisptr) { thisptr->count_elements = 0; }
 
 void dg_va_free(dg_vector_array *thisptr) {
   if (thisptr->allocated_by_malloc) {
-    free(thisptr->ptr);
+    dg_alloc_free(va_allocator(thisptr), thisptr->ptr, thisptr->ptr_bytes);
     thisptr->ptr = NULL;
   }
 }
@@ -125,6 +125,15 @@ static void get_net_message_array(dg_demver_data *version) {
     version->netmessage_array = new_protocol_messages;
     version->netmessage_count = ARRAYSIZE(new_protocol_messages);
   }
+
+  // Inverse for the writer, which may be writing a different protocol than the demo was read with
+  memset(version->netmessage_ids, -1, sizeof(version->netmessage_ids));
+  for (unsigned int i = 0; i < version->netmessage_count; ++i) {
+    net_message_type type = version->netmessage_array[i];
+    if (type != svc_invalid) {
+      version->netmessage_ids[type] = i;
+    }
+  }
 }
 
 static void get_net_message_bits(dg_demver_data *version) {
@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+enum { DEFAULT_BUFFER_SIZE = 1 << 16 };
+
 void dg_writer_init(writer *thisptr) {
   memset(thisptr, 0, sizeof(writer));
   dg_bitwriter_init(&thisptr->bitwriter, 32768);
@@ -14,36 +16,125 @@ void dg_writer_init(writer *thisptr) {
 
 void dg_writer_open_file(writer *thisptr, const char *filepath) {
   thisptr->_stream = fopen(filepath, "wb");
-  thisptr->output_funcs = (output_interface){dg_fstream_write};
+  thisptr->output_funcs = (output_interface){dg_fstream_write, dg_fstream_writev};
   thisptr->_custom_stream = false;
+  thisptr->_mapped = false;
 
   if (!thisptr->_stream) {
     thisptr->error = true;
     thisptr->error_message = "Unable to open file";
+  } else {
+    // Writes are already coalesced, a second buffer would only add a copy
+    setvbuf(thisptr->_stream, NULL, _IONBF, 0);
+  }
+}
+
+void dg_writer_open_file_mapped(writer *thisptr, const char *filepath) {
+  thisptr->_stream = dg_mapped_output_open(filepath);
+  if (!thisptr->_stream) {
+    dg_writer_open_file(thisptr, filepath);
+    return;
   }
+
+  thisptr->output_funcs = (output_interface){dg_mapped_output_write, NULL};
+  thisptr->_custom_stream = false;
+  thisptr->_mapped = true;
 }
+
 void dg_writer_open(writer *thisptr, void *stream, output_interface output_interface) {
   thisptr->_stream = stream;
   thisptr->output_funcs = output_interface;
   thisptr->_custom_stream = true;
+  thisptr->_mapped = false;
+}
+
+static void output_write(writer *thisptr, const void *src, size_t bytes) {
+  if (thisptr->output_funcs.write(thisptr->_stream, src, bytes) != bytes && !thisptr->error) {
+    thisptr->error = true;
+    thisptr->error_message = "Unable to write output";
+  }
+}
+
+void dg_writer_flush(writer *thisptr) {
+  if (thisptr->_buffer_offset > 0) {
+    output_write(thisptr, thisptr->_buffer, thisptr->_buffer_offset);
+    thisptr->_buffer_offset = 0;
+  }
+}
+
+static void writer_write_slow(writer *thisptr, const void *src, size_t bytes) {
+  if (thisptr->_buffer == NULL) {
+    thisptr->_buffer_capacity = thisptr->buffer_size ? thisptr->buffer_size : DEFAULT_BUFFER_SIZE;
+    thisptr->_buffer = dg_alloc_allocate(dg_heap_allocator(), thisptr->_buffer_capacity, 1);
+    thisptr->_buffer_offset = 0;
+    if (thisptr->_buffer == NULL) {
+      thisptr->_buffer_capacity = 0;
+    }
+  }
+
+  if (thisptr->_buffer_offset + bytes <= thisptr->_buffer_capacity) {
+    memcpy(thisptr->_buffer + thisptr->_buffer_offset, src, bytes);
+    thisptr->_buffer_offset += bytes;
+  } else if (bytes < thisptr->_buffer_capacity) {
+    dg_writer_flush(thisptr);
+    memcpy(thisptr->_buffer, src, bytes);
+    thisptr->_buffer_offset = bytes;
+  } else if (thisptr->output_funcs.writev && thisptr->_buffer_offset > 0) {
+    // Large payloads skip the buffer but go out in the same call as whatever precedes them
+    dg_output_chunk chunks[] = {{thisptr->_buffer, thisptr->_buffer_offset}, {src, bytes}};
+    size_t total = thisptr->_buffer_offset + bytes;
+    if (thisptr->output_funcs.writev(thisptr->_stream, chunks, 2) != total && !thisptr->error) {
+      thisptr->error = true;
+      thisptr->error_message = "Unable to write output";
+    }
+    thisptr->_buffer_offset = 0;
+  } else {
+    dg_writer_flush(thisptr);
+    output_write(thisptr, src, bytes);
+  }
+}
+
+static inline void writer_write(writer *thisptr, const void *src, size_t bytes) {
+  if (thisptr->_buffer_offset + bytes <= thisptr->_buffer_capacity) {
+    memcpy(thisptr->_buffer + thisptr->_buffer_offset, src, bytes);
+    thisptr->_buffer_offset += bytes;
+  } else {
+    writer_write_slow(thisptr, src, bytes);
+  }
 }
 
 void dg_writer_close(writer *thisptr) {
   dg_bitwriter_free(&thisptr->bitwriter);
+  if (thisptr->_stream) {
+    dg_writer_flush(thisptr);
+  }
+  if (thisptr->_buffer) {
+    dg_alloc_free(dg_heap_allocator(), thisptr->_buffer, thisptr->_buffer_capacity);
+  }
+  thisptr->_buffer = NULL;
+  thisptr->_buffer_offset = thisptr->_buffer_capacity = 0;
+
   if (!thisptr->_custom_stream && thisptr->_stream) {
-    fclose(thisptr->_stream);
+    if (thisptr->_mapped) {
+      if (!dg_mapped_output_close(thisptr->_stream) && !thisptr->error) {
+        thisptr->error = true;
+        thisptr->error_message = "Unable to finish mapped output file";
+      }
+    } else {
+      fclose(thisptr->_stream);
+    }
     thisptr->_stream = NULL;
   }
 }
 
-#define WRITE_BYTE(field) thisptr->output_funcs.write(thisptr->_stream, &message->field, 1);
-#define WRITE_INT32(field) thisptr->output_funcs.write(thisptr->_stream, &message->field, 4);
+#define WRITE_BYTE(field) writer_write(thisptr, &message->field, 1);
+#define WRITE_INT32(field) writer_write(thisptr, &message->field, 4);
 #define WRITE_STRING(field, length)                                                                \
-  thisptr->output_funcs.write(thisptr->_stream, &message->field, length);
+  writer_write(thisptr, &message->field, length);
 #define WRITE_CMDINFO_VEC(field)                                                                   \
-  thisptr->output_funcs.write(thisptr->_stream, &(cmdinfo->field.x), 4);                           \
-  thisptr->output_funcs.write(thisptr->_stream, &(cmdinfo->field.y), 4);                           \
-  thisptr->output_funcs.write(thisptr->_stream, &(cmdinfo->field.z), 4);
+  writer_write(thisptr, &(cmdinfo->field.x), 4);                           \
+  writer_write(thisptr, &(cmdinfo->field.y), 4);                           \
+  writer_write(thisptr, &(cmdinfo->field.z), 4);
 #define WRITE_PREAMBLE()                                                                           \
   WRITE_BYTE(preamble.type);                                                                       \
   WRITE_INT32(preamble.tick);                                                                      \
@@ -53,13 +144,13 @@ void dg_writer_close(writer *thisptr) {
 #define WRITE_DATA()                                                                               \
   WRITE_INT32(size_bytes);                                                                         \
   if (message->size_bytes > 0)                                                                     \
-    thisptr->output_funcs.write(thisptr->_stream, message->data, message->size_bytes);
+    writer_write(thisptr, message->data, message->size_bytes);
 
 void dg_write_preamble(writer *thisptr, dg_message_preamble preamble) {
-  thisptr->output_funcs.write(thisptr->_stream, &preamble.type, 1);
-  thisptr->output_funcs.write(thisptr->_stream, &preamble.tick, 4);
+  writer_write(thisptr, &preamble.type, 1);
+  writer_write(thisptr, &preamble.tick, 4);
   if (thisptr->version.has_slot_in_preamble) {
-    thisptr->output_funcs.write(thisptr->_stream, &preamble.slot, 1);
+    writer_write(thisptr, &preamble.slot, 1);
   }
 }
 
@@ -98,7 +189,7 @@ void dg_write_packet(writer *thisptr, dg_packet *message) {
 
   for (int i = 0; i < thisptr->version.cmdinfo_size; ++i) {
     dg_cmdinfo *cmdinfo = &message->cmdinfo[i];
-    thisptr->output_funcs.write(thisptr->_stream, &cmdinfo->interp_flags, 4);
+    writer_write(thisptr, &cmdinfo->interp_flags, 4);
 
     WRITE_CMDINFO_VEC(view_origin);
     WRITE_CMDINFO_VEC(view_angles);
@@ -113,6 +204,20 @@ void dg_write_packet(writer *thisptr, dg_packet *message) {
   WRITE_DATA();
 }
 
+// The netmessage layout only depends on these, everything else in the version is derived
+static bool same_netmessage_encoding(const dg_demver_data *lhs, const dg_demver_data *rhs) {
+  return lhs->game == rhs->game && lhs->demo_protocol == rhs->demo_protocol &&
+         lhs->network_protocol == rhs->network_protocol && lhs->l4d2_version == rhs->l4d2_version;
+}
+
+static void write_packet_span(writer *thisptr, dg_packet *packet, uint32_t start, uint32_t end) {
+  if (start != end) {
+    dg_bitstream span = dg_bitstream_create(packet->data, end);
+    dg_bitstream_advance(&span, start);
+    dg_bitwriter_write_bitstream(&thisptr->bitwriter, &span);
+  }
+}
+
 void dg_write_packet_parsed(writer *thisptr, packet_parsed *message_parsed) {
   dg_packet *message = &message_parsed->orig;
   thisptr->bitwriter.bitoffset = 0;
@@ -123,7 +228,7 @@ void dg_write_packet_parsed(writer *thisptr, packet_parsed *message_parsed) {
 
   for (int i = 0; i < thisptr->version.cmdinfo_size; ++i) {
     dg_cmdinfo *cmdinfo = &message->cmdinfo[i];
-    thisptr->output_funcs.write(thisptr->_stream, &cmdinfo->interp_flags, 4);
+    writer_write(thisptr, &cmdinfo->interp_flags, 4);
 
     WRITE_CMDINFO_VEC(view_origin);
     WRITE_CMDINFO_VEC(view_angles);
@@ -144,10 +249,32 @@ void dg_write_packet_parsed(writer *thisptr, packet_parsed *message_parsed) {
   }
 #endif
 
-  for (uint32_t i = 0; i < message_parsed->message_count; ++i) {
-    packet_net_message *netmsg = message_parsed->messages + i;
-    dg_bitwriter_write_netmessage(&thisptr->bitwriter, &thisptr->version, netmsg);
+  // Runs of unchanged messages are copied from the original packet, only dirty ones are encoded
+  bool passthrough = thisptr->copy_clean_messages && message->data != NULL &&
+                     same_netmessage_encoding(&message_parsed->version, &thisptr->version);
+  uint32_t packet_bits = message->size_bytes * 8;
+  uint32_t run_start = 0;
+  uint32_t run_end = 0;
+
+  packet_net_message *netmsg = message_parsed->first_message;
+  for (uint32_t i = 0; i < message_parsed->message_count; ++i, netmsg = dg_netmessage_next(netmsg)) {
+    bool copy = passthrough && !netmsg->dirty && netmsg->bit_start < netmsg->bit_end &&
+                netmsg->bit_end <= packet_bits;
+    if (copy && run_start != run_end && netmsg->bit_start == run_end) {
+      run_end = netmsg->bit_end;
+      continue;
+    }
+
+    write_packet_span(thisptr, message, run_start, run_end);
+    if (copy) {
+      run_start = netmsg->bit_start;
+      run_end = netmsg->bit_end;
+    } else {
+      run_start = run_end = 0;
+      dg_bitwriter_write_netmessage(&thisptr->bitwriter, &thisptr->version, netmsg);
+    }
   }
+  write_packet_span(thisptr, message, run_start, run_end);
 
   if (thisptr->bitwriter.bitoffset % 8 != 0) {
     uint32_t expected_bits =
@@ -162,8 +289,8 @@ void dg_write_packet_parsed(writer *thisptr, packet_parsed *message_parsed) {
   }
 
   uint32_t bytes = thisptr->bitwriter.bitoffset / 8;
-  thisptr->output_funcs.write(thisptr->_stream, &bytes, 4);
-  thisptr->output_funcs.write(thisptr->_stream, thisptr->bitwriter.ptr, bytes);
+  writer_write(thisptr, &bytes, 4);
+  writer_write(thisptr, thisptr->bitwriter.ptr, bytes);
 #ifdef GROUND_TRUTH_CHECK
   if(thisptr->expect_equal) {
       thisptr->bitwriter.truth_data = NULL;
@@ -175,8 +302,8 @@ void dg_write_synctick(writer *thisptr, dg_synctick *message) { WRITE_PREAMBLE()
 
 void dg_write_stop(writer *thisptr, dg_stop *message) {
   enum dg_type t = dg_type_stop;
-  thisptr->output_funcs.write(thisptr->_stream, &t, 1);
-  thisptr->output_funcs.write(thisptr->_stream, message->data, message->size_bytes);
+  writer_write(thisptr, &t, 1);
+  writer_write(thisptr, message->data, message->size_bytes);
 }
 
 void dg_write_stringtables(writer *thisptr, dg_stringtables *message) {
@@ -196,25 +323,21 @@ void dg_writer_free(writer *thisptr) {
 }
 
 void dg_write_byte(writer *thisptr, uint8_t value) {
-  thisptr->output_funcs.write(thisptr->_stream, &value, 1);
+  writer_write(thisptr, &value, 1);
 }
 
 void dg_write_short(writer *thisptr, uint16_t value) {
-  thisptr->output_funcs.write(thisptr->_stream, &value, 2);
+  writer_write(thisptr, &value, 2);
 }
 
 void dg_write_int32(writer *thisptr, int32_t value) {
-  thisptr->output_funcs.write(thisptr->_stream, &value, 4);
+  writer_write(thisptr, &value, 4);
 }
 
 void dg_write_data(writer *thisptr, void *src, uint32_t bytes) {
-  thisptr->output_funcs.write(thisptr->_stream, src, bytes);
+  writer_write(thisptr, src, bytes);
 }
 
 void dg_write_string(writer *thisptr, const char *str) {
-  while (*str) {
-    thisptr->output_funcs.write(thisptr->_stream, str, 1);
-    ++str;
-  }
-  thisptr->output_funcs.write(thisptr->_stream, str, 1);
+  writer_write(thisptr, str, strlen(str) + 1);
 }
@@ -0,0 +1,36 @@
+#include "demogobbler.h"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <memory>
+
+TEST(alloc_report, names) {
+  EXPECT_STREQ(dg_alloc_site_name(dg_alloc_site_read_vector3), "read_vector3");
+  EXPECT_STREQ(dg_alloc_site_name(dg_alloc_site_parse_netmessages_scrap), "parse_netmessages_scrap");
+  EXPECT_STREQ(dg_message_type_name(dg_type_packet), "packet");
+  EXPECT_STREQ(dg_net_message_name(svc_packet_entities), "svc_packet_entities");
+  EXPECT_STREQ(dg_net_message_name(svc_invalid), "none");
+}
+
+TEST(alloc_report, counts_eproparr) {
+  dg_alloc_report_reset();
+  dg_eproparr props = dg_eproparr_init(8);
+  bool newprop;
+  dg_eproparr_get(&props, 3, &newprop);
+  dg_eproparr_free(&props);
+
+  auto report = std::make_unique<dg_alloc_report>();
+  dg_alloc_report_get(report.get());
+  dg_alloc_counter total = dg_alloc_report_site_total(report.get(), dg_alloc_site_eproparr);
+
+  if (!report->enabled) {
+    // Library built without DEMOGOBBLER_ALLOC_TELEMETRY
+    EXPECT_EQ(total.allocs, 0u);
+    return;
+  }
+
+  EXPECT_GT(total.allocs, 0u);
+  EXPECT_EQ(total.bytes, total.freed_bytes);
+  // Made outside of any message
+  EXPECT_EQ(report->by_message[0][dg_alloc_site_eproparr].allocs, total.allocs);
+  EXPECT_EQ(report->by_netmessage[svc_invalid][dg_alloc_site_eproparr].allocs, total.allocs);
+}
@@ -1,5 +1,8 @@
 #include "gtest/gtest.h"
+#include <cstring>
+#include <vector>
 extern "C" {
+#include "demogobbler.h"
 #include "demogobbler/allocator.h"
 }
 
@@ -99,3 +102,144 @@ TEST(Arena, ClearWorks) {
   dg_arena_free(&a);
   free(expected_blocks);
 }
+
+TEST(Arena, StatsWork) {
+  dg_arena a = dg_arena_create(64);
+  dg_arena_allocate(&a, 48, 1);
+  dg_arena_allocate(&a, 48, 1);
+
+  dg_arena_stats stats = dg_arena_get_stats(&a);
+  EXPECT_EQ(stats.bytes_in_use, 96);
+  EXPECT_EQ(stats.bytes_allocated, 96);
+  EXPECT_EQ(stats.peak_bytes, 96);
+  EXPECT_EQ(stats.bytes_reserved, 128);
+  EXPECT_EQ(stats.block_count, 2);
+
+  dg_arena_clear(&a);
+  dg_arena_allocate(&a, 16, 1);
+  stats = dg_arena_get_stats(&a);
+  EXPECT_EQ(stats.bytes_in_use, 16);
+  EXPECT_EQ(stats.bytes_allocated, 112);
+  EXPECT_EQ(stats.peak_bytes, 96);
+
+  dg_arena_free(&a);
+}
+
+TEST(Arena, DeallocRollsBackLastAllocation) {
+  dg_arena a = dg_arena_create(64);
+  void *first = dg_arena_allocate(&a, 16, 1);
+  void *second = dg_arena_allocate(&a, 16, 1);
+
+  // Only the latest allocation can be given back
+  dg_arena_deallocate(&a, first, 16);
+  EXPECT_EQ(a.blocks[0].bytes_used, 32);
+  dg_arena_deallocate(&a, second, 16);
+  EXPECT_EQ(a.blocks[0].bytes_used, 16);
+  EXPECT_EQ(dg_arena_allocate(&a, 16, 1), second);
+
+  dg_arena_free(&a);
+}
+
+TEST(Arena, HeapAllocatorFrees) {
+  dg_alloc_state *heap = dg_heap_allocator();
+  ASSERT_NE(heap->dealloc, nullptr);
+  char *ptr = (char *)dg_alloc_allocate(heap, 16, 1);
+  ASSERT_NE(ptr, nullptr);
+  ptr = (char *)dg_alloc_reallocate(heap, ptr, 16, 64, 1);
+  ASSERT_NE(ptr, nullptr);
+  memset(ptr, 1, 64);
+  dg_alloc_free(heap, ptr, 64);
+}
+
+TEST(Arena, TrimKeepsLiveBlocks) {
+  dg_arena a = dg_arena_create(64);
+  for (int i = 0; i < 8; ++i) {
+    dg_arena_allocate(&a, 64, 1);
+  }
+  EXPECT_EQ(a.block_count, 8);
+
+  // Everything is still in use
+  dg_arena_trim(&a, 0);
+  EXPECT_EQ(a.block_count, 8);
+
+  dg_arena_clear(&a);
+  dg_arena_allocate(&a, 4, 1);
+  dg_arena_trim(&a, 128);
+  EXPECT_EQ(dg_arena_get_stats(&a).bytes_reserved, 128);
+  EXPECT_EQ(dg_arena_get_stats(&a).peak_bytes, 512);
+
+  dg_arena_trim(&a, 0);
+  EXPECT_EQ(a.block_count, 1);
+  EXPECT_EQ(a.current_block, 0);
+
+  dg_arena_clear(&a);
+  dg_arena_trim(&a, 0);
+  EXPECT_EQ(a.block_count, 0);
+  EXPECT_EQ(a.blocks, nullptr);
+
+  // The arena is still usable after trimming everything
+  uint32_t *ptr = (uint32_t *)dg_arena_allocate(&a, 4, 4);
+  ASSERT_NE(ptr, nullptr);
+  *ptr = 1;
+  EXPECT_EQ(a.block_count, 1);
+
+  dg_arena_free(&a);
+}
+
+TEST(Arena, HugePagesWork) {
+  dg_arena a = dg_arena_create_ex(4096, DG_ARENA_HUGE_PAGES);
+  uint8_t *ptr = (uint8_t *)dg_arena_allocate(&a, 4096, 1);
+  ASSERT_NE(ptr, nullptr);
+  memset(ptr, 0xff, 4096);
+  EXPECT_GE(dg_arena_get_stats(&a).bytes_reserved, 4096);
+  dg_arena_free(&a);
+}
+
+// Header followed by a console command and a stop message. Padded since the buffer stream
+// refuses reads that are as large as the whole buffer
+static std::vector<uint8_t> consolecmd_demo(const char *command) {
+  std::vector<uint8_t> out(1072);
+  memcpy(out.data(), "HL2DEMO", 8);
+  int32_t protocols[] = {3, 15};
+  memcpy(out.data() + 8, protocols, sizeof(protocols));
+
+  int32_t length = strlen(command) + 1;
+  int32_t tick = 0;
+  out.push_back(dg_type_consolecmd);
+  out.insert(out.end(), (uint8_t *)&tick, (uint8_t *)&tick + 4);
+  out.insert(out.end(), (uint8_t *)&length, (uint8_t *)&length + 4);
+  out.insert(out.end(), command, command + length);
+  out.push_back(dg_type_stop);
+  out.insert(out.end(), (uint8_t *)&tick, (uint8_t *)&tick + 4);
+  out.resize(1 << 16);
+  return out;
+}
+
+static void ignore_consolecmd(parser_state *, dg_consolecmd *) {}
+
+TEST(Arena, ThreadArenasAreReused) {
+  std::vector<uint8_t> demo = consolecmd_demo("echo hello");
+  dg_memory_stats stats[2];
+  dg_arena_block *blocks[2];
+
+  for (int i = 0; i < 2; ++i) {
+    dg_settings settings;
+    dg_settings_init(&settings);
+    settings.consolecmd_handler = ignore_consolecmd;
+    settings.reuse_thread_arenas = true;
+    settings.memory_stats = &stats[i];
+    dg_parse_result result = dg_parse_buffer(&settings, demo.data(), demo.size());
+    ASSERT_FALSE(result.error) << result.error_message;
+    blocks[i] = ((dg_arena *)settings.temp_alloc_state.allocator)->blocks;
+  }
+
+  EXPECT_EQ(blocks[0], blocks[1]);
+  for (auto &stat : stats) {
+    EXPECT_EQ(stat.packet_bytes, strlen("echo hello") + 1);
+    EXPECT_EQ(stat.temp.bytes_allocated, stat.packet_bytes);
+    EXPECT_EQ(stat.temp.block_count, 1);
+    EXPECT_EQ(stat.permanent.bytes_allocated, 0);
+  }
+
+  dg_release_thread_arenas();
+}
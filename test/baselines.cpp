@@ -75,7 +75,7 @@ static void parse_baselines(baseline_state* state) {
   write_args.input = sentry;
   write_args.writer = &writer;
 
-  auto result = dg_write_stringtable_entry(&write_args);
+  auto result = dg_write_stringtable_entry_ex(&write_args, &state->demver_data);
   EXPECT_EQ(result.error, false);
   EXPECT_EQ(dg_bitstream_bits_left(&state->instancebaselines.data), writer.bitoffset);
   dg_bitwriter_free(&writer);
@@ -98,8 +98,8 @@ static void handle_st(parser_state *_state, dg_stringtables_parsed *value) {
 
 static void handle_packet(parser_state *_state, packet_parsed *value) {
   baseline_state *state = (baseline_state *)_state->client_state;
-  for (size_t i = 0; i < value->message_count; ++i) {
-    packet_net_message *msg = value->messages + i;
+  packet_net_message *msg = value->first_message;
+  for (size_t i = 0; i < value->message_count; ++i, msg = dg_netmessage_next(msg)) {
     if (msg->mtype == svc_create_stringtable &&
         strcmp("instancebaseline", msg->message_svc_create_stringtable.name) == 0) {
       state->instancebaselines = msg->message_svc_create_stringtable;
@@ -127,6 +127,7 @@ static dg_parse_result get_baseline_state(const char *filepath, baseline_state *
   dg_alloc_state allocator = dg_arena_create_allocator(&state->memory);
   args.allocator = &allocator;
   args.flatten_datatables = true;
+  args.heap_allocator = NULL;
   args.message = &state->datatables;
   args.should_store_props = false;
   args.version_data = &state->demver_data;
@@ -255,6 +256,7 @@ static dg_parse_result get_baselinegen_state(const char *filepath, baselinegen_s
   dg_alloc_state allocator = dg_arena_create_allocator(&state->memory);
   args.allocator = &allocator;
   args.flatten_datatables = true;
+  args.heap_allocator = NULL;
   args.message = &state->datatables;
   args.should_store_props = false;
   args.version_data = &state->demver_data;
@@ -385,6 +385,41 @@ TEST(BitstreamPlusWriter, Bitstream) {
   free(data);
 }
 
+TEST(BitstreamPlusWriter, BitstreamOffsets) {
+  const int SIZE = 256;
+  uint8_t data[SIZE];
+  for (int i = 0; i < SIZE; ++i) {
+    data[i] = (i * 37 + 11) % 256;
+  }
+
+  // Every combination of source and destination alignment, both for the bytewise and the copy path
+  for (unsigned int dest_offset = 0; dest_offset < 8; ++dest_offset) {
+    for (unsigned int src_offset = 0; src_offset < 8; ++src_offset) {
+      for (unsigned int bits : {0u, 5u, 13u, 64u, 701u}) {
+        dg_bitstream stream = dg_bitstream_create(data, src_offset + bits);
+        dg_bitstream_advance(&stream, src_offset);
+        dg_bitwriter writer;
+        dg_bitwriter_init(&writer, 8);
+        dg_bitwriter_write_uint(&writer, 0x55, dest_offset);
+        dg_bitwriter_write_bitstream(&writer, &stream);
+        dg_bitwriter_write_uint(&writer, 0x3, 2);
+        ASSERT_EQ(writer.bitoffset, dest_offset + bits + 2);
+
+        dg_bitstream expected = dg_bitstream_create(data, src_offset + bits);
+        dg_bitstream_advance(&expected, src_offset);
+        dg_bitstream written = dg_bitstream_create(writer.ptr, writer.bitoffset);
+        EXPECT_EQ(dg_bitstream_read_uint(&written, dest_offset), 0x55u & ((1u << dest_offset) - 1));
+        for (unsigned int i = 0; i < bits; ++i) {
+          ASSERT_EQ(dg_bitstream_read_bit(&expected), dg_bitstream_read_bit(&written))
+              << "bit " << i << " src " << src_offset << " dest " << dest_offset;
+        }
+        EXPECT_EQ(dg_bitstream_read_uint(&written, 2), 0x3u);
+        dg_bitwriter_free(&writer);
+      }
+    }
+  }
+}
+
 TEST(BitstreamPlusWriter, IndexDiff) {
   for (uint32_t old_index = -1; old_index < 0xFFE; ++old_index) {
     for (uint32_t new_index = old_index + 1; new_index < 0xFFF; ++new_index) {
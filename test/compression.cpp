@@ -0,0 +1,163 @@
+#include "demogobbler.h"
+#include "demogobbler/compression.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> with_header(const char *id, std::vector<uint8_t> body) {
+  // Sized up front, a reallocating insert trips -Wstringop-overread in release builds
+  std::vector<uint8_t> out(4 + body.size());
+  memcpy(out.data(), id, 4);
+  std::copy(body.begin(), body.end(), out.begin() + 4);
+  return out;
+}
+
+// Stores everything as literals, enough to produce valid input for the decoder
+static std::vector<uint8_t> lzss_literals(const std::vector<uint8_t> &input) {
+  uint32_t size = input.size();
+  std::vector<uint8_t> out = with_header("LZSS", {});
+  out.insert(out.end(), (uint8_t *)&size, (uint8_t *)&size + 4);
+
+  size_t i = 0;
+  for (;;) {
+    size_t command_index = out.size();
+    out.push_back(0);
+    for (int bit = 0; bit < 8; ++bit) {
+      if (i == input.size()) {
+        out[command_index] |= 1 << bit;
+        out.push_back(0);
+        out.push_back(0);
+        return out;
+      }
+      out.push_back(input[i++]);
+    }
+  }
+}
+
+static std::string decompress(const std::vector<uint8_t> &input) {
+  uint32_t size = dg_decompressed_size(input.data(), input.size());
+  std::string out(size, '\0');
+  if (!dg_decompress(out.data(), size, input.data(), input.size())) {
+    return "failed";
+  }
+  return out;
+}
+
+TEST(compression, lzss) {
+  // abc followed by a 6 byte back reference 3 bytes back and the end marker
+  std::vector<uint8_t> input = with_header(
+      "LZSS", {9, 0, 0, 0, 0x18, 'a', 'b', 'c', 0x00, 0x25, 0x00, 0x00});
+  EXPECT_EQ(dg_decompressed_size(input.data(), input.size()), 9u);
+  EXPECT_EQ(decompress(input), "abcabcabc");
+
+  std::string text = "The quick brown fox jumps over the lazy dog";
+  EXPECT_EQ(decompress(lzss_literals(std::vector<uint8_t>(text.begin(), text.end()))), text);
+}
+
+TEST(compression, snappy) {
+  // Literal abc, then a 9 byte copy with a 1 byte offset of 3
+  std::vector<uint8_t> input = with_header("SNAP", {12, 0x08, 'a', 'b', 'c', 0x15, 3});
+  EXPECT_EQ(dg_decompressed_size(input.data(), input.size()), 12u);
+  EXPECT_EQ(decompress(input), "abcabcabcabc");
+
+  // Literal with the length in an extra byte, then a copy with a 2 byte offset
+  std::vector<uint8_t> body = {70, 60 << 2, 63};
+  for (int i = 0; i < 64; ++i) {
+    body.push_back('a' + i % 26);
+  }
+  body.insert(body.end(), {(5 << 2) | 2, 64, 0});
+  std::string expected;
+  for (int i = 0; i < 64; ++i) {
+    expected += 'a' + i % 26;
+  }
+  expected += expected.substr(0, 6);
+  EXPECT_EQ(decompress(with_header("SNAP", body)), expected);
+}
+
+TEST(compression, rejects_corrupt_input) {
+  char dest[16];
+  // Back reference before the start of the output
+  std::vector<uint8_t> lzss = with_header("LZSS", {3, 0, 0, 0, 0x01, 0x00, 0x25});
+  EXPECT_FALSE(dg_decompress(dest, 3, lzss.data(), lzss.size()));
+  // Truncated, no end marker
+  lzss = with_header("LZSS", {3, 0, 0, 0, 0x00, 'a', 'b'});
+  EXPECT_FALSE(dg_decompress(dest, 3, lzss.data(), lzss.size()));
+  // Size mismatch
+  lzss = with_header("LZSS", {9, 0, 0, 0, 0x18, 'a', 'b', 'c', 0x00, 0x25, 0x00, 0x00});
+  EXPECT_FALSE(dg_decompress(dest, 8, lzss.data(), lzss.size()));
+  // Copy longer than the output
+  std::vector<uint8_t> snappy = with_header("SNAP", {4, 0x08, 'a', 'b', 'c', 0x15, 3});
+  EXPECT_FALSE(dg_decompress(dest, 4, snappy.data(), snappy.size()));
+  // Not compressed
+  EXPECT_EQ(dg_decompressed_size("plain text", 10), 0u);
+  EXPECT_FALSE(dg_decompress(dest, 10, "plain text", 10));
+}
+
+static void parse_compressed_sentries(unsigned int leading_bits) {
+  dg_sentry_value values[2];
+  memset(values, 0, sizeof(values));
+  char names[2][8] = {"first", "second"};
+  for (int i = 0; i < 2; ++i) {
+    values[i].entry_bit = true;
+    values[i].has_name = true;
+    values[i].stored_string = names[i];
+  }
+
+  dg_sentry sentry;
+  memset(&sentry, 0, sizeof(sentry));
+  sentry.values = values;
+  sentry.values_length = 2;
+  sentry.max_entries = 64;
+
+  dg_bitwriter entries;
+  dg_bitwriter_init(&entries, 256);
+  dg_sentry_write_args write_args;
+  write_args.input = &sentry;
+  write_args.writer = &entries;
+  ASSERT_FALSE(dg_write_stringtable_entry(&write_args).error);
+
+  uint8_t *bytes = (uint8_t *)entries.ptr;
+  std::vector<uint8_t> compressed =
+      lzss_literals(std::vector<uint8_t>(bytes, bytes + (entries.bitoffset + 7) / 8));
+
+  dg_bitwriter message;
+  dg_bitwriter_init(&message, 1024);
+  dg_bitwriter_write_uint(&message, 0, leading_bits);
+  dg_bitwriter_write_uint32(&message, (entries.bitoffset + 7) / 8);
+  dg_bitwriter_write_uint32(&message, compressed.size());
+  dg_bitwriter_write_bits(&message, compressed.data(), compressed.size() * 8);
+
+  dg_demver_data demver;
+  memset(&demver, 0, sizeof(demver));
+  demver.demo_protocol = 3;
+  dg_arena arena = dg_arena_create(4096);
+  dg_alloc_state allocator = dg_arena_create_allocator(&arena);
+
+  dg_sentry_parse_args args;
+  memset(&args, 0, sizeof(args));
+  args.allocator = &allocator;
+  args.demver_data = &demver;
+  args.flags = 1;
+  args.max_entries = 64;
+  args.num_updated_entries = 2;
+  args.stream = dg_bitstream_create(message.ptr, message.bitoffset);
+  dg_bitstream_advance(&args.stream, leading_bits);
+
+  dg_sentry out;
+  dg_parse_result result = dg_parse_stringtable_entry(&args, &out);
+  ASSERT_FALSE(result.error) << result.error_message;
+  ASSERT_EQ(out.values_length, 2u);
+  EXPECT_STREQ(out.values[0].stored_string, "first");
+  EXPECT_STREQ(out.values[1].stored_string, "second");
+
+  dg_arena_free(&arena);
+  dg_bitwriter_free(&message);
+  dg_bitwriter_free(&entries);
+}
+
+TEST(compression, compressed_stringtable) {
+  parse_compressed_sentries(0);
+  parse_compressed_sentries(3); // Compressed data that is not byte aligned gets copied first
+}
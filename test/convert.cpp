@@ -2,8 +2,11 @@
 #include "demogobbler.h"
 #include "demogobbler/freddie.hpp"
 #include "utils/memory_stream.hpp"
+#include "utils/synthetic_demo.hpp"
 #include "gtest/gtest.h"
 #include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <regex>
 
 namespace {
@@ -62,19 +65,20 @@ static bool verify_updates(freddie::demo_t* demo) {
 
   args.allocator = &alligator;
   args.flatten_datatables = false;
+  args.heap_allocator = NULL;
   args.message = demo->get_datatables();
   args.should_store_props = false;
   args.version_data = &demo->demver_data;
   dg_estate_init(&state, args);
 
   for(size_t i=0; i < demo->packets.size() && !result.error; ++i) {
-    packet_parsed *ptr = std::get_if<packet_parsed>(&demo->packets[i]->packet);
+    packet_parsed *ptr = demo->packets[i].get_if<packet_parsed>();
 
     if(ptr == NULL)
       continue;
 
-    for(size_t msg_index=0; msg_index <  ptr->message_count; ++msg_index) {
-      packet_net_message* msg = ptr->messages + msg_index;
+    packet_net_message* msg = ptr->first_message;
+    for(size_t msg_index=0; msg_index <  ptr->message_count; ++msg_index, msg = dg_netmessage_next(msg)) {
       if(msg->mtype != svc_packet_entities)
         continue;
       dg_svc_packet_entities* packet_entities = &msg->message_svc_packet_entities;
@@ -121,6 +125,28 @@ static bool verify_updates(freddie::demo_t* demo) {
   return !result.error;
 }
 
+static const char *STREAMED_OUTPUT = "./tmp_convert/streamed.dem";
+
+// Converts the input again through the streaming overload and compares its output with the bytes
+// written from the converted demo_t
+static void expect_streaming_matches(const freddie::demo_t *example, const char *input_path,
+                                     const freddie::memory_stream *expected) {
+  std::filesystem::create_directory("./tmp_convert");
+  auto result = freddie::convert_demo(example, input_path, STREAMED_OUTPUT);
+  EXPECT_EQ(result.error, false) << "error streaming conversion: " << result.error_message;
+
+  if (!result.error) {
+    std::ifstream file(STREAMED_OUTPUT, std::ios::binary);
+    std::vector<uint8_t> streamed((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+    uint8_t *data = (uint8_t *)expected->buffer;
+    std::vector<uint8_t> written(data, data + expected->file_size);
+    EXPECT_EQ(streamed, written) << "streamed conversion differs from demo_t conversion";
+  }
+
+  std::filesystem::remove_all("./tmp_convert");
+}
+
 void do_conversion(const Conversion& conversion) {
   std::cout << "[----------] " << conversion.input << " => " << conversion.example << std::endl;
 
@@ -163,6 +189,8 @@ void do_conversion(const Conversion& conversion) {
     return;
   }
 
+  expect_streaming_matches(&example, conversion.input.c_str(), &output_stream.underlying);
+
   output_stream.underlying.offset = 0;
   freddie::demo_t output;
   result = freddie::demo_t::parse_demo(&output, &output_stream.underlying, {freddie::memory_stream_read, freddie::memory_stream_seek});
@@ -182,3 +210,30 @@ TEST(convert, test) {
     do_conversion(conversion);
   }
 }
+
+TEST(convert, streaming_matches_demo_t) {
+  std::filesystem::create_directory("./tmp_convert");
+  const char *input_path = "./tmp_convert/input.dem";
+  std::vector<uint8_t> bytes = packetentities_demo(4);
+  {
+    std::ofstream file(input_path, std::ios::binary);
+    file.write((const char *)bytes.data(), bytes.size());
+  }
+
+  // The demo is its own example, the entity updates still go through the prop conversion
+  freddie::demo_t example;
+  freddie::demo_t input;
+  auto result = freddie::demo_t::parse_demo(&example, input_path);
+  ASSERT_FALSE(result.error) << result.error_message;
+  result = freddie::demo_t::parse_demo(&input, input_path);
+  ASSERT_FALSE(result.error) << result.error_message;
+  result = freddie::convert_demo(&example, &input);
+  ASSERT_FALSE(result.error) << result.error_message;
+
+  wrapped_memory_stream output_stream;
+  result = input.write_demo(&output_stream.underlying, {freddie::memory_stream_write});
+  ASSERT_FALSE(result.error) << result.error_message;
+  ASSERT_GT(output_stream.underlying.file_size, 1072u);
+
+  expect_streaming_matches(&example, input_path, &output_stream.underlying);
+}
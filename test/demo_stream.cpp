@@ -0,0 +1,117 @@
+#include "demogobbler.h"
+#include "demogobbler/freddie.hpp"
+#include "utils/synthetic_demo.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <vector>
+
+struct demo_stream_fixture : ::testing::Test {
+  std::vector<uint8_t> input_bytes;
+  freddie::memory_stream output;
+
+  void SetUp() override { input_bytes = netmessage_demo(); }
+
+  dg_parse_result parse(freddie::demo_stream_t *stream) {
+    freddie::memory_stream input;
+    freddie::memory_stream_write(&input, input_bytes.data(), input_bytes.size());
+    input.offset = 0;
+    return stream->parse(&input, {freddie::memory_stream_read, freddie::memory_stream_seek});
+  }
+
+  std::vector<uint8_t> written() {
+    uint8_t *data = (uint8_t *)output.buffer;
+    return std::vector<uint8_t>(data, data + output.file_size);
+  }
+
+  // Ticks of the net_tick messages in the written demo
+  std::vector<uint32_t> written_ticks() {
+    std::vector<uint32_t> ticks;
+    std::vector<uint8_t> bytes = written();
+    bytes.resize(bytes.size() + 64);
+
+    dg_settings settings;
+    dg_settings_init(&settings);
+    settings.client_state = &ticks;
+    settings.packet_parsed_handler = [](parser_state *state, packet_parsed *message) {
+      auto *out = (std::vector<uint32_t> *)state->client_state;
+      packet_net_message *netmsg = message->first_message;
+      for (uint32_t i = 0; i < message->message_count; ++i, netmsg = dg_netmessage_next(netmsg)) {
+        if (netmsg->mtype == net_tick) {
+          out->push_back(netmsg->message_net_tick.tick);
+        }
+      }
+    };
+    dg_parse_result result = dg_parse_buffer(&settings, bytes.data(), bytes.size());
+    EXPECT_FALSE(result.error) << result.error_message;
+    return ticks;
+  }
+};
+
+TEST_F(demo_stream_fixture, passthrough) {
+  freddie::demo_stream_t stream;
+  size_t packets = 0;
+  stream.add_packet_transform([&packets](freddie::demo_stream_t *, freddie::demo_packet *) {
+    ++packets;
+    return true;
+  });
+  stream.open(&output, {freddie::memory_stream_write});
+  dg_parse_result result = parse(&stream);
+  ASSERT_FALSE(result.error) << result.error_message;
+  ASSERT_FALSE(stream.close().error);
+
+  EXPECT_EQ(packets, 2u);
+  std::vector<uint8_t> bytes = written();
+  ASSERT_GT(bytes.size(), 1072u);
+  ASSERT_LE(bytes.size(), input_bytes.size());
+  EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), input_bytes.begin()));
+}
+
+TEST_F(demo_stream_fixture, netmessage_transforms) {
+  freddie::demo_stream_t stream;
+  size_t calls = 0;
+  stream.add_netmessage_transform(
+      net_tick, [&calls](freddie::demo_stream_t *, packet_parsed *, packet_net_message *msg) {
+        msg->message_net_tick.tick += 100;
+        msg->dirty = true;
+        ++calls;
+      });
+  stream.open(&output, {freddie::memory_stream_write});
+  ASSERT_FALSE(parse(&stream).error);
+  ASSERT_FALSE(stream.close().error);
+
+  EXPECT_EQ(calls, 2u);
+  std::vector<uint32_t> expected = {142, 143};
+  EXPECT_EQ(written_ticks(), expected);
+}
+
+TEST_F(demo_stream_fixture, invalid_transform_type) {
+  freddie::demo_stream_t stream;
+  size_t calls = 0;
+  auto count = [&calls](freddie::demo_stream_t *, packet_parsed *, packet_net_message *) {
+    ++calls;
+  };
+  stream.add_netmessage_transform(svc_invalid, count);
+  stream.add_netmessage_transform((net_message_type)(svc_invalid + 100), count);
+
+  stream.open(&output, {freddie::memory_stream_write});
+  EXPECT_TRUE(parse(&stream).error);
+  EXPECT_TRUE(stream.close().error);
+  EXPECT_EQ(calls, 0u);
+}
+
+TEST_F(demo_stream_fixture, multiple_demos) {
+  freddie::demo_stream_t stream;
+  int parsed = 0;
+  // Only the last demo gets to stop the output
+  stream.add_packet_transform([&parsed](freddie::demo_stream_t *, freddie::demo_packet *packet) {
+    return parsed == 1 || !std::holds_alternative<dg_stop>(packet->packet);
+  });
+  stream.open(&output, {freddie::memory_stream_write});
+  for (; parsed < 2; ++parsed) {
+    ASSERT_FALSE(parse(&stream).error);
+  }
+  ASSERT_FALSE(stream.close().error);
+
+  std::vector<uint32_t> expected = {42, 43, 42, 43};
+  EXPECT_EQ(written_ticks(), expected);
+}
@@ -17,6 +17,13 @@ TEST(E2E, freddie) {
   }
 }
 
+TEST(E2E, freddie_stream) {
+  for (auto &demo : get_test_demos()) {
+    std::cout << "[----------] " << demo << std::endl;
+    copy_demo_stream(demo.c_str());
+  }
+}
+
 static void packet_handler(parser_state *, dg_packet *) {}
 
 TEST(E2E, buffer_stream_test) {
@@ -1,7 +1,12 @@
 #include "demogobbler.h"
 #include "demogobbler/bitwriter.h"
+#include "utils/synthetic_estate.hpp"
 #include "utils/test_demos.hpp"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
 
 extern "C" {
 #include "demogobbler/parser.h"
@@ -41,4 +46,327 @@ TEST(E2E, test_ents_reading) {
     auto output = dg_parse_file(&settings, demo.c_str());
     EXPECT_EQ(output.error, false) << output.error_message;
   }
-}
\ No newline at end of file
+}
+
+static std::vector<int> live_entities(const estate *state) {
+  std::vector<int> output;
+  for (dg_edict *ent = dg_estate_next_live(state, NULL); ent != NULL;
+       ent = dg_estate_next_live(state, ent)) {
+    output.push_back(ent - state->edicts);
+  }
+  std::sort(output.begin(), output.end());
+  return output;
+}
+
+TEST(estate, live_entities) {
+  synthetic_estate state(true);
+  prop_value health;
+  memset(&health, 0, sizeof(health));
+  health.prop_index =
+      dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iHealth").prop_index;
+  health.value.signed_val = 100;
+
+  dg_ent_update updates[4];
+  memset(updates, 0, sizeof(updates));
+  const int entered[] = {1, 5, 7, 1};
+  for (size_t i = 0; i < 4; ++i) {
+    updates[i].ent_index = entered[i];
+    updates[i].update_type = 2;
+    updates[i].prop_value_array = &health;
+    updates[i].prop_value_array_size = 1;
+  }
+
+  dg_packetentities_data data;
+  memset(&data, 0, sizeof(data));
+  data.ent_updates = updates;
+  data.ent_updates_count = 4;
+  auto result = dg_estate_update(&state.entity_state, &data);
+  EXPECT_EQ(result.error, false);
+  EXPECT_EQ(live_entities(&state.entity_state), std::vector<int>({1, 5, 7}));
+
+  // Delete 5 and leave pvs with 1, explicitly delete 7 and enter with 9
+  int explicit_deletes[] = {7};
+  updates[0].ent_index = 5;
+  updates[0].update_type = 3;
+  updates[1].ent_index = 1;
+  updates[1].update_type = 1;
+  updates[2].ent_index = 9;
+  data.ent_updates_count = 3;
+  data.explicit_deletes = explicit_deletes;
+  data.explicit_deletes_count = 1;
+  result = dg_estate_update(&state.entity_state, &data);
+  EXPECT_EQ(result.error, false);
+  EXPECT_EQ(live_entities(&state.entity_state), std::vector<int>({1, 9}));
+  EXPECT_EQ(state.entity_state.edicts[7].explicitly_deleted, true);
+
+  dg_prop_handle handle = dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iHealth");
+  dg_prop_value_inner *value = dg_eproparr_find(&state.entity_state.edicts[9].props, handle);
+  ASSERT_NE(value, nullptr);
+  EXPECT_EQ(value->signed_val, 100);
+
+  dg_estate_free(&state.entity_state);
+  EXPECT_EQ(dg_estate_next_live(&state.entity_state, NULL), nullptr);
+  EXPECT_EQ(state.entity_state.edicts[9].exists, false);
+}
+
+static void expect_same_props(const dg_serverclass_data *expected,
+                              const dg_serverclass_data *actual) {
+  ASSERT_EQ(actual->prop_count, expected->prop_count);
+  EXPECT_STREQ(actual->dt_name, expected->dt_name);
+  for (size_t i = 0; i < expected->prop_count; ++i) {
+    const dg_sendprop *a = expected->props + i;
+    const dg_sendprop *b = actual->props + i;
+    EXPECT_STREQ(b->name, a->name) << "prop " << i;
+    EXPECT_EQ(b->proptype, a->proptype) << "prop " << i;
+    EXPECT_EQ(b->priority, a->priority) << "prop " << i;
+    EXPECT_EQ(b->prop_numbits, a->prop_numbits) << "prop " << i;
+    EXPECT_EQ(b->owner_class, a->owner_class) << "prop " << i;
+#define EXPECT_SAME_FLAG(flag) EXPECT_EQ(b->flag, a->flag) << #flag << " of prop " << i;
+    EXPECT_SAME_FLAG(flag_unsigned);
+    EXPECT_SAME_FLAG(flag_coord);
+    EXPECT_SAME_FLAG(flag_noscale);
+    EXPECT_SAME_FLAG(flag_rounddown);
+    EXPECT_SAME_FLAG(flag_roundup);
+    EXPECT_SAME_FLAG(flag_normal);
+    EXPECT_SAME_FLAG(flag_exclude);
+    EXPECT_SAME_FLAG(flag_xyze);
+    EXPECT_SAME_FLAG(flag_insidearray);
+    EXPECT_SAME_FLAG(flag_proxyalwaysyes);
+    EXPECT_SAME_FLAG(flag_changesoften);
+    EXPECT_SAME_FLAG(flag_isvectorelem);
+    EXPECT_SAME_FLAG(flag_collapsible);
+    EXPECT_SAME_FLAG(flag_coordmp);
+    EXPECT_SAME_FLAG(flag_coordmplp);
+    EXPECT_SAME_FLAG(flag_coordmpint);
+    EXPECT_SAME_FLAG(flag_cellcoord);
+    EXPECT_SAME_FLAG(flag_cellcoordlp);
+    EXPECT_SAME_FLAG(flag_cellcoordint);
+#undef EXPECT_SAME_FLAG
+  }
+}
+
+TEST(estate, parallel_flatten) {
+  synthetic_estate state;
+
+  // Many serverclasses alternating between the two tables, flattened serially and with several
+  // threads
+  std::vector<dg_serverclass> serverclasses(100);
+  for (size_t i = 0; i < serverclasses.size(); ++i) {
+    serverclasses[i].serverclass_name = i % 2 == 0 ? "CDerived" : "CBase";
+    serverclasses[i].datatable_name = i % 2 == 0 ? "DT_Derived" : "DT_Base";
+  }
+
+  dg_datatables_parsed datatables = state.datatables;
+  datatables.serverclasses = serverclasses.data();
+  datatables.serverclass_count = serverclasses.size();
+
+  estate_init_args args;
+  args.allocator = &state.allocator;
+  args.flatten_datatables = true;
+  args.heap_allocator = NULL;
+  args.message = &datatables;
+  args.should_store_props = false;
+  args.version_data = &state.demver_data;
+
+  estate serial;
+  memset(&serial, 0, sizeof(serial));
+  ASSERT_FALSE(dg_estate_init(&serial, args).error);
+  estate parallel;
+  memset(&parallel, 0, sizeof(parallel));
+  ASSERT_FALSE(dg_estate_init_ex(&parallel, args, NULL, 4).error);
+
+  for (size_t i = 0; i < serverclasses.size(); ++i) {
+    const dg_serverclass_data *data = parallel.class_datas + i;
+    ASSERT_EQ(data->prop_count, i % 2 == 0 ? 5u : 4u);
+    EXPECT_STREQ(data->dt_name, serverclasses[i].datatable_name);
+    EXPECT_NE(dg_estate_find_prop(&parallel, i, "DT_Base.m_iAmmo").prop_index,
+              DG_PROP_HANDLE_INVALID);
+    expect_same_props(serial.class_datas + i, data);
+  }
+
+  dg_estate_free(&parallel);
+  dg_estate_free(&serial);
+}
+
+TEST(estate, flatten_excludes_and_many_baseclasses) {
+  synthetic_estate state;
+
+  // DT_Many has more non-collapsible baseclasses than the old fixed size buffer allowed and
+  // excludes DT_Base.m_flSpeed from all of them
+  const size_t baseclass_count = 1500;
+  std::vector<dg_sendprop> props(baseclass_count + 1);
+  memset(props.data(), 0, sizeof(dg_sendprop) * props.size());
+  for (size_t i = 0; i < baseclass_count; ++i) {
+    props[i].name = "baseclass";
+    props[i].proptype = sendproptype_datatable;
+    props[i].dtname = "DT_Base";
+  }
+  props[baseclass_count].name = "m_flSpeed";
+  props[baseclass_count].proptype = sendproptype_int;
+  props[baseclass_count].flag_exclude = true;
+  props[baseclass_count].exclude_name = "DT_Base";
+
+  std::vector<dg_sendtable> sendtables(state.sendtables, state.sendtables + 2);
+  dg_sendtable many;
+  memset(&many, 0, sizeof(many));
+  many.name = "DT_Many";
+  many.props = props.data();
+  many.prop_count = props.size();
+  sendtables.push_back(many);
+
+  dg_serverclass serverclass;
+  memset(&serverclass, 0, sizeof(serverclass));
+  serverclass.serverclass_name = "CMany";
+  serverclass.datatable_name = "DT_Many";
+
+  dg_datatables_parsed datatables = state.datatables;
+  datatables.sendtables = sendtables.data();
+  datatables.sendtable_count = sendtables.size();
+  datatables.serverclasses = &serverclass;
+  datatables.serverclass_count = 1;
+
+  estate_init_args args;
+  args.allocator = &state.allocator;
+  args.flatten_datatables = true;
+  args.heap_allocator = NULL;
+  args.message = &datatables;
+  args.should_store_props = false;
+  args.version_data = &state.demver_data;
+
+  estate entity_state;
+  memset(&entity_state, 0, sizeof(entity_state));
+  ASSERT_FALSE(dg_estate_init_ex(&entity_state, args, NULL, 1).error);
+
+  const dg_serverclass_data *data = entity_state.class_datas;
+  ASSERT_EQ(data->prop_count, baseclass_count * 3);
+  for (size_t i = 0; i < data->prop_count; ++i) {
+    EXPECT_STRNE(data->props[i].name, "m_flSpeed");
+  }
+  EXPECT_STREQ(data->props[0].name, "m_iHealth");
+  EXPECT_STREQ(data->props[3].name, "m_iHealth");
+
+  dg_estate_free(&entity_state);
+}
+
+static std::string packetentities_bits(dg_packetentities_data *data,
+                                       const dg_demver_data *version) {
+  dg_bitwriter writer;
+  dg_bitwriter_init(&writer, 1024);
+  write_packetentities_args args;
+  memset(&args, 0, sizeof(args));
+  args.data = data;
+  args.version = version;
+  dg_bitwriter_write_packetentities(&writer, args);
+  dg_bitstream stream = dg_bitstream_create(writer.ptr, writer.bitoffset);
+  std::string bits;
+  while (dg_bitstream_bits_left(&stream) > 0) {
+    bits += dg_bitstream_read_bit(&stream) ? '1' : '0';
+  }
+  dg_bitwriter_free(&writer);
+  return bits;
+}
+
+// Entity 1 enters the PVS with health and speed, is parsed with prop spans and written back
+static void packetentities_prop_spans(synthetic_estate *state, const dg_demver_data *version,
+                                      bool new_way) {
+  prop_value props[2];
+  memset(props, 0, sizeof(props));
+  props[0].prop_index =
+      dg_estate_find_prop(&state->entity_state, 0, "DT_Base.m_iHealth").prop_index;
+  props[0].value.proptype = sendproptype_int;
+  props[0].value.type = dg_int_signed;
+  props[0].value.prop_numbits = 10;
+  props[0].value.signed_val = 75;
+  props[1].prop_index =
+      dg_estate_find_prop(&state->entity_state, 0, "DT_Derived.m_flSpeed").prop_index;
+  props[1].value.proptype = sendproptype_float;
+  props[1].value.type = dg_float_noscale;
+  props[1].value.float_val = 2.5f;
+  const uint32_t health_index = props[0].prop_index;
+  if (props[0].prop_index > props[1].prop_index) {
+    std::swap(props[0], props[1]);
+  }
+
+  dg_ent_update update;
+  memset(&update, 0, sizeof(update));
+  update.ent_index = 1;
+  update.update_type = 2;
+  update.prop_value_array = props;
+  update.prop_value_array_size = 2;
+  update.new_way = new_way;
+
+  dg_packetentities_data data;
+  memset(&data, 0, sizeof(data));
+  data.ent_updates = &update;
+  data.ent_updates_count = 1;
+  data.serverclass_bits = 1;
+
+  dg_bitwriter encoded;
+  dg_bitwriter_init(&encoded, 1024);
+  write_packetentities_args write_args;
+  memset(&write_args, 0, sizeof(write_args));
+  write_args.data = &data;
+  write_args.version = version;
+  dg_bitwriter_write_packetentities(&encoded, write_args);
+  std::string original = packetentities_bits(&data, version);
+
+  dg_svc_packet_entities message;
+  memset(&message, 0, sizeof(message));
+  message.max_entries = 2;
+  message.updated_entries = 1;
+  message.data = dg_bitstream_create(encoded.ptr, encoded.bitoffset);
+
+  dg_packetentities_data parsed;
+  memset(&parsed, 0, sizeof(parsed));
+  dg_packetentities_parse_args args;
+  memset(&args, 0, sizeof(args));
+  args.message = &message;
+  args.allocator = &state->allocator;
+  args.permanent_allocator = &state->allocator;
+  args.demver_data = version;
+  args.entity_state = &state->entity_state;
+  args.output = &parsed;
+  args.record_prop_spans = true;
+  dg_parse_result result = dg_parse_packetentities(&args);
+  ASSERT_FALSE(result.error) << result.error_message;
+  ASSERT_EQ(parsed.ent_updates_count, 1u);
+
+  dg_ent_update *parsed_update = parsed.ent_updates;
+  EXPECT_EQ(parsed_update->prop_source, encoded.ptr);
+  ASSERT_EQ(parsed_update->prop_value_array_size, 2u);
+  prop_value *health = parsed_update->prop_value_array;
+  if (health->prop_index != health_index) {
+    ++health;
+  }
+  EXPECT_EQ(health->bit_length, 10u);
+  EXPECT_FALSE(health->dirty);
+  EXPECT_EQ(packetentities_bits(&parsed, version), original);
+
+  // The clean span is copied from the message data, the edited value only shows up once dirty
+  health->value.signed_val = 20;
+  EXPECT_EQ(packetentities_bits(&parsed, version), original);
+  health->dirty = true;
+  std::string changed = packetentities_bits(&parsed, version);
+  EXPECT_NE(changed, original);
+  for (prop_value &prop : props) {
+    if (prop.prop_index == health_index) {
+      prop.value.signed_val = 20;
+    }
+  }
+  EXPECT_EQ(changed, packetentities_bits(&data, version));
+
+  dg_bitwriter_free(&encoded);
+}
+
+TEST(estate, packetentities_prop_spans_old) {
+  synthetic_estate state;
+  packetentities_prop_spans(&state, &state.demver_data, false);
+}
+
+TEST(estate, packetentities_prop_spans_prot4) {
+  synthetic_estate state;
+  dg_demver_data version = state.demver_data;
+  version.demo_protocol = 4;
+  version.game = portal2;
+  packetentities_prop_spans(&state, &version, true);
+}
@@ -0,0 +1,181 @@
+#include "demogobbler.h"
+#include "utils/synthetic_estate.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+struct EstateCacheTest : ::testing::Test {
+  static void SetUpTestSuite() { std::filesystem::create_directory("./tmp_estate_cache"); }
+
+  static void TearDownTestSuite() { std::filesystem::remove_all("./tmp_estate_cache"); }
+};
+
+static estate_init_args cached_args(synthetic_estate &state, const char *raw_buffer) {
+  state.datatables._raw_buffer = (void *)raw_buffer;
+  state.datatables._raw_buffer_bytes = strlen(raw_buffer);
+
+  estate_init_args args;
+  args.allocator = &state.allocator;
+  args.flatten_datatables = false;
+  args.heap_allocator = NULL;
+  args.message = &state.datatables;
+  args.should_store_props = false;
+  args.version_data = &state.demver_data;
+  return args;
+}
+
+static void expect_same_props(const dg_serverclass_data *expected,
+                              const dg_serverclass_data *actual) {
+  ASSERT_EQ(expected->prop_count, actual->prop_count);
+  EXPECT_STREQ(expected->dt_name, actual->dt_name);
+
+  for (size_t i = 0; i < expected->prop_count; ++i) {
+    char expected_name[64];
+    char actual_name[64];
+    dg_sendprop_name(expected_name, sizeof(expected_name), expected->props + i);
+    dg_sendprop_name(actual_name, sizeof(actual_name), actual->props + i);
+    EXPECT_STREQ(expected_name, actual_name);
+    EXPECT_EQ(expected->props[i].proptype, actual->props[i].proptype);
+    EXPECT_EQ(expected->props[i].prop_numbits, actual->props[i].prop_numbits);
+    EXPECT_EQ(expected->props[i].array_num_elements, actual->props[i].array_num_elements);
+    EXPECT_EQ(expected->props[i].priority, actual->props[i].priority);
+    EXPECT_EQ(expected->props[i].flag_unsigned, actual->props[i].flag_unsigned);
+    EXPECT_EQ(expected->props[i].flag_noscale, actual->props[i].flag_noscale);
+    EXPECT_EQ(expected->props[i].flag_insidearray, actual->props[i].flag_insidearray);
+    EXPECT_EQ(expected->props[i].flag_cellcoordint, actual->props[i].flag_cellcoordint);
+
+    if (expected->props[i].proptype == sendproptype_array) {
+      EXPECT_EQ(expected->props[i].array_prop->prop_numbits,
+                actual->props[i].array_prop->prop_numbits);
+      EXPECT_EQ(expected->props[i].array_prop->flag_insidearray,
+                actual->props[i].array_prop->flag_insidearray);
+    } else {
+      EXPECT_EQ(expected->props[i].prop_.low_value, actual->props[i].prop_.low_value);
+      EXPECT_EQ(expected->props[i].prop_.high_value, actual->props[i].prop_.high_value);
+    }
+  }
+}
+
+TEST_F(EstateCacheTest, hit_and_miss) {
+  synthetic_estate state;
+  dg_estate_cache *cache = dg_estate_cache_create();
+
+  estate first;
+  memset(&first, 0, sizeof(first));
+  ASSERT_FALSE(dg_estate_init_cached(&first, cached_args(state, "datatables"), cache).error);
+  EXPECT_EQ(dg_estate_cache_entry_count(cache), 1u);
+  // Misses flatten everything even when not asked to
+  expect_same_props(state.entity_state.class_datas, first.class_datas);
+
+  estate second;
+  memset(&second, 0, sizeof(second));
+  ASSERT_FALSE(dg_estate_init_cached(&second, cached_args(state, "datatables"), cache).error);
+  EXPECT_EQ(dg_estate_cache_entry_count(cache), 1u);
+  EXPECT_NE(second.class_datas, first.class_datas);
+  expect_same_props(state.entity_state.class_datas, second.class_datas);
+
+  dg_prop_handle handle = dg_estate_find_prop(&second, 0, "DT_Base.m_iAmmo[2]");
+  ASSERT_NE(handle.prop_index, DG_PROP_HANDLE_INVALID);
+  EXPECT_EQ(handle.array_index, 2);
+
+  estate third;
+  memset(&third, 0, sizeof(third));
+  ASSERT_FALSE(dg_estate_init_cached(&third, cached_args(state, "other datatables"), cache).error);
+  EXPECT_EQ(dg_estate_cache_entry_count(cache), 2u);
+
+  dg_estate_free(&first);
+  dg_estate_free(&second);
+  dg_estate_free(&third);
+  dg_estate_cache_free(cache);
+}
+
+TEST_F(EstateCacheTest, shared_between_threads) {
+  dg_estate_cache *cache = dg_estate_cache_create();
+  const char *raw_buffers[] = {"datatables", "other datatables"};
+  std::vector<std::thread> threads;
+  bool errors[8] = {};
+
+  // Every thread has its own datatables, half of them with each key
+  for (size_t i = 0; i < 8; ++i) {
+    threads.emplace_back([&, i]() {
+      for (int repeat = 0; repeat < 20; ++repeat) {
+        synthetic_estate state;
+        estate entity_state;
+        memset(&entity_state, 0, sizeof(entity_state));
+        estate_init_args args = cached_args(state, raw_buffers[i % 2]);
+        errors[i] |= dg_estate_init_cached(&entity_state, args, cache).error;
+        errors[i] |= dg_estate_find_prop(&entity_state, 0, "DT_Derived.m_flSpeed").prop_index ==
+                     DG_PROP_HANDLE_INVALID;
+        dg_estate_free(&entity_state);
+      }
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (bool error : errors) {
+    EXPECT_FALSE(error);
+  }
+  EXPECT_EQ(dg_estate_cache_entry_count(cache), 2u);
+  dg_estate_cache_free(cache);
+}
+
+TEST_F(EstateCacheTest, save_and_load) {
+  const char *filepath = "./tmp_estate_cache/classes.bin";
+  synthetic_estate state;
+  dg_estate_cache *cache = dg_estate_cache_create();
+  // Every prop field is written out separately, give some of the less common ones values
+  state.base_props[0].flag_unsigned = true;
+  state.base_props[0].flag_cellcoordint = true;
+  state.base_props[0].priority = 64;
+  state.base_props[4].prop_.low_value = -4096.0f;
+  state.base_props[4].prop_.high_value = 4096.0f;
+
+  estate first;
+  memset(&first, 0, sizeof(first));
+  ASSERT_FALSE(dg_estate_init_cached(&first, cached_args(state, "datatables"), cache).error);
+  ASSERT_FALSE(dg_estate_cache_save(cache, filepath).error);
+
+  dg_estate_cache *loaded = dg_estate_cache_create();
+  ASSERT_FALSE(dg_estate_cache_load(loaded, filepath).error);
+  EXPECT_EQ(dg_estate_cache_entry_count(loaded), 1u);
+
+  estate second;
+  memset(&second, 0, sizeof(second));
+  ASSERT_FALSE(dg_estate_init_cached(&second, cached_args(state, "datatables"), loaded).error);
+  EXPECT_EQ(dg_estate_cache_entry_count(loaded), 1u);
+  expect_same_props(first.class_datas, second.class_datas);
+  const dg_sendprop *health = second.class_datas->props +
+                              dg_estate_find_prop(&second, 0, "DT_Base.m_iHealth").prop_index;
+  EXPECT_TRUE(health->flag_unsigned);
+  EXPECT_EQ(health->priority, 64u);
+  EXPECT_NE(dg_estate_find_prop(&second, 0, "DT_Derived.m_flSpeed").prop_index,
+            DG_PROP_HANDLE_INVALID);
+
+  // Loading entries that already exist does not duplicate them
+  ASSERT_FALSE(dg_estate_cache_load(loaded, filepath).error);
+  EXPECT_EQ(dg_estate_cache_entry_count(loaded), 1u);
+
+  dg_estate_free(&first);
+  dg_estate_free(&second);
+  dg_estate_cache_free(cache);
+  dg_estate_cache_free(loaded);
+}
+
+TEST_F(EstateCacheTest, rejects_bad_files) {
+  const char *filepath = "./tmp_estate_cache/garbage.bin";
+  FILE *file = fopen(filepath, "wb");
+  ASSERT_NE(file, nullptr);
+  fputs("not a cache", file);
+  fclose(file);
+
+  dg_estate_cache *cache = dg_estate_cache_create();
+  EXPECT_TRUE(dg_estate_cache_load(cache, filepath).error);
+  EXPECT_TRUE(dg_estate_cache_load(cache, "./tmp_estate_cache/missing.bin").error);
+  EXPECT_EQ(dg_estate_cache_entry_count(cache), 0u);
+  dg_estate_cache_free(cache);
+}
@@ -0,0 +1,154 @@
+#include "demogobbler.h"
+#include "gtest/gtest.h"
+#include <cstring>
+
+struct game_event_fixture : ::testing::Test {
+  dg_arena arena;
+  dg_alloc_state allocator;
+  dg_bitwriter list_writer;
+  dg_bitwriter event_writer;
+  dg_svc_game_event_list list_message;
+  dg_game_event_list list;
+
+  void SetUp() override {
+    arena = dg_arena_create(1 << 16);
+    allocator = dg_arena_create_allocator(&arena);
+    dg_bitwriter_init(&list_writer, 1024);
+    dg_bitwriter_init(&event_writer, 1024);
+
+    // player_death { userid: short, attacker: short, weapon: string, headshot: bool }
+    dg_bitwriter_write_uint(&list_writer, 23, 9);
+    dg_bitwriter_write_cstring(&list_writer, "player_death");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_short, 3);
+    dg_bitwriter_write_cstring(&list_writer, "userid");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_short, 3);
+    dg_bitwriter_write_cstring(&list_writer, "attacker");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_string, 3);
+    dg_bitwriter_write_cstring(&list_writer, "weapon");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_bool, 3);
+    dg_bitwriter_write_cstring(&list_writer, "headshot");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_local, 3);
+
+    // round_start { timelimit: long, fraglimit: byte, objective: float, steamid: uint64 }
+    dg_bitwriter_write_uint(&list_writer, 40, 9);
+    dg_bitwriter_write_cstring(&list_writer, "round_start");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_long, 3);
+    dg_bitwriter_write_cstring(&list_writer, "timelimit");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_byte, 3);
+    dg_bitwriter_write_cstring(&list_writer, "fraglimit");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_float, 3);
+    dg_bitwriter_write_cstring(&list_writer, "objective");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_uint64, 3);
+    dg_bitwriter_write_cstring(&list_writer, "steamid");
+    dg_bitwriter_write_uint(&list_writer, dg_game_event_key_local, 3);
+
+    memset(&list_message, 0, sizeof(list_message));
+    list_message.events = 2;
+    list_message.length = list_writer.bitoffset;
+    list_message.data = dg_bitstream_create(list_writer.ptr, list_writer.bitoffset);
+    dg_parse_result result = dg_parse_game_event_list(&list, &list_message, &allocator);
+    ASSERT_FALSE(result.error) << result.error_message;
+  }
+
+  void TearDown() override {
+    dg_game_event_list_free(&list);
+    dg_bitwriter_free(&event_writer);
+    dg_bitwriter_free(&list_writer);
+    dg_arena_free(&arena);
+  }
+
+  void reset_event() {
+    dg_bitwriter_free(&event_writer);
+    dg_bitwriter_init(&event_writer, 1024);
+  }
+
+  dg_svc_game_event event_message() {
+    dg_svc_game_event message;
+    memset(&message, 0, sizeof(message));
+    message.length = event_writer.bitoffset;
+    message.data = dg_bitstream_create(event_writer.ptr, event_writer.bitoffset);
+    return message;
+  }
+
+  void write_player_death() {
+    dg_bitwriter_write_uint(&event_writer, 23, 9);
+    dg_bitwriter_write_sint(&event_writer, 3, 16);
+    dg_bitwriter_write_sint(&event_writer, -1, 16);
+    dg_bitwriter_write_cstring(&event_writer, "crowbar");
+    dg_bitwriter_write_bit(&event_writer, true);
+  }
+};
+
+TEST_F(game_event_fixture, descriptors) {
+  EXPECT_EQ(list.descriptor_count, 2u);
+  const dg_game_event_descriptor *death = dg_game_event_list_find(&list, "player_death");
+  ASSERT_NE(death, nullptr);
+  EXPECT_EQ(death->event_id, 23u);
+  ASSERT_EQ(death->key_count, 4u);
+  EXPECT_STREQ(death->keys[2].key_value, "weapon");
+  EXPECT_EQ(death->keys[2].type, (uint32_t)dg_game_event_key_string);
+  EXPECT_EQ(dg_game_event_key_index(death, "headshot"), 3);
+  EXPECT_EQ(dg_game_event_key_index(death, "assister"), -1);
+  EXPECT_EQ(dg_game_event_list_find(&list, "player_hurt"), nullptr);
+}
+
+TEST_F(game_event_fixture, decode_values) {
+  write_player_death();
+  dg_svc_game_event message = event_message();
+  dg_game_event event;
+  dg_parse_result result = dg_parse_game_event(&event, &list, &message, &allocator);
+  ASSERT_FALSE(result.error) << result.error_message;
+  ASSERT_NE(event.descriptor, nullptr);
+  EXPECT_STREQ(event.descriptor->name, "player_death");
+  EXPECT_EQ(event.values[0].int_val, 3);
+  EXPECT_EQ(event.values[1].int_val, -1);
+  EXPECT_STREQ(event.values[2].str_val, "crowbar");
+  EXPECT_TRUE(event.values[3].bool_val);
+
+  reset_event();
+  dg_bitwriter_write_uint(&event_writer, 40, 9);
+  dg_bitwriter_write_sint32(&event_writer, -600);
+  dg_bitwriter_write_uint(&event_writer, 200, 8);
+  dg_bitwriter_write_float(&event_writer, 1.5f);
+  dg_bitwriter_write_uint(&event_writer, 76561197960265728ull, 64);
+  message = event_message();
+  result = dg_parse_game_event(&event, &list, &message, &allocator);
+  ASSERT_FALSE(result.error) << result.error_message;
+  EXPECT_EQ(event.values[0].int_val, -600);
+  EXPECT_EQ(event.values[1].int_val, 200);
+  EXPECT_EQ(event.values[2].float_val, 1.5f);
+  EXPECT_EQ(event.values[3].uint64_val, 76561197960265728ull);
+}
+
+TEST_F(game_event_fixture, skip_unwanted_and_unknown) {
+  const char *names[] = {"round_start", "player_hurt"};
+  dg_game_event_list_set_wanted(&list, names, 2);
+
+  write_player_death();
+  dg_svc_game_event message = event_message();
+  dg_game_event event;
+  EXPECT_FALSE(dg_parse_game_event(&event, &list, &message, &allocator).error);
+  EXPECT_EQ(event.descriptor, nullptr);
+
+  reset_event();
+  dg_bitwriter_write_uint(&event_writer, 100, 9);
+  message = event_message();
+  EXPECT_FALSE(dg_parse_game_event(&event, &list, &message, &allocator).error);
+  EXPECT_EQ(event.descriptor, nullptr);
+
+  dg_game_event_list_set_wanted(&list, NULL, 0);
+  reset_event();
+  write_player_death();
+  message = event_message();
+  EXPECT_FALSE(dg_parse_game_event(&event, &list, &message, &allocator).error);
+  EXPECT_NE(event.descriptor, nullptr);
+}
+
+TEST_F(game_event_fixture, truncated_event) {
+  dg_bitwriter_write_uint(&event_writer, 23, 9);
+  dg_bitwriter_write_sint(&event_writer, 3, 16);
+  dg_svc_game_event message = event_message();
+  dg_game_event event;
+  EXPECT_TRUE(dg_parse_game_event(&event, &list, &message, &allocator).error);
+  EXPECT_EQ(event.descriptor, nullptr);
+}
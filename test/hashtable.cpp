@@ -1,8 +1,12 @@
 extern "C" {
+#include "demogobbler/allocator.h"
 #include "demogobbler/hashtable.h"
 }
 
 #include "gtest/gtest.h"
+#include <cstring>
+#include <string>
+#include <vector>
 
 TEST(dg_hashtable, works) {
   auto table = dg_hashtable_create(100);
@@ -26,3 +30,106 @@ TEST(dg_hashtable, works) {
 
   dg_hashtable_free(&table);
 }
+
+TEST(dg_hashtable, grows) {
+  auto table = dg_hashtable_create(1);
+  std::vector<std::string> strings;
+  for (size_t i = 0; i < 5000; ++i) {
+    strings.push_back("DT_Table" + std::to_string(i));
+  }
+
+  for (size_t i = 0; i < strings.size(); ++i) {
+    dg_hashtable_entry entry;
+    entry.str = strings[i].c_str();
+    entry.value = i;
+    EXPECT_TRUE(dg_hashtable_insert(&table, entry));
+  }
+
+  EXPECT_EQ(table.item_count, strings.size());
+  for (size_t i = 0; i < strings.size(); ++i) {
+    EXPECT_EQ(dg_hashtable_get(&table, strings[i].c_str()).value, i);
+  }
+  EXPECT_EQ(dg_hashtable_get(&table, "DT_Table5000").str, nullptr);
+
+  dg_hashtable_clear(&table);
+  EXPECT_EQ(dg_hashtable_get(&table, strings[0].c_str()).str, nullptr);
+  dg_hashtable_free(&table);
+}
+
+TEST(dg_hashtable, prehashed) {
+  auto table = dg_hashtable_create(4);
+  const char *key = "DT_BaseEntity";
+  size_t length = strlen(key);
+  uint32_t hash = dg_hashtable_hash(key, length);
+
+  dg_hashtable_entry entry;
+  entry.str = key;
+  entry.value = 7;
+  EXPECT_TRUE(dg_hashtable_insert_hashed(&table, entry, length, hash));
+  EXPECT_FALSE(dg_hashtable_insert(&table, entry));
+
+  EXPECT_EQ(dg_hashtable_get(&table, "DT_BaseEntity").value, 7u);
+  // Only the given length of the key is compared
+  EXPECT_EQ(dg_hashtable_get_hashed(&table, "DT_BaseEntity.m_iHealth", length, hash).value, 7u);
+  dg_hashtable_free(&table);
+}
+
+namespace {
+struct counting_allocator {
+  int64_t outstanding_bytes = 0;
+  size_t allocations = 0;
+
+  static void *alloc(counting_allocator *thisptr, uint32_t size, uint32_t) {
+    thisptr->outstanding_bytes += size;
+    thisptr->allocations += 1;
+    return malloc(size);
+  }
+
+  static void *realloc(counting_allocator *thisptr, void *ptr, uint32_t prev_size, uint32_t size,
+                       uint32_t) {
+    thisptr->outstanding_bytes += (int64_t)size - (ptr ? prev_size : 0);
+    thisptr->allocations += 1;
+    return ::realloc(ptr, size);
+  }
+
+  static void dealloc(counting_allocator *thisptr, void *ptr, uint32_t size) {
+    if (ptr) {
+      thisptr->outstanding_bytes -= size;
+      free(ptr);
+    }
+  }
+
+  dg_alloc_state state() {
+    dg_alloc_state out;
+    memset(&out, 0, sizeof(out));
+    out.allocator = this;
+    out.alloc = (func_dg_alloc)alloc;
+    out.realloc = (func_dg_realloc)realloc;
+    out.dealloc = (func_dg_dealloc)dealloc;
+    return out;
+  }
+};
+} // namespace
+
+TEST(dg_hashtable, custom_allocator) {
+  counting_allocator counter;
+  dg_alloc_state state = counter.state();
+  auto table = dg_hashtable_create_ex(1, &state);
+  std::vector<std::string> strings;
+  for (size_t i = 0; i < 100; ++i) {
+    strings.push_back("DT_Table" + std::to_string(i));
+  }
+
+  for (size_t i = 0; i < strings.size(); ++i) {
+    dg_hashtable_entry entry;
+    entry.str = strings[i].c_str();
+    entry.value = i;
+    EXPECT_TRUE(dg_hashtable_insert(&table, entry));
+  }
+
+  // Growing goes through the allocator as well
+  EXPECT_GT(counter.allocations, 1u);
+  EXPECT_GT(counter.outstanding_bytes, 0);
+  dg_hashtable_free(&table);
+  EXPECT_EQ(counter.outstanding_bytes, 0);
+}
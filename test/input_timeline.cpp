@@ -0,0 +1,138 @@
+#include "demogobbler.h"
+#include "demogobbler/usercmd_types.h"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <vector>
+
+static uint8_t usercmd_data[] = {0xd3, 0x8,  0x0,  0x0,  0xfa, 0x5,  0x0,  0x0,  0x64,
+                                 0x71, 0x24, 0x15, 0x7e, 0x6c, 0xf4, 0xf0, 0x43, 0x0,
+                                 0x80, 0xf0, 0x61, 0x9,  0x4,  0x0,  0x0,  0x0};
+
+template <typename T> static void append(std::vector<uint8_t> &out, T value) {
+  out.insert(out.end(), (uint8_t *)&value, (uint8_t *)&value + sizeof(value));
+}
+
+// Header, a packet with no netmessages, a usercmd and a stop message. Padded since the buffer
+// stream refuses reads that are as large as the whole buffer
+static std::vector<uint8_t> input_demo(int32_t tick_count = 2) {
+  std::vector<uint8_t> out(1072);
+  memcpy(out.data(), "HL2DEMO", 8);
+  int32_t protocols[] = {3, 15};
+  memcpy(out.data() + 8, protocols, sizeof(protocols));
+  memcpy(out.data() + 1060, &tick_count, sizeof(tick_count));
+
+  out.push_back(dg_type_packet);
+  append<int32_t>(out, 5);
+  dg_cmdinfo cmdinfo;
+  memset(&cmdinfo, 0, sizeof(cmdinfo));
+  cmdinfo.interp_flags = 1;
+  cmdinfo.view_origin = {1.0f, 2.0f, 3.0f};
+  cmdinfo.view_angles = {10.0f, 20.0f, 0.0f};
+  append(out, cmdinfo);
+  append<int32_t>(out, 0); // in sequence
+  append<int32_t>(out, 0); // out sequence
+  append<int32_t>(out, 0); // no data
+
+  out.push_back(dg_type_usercmd);
+  append<int32_t>(out, 6);
+  append<int32_t>(out, 1);
+  append<int32_t>(out, sizeof(usercmd_data));
+  out.insert(out.end(), usercmd_data, usercmd_data + sizeof(usercmd_data));
+
+  out.push_back(dg_type_stop);
+  append<int32_t>(out, 6);
+  out.resize(1 << 16);
+  return out;
+}
+
+TEST(input_timeline, extracts_usercmds_and_cmdinfo) {
+  std::vector<uint8_t> demo = input_demo();
+  dg_input_timeline timeline;
+  dg_input_timeline_init(&timeline, NULL);
+
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.input_timeline = &timeline;
+  dg_parse_result result = dg_parse_buffer(&settings, demo.data(), demo.size());
+  ASSERT_FALSE(result.error) << result.error_message;
+  // Reserved from the header's tick count
+  EXPECT_GE(timeline.usercmds.capacity, 3u);
+
+  ASSERT_EQ(timeline.cmdinfo.count, 1u);
+  EXPECT_EQ(timeline.cmdinfo.tick[0], 5);
+  EXPECT_EQ(timeline.cmdinfo.slot[0], 0);
+  EXPECT_EQ(timeline.cmdinfo.interp_flags[0], 1);
+  EXPECT_EQ(timeline.cmdinfo.view_origin[0].y, 2.0f);
+  EXPECT_EQ(timeline.cmdinfo.view_angles[0].x, 10.0f);
+
+  dg_usercmd input;
+  memset(&input, 0, sizeof(input));
+  input.data = usercmd_data;
+  input.size_bytes = sizeof(usercmd_data);
+  dg_usercmd_parsed expected;
+  ASSERT_FALSE(dg_parser_parse_usercmd(NULL, &input, &expected).error);
+
+  ASSERT_EQ(timeline.usercmds.count, 1u);
+  EXPECT_EQ(timeline.usercmds.tick[0], 6);
+  EXPECT_EQ(timeline.usercmds.command_number[0], expected.command_number);
+  EXPECT_EQ(timeline.usercmds.tick_count[0], expected.tick_count);
+  EXPECT_EQ(timeline.usercmds.viewangles[0].x, expected.viewangle.x);
+  EXPECT_EQ(timeline.usercmds.viewangles[0].y, expected.viewangle.y);
+  EXPECT_EQ(timeline.usercmds.forwardmove[0], expected.movement.forward);
+  EXPECT_EQ(timeline.usercmds.sidemove[0], expected.movement.side);
+  EXPECT_EQ(timeline.usercmds.buttons[0], expected.buttons);
+  EXPECT_EQ(timeline.usercmds.mouse_dx[0], (int16_t)expected.mouse_dx);
+
+  // Parsing again appends to the timeline unless it is cleared
+  ASSERT_FALSE(dg_parse_buffer(&settings, demo.data(), demo.size()).error);
+  EXPECT_EQ(timeline.usercmds.count, 2u);
+  dg_input_timeline_clear(&timeline);
+  ASSERT_FALSE(dg_parse_buffer(&settings, demo.data(), demo.size()).error);
+  EXPECT_EQ(timeline.usercmds.count, 1u);
+  EXPECT_EQ(timeline.cmdinfo.count, 1u);
+
+  dg_input_timeline_free(&timeline);
+  EXPECT_EQ(timeline.usercmds.count, 0u);
+  EXPECT_EQ(timeline.usercmds.tick, nullptr);
+}
+
+TEST(input_timeline, untrusted_tick_count) {
+  std::vector<uint8_t> demo = input_demo(INT32_MAX);
+  dg_input_timeline timeline;
+  dg_input_timeline_init(&timeline, NULL);
+
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.input_timeline = &timeline;
+  dg_parse_result result = dg_parse_buffer(&settings, demo.data(), demo.size());
+  ASSERT_FALSE(result.error) << result.error_message;
+  EXPECT_LE(timeline.usercmds.capacity, 1u << 20);
+  EXPECT_LE(timeline.cmdinfo.capacity, 1u << 20);
+  EXPECT_EQ(timeline.usercmds.count, 1u);
+
+  dg_input_timeline_free(&timeline);
+}
+
+TEST(input_timeline, grows) {
+  dg_input_timeline timeline;
+  dg_input_timeline_init(&timeline, NULL);
+
+  dg_usercmd input;
+  memset(&input, 0, sizeof(input));
+  input.data = usercmd_data;
+  input.size_bytes = sizeof(usercmd_data);
+  dg_usercmd_parsed parsed;
+  ASSERT_FALSE(dg_parser_parse_usercmd(NULL, &input, &parsed).error);
+
+  for (int i = 0; i < 1000; ++i) {
+    input.preamble.tick = i;
+    dg_input_timeline_add_usercmd(&timeline, &parsed);
+  }
+
+  ASSERT_EQ(timeline.usercmds.count, 1000u);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(timeline.usercmds.tick[i], i);
+    ASSERT_EQ(timeline.usercmds.command_number[i], parsed.command_number);
+  }
+  dg_input_timeline_free(&timeline);
+}
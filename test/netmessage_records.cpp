@@ -0,0 +1,207 @@
+#include "demogobbler.h"
+#include "utils/synthetic_demo.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <vector>
+
+struct record_info {
+  net_message_type type;
+  uint32_t record_bytes;
+  uint32_t tick;
+};
+
+static void collect_records(parser_state *state, packet_parsed *message) {
+  auto *records = (std::vector<record_info> *)state->client_state;
+  packet_net_message *netmsg = message->first_message;
+  for (uint32_t i = 0; i < message->message_count; ++i, netmsg = dg_netmessage_next(netmsg)) {
+    record_info info;
+    info.type = netmsg->mtype;
+    info.record_bytes = dg_netmessage_record_bytes(netmsg->mtype);
+    info.tick = netmsg->mtype == net_tick ? netmsg->message_net_tick.tick : 0;
+    records->push_back(info);
+  }
+}
+
+TEST(netmessage_records, compact_and_iterable) {
+  std::vector<uint8_t> demo = netmessage_demo();
+  std::vector<record_info> records;
+
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.client_state = &records;
+  settings.packet_parsed_handler = collect_records;
+  dg_parse_result result = dg_parse_buffer(&settings, demo.data(), demo.size());
+  ASSERT_FALSE(result.error) << result.error_message;
+
+  ASSERT_EQ(records.size(), 3u);
+  EXPECT_EQ(records[0].type, net_tick);
+  EXPECT_EQ(records[0].tick, 42u);
+  EXPECT_EQ(records[1].type, net_nop);
+  EXPECT_EQ(records[2].type, net_tick);
+  EXPECT_EQ(records[2].tick, 43u);
+
+  for (const record_info &info : records) {
+    EXPECT_EQ(info.record_bytes % 8, 0u);
+    EXPECT_LT(info.record_bytes, sizeof(packet_net_message));
+  }
+}
+
+TEST(netmessage_records, unknown_type_id) {
+  std::vector<uint8_t> demo = netmessage_demo(63);
+  std::vector<record_info> records;
+
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.client_state = &records;
+  settings.packet_parsed_handler = collect_records;
+  dg_parse_result result = dg_parse_buffer(&settings, demo.data(), demo.size());
+  EXPECT_TRUE(result.error);
+  EXPECT_TRUE(records.empty());
+}
+
+struct passthrough_state {
+  bool copy_clean;
+  bool mutate;
+  bool mark_dirty;
+  std::vector<uint8_t> original;
+  std::vector<uint8_t> written;
+};
+
+static size_t append_output(void *stream, const void *src, size_t bytes) {
+  auto *out = (std::vector<uint8_t> *)stream;
+  out->insert(out->end(), (uint8_t *)src, (uint8_t *)src + bytes);
+  return bytes;
+}
+
+static void rewrite_packet(parser_state *state, packet_parsed *message) {
+  auto *pass = (passthrough_state *)state->client_state;
+  uint8_t *data = (uint8_t *)message->orig.data;
+  pass->original.assign(data, data + message->orig.size_bytes);
+
+  packet_net_message *netmsg = message->first_message;
+  for (uint32_t i = 0; i < message->message_count; ++i, netmsg = dg_netmessage_next(netmsg)) {
+    if (netmsg->mtype == net_tick && pass->mutate) {
+      netmsg->message_net_tick.tick += 100;
+      netmsg->dirty = pass->mark_dirty;
+    }
+  }
+
+  std::vector<uint8_t> output;
+  writer w;
+  dg_writer_init(&w);
+  w.version = message->version;
+  w.copy_clean_messages = pass->copy_clean;
+  dg_writer_open(&w, &output, {append_output});
+  dg_write_packet_parsed(&w, message);
+  dg_writer_free(&w);
+
+  // Preamble, one cmdinfo, sequence numbers and the payload length come before the payload
+  size_t header_bytes = 5 + sizeof(dg_cmdinfo) + 12;
+  pass->written.assign(output.begin() + header_bytes, output.end());
+}
+
+static passthrough_state rewrite(bool copy_clean, bool mutate, bool mark_dirty) {
+  std::vector<uint8_t> demo = netmessage_demo();
+  passthrough_state pass;
+  pass.copy_clean = copy_clean;
+  pass.mutate = mutate;
+  pass.mark_dirty = mark_dirty;
+
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.client_state = &pass;
+  settings.packet_parsed_handler = rewrite_packet;
+  dg_parse_result result = dg_parse_buffer(&settings, demo.data(), demo.size());
+  EXPECT_FALSE(result.error) << result.error_message;
+  return pass;
+}
+
+TEST(netmessage_records, spans_cover_packet) {
+  std::vector<uint8_t> demo = netmessage_demo();
+  std::vector<uint32_t> spans;
+
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.client_state = &spans;
+  settings.packet_parsed_handler = [](parser_state *state, packet_parsed *message) {
+    auto *out = (std::vector<uint32_t> *)state->client_state;
+    packet_net_message *netmsg = message->first_message;
+    for (uint32_t i = 0; i < message->message_count; ++i, netmsg = dg_netmessage_next(netmsg)) {
+      out->push_back(netmsg->bit_start);
+      out->push_back(netmsg->bit_end);
+      EXPECT_FALSE(netmsg->dirty);
+    }
+  };
+  ASSERT_FALSE(dg_parse_buffer(&settings, demo.data(), demo.size()).error);
+
+  // net_tick is a 6 bit type and 64 bits of body, net_nop only has the type
+  std::vector<uint32_t> expected = {0, 70, 70, 76, 76, 146};
+  EXPECT_EQ(spans, expected);
+}
+
+static uint32_t first_tick(const std::vector<uint8_t> &payload) {
+  dg_bitstream stream = dg_bitstream_create((void *)payload.data(), payload.size() * 8);
+  dg_bitstream_read_uint(&stream, 6);
+  return dg_bitstream_read_uint32(&stream);
+}
+
+TEST(netmessage_records, edits_are_written_by_default) {
+  passthrough_state unchanged = rewrite(false, false, false);
+  EXPECT_EQ(unchanged.written, unchanged.original);
+
+  passthrough_state edited = rewrite(false, true, false);
+  ASSERT_EQ(edited.written.size(), edited.original.size());
+  EXPECT_EQ(first_tick(edited.written), 142u);
+}
+
+TEST(netmessage_records, clean_messages_are_copied) {
+  passthrough_state unchanged = rewrite(true, false, false);
+  EXPECT_EQ(unchanged.written, unchanged.original);
+
+  // The writer was told that every edit is marked, so an unmarked one is not looked at
+  passthrough_state unmarked = rewrite(true, true, false);
+  EXPECT_EQ(unmarked.written, unmarked.original);
+
+  passthrough_state dirty = rewrite(true, true, true);
+  ASSERT_EQ(dirty.written.size(), dirty.original.size());
+  EXPECT_NE(dirty.written, dirty.original);
+  EXPECT_EQ(first_tick(dirty.written), 142u);
+}
+
+struct entity_record_info {
+  uint32_t nops = 0;
+  uint32_t entity_messages = 0;
+  bool orig_matches = false;
+};
+
+TEST(netmessage_records, moved_records_keep_parsed_entities) {
+  // Enough net_nops to outgrow the initial record buffer several times
+  const uint32_t NOPS = 4000;
+  std::vector<uint8_t> demo = packetentities_demo(NOPS);
+  entity_record_info info;
+
+  dg_settings settings;
+  dg_settings_init(&settings);
+  settings.client_state = &info;
+  settings.parse_packetentities = true;
+  settings.packet_parsed_handler = [](parser_state *state, packet_parsed *message) {
+    auto *out = (entity_record_info *)state->client_state;
+    packet_net_message *netmsg = message->first_message;
+    for (uint32_t i = 0; i < message->message_count; ++i, netmsg = dg_netmessage_next(netmsg)) {
+      if (netmsg->mtype == net_nop) {
+        ++out->nops;
+      } else if (netmsg->mtype == svc_packet_entities) {
+        ++out->entity_messages;
+        dg_svc_packetentities_parsed *parsed = netmsg->message_svc_packet_entities.parsed;
+        out->orig_matches = parsed && parsed->orig == &netmsg->message_svc_packet_entities;
+      }
+    }
+  };
+  dg_parse_result result = dg_parse_buffer(&settings, demo.data(), demo.size());
+  ASSERT_FALSE(result.error) << result.error_message;
+
+  // The parser stops when the bits left could only hold a message type
+  EXPECT_GE(info.nops, NOPS - 1);
+  EXPECT_EQ(info.entity_messages, 1u);
+  EXPECT_TRUE(info.orig_matches);
+}
@@ -52,14 +52,12 @@ static void packet_handler(parser_state *state, packet_parsed *packet_parsed) {
 #endif
   tester->packet_bits = packet->size_bytes * 8;
 
-  for (size_t i = 0; i < packet_parsed->message_count; ++i) {
-    packet_net_message *message = &packet_parsed->messages[i];
+  packet_net_message *message = packet_parsed->first_message;
+  for (size_t i = 0; i < packet_parsed->message_count; ++i, message = dg_netmessage_next(message)) {
     dg_bitwriter_write_netmessage(&tester->writer, &tester->version, message);
 
-#ifdef DEBUG
-    EXPECT_EQ(tester->writer.bitoffset, message->offset)
+    EXPECT_EQ(tester->writer.bitoffset, message->bit_end)
         << "Error writing message of type " << message->mtype;
-#endif
 
     if (tester->writer.error) {
       EXPECT_EQ(tester->writer.error, false) << tester->writer.error_message;
@@ -0,0 +1,91 @@
+#include "demogobbler.h"
+#include "demogobbler/freddie.hpp"
+#include "utils/synthetic_demo.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <vector>
+
+static dg_synctick synctick(int32_t tick) {
+  dg_synctick packet;
+  memset(&packet, 0, sizeof(packet));
+  packet.preamble.type = dg_type_synctick;
+  packet.preamble.tick = tick;
+  return packet;
+}
+
+TEST(packet_store, views) {
+  freddie::packet_store store;
+  dg_stop stop;
+  memset(&stop, 0, sizeof(stop));
+  stop.size_bytes = 7;
+  store.push_back(synctick(1));
+  store.push_back(stop);
+  store.push_back(synctick(2));
+
+  ASSERT_EQ(store.size(), 3u);
+  EXPECT_EQ(store[0].type, freddie::packet_type_index<dg_synctick>);
+  EXPECT_EQ(store[1].type, freddie::packet_variant_t(stop).index());
+  ASSERT_NE(store[0].get_if<dg_synctick>(), nullptr);
+  EXPECT_EQ(store[0].get_if<dg_stop>(), nullptr);
+  EXPECT_EQ(store[0].get_if<dg_synctick>()->preamble.tick, 1);
+  ASSERT_NE(store[1].get_if<dg_stop>(), nullptr);
+  EXPECT_EQ(store[1].get_if<dg_stop>()->size_bytes, 7);
+  EXPECT_EQ(store[2].get_if<dg_synctick>()->preamble.tick, 2);
+
+  // Same type is replaced in place, another type gets a new payload
+  void *first = store[0].data;
+  store.set(0, synctick(3));
+  EXPECT_EQ(store[0].data, first);
+  EXPECT_EQ(store[0].get_if<dg_synctick>()->preamble.tick, 3);
+  store.set(2, stop);
+  EXPECT_EQ(store[2].get_if<dg_synctick>(), nullptr);
+  EXPECT_EQ(store[2].get_if<dg_stop>()->size_bytes, 7);
+
+  store.clear();
+  EXPECT_EQ(store.size(), 0u);
+  EXPECT_EQ(store.memory_usage().payload_bytes, 0u);
+}
+
+TEST(packet_store, memory_usage) {
+  const size_t PACKETS = 1 << 16;
+  freddie::packet_store store;
+  for (size_t i = 0; i < PACKETS; ++i) {
+    store.push_back(synctick(i));
+  }
+
+  // Packets span many chunks
+  for (size_t i = 0; i < PACKETS; i += 4099) {
+    EXPECT_EQ(store[i].get_if<dg_synctick>()->preamble.tick, (int32_t)i);
+  }
+
+  freddie::packet_store_usage usage = store.memory_usage();
+  EXPECT_EQ(usage.packet_count, PACKETS);
+  EXPECT_EQ(usage.payload_bytes, PACKETS * sizeof(dg_synctick));
+  EXPECT_GE(usage.reserved_bytes, usage.header_bytes + usage.payload_bytes);
+  EXPECT_LT(usage.reserved_bytes, PACKETS * sizeof(freddie::demo_packet) / 8);
+}
+
+TEST(packet_store, demo_roundtrip) {
+  std::vector<uint8_t> input = netmessage_demo();
+  freddie::memory_stream stream;
+  freddie::memory_stream_write(&stream, input.data(), input.size());
+  stream.offset = 0;
+
+  freddie::demo_t demo;
+  dg_parse_result result = freddie::demo_t::parse_demo(
+      &demo, &stream, {freddie::memory_stream_read, freddie::memory_stream_seek});
+  ASSERT_FALSE(result.error) << result.error_message;
+  ASSERT_EQ(demo.packets.size(), 2u);
+  EXPECT_NE(demo.packets[0].get_if<packet_parsed>(), nullptr);
+  EXPECT_NE(demo.packets[1].get_if<dg_stop>(), nullptr);
+
+  freddie::demo_memory_usage usage = demo.memory_usage();
+  EXPECT_EQ(usage.packets.packet_count, 2u);
+  EXPECT_GT(usage.data.bytes_in_use, 0u);
+
+  freddie::memory_stream output;
+  ASSERT_FALSE(demo.write_demo(&output, {freddie::memory_stream_write}).error);
+  uint8_t *written = (uint8_t *)output.buffer;
+  ASSERT_LE(output.file_size, input.size());
+  EXPECT_TRUE(std::equal(written, written + output.file_size, input.begin()));
+}
@@ -0,0 +1,69 @@
+#include "demogobbler.h"
+#include "utils/synthetic_estate.hpp"
+#include "gtest/gtest.h"
+
+TEST(prop_index, finds_qualified_names) {
+  synthetic_estate state;
+  const dg_serverclass_data *data = state.entity_state.class_datas;
+  ASSERT_EQ(data->prop_count, 5u);
+
+  const char *names[] = {"DT_Base.m_iHealth", "DT_Base.m_vecOrigin", "DT_Base.m_iAmmo",
+                         "DT_Base.m_flSpeed", "DT_Derived.m_flSpeed"};
+
+  for (const char *name : names) {
+    dg_prop_handle handle = dg_estate_find_prop(&state.entity_state, 0, name);
+    ASSERT_NE(handle.prop_index, DG_PROP_HANDLE_INVALID) << name;
+    EXPECT_EQ(handle.serverclass, 0u);
+    EXPECT_EQ(handle.array_index, -1);
+
+    char buffer[64];
+    dg_sendprop_name(buffer, sizeof(buffer), dg_estate_handle_prop(&state.entity_state, handle));
+    EXPECT_STREQ(buffer, name);
+  }
+
+  EXPECT_EQ(dg_estate_find_prop(&state.entity_state, 0, "DT_Derived.m_iHealth").prop_index,
+            DG_PROP_HANDLE_INVALID);
+  EXPECT_EQ(dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iHealt").prop_index,
+            DG_PROP_HANDLE_INVALID);
+  EXPECT_EQ(dg_estate_find_prop(&state.entity_state, 0, "m_iHealth").prop_index,
+            DG_PROP_HANDLE_INVALID);
+  EXPECT_EQ(dg_estate_find_prop(&state.entity_state, 1, "DT_Base.m_iHealth").prop_index,
+            DG_PROP_HANDLE_INVALID);
+}
+
+TEST(prop_index, array_elements) {
+  synthetic_estate state;
+  dg_prop_handle handle = dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iAmmo[3]");
+  ASSERT_NE(handle.prop_index, DG_PROP_HANDLE_INVALID);
+  EXPECT_EQ(handle.array_index, 3);
+  EXPECT_EQ(dg_estate_handle_prop(&state.entity_state, handle)->proptype, sendproptype_array);
+
+  EXPECT_EQ(dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iAmmo[4]").prop_index,
+            DG_PROP_HANDLE_INVALID);
+  EXPECT_EQ(dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iAmmo[]").prop_index,
+            DG_PROP_HANDLE_INVALID);
+  EXPECT_EQ(dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iHealth[0]").prop_index,
+            DG_PROP_HANDLE_INVALID);
+}
+
+TEST(prop_index, sendprop_and_eproparr) {
+  synthetic_estate state;
+  const dg_serverclass_data *data = state.entity_state.class_datas;
+  for (size_t i = 0; i < data->prop_count; ++i) {
+    dg_prop_handle handle = dg_estate_find_sendprop(&state.entity_state, 0, data->props + i);
+    EXPECT_EQ(handle.prop_index, i);
+  }
+
+  dg_prop_handle handle = dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iHealth");
+  dg_eproparr props = dg_eproparr_init(data->prop_count);
+  EXPECT_EQ(dg_eproparr_find(&props, handle), nullptr);
+
+  bool newprop;
+  dg_prop_value_inner *value = dg_eproparr_get(&props, handle.prop_index, &newprop);
+  value->signed_val = 100;
+  EXPECT_EQ(dg_eproparr_find(&props, handle), value);
+
+  dg_prop_handle other = dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_flSpeed");
+  EXPECT_EQ(dg_eproparr_find(&props, other), nullptr);
+  dg_eproparr_free(&props);
+}
@@ -5,11 +5,17 @@
 TEST(dg_eproparr, works) {
   bool newprop;
   dg_eproparr props = dg_eproparr_init(200);
+  dg_eproparr_get(&props, 35, &newprop);
+  EXPECT_EQ(newprop, true);
+  dg_eproparr_get(&props, 20, &newprop);
+  EXPECT_EQ(newprop, true);
   dg_prop_value_inner *val1 = dg_eproparr_get(&props, 20, &newprop);
+  EXPECT_EQ(newprop, false);
   dg_prop_value_inner *val2 = dg_eproparr_get(&props, 35, &newprop);
+  EXPECT_EQ(newprop, false);
 
-  EXPECT_EQ(val1 - props.values, 20);
-  EXPECT_EQ(val2 - props.values, 35);
+  EXPECT_EQ(dg_eproparr_index(&props, val1), 20);
+  EXPECT_EQ(dg_eproparr_index(&props, val2), 35);
 
   dg_prop_value_inner *val1_get = dg_eproparr_next(&props, NULL);
   dg_prop_value_inner *val2_get = dg_eproparr_next(&props, val1_get);
@@ -21,6 +27,59 @@ TEST(dg_eproparr, works) {
   dg_eproparr_free(&props);
 }
 
+TEST(dg_eproparr, sparse_to_dense) {
+  bool newprop;
+  const uint16_t prop_count = 300;
+  dg_eproparr props = dg_eproparr_init(prop_count);
+
+  // Insert in a scrambled order and check that values survive the move to dense storage
+  for (uint16_t i = 0; i < prop_count; ++i) {
+    uint16_t index = (i * 7) % prop_count;
+    dg_prop_value_inner *value = dg_eproparr_get(&props, index, &newprop);
+    EXPECT_EQ(newprop, true);
+    value->unsigned_val = index;
+
+    if (i == 10) {
+      EXPECT_EQ(props.dense, false);
+    }
+  }
+
+  EXPECT_EQ(props.dense, true);
+  EXPECT_EQ(props.value_count, prop_count);
+
+  uint16_t expected = 0;
+  for (dg_prop_value_inner *value = dg_eproparr_next(&props, NULL); value != NULL;
+       value = dg_eproparr_next(&props, value)) {
+    EXPECT_EQ(dg_eproparr_index(&props, value), expected);
+    EXPECT_EQ(value->unsigned_val, expected);
+    ++expected;
+  }
+  EXPECT_EQ(expected, prop_count);
+  dg_eproparr_free(&props);
+}
+
+TEST(dg_eproparr, sparse_order) {
+  bool newprop;
+  dg_eproparr props = dg_eproparr_init(1000);
+  const uint16_t indices[] = {900, 5, 130, 64, 63, 999, 0};
+
+  for (uint16_t index : indices) {
+    dg_eproparr_get(&props, index, &newprop)->unsigned_val = index;
+  }
+
+  EXPECT_EQ(props.dense, false);
+  const uint16_t sorted[] = {0, 5, 63, 64, 130, 900, 999};
+  dg_prop_value_inner *value = dg_eproparr_next(&props, NULL);
+  for (uint16_t index : sorted) {
+    ASSERT_NE(value, nullptr);
+    EXPECT_EQ(value->unsigned_val, index);
+    EXPECT_EQ(dg_eproparr_index(&props, value), index);
+    value = dg_eproparr_next(&props, value);
+  }
+  EXPECT_EQ(value, nullptr);
+  dg_eproparr_free(&props);
+}
+
 TEST(dg_eproplist, works) {
   bool newprop;
   dg_eproplist list = dg_eproplist_init();
@@ -0,0 +1,93 @@
+#include "demogobbler.h"
+#include "gtest/gtest.h"
+#include <cstring>
+
+// Two entries with plain string names, the second one with userdata
+static void write_entries(dg_bitwriter *writer, bool dictionary_enabled) {
+  dg_bitwriter_write_bit(writer, dictionary_enabled);
+
+  dg_bitwriter_write_bit(writer, true);  // entry_bit
+  dg_bitwriter_write_bit(writer, true);  // has_name
+  dg_bitwriter_write_bit(writer, false); // reuse_previous_value
+  dg_bitwriter_write_cstring(writer, "models/a.mdl");
+  dg_bitwriter_write_bit(writer, false); // has_user_data
+
+  dg_bitwriter_write_bit(writer, true);  // entry_bit
+  dg_bitwriter_write_bit(writer, true);  // has_name
+  dg_bitwriter_write_bit(writer, false); // reuse_previous_value
+  dg_bitwriter_write_cstring(writer, "models/other.mdl");
+  dg_bitwriter_write_bit(writer, true); // has_user_data
+  dg_bitwriter_write_uint(writer, 1, 14);
+  dg_bitwriter_write_uint(writer, 0xAB, 8);
+}
+
+static dg_sentry_parse_args protocol4_args(dg_demver_data *demver, dg_alloc_state *allocator,
+                                           dg_bitwriter *writer) {
+  memset(demver, 0, sizeof(*demver));
+  demver->demo_protocol = 4;
+
+  dg_sentry_parse_args args;
+  memset(&args, 0, sizeof(args));
+  args.allocator = allocator;
+  args.demver_data = demver;
+  args.max_entries = 64;
+  args.num_updated_entries = 2;
+  args.stream = dg_bitstream_create(writer->ptr, writer->bitoffset);
+  return args;
+}
+
+TEST(stringtable_protocol4, parse_and_rewrite) {
+  dg_arena arena = dg_arena_create(4096);
+  dg_alloc_state allocator = dg_arena_create_allocator(&arena);
+  dg_bitwriter input;
+  dg_bitwriter_init(&input, 256);
+  write_entries(&input, false);
+
+  dg_demver_data demver;
+  dg_sentry_parse_args args = protocol4_args(&demver, &allocator, &input);
+  dg_sentry out;
+  dg_parse_result result = dg_parse_stringtable_entry(&args, &out);
+  ASSERT_FALSE(result.error) << result.error_message;
+  EXPECT_FALSE(out.dictionary_enabled);
+  ASSERT_EQ(out.values_length, 2u);
+  EXPECT_STREQ(out.values[0].stored_string, "models/a.mdl");
+  EXPECT_STREQ(out.values[1].stored_string, "models/other.mdl");
+  EXPECT_EQ(out.values[1].userdata_length, 1u);
+
+  // The protocol 4 flag bit is written back, the bits match the input
+  dg_bitwriter output;
+  dg_bitwriter_init(&output, 256);
+  dg_sentry_write_args write_args;
+  write_args.input = &out;
+  write_args.writer = &output;
+  ASSERT_FALSE(dg_write_stringtable_entry_ex(&write_args, &demver).error);
+  ASSERT_EQ(output.bitoffset, input.bitoffset);
+  EXPECT_EQ(memcmp(output.ptr, input.ptr, input.bitoffset / 8), 0);
+
+  dg_bitwriter_free(&output);
+  dg_bitwriter_free(&input);
+  dg_arena_free(&arena);
+}
+
+TEST(stringtable_protocol4, dictionary_tables_are_left_unparsed) {
+  dg_arena arena = dg_arena_create(4096);
+  dg_alloc_state allocator = dg_arena_create_allocator(&arena);
+  dg_bitwriter input;
+  dg_bitwriter_init(&input, 256);
+  write_entries(&input, true);
+
+  // The table info is kept but the entries are not parsed
+  dg_demver_data demver;
+  dg_sentry_parse_args args = protocol4_args(&demver, &allocator, &input);
+  args.user_data_size_bits = 12;
+  dg_sentry out;
+  EXPECT_FALSE(dg_parse_stringtable_entry(&args, &out).error);
+  EXPECT_TRUE(out.dictionary_enabled);
+  EXPECT_EQ(out.values, nullptr);
+  EXPECT_EQ(out.values_length, 0u);
+  EXPECT_EQ(out.max_entries, 64u);
+  EXPECT_EQ(out.user_data_size_bits, 12u);
+
+  dg_bitwriter_free(&input);
+  dg_arena_free(&arena);
+}
@@ -0,0 +1,144 @@
+#include "demogobbler.h"
+#include "gtest/gtest.h"
+#include <cstring>
+
+// Parser whose memory comes from an arena that is freed with it
+struct tracked_parser {
+  dg_arena arena;
+  dg_parser parser;
+
+  tracked_parser(bool track_stringtables = true) {
+    arena = dg_arena_create(1 << 16);
+    dg_settings settings;
+    dg_settings_init(&settings);
+    settings.track_stringtables = track_stringtables;
+    settings.permanent_alloc_state = dg_arena_create_allocator(&arena);
+    settings.heap_alloc_state = dg_arena_create_allocator(&arena);
+    dg_parser_init(&parser, &settings);
+  }
+
+  ~tracked_parser() { dg_arena_free(&arena); }
+};
+
+static dg_sentry_value named_value(uint32_t index, const char *name) {
+  dg_sentry_value value;
+  memset(&value, 0, sizeof(value));
+  value.entry_index = index;
+  value.has_name = name != nullptr;
+  value.stored_string = (char *)name;
+  return value;
+}
+
+static dg_sentry make_sentry(dg_sentry_value *values, uint32_t count) {
+  dg_sentry sentry;
+  memset(&sentry, 0, sizeof(sentry));
+  sentry.values = values;
+  sentry.values_length = count;
+  sentry.max_entries = 16;
+  return sentry;
+}
+
+TEST(stringtable_state, create_and_update) {
+  tracked_parser tracked;
+  uint8_t userdata[] = {0xAB, 0x05};
+
+  dg_sentry_value values[3];
+  values[0] = named_value(0, "models/props/crate.mdl");
+  values[0].has_user_data = true;
+  values[0].userdata = dg_bitstream_create(userdata, 11);
+  values[1] = named_value(1, "chair.mdl");
+  values[1].reuse_previous_value = true;
+  values[1].reuse_str_index = 0;
+  values[1].reuse_length = 13;
+  values[2] = named_value(2, nullptr);
+  dg_sentry created = make_sentry(values, 3);
+
+  ASSERT_FALSE(dg_parser_add_stringtable_ex(&tracked.parser, "modelprecache", &created).error);
+  const parser_state *state = &tracked.parser.state;
+  ASSERT_EQ(dg_stringtable_find_table(state, "modelprecache"), 0);
+  EXPECT_EQ(dg_stringtable_find_table(state, "soundprecache"), -1);
+
+  const dg_stringtable_item *crate = dg_stringtable_get(state, 0, 0);
+  ASSERT_NE(crate, nullptr);
+  EXPECT_STREQ(crate->name, "models/props/crate.mdl");
+  ASSERT_EQ(crate->userdata_bits, 11u);
+  EXPECT_EQ(crate->userdata[0], 0xAB);
+  EXPECT_EQ(crate->userdata[1], 0x05);
+  EXPECT_STREQ(dg_stringtable_get(state, 0, 1)->name, "models/props/chair.mdl");
+  EXPECT_STREQ(dg_stringtable_get(state, 0, 2)->name, "");
+  EXPECT_EQ(dg_stringtable_get(state, 0, 2)->userdata, nullptr);
+  EXPECT_EQ(dg_stringtable_get(state, 0, 3), nullptr);
+  EXPECT_EQ(dg_stringtable_get(state, 1, 0), nullptr);
+
+  EXPECT_EQ(dg_stringtable_find(state, 0, "models/props/chair.mdl"), 1);
+  EXPECT_EQ(dg_stringtable_find(state, 0, "chair.mdl"), -1);
+
+  int32_t tick;
+  uint32_t count;
+  const dg_stringtable_change *changes = dg_stringtable_changes(state, &tick, &count);
+  ASSERT_EQ(count, 3u);
+  for (uint32_t i = 0; i < count; ++i) {
+    EXPECT_EQ(changes[i].entry_index, i);
+    EXPECT_TRUE(changes[i].flags & dg_stringtable_change_added);
+  }
+
+  // Existing entries keep their names, adding a name that exists updates that entry
+  dg_sentry_value updates[2];
+  updates[0] = named_value(1, "ignored.mdl");
+  updates[0].has_user_data = true;
+  updates[0].userdata = dg_bitstream_create(userdata, 8);
+  updates[1] = named_value(3, "models/props/crate.mdl");
+  dg_sentry update = make_sentry(updates, 2);
+  ASSERT_FALSE(dg_parser_update_stringtable(&tracked.parser, 0, &update).error);
+
+  const dg_stringtable_item *chair = dg_stringtable_get(state, 0, 1);
+  EXPECT_STREQ(chair->name, "models/props/chair.mdl");
+  ASSERT_EQ(chair->userdata_bits, 8u);
+  EXPECT_EQ(chair->userdata[0], 0xAB);
+  EXPECT_EQ(dg_stringtable_get(state, 0, 0)->userdata, nullptr);
+  EXPECT_EQ(dg_stringtable_get(state, 0, 3), nullptr);
+
+  changes = dg_stringtable_changes(state, &tick, &count);
+  ASSERT_EQ(count, 5u);
+  EXPECT_EQ(changes[3].entry_index, 1u);
+  EXPECT_EQ(changes[3].flags, (uint32_t)dg_stringtable_change_userdata);
+  EXPECT_EQ(changes[4].entry_index, 0u);
+}
+
+TEST(stringtable_state, rejects_bad_reuse) {
+  tracked_parser tracked;
+  dg_sentry_value values[1];
+  values[0] = named_value(0, "suffix");
+  values[0].reuse_previous_value = true;
+  values[0].reuse_str_index = 0;
+  values[0].reuse_length = 4;
+  dg_sentry created = make_sentry(values, 1);
+  EXPECT_TRUE(dg_parser_add_stringtable_ex(&tracked.parser, "downloadables", &created).error);
+
+  values[0] = named_value(16, "out of range");
+  EXPECT_TRUE(dg_parser_update_stringtable(&tracked.parser, 0, &created).error);
+}
+
+TEST(stringtable_state, untracked) {
+  tracked_parser untracked(false);
+  dg_parser &parser = untracked.parser;
+
+  dg_sentry_value values[1];
+  values[0] = named_value(0, "name");
+  dg_sentry created = make_sentry(values, 1);
+  ASSERT_FALSE(dg_parser_add_stringtable_ex(&parser, "modelprecache", &created).error);
+  EXPECT_EQ(dg_stringtable_get(&parser.state, 0, 0), nullptr);
+  EXPECT_EQ(dg_stringtable_find(&parser.state, 0, "name"), -1);
+  EXPECT_EQ(dg_stringtable_find_table(&parser.state, "modelprecache"), -1);
+}
+
+TEST(stringtable_state, unnamed) {
+  tracked_parser tracked;
+
+  dg_sentry_value values[1];
+  values[0] = named_value(0, "name");
+  dg_sentry created = make_sentry(values, 1);
+  ASSERT_FALSE(dg_parser_add_stringtable(&tracked.parser, &created).error);
+  EXPECT_EQ(dg_stringtable_find(&tracked.parser.state, 0, "name"), 0);
+  EXPECT_EQ(dg_stringtable_find_table(&tracked.parser.state, "modelprecache"), -1);
+}
@@ -0,0 +1,192 @@
+#include "demogobbler.h"
+#include "utils/synthetic_estate.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <string>
+#include <utility>
+
+struct temp_entity_fixture : ::testing::Test {
+  synthetic_estate state;
+  dg_bitwriter writer;
+  prop_value health;
+  prop_value speed;
+
+  void SetUp() override {
+    dg_bitwriter_init(&writer, 1024);
+    memset(&health, 0, sizeof(health));
+    health.prop_index = dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iHealth").prop_index;
+    health.value.proptype = sendproptype_int;
+    health.value.type = dg_int_signed;
+    health.value.prop_numbits = 10;
+    health.value.signed_val = 75;
+    memset(&speed, 0, sizeof(speed));
+    speed.prop_index = dg_estate_find_prop(&state.entity_state, 0, "DT_Derived.m_flSpeed").prop_index;
+    speed.value.proptype = sendproptype_float;
+    speed.value.type = dg_float_noscale;
+    speed.value.float_val = 2.5f;
+  }
+
+  void TearDown() override { dg_bitwriter_free(&writer); }
+
+  void write_entity(bool has_delay, int32_t delay, bool has_class, prop_value *props,
+                    size_t count) {
+    dg_bitwriter_write_bit(&writer, has_delay);
+    if (has_delay) {
+      dg_bitwriter_write_sint(&writer, delay, 8);
+    }
+    dg_bitwriter_write_bit(&writer, has_class);
+    if (has_class) {
+      dg_bitwriter_write_uint(&writer, 1, 1); // serverclass 0, one bit for a single class
+    }
+
+    dg_ent_update update;
+    memset(&update, 0, sizeof(update));
+    update.prop_value_array = props;
+    update.prop_value_array_size = count;
+    dg_bitwriter_write_props(&writer, &state.demver_data, &update);
+  }
+
+  dg_parse_result parse(uint8_t num_entries, const bool *wanted_classes,
+                        dg_svc_temp_entities_parsed *output, bool record_spans = false) {
+    dg_svc_temp_entities message;
+    memset(&message, 0, sizeof(message));
+    message.num_entries = num_entries;
+    message.data = dg_bitstream_create(writer.ptr, writer.bitoffset);
+
+    dg_temp_entities_parse_args args;
+    args.message = &message;
+    args.allocator = &state.allocator;
+    args.permanent_allocator = &state.allocator;
+    args.demver_data = &state.demver_data;
+    args.entity_state = &state.entity_state;
+    args.output = output;
+    args.wanted_classes = wanted_classes;
+    args.record_prop_spans = record_spans;
+    return dg_parse_temp_entities(&args);
+  }
+};
+
+TEST_F(temp_entity_fixture, decodes_props) {
+  // Props are sent in flattened order
+  prop_value props[] = {health, speed};
+  if (props[0].prop_index > props[1].prop_index) {
+    std::swap(props[0], props[1]);
+  }
+  write_entity(true, -50, true, props, 2);
+  write_entity(false, 0, false, &speed, 1);
+
+  dg_svc_temp_entities_parsed output;
+  dg_parse_result result = parse(2, NULL, &output);
+  ASSERT_FALSE(result.error) << result.error_message;
+  ASSERT_EQ(output.entities_count, 2u);
+
+  const dg_temp_entity *first = output.entities;
+  EXPECT_FLOAT_EQ(first->delay, -0.5f);
+  EXPECT_EQ(first->update.datatable_id, 0);
+  EXPECT_EQ(first->update.ent_index, -1);
+  ASSERT_EQ(first->update.prop_value_array_size, 2u);
+  for (size_t i = 0; i < 2; ++i) {
+    const prop_value *value = first->update.prop_value_array + i;
+    EXPECT_EQ(value->prop_index, props[i].prop_index);
+    if (value->prop_index == health.prop_index) {
+      EXPECT_EQ(value->value.signed_val, 75);
+    } else {
+      EXPECT_EQ(value->value.float_val, 2.5f);
+    }
+  }
+
+  const dg_temp_entity *second = output.entities + 1;
+  EXPECT_EQ(second->delay, 0.0f);
+  EXPECT_EQ(second->update.datatable_id, 0);
+  ASSERT_EQ(second->update.prop_value_array_size, 1u);
+  EXPECT_EQ(second->update.prop_value_array[0].prop_index, speed.prop_index);
+}
+
+TEST_F(temp_entity_fixture, filtered_classes_are_skipped) {
+  prop_value props[] = {health};
+  write_entity(false, 0, true, props, 1);
+  write_entity(false, 0, false, props, 1);
+
+  bool wanted[] = {false};
+  dg_svc_temp_entities_parsed output;
+  dg_parse_result result = parse(2, wanted, &output);
+  ASSERT_FALSE(result.error) << result.error_message;
+  EXPECT_EQ(output.entities_count, 0u);
+}
+
+TEST_F(temp_entity_fixture, bad_class) {
+  prop_value props[] = {health};
+  write_entity(false, 0, false, props, 1);
+
+  dg_svc_temp_entities_parsed output;
+  EXPECT_TRUE(parse(1, NULL, &output).error);
+
+  dg_bitwriter_free(&writer);
+  dg_bitwriter_init(&writer, 1024);
+  dg_bitwriter_write_bit(&writer, false);
+  dg_bitwriter_write_bit(&writer, true);
+  dg_bitwriter_write_uint(&writer, 0, 1);
+  EXPECT_TRUE(parse(1, NULL, &output).error);
+}
+
+static std::string written_bits(const dg_ent_update *update, const dg_demver_data *version) {
+  dg_bitwriter writer;
+  dg_bitwriter_init(&writer, 1024);
+  dg_bitwriter_write_props(&writer, version, update);
+  dg_bitstream stream = dg_bitstream_create(writer.ptr, writer.bitoffset);
+  std::string bits;
+  while (dg_bitstream_bits_left(&stream) > 0) {
+    bits += dg_bitstream_read_bit(&stream) ? '1' : '0';
+  }
+  dg_bitwriter_free(&writer);
+  return bits;
+}
+
+TEST_F(temp_entity_fixture, prop_spans) {
+  prop_value props[] = {health, speed};
+  if (props[0].prop_index > props[1].prop_index) {
+    std::swap(props[0], props[1]);
+  }
+  write_entity(false, 0, true, props, 2);
+
+  dg_svc_temp_entities_parsed output;
+  dg_parse_result result = parse(1, NULL, &output, true);
+  ASSERT_FALSE(result.error) << result.error_message;
+  dg_ent_update *update = &output.entities->update;
+  EXPECT_EQ(update->prop_source, writer.ptr);
+  ASSERT_EQ(update->prop_value_array_size, 2u);
+
+  prop_value *parsed_health = update->prop_value_array;
+  if (parsed_health->prop_index != health.prop_index) {
+    ++parsed_health;
+  }
+  EXPECT_EQ(parsed_health->bit_length, 10u);
+  EXPECT_FALSE(parsed_health->dirty);
+
+  dg_ent_update encoded;
+  memset(&encoded, 0, sizeof(encoded));
+  encoded.prop_value_array = props;
+  encoded.prop_value_array_size = 2;
+  std::string original = written_bits(&encoded, &state.demver_data);
+  EXPECT_EQ(written_bits(update, &state.demver_data), original);
+
+  // The span points at the encoded health in the temp entity data
+  dg_bitstream span = dg_bitstream_create(writer.ptr, writer.bitoffset);
+  dg_bitstream_advance(&span, parsed_health->bit_start);
+  EXPECT_EQ(dg_bitstream_read_sint(&span, parsed_health->bit_length), 75);
+
+  // A clean prop is copied from that span, so the edited value is not written
+  parsed_health->value.signed_val = 20;
+  EXPECT_EQ(written_bits(update, &state.demver_data), original);
+  EXPECT_EQ(update->prop_source, writer.ptr);
+
+  parsed_health->dirty = true;
+  std::string changed = written_bits(update, &state.demver_data);
+  EXPECT_NE(changed, original);
+  for (prop_value &prop : props) {
+    if (prop.prop_index == health.prop_index) {
+      prop.value.signed_val = 20;
+    }
+  }
+  EXPECT_EQ(changed, written_bits(&encoded, &state.demver_data));
+}
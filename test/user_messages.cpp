@@ -0,0 +1,156 @@
+#include "demogobbler.h"
+#include "gtest/gtest.h"
+#include <cstring>
+
+struct user_message_fixture : ::testing::Test {
+  dg_arena arena;
+  dg_alloc_state allocator;
+  dg_bitwriter writer;
+  dg_demver_data version;
+  const char *game_directory = "hl2";
+
+  void SetUp() override {
+    arena = dg_arena_create(4096);
+    allocator = dg_arena_create_allocator(&arena);
+    dg_bitwriter_init(&writer, 1024);
+    memset(&version, 0, sizeof(version));
+  }
+
+  void TearDown() override {
+    dg_bitwriter_free(&writer);
+    dg_arena_free(&arena);
+  }
+
+  dg_svc_user_message message(uint8_t msg_type) {
+    dg_svc_user_message out;
+    memset(&out, 0, sizeof(out));
+    out.msg_type = msg_type;
+    out.length = writer.bitoffset;
+    out.data = dg_bitstream_create(writer.ptr, writer.bitoffset);
+    dg_user_message_registry registry = dg_user_message_registry_get(&version, game_directory);
+    out.type = dg_user_message_type_get(&registry, msg_type);
+    out.allocator = &allocator;
+    return out;
+  }
+};
+
+TEST_F(user_message_fixture, registry) {
+  version.game = portal2;
+  dg_user_message_registry registry = dg_user_message_registry_get(&version, "portal2");
+  const dg_user_message_type *type = dg_user_message_type_get(&registry, 4);
+  ASSERT_NE(type, nullptr);
+  EXPECT_STREQ(type->name, "SayText2");
+  EXPECT_EQ(type->kind, dg_user_message_say_text2);
+  EXPECT_EQ(dg_user_message_type_get(&registry, 0), nullptr);
+  EXPECT_EQ(dg_user_message_type_get(&registry, 255), nullptr);
+
+  version.game = orangebox;
+  registry = dg_user_message_registry_get(&version, "hl2");
+  EXPECT_STREQ(dg_user_message_type_get(&registry, 4)->name, "TextMsg");
+  EXPECT_STREQ(dg_user_message_type_get(&registry, 15)->name, "Damage");
+  version.game = csgo;
+  registry = dg_user_message_registry_get(&version, "csgo");
+  EXPECT_EQ(dg_user_message_type_get(&registry, 4), nullptr);
+}
+
+TEST_F(user_message_fixture, unknown_mods_have_no_registry) {
+  // Counter-Strike: Source and Team Fortress 2 number their messages differently
+  for (const char *mod : {"cstrike", "tf", "hl2mp"}) {
+    for (dg_game game : {orangebox, steampipe}) {
+      version.game = game;
+      dg_user_message_registry registry = dg_user_message_registry_get(&version, mod);
+      EXPECT_EQ(registry.count, 0u) << mod;
+      EXPECT_EQ(dg_user_message_type_get(&registry, 4), nullptr);
+    }
+  }
+
+  version.game = steampipe;
+  dg_user_message_registry registry = dg_user_message_registry_get(&version, "ep2");
+  EXPECT_STREQ(dg_user_message_type_get(&registry, 3)->name, "SayText");
+}
+
+TEST_F(user_message_fixture, say_text_is_decoded_once) {
+  version.game = orangebox;
+  dg_bitwriter_write_uint(&writer, 2, 8);
+  dg_bitwriter_write_cstring(&writer, "hello");
+  dg_bitwriter_write_uint(&writer, 1, 8);
+  dg_svc_user_message msg = message(3);
+
+  const dg_user_message *decoded;
+  ASSERT_FALSE(dg_user_message_decode(&msg, &decoded).error);
+  ASSERT_NE(decoded, nullptr);
+  EXPECT_EQ(decoded->kind, dg_user_message_say_text);
+  EXPECT_EQ(decoded->say_text.client, 2);
+  EXPECT_STREQ(decoded->say_text.text, "hello");
+  EXPECT_TRUE(decoded->say_text.chat);
+
+  const dg_user_message *again;
+  ASSERT_FALSE(dg_user_message_decode(&msg, &again).error);
+  EXPECT_EQ(again, decoded);
+}
+
+TEST_F(user_message_fixture, hud_msg) {
+  version.game = portal2;
+  dg_bitwriter_write_uint(&writer, 1, 8);
+  dg_bitwriter_write_float(&writer, 0.5f);
+  dg_bitwriter_write_float(&writer, -1.0f);
+  for (int i = 0; i < 8; ++i) {
+    dg_bitwriter_write_uint(&writer, i * 10, 8);
+  }
+  dg_bitwriter_write_uint(&writer, 2, 8);
+  dg_bitwriter_write_float(&writer, 0.1f);
+  dg_bitwriter_write_float(&writer, 0.2f);
+  dg_bitwriter_write_float(&writer, 3.0f);
+  dg_bitwriter_write_float(&writer, 0.0f);
+  dg_bitwriter_write_cstring(&writer, "Chamber 01");
+  dg_svc_user_message msg = message(6);
+
+  const dg_user_message *decoded;
+  ASSERT_FALSE(dg_user_message_decode(&msg, &decoded).error);
+  ASSERT_NE(decoded, nullptr);
+  const dg_um_hud_msg *hud = &decoded->hud_msg;
+  EXPECT_EQ(hud->channel, 1);
+  EXPECT_EQ(hud->y, -1.0f);
+  EXPECT_EQ(hud->color1[1], 10);
+  EXPECT_EQ(hud->color2[3], 70);
+  EXPECT_EQ(hud->effect, 2);
+  EXPECT_EQ(hud->hold_time, 3.0f);
+  EXPECT_STREQ(hud->message, "Chamber 01");
+}
+
+TEST_F(user_message_fixture, damage) {
+  // Registered with 18 bytes: two bytes, a long and three floats
+  version.game = orangebox;
+  dg_bitwriter_write_uint(&writer, 5, 8);
+  dg_bitwriter_write_uint(&writer, 20, 8);
+  dg_bitwriter_write_sint32(&writer, -1);
+  dg_bitwriter_write_float(&writer, 0.0f);
+  dg_bitwriter_write_float(&writer, -10.0f);
+  dg_bitwriter_write_float(&writer, 256.5f);
+  ASSERT_EQ(writer.bitoffset, 18u * 8);
+  dg_svc_user_message msg = message(15);
+
+  const dg_user_message *decoded;
+  ASSERT_FALSE(dg_user_message_decode(&msg, &decoded).error);
+  ASSERT_NE(decoded, nullptr);
+  EXPECT_EQ(decoded->damage.armor, 5);
+  EXPECT_EQ(decoded->damage.damage_taken, 20);
+  EXPECT_EQ(decoded->damage.bits_damage, -1);
+  EXPECT_EQ(decoded->damage.origin.x, 0.0f);
+  EXPECT_EQ(decoded->damage.origin.y, -10.0f);
+  EXPECT_EQ(decoded->damage.origin.z, 256.5f);
+}
+
+TEST_F(user_message_fixture, unregistered_and_malformed) {
+  version.game = orangebox;
+  dg_bitwriter_write_uint(&writer, 1, 8);
+  dg_svc_user_message msg = message(0);
+  const dg_user_message *decoded;
+  ASSERT_FALSE(dg_user_message_decode(&msg, &decoded).error);
+  EXPECT_EQ(decoded, nullptr);
+
+  // Shake is missing its floats
+  msg = message(10);
+  EXPECT_TRUE(dg_user_message_decode(&msg, &decoded).error);
+  EXPECT_EQ(msg.decoded, nullptr);
+}
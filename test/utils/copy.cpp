@@ -105,3 +105,23 @@ void copy_demo_test(const char *filepath) {
     }
   }
 }
+
+void copy_demo_stream(const char *filepath) {
+  freddie::memory_stream output;
+  wrapped_memory_stream input;
+  output.ground_truth = &input.underlying;
+  input.underlying.fill_with_file(filepath);
+
+  freddie::demo_stream_t stream;
+  stream.writer.expect_equal = true;
+  stream.open(&output, {freddie::memory_stream_write});
+  auto result = stream.parse(&input.underlying, {freddie::memory_stream_read, freddie::memory_stream_seek});
+  EXPECT_EQ(result.error, false) << result.error_message;
+  result = stream.close();
+  EXPECT_EQ(result.error, false) << result.error_message;
+
+  // Steampipe demos have some garbage in the last tick, same as with copy_demo_freddie
+  if (stream.demver_data.game != steampipe) {
+    EXPECT_TRUE(output.agrees) << "Streamed copy did not match the input";
+  }
+}
@@ -2,3 +2,4 @@
 
 void copy_demo_freddie(const char *filepath);
 void copy_demo_test(const char* filepath);
+void copy_demo_stream(const char *filepath);
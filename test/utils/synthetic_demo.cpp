@@ -0,0 +1,139 @@
+#include "synthetic_demo.hpp"
+#include "demogobbler.h"
+#include "demogobbler/bitwriter.h"
+#include "demogobbler/packet_netmessages.h"
+#include "synthetic_estate.hpp"
+#include <cstring>
+
+template <typename T> static void append(std::vector<uint8_t> &out, T value) {
+  out.insert(out.end(), (uint8_t *)&value, (uint8_t *)&value + sizeof(value));
+}
+
+// Padded since the buffer stream refuses reads that are as large as the whole buffer
+std::vector<uint8_t> netmessage_demo(uint32_t extra_type) {
+  std::vector<uint8_t> out(1072);
+  memcpy(out.data(), "HL2DEMO", 8);
+  int32_t protocols[] = {3, 15};
+  memcpy(out.data() + 8, protocols, sizeof(protocols));
+
+  dg_bitwriter writer;
+  dg_bitwriter_init(&writer, 256);
+  for (uint32_t tick : {42u, 43u}) {
+    dg_bitwriter_write_uint(&writer, 3, 6); // net_tick
+    dg_bitwriter_write_uint32(&writer, tick);
+    dg_bitwriter_write_uint(&writer, 1, 16);
+    dg_bitwriter_write_uint(&writer, 2, 16);
+    if (tick == 42) {
+      dg_bitwriter_write_uint(&writer, extra_type, 6); // net_nop by default
+    }
+  }
+  uint32_t bytes = (writer.bitoffset + 7) / 8;
+
+  out.push_back(dg_type_packet);
+  append<int32_t>(out, 5);
+  dg_cmdinfo cmdinfo;
+  memset(&cmdinfo, 0, sizeof(cmdinfo));
+  append(out, cmdinfo);
+  append<int32_t>(out, 0); // in sequence
+  append<int32_t>(out, 0); // out sequence
+  append<int32_t>(out, bytes);
+  out.insert(out.end(), writer.ptr, writer.ptr + bytes);
+  dg_bitwriter_free(&writer);
+
+  out.push_back(dg_type_stop);
+  append<int32_t>(out, 6);
+  out.resize(1 << 16);
+  return out;
+}
+
+static size_t append_output(void *stream, const void *src, size_t bytes) {
+  auto *out = (std::vector<uint8_t> *)stream;
+  out->insert(out->end(), (const uint8_t *)src, (const uint8_t *)src + bytes);
+  return bytes;
+}
+
+std::vector<uint8_t> packetentities_demo(uint32_t nop_count) {
+  synthetic_estate state;
+  std::vector<uint8_t> out;
+  writer w;
+  dg_writer_init(&w);
+  dg_writer_open(&w, &out, {append_output});
+
+  dg_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.ID, "HL2DEMO", 8);
+  header.demo_protocol = 3;
+  header.net_protocol = 15;
+  dg_demver_data version = dg_get_demo_version(&header);
+  w.version = version;
+  dg_write_header(&w, &header);
+
+  dg_datatables_parsed datatables = state.datatables;
+  datatables.preamble.type = dg_type_datatables;
+  dg_write_datatables_parsed(&w, &datatables);
+
+  prop_value health;
+  memset(&health, 0, sizeof(health));
+  health.prop_index = dg_estate_find_prop(&state.entity_state, 0, "DT_Base.m_iHealth").prop_index;
+  health.value.proptype = sendproptype_int;
+  health.value.type = dg_int_signed;
+  health.value.prop_numbits = 10;
+  health.value.signed_val = 75;
+
+  dg_ent_update update;
+  memset(&update, 0, sizeof(update));
+  update.ent_index = 1;
+  update.update_type = 2;
+  update.prop_value_array = &health;
+  update.prop_value_array_size = 1;
+
+  dg_packetentities_data data;
+  memset(&data, 0, sizeof(data));
+  data.ent_updates = &update;
+  data.ent_updates_count = 1;
+  data.serverclass_bits = 1;
+
+  dg_bitwriter entity_bits;
+  dg_bitwriter_init(&entity_bits, 256);
+  write_packetentities_args args;
+  memset(&args, 0, sizeof(args));
+  args.data = &data;
+  args.version = &version;
+  dg_bitwriter_write_packetentities(&entity_bits, args);
+
+  packet_net_message message;
+  memset(&message, 0, sizeof(message));
+  message.mtype = svc_packet_entities;
+  message.message_svc_packet_entities.max_entries = 2;
+  message.message_svc_packet_entities.updated_entries = 1;
+  message.message_svc_packet_entities.data =
+      dg_bitstream_create(entity_bits.ptr, entity_bits.bitoffset);
+
+  dg_bitwriter packet_bits;
+  dg_bitwriter_init(&packet_bits, 256);
+  dg_bitwriter_write_netmessage(&packet_bits, &version, &message);
+  for (uint32_t i = 0; i < nop_count; ++i) {
+    dg_bitwriter_write_uint(&packet_bits, version.netmessage_ids[net_nop],
+                            version.netmessage_type_bits);
+  }
+  // Pad with zero bits that are too few to hold another message
+  dg_bitwriter_write_uint(&packet_bits, 0, (8 - packet_bits.bitoffset % 8) % 8);
+
+  dg_packet packet;
+  memset(&packet, 0, sizeof(packet));
+  packet.preamble.type = dg_type_packet;
+  packet.preamble.tick = 5;
+  packet.data = packet_bits.ptr;
+  packet.size_bytes = packet_bits.bitoffset / 8;
+  dg_write_packet(&w, &packet);
+
+  dg_stop stop;
+  memset(&stop, 0, sizeof(stop));
+  dg_write_stop(&w, &stop);
+  dg_writer_free(&w);
+  dg_bitwriter_free(&packet_bits);
+  dg_bitwriter_free(&entity_bits);
+
+  out.resize(out.size() + (1 << 16));
+  return out;
+}
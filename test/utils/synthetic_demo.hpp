@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Protocol 3/15 demo with a single packet holding net_tick (tick 42), a message with the raw type
+// id extra_type (net_nop by default) and net_tick (tick 43), followed by dg_stop
+std::vector<uint8_t> netmessage_demo(uint32_t extra_type = 0);
+
+// Protocol 3/15 demo with the datatables of synthetic_estate and a single packet holding an
+// svc_packet_entities message where entity 1 enters the PVS with m_iHealth set to 75, followed
+// by nop_count net_nops and dg_stop
+std::vector<uint8_t> packetentities_demo(uint32_t nop_count);
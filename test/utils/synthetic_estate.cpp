@@ -0,0 +1,80 @@
+#include "synthetic_estate.hpp"
+#include <cstdio>
+#include <cstring>
+
+synthetic_estate::synthetic_estate(bool should_store_props) {
+  memory = dg_arena_create(1 << 15);
+  allocator = dg_arena_create_allocator(&memory);
+  memset(base_props, 0, sizeof(base_props));
+  memset(derived_props, 0, sizeof(derived_props));
+  memset(sendtables, 0, sizeof(sendtables));
+  memset(&serverclass, 0, sizeof(serverclass));
+  memset(&datatables, 0, sizeof(datatables));
+  memset(&demver_data, 0, sizeof(demver_data));
+  memset(&entity_state, 0, sizeof(entity_state));
+
+  sendtables[0].name = "DT_Base";
+  sendtables[0].props = base_props;
+  sendtables[0].prop_count = 5;
+  sendtables[1].name = "DT_Derived";
+  sendtables[1].props = derived_props;
+  sendtables[1].prop_count = 2;
+
+  base_props[0].name = "m_iHealth";
+  base_props[0].proptype = sendproptype_int;
+  base_props[0].prop_numbits = 10;
+  base_props[1].name = "m_vecOrigin";
+  base_props[1].proptype = sendproptype_vector3;
+  base_props[1].flag_noscale = true;
+  base_props[2].name = "000";
+  base_props[2].proptype = sendproptype_int;
+  base_props[2].prop_numbits = 8;
+  base_props[2].flag_insidearray = true;
+  base_props[3].name = "m_iAmmo";
+  base_props[3].proptype = sendproptype_array;
+  base_props[3].array_num_elements = 4;
+  base_props[3].array_prop = base_props + 2;
+  base_props[4].name = "m_flSpeed";
+  base_props[4].proptype = sendproptype_float;
+  base_props[4].flag_noscale = true;
+
+  for (size_t i = 0; i < 5; ++i) {
+    base_props[i].baseclass = sendtables + 0;
+  }
+
+  derived_props[0].name = "baseclass";
+  derived_props[0].proptype = sendproptype_datatable;
+  derived_props[0].dtname = "DT_Base";
+  derived_props[1].name = "m_flSpeed";
+  derived_props[1].proptype = sendproptype_float;
+  derived_props[1].flag_noscale = true;
+  derived_props[1].baseclass = sendtables + 1;
+
+  serverclass.serverclass_name = "CDerived";
+  serverclass.datatable_name = "DT_Derived";
+
+  datatables.sendtables = sendtables;
+  datatables.sendtable_count = 2;
+  datatables.serverclasses = &serverclass;
+  datatables.serverclass_count = 1;
+
+  demver_data.demo_protocol = 3;
+  demver_data.game = orangebox;
+
+  estate_init_args args;
+  args.allocator = &allocator;
+  args.flatten_datatables = true;
+  args.heap_allocator = NULL;
+  args.message = &datatables;
+  args.should_store_props = should_store_props;
+  args.version_data = &demver_data;
+  dg_parse_result result = dg_estate_init(&entity_state, args);
+  if (result.error) {
+    std::printf("failed to init synthetic estate: %s\n", result.error_message);
+  }
+}
+
+synthetic_estate::~synthetic_estate() {
+  dg_estate_free(&entity_state);
+  dg_arena_free(&memory);
+}
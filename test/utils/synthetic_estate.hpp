@@ -0,0 +1,21 @@
+#pragma once
+
+#include "demogobbler.h"
+
+// Entity state flattened from a small handmade set of datatables:
+// serverclass 0 (CDerived) -> DT_Derived -> DT_Base with an int, a vector, an int array and a
+// float, and DT_Derived adds another float
+struct synthetic_estate {
+  dg_arena memory;
+  dg_alloc_state allocator;
+  dg_sendprop base_props[5];
+  dg_sendprop derived_props[2];
+  dg_sendtable sendtables[2];
+  dg_serverclass serverclass;
+  dg_datatables_parsed datatables;
+  dg_demver_data demver_data;
+  estate entity_state;
+
+  synthetic_estate(bool should_store_props = false);
+  ~synthetic_estate();
+};
@@ -0,0 +1,133 @@
+#include "demogobbler.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+struct recording_stream {
+  std::vector<uint8_t> bytes;
+  size_t calls = 0;
+};
+
+static size_t recording_write(void *stream, const void *src, size_t bytes) {
+  auto *thisptr = (recording_stream *)stream;
+  thisptr->bytes.insert(thisptr->bytes.end(), (uint8_t *)src, (uint8_t *)src + bytes);
+  ++thisptr->calls;
+  return bytes;
+}
+
+static size_t recording_writev(void *stream, const dg_output_chunk *chunks, int count) {
+  auto *thisptr = (recording_stream *)stream;
+  size_t total = 0;
+  for (int i = 0; i < count; ++i) {
+    const uint8_t *data = (const uint8_t *)chunks[i].data;
+    thisptr->bytes.insert(thisptr->bytes.end(), data, data + chunks[i].bytes);
+    total += chunks[i].bytes;
+  }
+  ++thisptr->calls;
+  return total;
+}
+
+struct writer_output_fixture : ::testing::Test {
+  std::vector<uint8_t> small_payload;
+  std::vector<uint8_t> large_payload;
+  dg_header header;
+
+  void SetUp() override {
+    small_payload.assign(20, 0x11);
+    large_payload.assign(3000, 0x22);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.ID, "HL2DEMO", 8);
+    header.demo_protocol = 3;
+    header.net_protocol = 15;
+  }
+
+  void write_demo(writer *w) {
+    w->version = dg_get_demo_version(&header);
+    dg_write_header(w, &header);
+
+    dg_packet packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.preamble.type = dg_type_packet;
+    for (int i = 0; i < 50; ++i) {
+      std::vector<uint8_t> &payload = i % 10 == 9 ? large_payload : small_payload;
+      packet.preamble.tick = i;
+      packet.cmdinfo[0].view_origin.x = i;
+      packet.data = payload.data();
+      packet.size_bytes = payload.size();
+      dg_write_packet(w, &packet);
+    }
+
+    uint8_t stop_data[] = {0, 0, 0, 0};
+    dg_stop stop;
+    stop.data = stop_data;
+    stop.size_bytes = sizeof(stop_data);
+    dg_write_stop(w, &stop);
+  }
+
+  recording_stream write_recorded(uint32_t buffer_size, bool vectored) {
+    recording_stream stream;
+    writer w;
+    dg_writer_init(&w);
+    w.buffer_size = buffer_size;
+    output_interface funcs = {recording_write, vectored ? recording_writev : NULL};
+    dg_writer_open(&w, &stream, funcs);
+    write_demo(&w);
+    EXPECT_FALSE(w.error) << w.error_message;
+    dg_writer_free(&w);
+    return stream;
+  }
+};
+
+TEST_F(writer_output_fixture, buffering_keeps_output) {
+  // A single byte buffer passes every write straight through
+  recording_stream unbuffered = write_recorded(1, false);
+  recording_stream buffered = write_recorded(0, false);
+  recording_stream small = write_recorded(512, false);
+  recording_stream vectored = write_recorded(512, true);
+
+  EXPECT_EQ(buffered.bytes, unbuffered.bytes);
+  EXPECT_EQ(small.bytes, unbuffered.bytes);
+  EXPECT_EQ(vectored.bytes, unbuffered.bytes);
+
+  EXPECT_EQ(buffered.calls, 1u);
+  EXPECT_LT(small.calls, unbuffered.calls / 10);
+  // Large payloads are joined with the bytes before them
+  EXPECT_LT(vectored.calls, small.calls);
+}
+
+static std::vector<uint8_t> read_file(const std::string &path) {
+  std::ifstream stream(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), {});
+}
+
+TEST_F(writer_output_fixture, file_outputs) {
+  recording_stream expected = write_recorded(1, false);
+  std::filesystem::path dir = std::filesystem::temp_directory_path();
+  std::string file_path = (dir / "demogobbler_writer_output.dem").string();
+  std::string mapped_path = (dir / "demogobbler_writer_output_mapped.dem").string();
+
+  writer w;
+  dg_writer_init(&w);
+  dg_writer_open_file(&w, file_path.c_str());
+  ASSERT_FALSE(w.error);
+  write_demo(&w);
+  dg_writer_free(&w);
+  EXPECT_FALSE(w.error) << w.error_message;
+
+  dg_writer_init(&w);
+  w.buffer_size = 256;
+  dg_writer_open_file_mapped(&w, mapped_path.c_str());
+  ASSERT_FALSE(w.error);
+  write_demo(&w);
+  dg_writer_free(&w);
+  EXPECT_FALSE(w.error) << w.error_message;
+
+  EXPECT_EQ(read_file(file_path), expected.bytes);
+  EXPECT_EQ(read_file(mapped_path), expected.bytes);
+  std::remove(file_path.c_str());
+  std::remove(mapped_path.c_str());
+}
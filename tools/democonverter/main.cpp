@@ -9,7 +9,6 @@ int main(int argc, char **argv) {
   }
 
   freddie::demo_t example;
-  freddie::demo_t input;
   auto result = freddie::demo_t::parse_demo(&example, argv[1]);
 
   if(result.error)
@@ -18,15 +17,8 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  result = freddie::demo_t::parse_demo(&input, argv[2]);
-
-  if(result.error)
-  {
-    std::printf("error parsing input demo: %s\n", result.error_message);
-    return 1;
-  }
-
-  result = freddie::convert_demo(&example, &input);
+  // The input is converted packet by packet as it is read
+  result = freddie::convert_demo(&example, argv[2], argv[3]);
 
   if(result.error)
   {
@@ -34,13 +26,5 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  result = input.write_demo(argv[3]);
-
-  if(result.error)
-  {
-    std::printf("error writing output demo: %s\n", result.error_message);
-    return 1;
-  }
-
   return 0;
 }
\ No newline at end of file
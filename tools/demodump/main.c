@@ -90,8 +90,8 @@ void print_packet(parser_state *a, packet_parsed *message) {
   print_packet_orig(a, &message->orig);
   int create_stringtable_index = 0;
 
-  for (size_t i = 0; i < message->message_count; ++i) {
-    packet_net_message *netmsg = message->messages + i;
+  packet_net_message *netmsg = message->first_message;
+  for (size_t i = 0; i < message->message_count; ++i, netmsg = dg_netmessage_next(netmsg)) {
     if (netmsg->mtype == svc_create_stringtable) {
       struct dg_svc_create_stringtable msg = netmsg->message_svc_create_stringtable;
       uint32_t data_length = dg_bitstream_bits_left(&msg.data);
@@ -1,5 +1,6 @@
 #include "demogobbler/freddie.hpp"
 #include <cstdio>
+#include <algorithm>
 #include <cstring>
 #include <map>
 #include <vector>
@@ -8,173 +9,181 @@
 
 using namespace freddie;
 
-static int get_prop_index(demo_t *demo, int datatable_id, const char *prop_name) {
-  estate state = {0};
-  estate_init_args args;
-  dg_alloc_state allocator = dg_arena_create_allocator(&demo->arena);
-  args.allocator = &allocator;
-  args.flatten_datatables = false;
-  args.should_store_props = false;
-  args.message = demo->get_datatables();
-  auto result = dg_estate_init(&state, args);
-  if (result.error) {
-    printf("Failed to get prop_index: %s\n", result.error_message);
-    return -1;
-  }
+// Player updates of one ghost demo by tick. The props keep their original bits, the decoded values
+// of vector, string and array props point into packets that are gone after parsing
+struct ghost_t {
+  dg_arena arena;
+  dg_alloc_state allocator;
+  std::map<int32_t, dg_ent_update> updates;
 
-  int prop_index = -1;
-  dg_serverclass_data *class_data =
-      dg_estate_serverclass_data(&state, &demo->demver_data, &allocator, datatable_id);
-  for (size_t i = 0; i < class_data->prop_count; i++) {
-    if (strcmp(prop_name, class_data->props[i].name) == 0) {
-      prop_index = i;
-      break;
+  ghost_t() {
+    arena = dg_arena_create(1 << 16);
+    allocator = dg_arena_create_allocator(&arena);
+  }
+  ~ghost_t() { dg_arena_free(&arena); }
+  ghost_t(const ghost_t &rhs) = delete;
+  ghost_t &operator=(const ghost_t &rhs) = delete;
+};
+
+static dg_ent_update keep_update(const dg_ent_update *update, dg_alloc_state *allocator) {
+  dg_ent_update copy = *update;
+  size_t count = update->prop_value_array_size;
+  copy.prop_value_array =
+      (prop_value *)dg_alloc_allocate(allocator, sizeof(prop_value) * count, alignof(prop_value));
+  std::copy(update->prop_value_array, update->prop_value_array + count, copy.prop_value_array);
+
+  if (update->prop_source && count > 0) {
+    // Props are stored in the order they were read
+    uint32_t first_byte = copy.prop_value_array[0].bit_start / 8;
+    const prop_value *last = copy.prop_value_array + count - 1;
+    uint32_t bytes = (last->bit_start + last->bit_length + 7) / 8 - first_byte;
+    uint8_t *bits = (uint8_t *)dg_alloc_allocate(allocator, bytes, 1);
+    memcpy(bits, (const uint8_t *)update->prop_source + first_byte, bytes);
+    copy.prop_source = bits;
+    for (size_t i = 0; i < count; ++i) {
+      copy.prop_value_array[i].bit_start -= first_byte * 8;
     }
   }
 
-  dg_estate_free(&state);
-  return prop_index;
+  return copy;
 }
 
-static void collect_player_updates(demo_t *demo, std::map<int32_t, dg_ent_update> &data) {
-  for (auto &message : demo->packets) {
-    auto *packet = &message->packet;
-    packet_parsed *ptr = std::get_if<packet_parsed>(packet);
-
-    if (!ptr)
-      continue;
-
-    int32_t tick = ptr->orig.preamble.tick;
-    for (size_t msg_index = 0; msg_index < ptr->message_count; ++msg_index) {
-      packet_net_message *msg = ptr->messages + msg_index;
-      if (msg->mtype == svc_packet_entities) {
-        dg_packetentities_data *packet_entities = &msg->message_svc_packet_entities.parsed->data;
-        for (uint32_t j = 0; j < packet_entities->ent_updates_count; j++) {
-          if (packet_entities->ent_updates[j].ent_index == 1) {
-            data[tick] = packet_entities->ent_updates[j];
-            break;
-          }
+static void collect_player_updates(parser_state *state, packet_parsed *packet) {
+  ghost_t *ghost = (ghost_t *)state->client_state;
+  int32_t tick = packet->orig.preamble.tick;
+  packet_net_message *msg = packet->first_message;
+  for (size_t msg_index = 0; msg_index < packet->message_count;
+       ++msg_index, msg = dg_netmessage_next(msg)) {
+    if (msg->mtype == svc_packet_entities) {
+      dg_packetentities_data *packet_entities = &msg->message_svc_packet_entities.parsed->data;
+      for (uint32_t j = 0; j < packet_entities->ent_updates_count; j++) {
+        if (packet_entities->ent_updates[j].ent_index == 1) {
+          ghost->updates[tick] = keep_update(packet_entities->ent_updates + j, &ghost->allocator);
+          break;
         }
       }
     }
   }
 }
 
-static void add_player_updates(demo_t *demo, std::vector<std::map<int32_t, dg_ent_update>> &data) {
+struct superimposer_t {
+  std::vector<ghost_t> *ghosts;
   int m_flSimulationTime_index = -1;
-  // Changing m_flSimulationTime doesn't seem to fix Portal2 demo
-  bool should_smooth_demo = (demo->demver_data.demo_protocol < 4);
+};
 
-  for (auto &message : demo->packets) {
-    auto *packet = &message->packet;
-    packet_parsed *ptr = std::get_if<packet_parsed>(packet);
+static void add_player_updates(superimposer_t *superimposer, demo_stream_t *stream,
+                               packet_parsed *packet, packet_net_message *msg) {
+  // Changing m_flSimulationTime doesn't seem to fix Portal2 demo
+  bool should_smooth_demo = (stream->demver_data.demo_protocol < 4);
+  std::vector<ghost_t> &data = *superimposer->ghosts;
+  int32_t tick = packet->orig.preamble.tick;
+  dg_packetentities_data *packet_entities = &msg->message_svc_packet_entities.parsed->data;
+
+  if (should_smooth_demo && superimposer->m_flSimulationTime_index == -1) {
+    for (uint32_t i = 0; i < packet_entities->ent_updates_count; i++) {
+      if (packet_entities->ent_updates[i].ent_index == 1) {
+        dg_prop_handle handle =
+            dg_estate_find_prop(&stream->state->entity_state,
+                                packet_entities->ent_updates[i].datatable_id,
+                                "DT_BaseEntity.m_flSimulationTime");
+        if (handle.prop_index != DG_PROP_HANDLE_INVALID) {
+          superimposer->m_flSimulationTime_index = handle.prop_index;
+        }
+        break;
+      }
+    }
+  }
 
-    if (!ptr)
+  // Get all the updates
+  std::vector<dg_ent_update> player_updates;
+  uint32_t max_entries = msg->message_svc_packet_entities.max_entries;
+  for (size_t i = 0; i < data.size(); i++) {
+    auto it = data[i].updates.find(tick);
+    if (it == data[i].updates.end())
       continue;
 
-    int32_t tick = ptr->orig.preamble.tick;
-    for (size_t msg_index = 0; msg_index < ptr->message_count; ++msg_index) {
-      packet_net_message *msg = ptr->messages + msg_index;
-      if (msg->mtype == svc_packet_entities) {
-        dg_packetentities_data *packet_entities = &msg->message_svc_packet_entities.parsed->data;
-
-        if (should_smooth_demo && m_flSimulationTime_index == -1) {
-          for (uint32_t i = 0; i < packet_entities->ent_updates_count; i++) {
-            if (packet_entities->ent_updates[i].ent_index == 1) {
-              m_flSimulationTime_index = get_prop_index(
-                  demo, packet_entities->ent_updates[i].datatable_id, "m_flSimulationTime");
-              break;
-            }
-          }
-        }
-
-        // Get all the updates
-        std::vector<dg_ent_update> player_updates;
-        uint32_t max_entries = msg->message_svc_packet_entities.max_entries;
-        for (size_t i = 0; i < data.size(); i++) {
-          if (data[i].find(tick) == data[i].end())
-            continue;
-
-          // Ghost index starts at DEMO_GHOST_INDEX
-          dg_ent_update *update = &data[i][tick];
-          update->ent_index = DEMO_GHOST_INDEX + i;
-          max_entries = DEMO_GHOST_INDEX + i - 1;
-
-          if (should_smooth_demo && m_flSimulationTime_index != -1) {
-            // Hack to fix interpolation issue
-            for (size_t j = 0; j < update->prop_value_array_size; j++) {
-              if ((int)update->prop_value_array[j].prop_index == m_flSimulationTime_index &&
-                  update->prop_value_array[j].value.signed_val < 33) {
-                update->prop_value_array[j].value.signed_val += 100;
-              }
-            }
-          }
-          player_updates.push_back(data[i][tick]);
+    // Ghost index starts at DEMO_GHOST_INDEX
+    dg_ent_update *update = &it->second;
+    update->ent_index = DEMO_GHOST_INDEX + i;
+    max_entries = DEMO_GHOST_INDEX + i - 1;
+
+    if (should_smooth_demo && superimposer->m_flSimulationTime_index != -1) {
+      // Hack to fix interpolation issue
+      for (size_t j = 0; j < update->prop_value_array_size; j++) {
+        if ((int)update->prop_value_array[j].prop_index ==
+                superimposer->m_flSimulationTime_index &&
+            update->prop_value_array[j].value.signed_val < 33) {
+          update->prop_value_array[j].value.signed_val += 100;
+          update->prop_value_array[j].dirty = true;
         }
-
-        if (player_updates.empty())
-          continue;
-
-        // Edit the packet_entities->ent_pudates
-        write_packetentities_args args = {0};
-        args.is_delta = msg->message_svc_packet_entities.is_delta;
-        args.version = &demo->demver_data;
-        std::vector<dg_ent_update> new_updates(packet_entities->ent_updates,
-                                               packet_entities->ent_updates +
-                                                   packet_entities->ent_updates_count);
-        new_updates.insert(new_updates.end(), player_updates.begin(), player_updates.end());
-
-        packet_entities->ent_updates_count = new_updates.size();
-        packet_entities->ent_updates = new_updates.data();
-        msg->message_svc_packet_entities.max_entries = max_entries;
-        msg->message_svc_packet_entities.updated_entries += player_updates.size();
-
-        args.data = &msg->message_svc_packet_entities.parsed->data;
-        uint32_t bits = dg_bitstream_bits_left(&msg->message_svc_packet_entities.data);
-        dg_bitwriter bitwriter;
-        dg_bitwriter_init(&bitwriter, bits);
-        auto stream = get_start_state(&bitwriter);
-        dg_bitwriter_write_packetentities(&bitwriter, args);
-        freddie::finalize_stream(&stream, &bitwriter);
-        message->memory.attach(bitwriter.ptr); // transfer the bitwriter memory over to the packet
-        msg->message_svc_packet_entities.data = stream;
       }
     }
+    player_updates.push_back(*update);
   }
+
+  if (player_updates.empty())
+    return;
+
+  // Edit the packet_entities->ent_pudates, the packet points at them until it has been written
+  size_t update_count = packet_entities->ent_updates_count + player_updates.size();
+  dg_ent_update *new_updates = (dg_ent_update *)dg_alloc_allocate(
+      &stream->allocator, update_count * sizeof(dg_ent_update), alignof(dg_ent_update));
+  std::copy(packet_entities->ent_updates,
+            packet_entities->ent_updates + packet_entities->ent_updates_count, new_updates);
+  std::copy(player_updates.begin(), player_updates.end(),
+            new_updates + packet_entities->ent_updates_count);
+
+  packet_entities->ent_updates_count = update_count;
+  packet_entities->ent_updates = new_updates;
+  msg->message_svc_packet_entities.max_entries = max_entries;
+  msg->message_svc_packet_entities.updated_entries += player_updates.size();
+
+  encode_packetentities(msg, &stream->demver_data, &stream->allocator);
 }
 
 static void demo_superimpose(const char *output_path, const char *main_demo_path,
                              const char **demo_paths, size_t demo_count) {
   dg_parse_result result = {0};
-  demo_t main_demo;
-  std::unique_ptr<demo_t[]> demos(new demo_t[demo_count]);
-  std::vector<std::map<int32_t, dg_ent_update>> player_updates;
+  std::vector<ghost_t> ghosts(demo_count);
 
   // Collect player entity data from demos
   printf("Collecting data...\n");
   for (size_t i = 0; i < demo_count; i++) {
-    result = demo_t::parse_demo(&demos[i], demo_paths[i]);
+    dg_settings settings;
+    dg_settings_init(&settings);
+    settings.client_state = &ghosts[i];
+    settings.packet_parsed_handler = collect_player_updates;
+    settings.parse_packetentities = true;
+    settings.record_prop_spans = true;
+    result = dg_parse_file(&settings, demo_paths[i]);
     if (result.error) {
       printf("Error parsing demo %s: %s\n", demo_paths[i], result.error_message);
       return;
     }
-
-    std::map<int32_t, dg_ent_update> player_update;
-    collect_player_updates(&demos[i], player_update);
-    player_updates.push_back(player_update);
   }
 
-  // Write collected data to one demo
+  // Write collected data to one demo while reading the main demo
   printf("Writing output...\n");
-  result = demo_t::parse_demo(&main_demo, main_demo_path);
+  superimposer_t superimposer;
+  superimposer.ghosts = &ghosts;
+  demo_stream_t stream;
+  stream.add_netmessage_transform(
+      svc_packet_entities,
+      [&superimposer](demo_stream_t *stream, packet_parsed *packet, packet_net_message *msg) {
+        add_player_updates(&superimposer, stream, packet, msg);
+      });
+  stream.open(output_path);
+  result = stream.parse(main_demo_path);
+  dg_parse_result close_result = stream.close();
+  if (!result.error) {
+    result = close_result;
+  }
+
   if (result.error) {
-    printf("Error parsing demo %s: %s\n", main_demo_path, result.error_message);
+    printf("Error writing demo %s: %s\n", main_demo_path, result.error_message);
     return;
   }
 
-  add_player_updates(&main_demo, player_updates);
-  main_demo.write_demo(output_path);
-
   printf("Done!\n");
 }
 
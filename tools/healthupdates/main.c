@@ -22,17 +22,6 @@ static void print_int(dg_sendprop *prop, dg_prop_value_inner value) {
   }
 }
 
-static const char *get_prop_name(dg_sendprop *prop) {
-  static char BUFFER[1024];
-
-  if (prop->proptype != sendproptype_datatable && prop->baseclass) {
-    snprintf(BUFFER, sizeof(BUFFER), "%s.%s", prop->baseclass->name, prop->name);
-    return BUFFER;
-  } else {
-    return prop->name;
-  }
-}
-
 static void grab_header(parser_state* a, dg_header* header)
 {
   dump_state* state = a->client_state;
@@ -53,15 +42,17 @@ static void handle_packetentities_parsed(parser_state *state,
     dg_ent_update *update = message->data.ent_updates + i;
     if(update->ent_index != 3)
       continue;
-    dg_serverclass_data* data = state->entity_state.class_datas + update->datatable_id;
+    dg_prop_handle health =
+        dg_estate_find_prop(&state->entity_state, update->datatable_id, "m_iHealth.001");
+
+    if (health.prop_index == DG_PROP_HANDLE_INVALID)
+      continue;
 
     if (update->prop_value_array_size > 0) {
       for (size_t u = 0; u < update->prop_value_array_size; ++u) {
         prop_value *value = update->prop_value_array + u;
-        dg_sendprop* prop = data->props + value->prop_index;
-        const char *prop_name = get_prop_name(prop);
 
-        if(strcmp("m_iHealth.001", prop_name) == 0)
+        if(value->prop_index == health.prop_index)
         {
           int hp = value->value.signed_val;
 
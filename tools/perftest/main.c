@@ -24,6 +24,55 @@ void print_netmessages(parser_state *a, packet_net_message *message) {}
 
 void print_parsed_packet(parser_state *a, packet_parsed *message) {}
 
+static void print_counter(const char *indent, const char *name, dg_alloc_counter counter) {
+  printf("%s%-24s %10llu allocs %12llu bytes %10llu frees %12llu bytes\n", indent, name,
+         (unsigned long long)counter.allocs, (unsigned long long)counter.bytes,
+         (unsigned long long)counter.frees, (unsigned long long)counter.freed_bytes);
+}
+
+static void print_sites(const char *name, const dg_alloc_counter *counters) {
+  bool printed_name = false;
+  for (int site = 0; site < dg_alloc_site_count; ++site) {
+    if (counters[site].allocs == 0 && counters[site].frees == 0)
+      continue;
+    if (!printed_name) {
+      printf("  %s\n", name);
+      printed_name = true;
+    }
+    print_counter("    ", dg_alloc_site_name(site), counters[site]);
+  }
+}
+
+static void print_alloc_report(void) {
+  dg_alloc_report *report = malloc(sizeof(dg_alloc_report));
+  dg_alloc_report_get(report);
+
+  if (!report->enabled) {
+    printf("Allocation report unavailable, build with -DDEMOGOBBLER_ALLOC_TELEMETRY=ON\n");
+    free(report);
+    return;
+  }
+
+  printf("Allocations by site:\n");
+  for (int site = 0; site < dg_alloc_site_count; ++site) {
+    dg_alloc_counter total = dg_alloc_report_site_total(report, site);
+    if (total.allocs > 0 || total.frees > 0)
+      print_counter("  ", dg_alloc_site_name(site), total);
+  }
+
+  printf("Allocations by message type:\n");
+  for (int type = 0; type < DG_ALLOC_REPORT_MESSAGE_TYPES; ++type) {
+    print_sites(dg_message_type_name(type), report->by_message[type]);
+  }
+
+  printf("Allocations by netmessage type:\n");
+  for (int type = 0; type < svc_invalid; ++type) {
+    print_sites(dg_net_message_name(type), report->by_netmessage[type]);
+  }
+
+  free(report);
+}
+
 int main(int argc, char **argv) {
   if (argc <= 2) {
     printf("Usage: perftest <filepath> <iterations>\n");
@@ -49,5 +98,7 @@ int main(int argc, char **argv) {
     dg_parse_file(&settings, argv[1]);
   }
 
+  print_alloc_report();
+
   return 0;
 }
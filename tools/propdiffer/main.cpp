@@ -41,14 +41,6 @@ static int32_t get_dt(const estate *state, const char *name, int32_t initial_gue
   if (args->func)                                                                                  \
   args->func(__VA_ARGS__)
 
-static bool prop_equal(const dg_sendprop* prop1, const char* prop_name)
-{
-  char prop1_name[64];
-  dg_sendprop_name(prop1_name, sizeof(prop1_name), prop1);
-
-  return strcmp(prop1_name, prop_name) == 0;
-}
-
 static bool prop_attributes_equal(const compare_props_args *args, const dg_sendprop* prop1, const dg_sendprop* prop2)
 {
   char prop1_name[64];
@@ -83,43 +75,28 @@ static bool prop_attributes_equal(const compare_props_args *args, const dg_sendp
   return equal;
 }
 
-static dg_sendprop* find_prop(const dg_serverclass_data *data, const char* name, size_t initial_index)
-{
-  if(initial_index < data->prop_count)
-  {
-    if(prop_equal(data->props + initial_index, name))
-    {
-      return data->props + initial_index;
-    }
-  }
-
-  for(size_t i=0; i < data->prop_count; ++i)
-  {
-    if(prop_equal(data->props + i, name))
-      return data->props + i;
-  }
-
-  return nullptr;
-}
-
 static void compare_sendtable_props(const compare_props_args *args,
-                                    const dg_serverclass_data *data1,
-                                    const dg_serverclass_data *data2) {
+                                    const estate *state1, uint32_t dt1,
+                                    const estate *state2, uint32_t dt2) {
   char buffer[64];
+  const dg_serverclass_data *data1 = state1->class_datas + dt1;
+  const dg_serverclass_data *data2 = state2->class_datas + dt2;
   for(size_t i=0; i < data1->prop_count; ++i)
   {
     dg_sendprop* first_prop = data1->props + i;
-    dg_sendprop_name(buffer, sizeof(buffer), first_prop);
-    dg_sendprop* prop = find_prop(data2, buffer, i);
-    if(!prop)
+    dg_prop_handle handle = dg_estate_find_sendprop(state2, dt2, first_prop);
+    if(handle.prop_index == DG_PROP_HANDLE_INVALID)
     {
+      dg_sendprop_name(buffer, sizeof(buffer), first_prop);
       args->func(true, "\tonly has %s at %lu\n", buffer, i);
       continue;
     }
   
-    size_t index = prop - data2->props;
+    dg_sendprop* prop = data2->props + handle.prop_index;
+    size_t index = handle.prop_index;
     if(index != i)
     {
+      dg_sendprop_name(buffer, sizeof(buffer), first_prop);
       args->func(true, "\tprop %s index changed %lu -> %lu\n", buffer, i, index);
     }
 
@@ -129,10 +106,10 @@ static void compare_sendtable_props(const compare_props_args *args,
   for(size_t i=0; i < data2->prop_count; ++i)
   {
     dg_sendprop* first_prop = data2->props + i;
-    dg_sendprop_name(buffer, sizeof(buffer), first_prop);
-    dg_sendprop* prop = find_prop(data1, buffer, i);
-    if(!prop)
+    dg_prop_handle handle = dg_estate_find_sendprop(state1, dt1, first_prop);
+    if(handle.prop_index == DG_PROP_HANDLE_INVALID)
     {
+      dg_sendprop_name(buffer, sizeof(buffer), first_prop);
       args->func(false, "\tonly has %s at %lu\n", buffer, i);
       continue;
     }